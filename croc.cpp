@@ -16,6 +16,8 @@ local _setInterruptibleThread = _croctmp._setInterruptibleThread
 local _haltWasTriggered = _croctmp._haltWasTriggered
 local _resetInterrupt = _croctmp._resetInterrupt
 local _loadFileLib = _croctmp._loadFileLib
+local _loadImage = _croctmp._loadImage
+local _saveImage = _croctmp._saveImage
 
 local Version = "Croc alpha"
 
@@ -35,14 +37,17 @@ Usage:
     croc [options] filename [args]     run <filename> with args
     croc [options] -e "string"         run "string"
     croc --compile outpath filename    compile module to bytecode
+    croc --bundle outname filename     bundle program into one file
     croc --doctable outname filename   extract doctable as JSON
     croc --help (or croc -h)           prints the full help and exits
     croc --version (or croc -v)        prints version and exits
 
 Options:
+    --cache "dir"                      cache compiled modules in dir
     -d (or --debug)                    load debug lib
     --docs=<on|off|default>            doc comment mode
-    -I "path"                          add import path
+    --image "file"                     load/save imported modules as image
+    -I "path"                          add import path (also for --bundle)
     -l dotted.module.name              import module
     --safe                             safe libs only (overrides -d)]=]
 
@@ -51,6 +56,12 @@ This is the Croc standalone interpreter. It can be run in several different
 modes, and the modes in which code is executed can also take options.
 
 The execution options are as follows:
+    --cache "dir"
+        Sets modules.cacheDir to 'dir', so that modules which are compiled
+        from source when imported are saved there in compiled form, and
+        loaded from there instead of being compiled again the next time
+        (as long as their source hasn't changed). 'dir' must already exist.
+
     -d, --debug
         Load the debug library.
 
@@ -59,9 +70,18 @@ The execution options are as follows:
         objects. The default is to enable them in interactive mode and disable
         them in file and string mode.
 
+    --image "file"
+        Only used in file mode. If 'file' exists and is an image of the
+        modules that the program imports, they're loaded from it instead of
+        being imported normally, which is much faster. Otherwise, the modules
+        are imported normally and then saved to 'file' before main() is
+        called. Their state is saved as it is at that point. The image
+        records the files the modules were loaded from, and if any of them
+        has changed since, it's ignored and rebuilt.
+
     -I "path"
         Specifies an import path to search when importing modules. You can
-        add multiple import paths.
+        add multiple import paths. These can also be given before --bundle.
 
     -l dotted.module.name
         Imports the module "dotted.module.name" before running your code. You
@@ -79,12 +99,13 @@ The execution modes are as follows:
         Ctrl+D and hitting enter.
 
     croc [options] filename [args...]
-        File mode. 'filename' can be either a path to a .croc or .croco file,
-        or it can be a dotted.module.name. In either case, the given file or
-        module is loaded/imported, and its main() function (if any) will be
-        called with 'args' as the arguments. All the arguments will be
+        File mode. 'filename' can be either a path to a .croc, .croco, or
+        .crocb file, or it can be a dotted.module.name. In any case, the given
+        file or module is loaded/imported, and its main() function (if any)
+        will be called with 'args' as the arguments. All the arguments will be
         strings. If the main() function returns an integer, it will be used
-        as the exit code.
+        as the exit code. For a .crocb bundle, the module run is the bundle's
+        main module.
 
     croc [options] -e "string"
         String mode. 'string' will be executed as if you typed it in at the
@@ -100,6 +121,19 @@ The execution modes are as follows:
         If 'outpath' is -, the output file will be in the same directory as
         the input. Otherwise, it must be a directory.
 
+    croc [-I "path"] --bundle outname filename
+        Compiles the program whose main module is given by 'filename' (either
+        a path to a .croc file or a dotted.module.name), along with every
+        module it imports other than the standard libraries, and saves them
+        all into the bundle 'outname' using modules.saveBundle. Only imports
+        whose module names are constant strings are followed. Modules are
+        searched for in the import paths given with -I, which is the only
+        option that can come before --bundle. Running the bundle with
+        'croc outname.crocb' doesn't search for or compile any of its
+        modules, so it can be copied anywhere on its own. It has to be
+        rebuilt for other versions of Croc. If bundling fails, 'outname' is
+        not left behind.
+
     croc --doctable outname filename
         Extracts documentation comments from the module given by 'filename'
         (which must be an actual path) and saves the documentation table for
@@ -119,8 +153,8 @@ The execution modes are as follows:
     croc --version
         Prints the version info and exit.
 
-Any invalid options are an error. Any extra arguments after options such as -e
-and --compile are ignored.
+Any invalid options are an error. Any extra arguments after options such as -e,
+--compile, and --bundle are ignored.
 
 Exit codes:
     0 means execution completed successfully.
@@ -161,9 +195,11 @@ local function parseArguments(args: array)
 		safe = false
 		docsEnabled = "default"
 		inputFile = ""
+		imageFile = ""
 		args = []
 		docOutfile = ""
 		crocoOutfile = ""
+		bundleOutfile = ""
 		execStr = ""
 		exec = false
 	}
@@ -213,6 +249,23 @@ local function parseArguments(args: array)
 	{
 		switch(args[i])
 		{
+			case "--bundle":
+				// It needs the import paths, so it can come after -I options, but nothing else.
+				for(j; 0 .. i, 2)
+				{
+					if(args[j] is not "-I")
+						return argError(ret, "'--bundle' flag may only be preceded by -I options")
+				}
+
+				i += 2
+
+				if(i >= #args)
+					return argError(ret, "--bundle must be followed by two arguments");
+
+				ret.bundleOutfile = args[i - 1]
+				ret.inputFile = args[i]
+				return ret
+
 			case "-v", "--version", "-h", "--help", "--compile", "--doctable":
 				return argError(ret, "'{}' flag may not be preceded by options".format(args[i]))
 
@@ -225,6 +278,24 @@ local function parseArguments(args: array)
 				modules.path ~= ';' ~ args[i]
 				continue
 
+			case "--cache":
+				i++
+
+				if(i >= #args)
+					return argError(ret, "--cache must be followed by a directory")
+
+				modules.cacheDir = args[i]
+				continue
+
+			case "--image":
+				i++
+
+				if(i >= #args)
+					return argError(ret, "--image must be followed by a filename")
+
+				ret.imageFile = args[i]
+				continue
+
 			case "-d", "--debug":
 				ret.debugEnabled = true
 				continue
@@ -379,6 +450,38 @@ local function doCompile(inputFile: string, outputFile: string)
 	return ExitCode.OK
 }
 
+local function doBundle(inputFile: string, outputFile: string)
+{
+	local out
+
+	try
+	{
+		out = stream.BufferedOutStream(file.outFile(outputFile, "c"))
+		modules.saveBundle(out, inputFile)
+		out.flush()
+		out.close()
+	}
+	catch(e)
+	{
+		writefln("Error: {}", e)
+
+		// Don't leave a truncated bundle behind.
+		if(out is not null)
+		{
+			try
+			{
+				out.close()
+				file.remove(outputFile)
+			}
+			catch(e2) {}
+		}
+
+		return ExitCode.OtherError
+	}
+
+	return ExitCode.OK
+}
+
 local function unloadFileLib()
 {
 	hash.remove(modules.loaded, 'file')
@@ -387,35 +490,59 @@ local function unloadFileLib()
 	gc.collect()
 }
 
-local function doFile(isSafe: bool, inputFile: string, docsEnabled: string, args: array)
+local function doFile(isSafe: bool, inputFile: string, imageFile: string, docsEnabled: string, args: array)
 {
 	if(docsEnabled is "on")
 		compiler.setFlags("alldocs")
 
+	local imageLoaded = false
+
+	if(#imageFile)
+	{
+		try
+			imageLoaded = _loadImage(imageFile)
+		catch(e)
+			writefln("Warning: could not load image '{}': {}", imageFile, e)
+	}
+
 	try
 	{
 		local modToRun = inputFile
 
-		if(inputFile.endsWith(".croc") or inputFile.endsWith(".croco"))
+		if(inputFile.endsWith(".crocb"))
 		{
-			local fd, modName
-
 			if(isSafe)
 				_loadFileLib();
 
-			if(inputFile[-1] is 'o')
-				fd, modName = serialization.deserializeModule(stream.MemblockStream(file.readMemblock(inputFile)))
-			else
-				fd, modName = compiler.compileModule(file.readTextFile(inputFile), inputFile)
+			modToRun = modules.loadBundle(stream.MemblockStream(file.readMemblock(inputFile)))
 
 			if(isSafe)
 				unloadFileLib();
 
-			modules.customLoaders[modName] = fd
-			modToRun = modName
+			if(modToRun is null)
+			{
+				writefln("Error: '{}' was bundled by a different version of Croc; rebuild it", inputFile)
+				return ExitCode.OtherError
+			}
+		}
+
+		local mod
+
+		// If the module was loaded from the image, this doesn't have to compile it again.
+		if(inputFile.endsWith(".croc") or inputFile.endsWith(".croco"))
+			mod = modules.loadFile(inputFile)
+		else
+			mod = modules.load(modToRun)
+
+		if(#imageFile and not imageLoaded)
+		{
+			try
+				_saveImage(imageFile)
+			catch(e)
+				writefln("Warning: could not save image '{}': {}", imageFile, e)
 		}
 
-		local ret = modules.runMain(modules.load(modToRun), args.expand())
+		local ret = modules.runMain(mod, args.expand())
 
 		if(isInt(ret))
 			return ret
@@ -544,13 +671,19 @@ return function main(args: array)
 		_loadLibs(false, false)
 		return doCompile(params.inputFile, params.crocoOutfile)
 	}
+	else if(#params.bundleOutfile)
+	{
+		// Need file lib
+		_loadLibs(false, false)
+		return doBundle(params.inputFile, params.bundleOutfile)
+	}
 
 	_loadLibs(params.safe, params.debugEnabled)
 
 	if(params.exec)
 		return doOneLine(params.execStr)
 	else if(#params.inputFile)
-		return doFile(params.safe, params.inputFile, params.docsEnabled, params.args)
+		return doFile(params.safe, params.inputFile, params.imageFile, params.docsEnabled, params.args)
 	else
 		return doInteractive(params.docsEnabled)
 }
@@ -578,6 +711,18 @@ word_t _loadFileLib(CrocThread* t)
 	return 0;
 }
 
+word_t _loadImage(CrocThread* t)
+{
+	croc_pushBool(t, croc_vm_loadImage(t, croc_ex_checkStringParam(t, 1)));
+	return 1;
+}
+
+word_t _saveImage(CrocThread* t)
+{
+	croc_vm_saveImage(t, croc_ex_checkStringParam(t, 1));
+	return 0;
+}
+
 CrocThread* _interruptThread = nullptr;
 bool _triggered = false;
 
@@ -657,6 +802,7 @@ int main(int argc, char** argv)
 #endif
 
 	auto t = croc_vm_openDefault();
+	croc_vm_enableLock(t); // so scripts can use thread.spawnOS
 	croc_function_new(t, "_unhandledEx", 1, &unhandledEx, 0);
 	croc_eh_setUnhandledExHandler(t);
 	croc_popTop(t);
@@ -668,6 +814,10 @@ int main(int argc, char** argv)
 			croc_fielda(t, -2, "_loadLibs");
 			croc_function_new(t, "_loadFileLib", 0, &_loadFileLib, 0);
 			croc_fielda(t, -2, "_loadFileLib");
+			croc_function_new(t, "_loadImage", 1, &_loadImage, 0);
+			croc_fielda(t, -2, "_loadImage");
+			croc_function_new(t, "_saveImage", 1, &_saveImage, 0);
+			croc_fielda(t, -2, "_saveImage");
 			croc_function_new(t, "_setInterruptibleThread", 1, &_setInterruptibleThread, 0);
 			croc_fielda(t, -2, "_setInterruptibleThread");
 			croc_function_new(t, "_haltWasTriggered", 0, &_haltWasTriggered, 0);
@@ -0,0 +1,537 @@
+
+#ifdef CROC_NET_ADDON
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#endif
+
+#include "croc/api.h"
+#include "croc/internal/stack.hpp"
+#include "croc/stdlib/helpers/register.hpp"
+#include "croc/types/base.hpp"
+#include "croc/stdlib/helpers/oscompat.hpp"
+
+namespace croc
+{
+#ifndef CROC_NET_ADDON
+void initNetLib(CrocThread* t)
+{
+	croc_eh_throwStd(t, "ApiError", "Attempting to load the net library, but it was not compiled in");
+}
+#else
+namespace
+{
+#include "croc/addons/net.croc.hpp"
+
+#ifdef CROC_BUILTIN_DOCS
+const char* moduleDocs = DModule("net")
+R"(Non-blocking TCP and Unix-domain stream sockets, built on the task scheduler in the \link{thread} module.
+
+Every socket is put in non-blocking mode. Any operation which would block suspends just the task that made it, and the
+task is resumed once the socket is ready, so one OS thread can serve thousands of connections at once, each handled by
+straight-line code in its own task. For example, an echo server:
+
+\code
+import net
+
+local server = net.listenTCP("127.0.0.1", 7000)
+
+thread.spawn(function()
+{
+	while(true)
+	{
+		local conn = server.accept()
+
+		thread.spawn(function()
+		{
+			local buf = memblock.new(4096)
+
+			for(local n = conn.read(buf); n > 0; n = conn.read(buf))
+				conn.writeExact(buf, 0, n)
+
+			conn.close()
+		})
+	}
+})
+
+thread.run()
+\endcode
+
+Outside of \link{thread.run}, these operations just block the calling OS thread, so simple clients can be written
+without bothering with tasks at all.
+
+Host name lookup (in \link{connectTCP} and \link{listenTCP}) is done with the system resolver, and does block the whole
+OS thread.
+
+\b{Including this library in the host}
+
+To use this library, the host must have it compiled into it. Compile Croc with the \tt{CROC_NET_ADDON} option enabled
+in the CMake configuration. Then, from your host, when setting up the VM use the \tt{croc_vm_loadAddons} or
+\tt{croc_vm_loadAllAvailableAddons} API functions to load this library into the VM. Then from your Croc code, you can
+just \tt{import net} to access it. This library is only available on POSIX systems, and suspending tasks on sockets only
+works where the \link{thread} scheduler supports waiting on descriptors (currently Linux).
+)";
+#endif
+
+#ifndef _WIN32
+// =====================================================================================================================
+// Helpers
+
+// Addresses are passed around script code as memblocks holding the raw sockaddr.
+const sockaddr* getAddr(CrocThread* t, word_t slot, socklen_t& len)
+{
+	croc_ex_checkParam(t, slot, CrocType_Memblock);
+	auto data = croc_memblock_getData(t, slot);
+	len = cast(socklen_t)croc_len(t, slot);
+	return cast(const sockaddr*)data;
+}
+
+int getFD(CrocThread* t, word_t slot)
+{
+	auto fd = croc_ex_checkIntParam(t, slot);
+
+	if(fd < 0 || fd > 0x7FFFFFFF)
+		croc_eh_throwStd(t, "RangeError", "Invalid file descriptor: %" CROC_INTEGER_FORMAT, fd);
+
+	return cast(int)fd;
+}
+
+void throwNetEx(CrocThread* t, const char* what)
+{
+	croc_pushFormat(t, "%s: ", what);
+	oscompat::pushSystemErrorMsg(t);
+	croc_cat(t, 2);
+	oscompat::throwIOEx(t);
+}
+
+bool setNonBlocking(int fd)
+{
+	auto flags = fcntl(fd, F_GETFL);
+	return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1 && fcntl(fd, F_SETFD, FD_CLOEXEC) != -1;
+}
+
+int makeSocket(CrocThread* t, int family)
+{
+	auto fd = socket(family, SOCK_STREAM, 0);
+
+	if(fd == -1)
+		throwNetEx(t, "Could not create socket");
+
+	if(!setNonBlocking(fd))
+	{
+		auto err = errno;
+		close(fd);
+		errno = err;
+		throwNetEx(t, "Could not make socket non-blocking");
+	}
+
+	if(family != AF_UNIX)
+	{
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	}
+
+	return fd;
+}
+
+// Pushes an address as (host, port) for IP addresses, or (path, null) for Unix-domain ones.
+word_t pushAddr(CrocThread* t, const sockaddr_storage& addr, socklen_t len)
+{
+	char buf[INET6_ADDRSTRLEN];
+
+	switch(addr.ss_family)
+	{
+		case AF_INET: {
+			auto in = cast(const sockaddr_in*)&addr;
+			croc_pushString(t, inet_ntop(AF_INET, &in->sin_addr, buf, sizeof(buf)));
+			croc_pushInt(t, ntohs(in->sin_port));
+			return 2;
+		}
+		case AF_INET6: {
+			auto in6 = cast(const sockaddr_in6*)&addr;
+			croc_pushString(t, inet_ntop(AF_INET6, &in6->sin6_addr, buf, sizeof(buf)));
+			croc_pushInt(t, ntohs(in6->sin6_port));
+			return 2;
+		}
+		case AF_UNIX: {
+			auto un = cast(const sockaddr_un*)&addr;
+			auto pathOffs = offsetof(sockaddr_un, sun_path);
+			auto pathLen = len > pathOffs ? strnlen(un->sun_path, len - pathOffs) : 0;
+			croc_pushStringn(t, un->sun_path, pathLen);
+			croc_pushNull(t);
+			return 2;
+		}
+		default:
+			return croc_eh_throwStd(t, "ValueError", "Unknown address family %d", addr.ss_family);
+	}
+}
+
+// =====================================================================================================================
+// Primitives, given to the script half
+
+word_t _resolve(CrocThread* t)
+{
+	auto host = croc_ex_checkStringParam(t, 1);
+	auto port = croc_ex_checkIntParam(t, 2);
+	auto passive = croc_ex_checkBoolParam(t, 3);
+
+	char portStr[8];
+	snprintf(portStr, sizeof(portStr), "%d", cast(int)port);
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICSERV | (passive ? AI_PASSIVE : AI_ADDRCONFIG);
+
+	// The host string is kept alive by the stack, and strings never change, so it's safe to use with the lock released.
+	addrinfo* res;
+	croc_vm_releaseLock(t);
+	auto err = getaddrinfo(*host ? host : nullptr, portStr, &hints, &res);
+	auto sysErr = errno;
+	croc_vm_acquireLock(t);
+
+	if(err != 0)
+	{
+		if(err == EAI_SYSTEM)
+		{
+			errno = sysErr;
+			throwNetEx(t, "Could not resolve host");
+		}
+
+		croc_eh_throwStd(t, "IOException", "Could not resolve host '%s': %s", host, gai_strerror(err));
+	}
+
+	croc_array_new(t, 0);
+
+	for(auto ai = res; ai != nullptr; ai = ai->ai_next)
+	{
+		croc_memblock_fromNativeArray(t, ai->ai_addr, ai->ai_addrlen);
+		croc_cateq(t, -2, 1);
+	}
+
+	freeaddrinfo(res);
+	return 1;
+}
+
+word_t _unixAddr(CrocThread* t)
+{
+	uword_t len;
+	auto path = croc_ex_checkStringParamn(t, 1, &len);
+
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+
+	if(len == 0 || len >= sizeof(addr.sun_path))
+		croc_eh_throwStd(t, "ValueError", "Invalid Unix-domain socket path length (%u)", cast(uint32_t)len);
+
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path, len);
+	croc_memblock_fromNativeArray(t, &addr, offsetof(sockaddr_un, sun_path) + len + 1);
+	return 1;
+}
+
+word_t _socket(CrocThread* t)
+{
+	socklen_t len;
+	auto addr = getAddr(t, 1, len);
+	croc_pushInt(t, makeSocket(t, addr->sa_family));
+	return 1;
+}
+
+// Returns null if connected, true if the connection is in progress, or an error message.
+word_t _connect(CrocThread* t)
+{
+	auto fd = getFD(t, 1);
+	socklen_t len;
+	auto addr = getAddr(t, 2, len);
+
+	while(connect(fd, addr, len) == -1)
+	{
+		if(errno == EINTR)
+			continue;
+
+		if(errno == EINPROGRESS)
+			croc_pushBool(t, true);
+		else
+			oscompat::pushSystemErrorMsg(t);
+
+		return 1;
+	}
+
+	croc_pushNull(t);
+	return 1;
+}
+
+// After waiting on an in-progress connection, returns null if it succeeded or an error message.
+word_t _connectResult(CrocThread* t)
+{
+	auto fd = getFD(t, 1);
+	int err = 0;
+	socklen_t len = sizeof(err);
+
+	if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1)
+		err = errno;
+
+	if(err == 0)
+		croc_pushNull(t);
+	else
+		croc_pushString(t, strerror(err));
+
+	return 1;
+}
+
+// Returns the listening fd, or null and an error message.
+word_t _listen(CrocThread* t)
+{
+	socklen_t len;
+	auto addr = getAddr(t, 1, len);
+	auto backlog = croc_ex_checkIntParam(t, 2);
+	auto fd = makeSocket(t, addr->sa_family);
+
+	if(addr->sa_family != AF_UNIX)
+	{
+		int one = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	}
+
+	if(bind(fd, addr, len) == -1 || listen(fd, backlog > SOMAXCONN ? SOMAXCONN : cast(int)backlog) == -1)
+	{
+		auto err = errno;
+		close(fd);
+		errno = err;
+		croc_pushNull(t);
+		oscompat::pushSystemErrorMsg(t);
+		return 2;
+	}
+
+	croc_pushInt(t, fd);
+	return 1;
+}
+
+// Returns the new connection's fd, or null if there's nothing to accept yet.
+word_t _accept(CrocThread* t)
+{
+	auto fd = getFD(t, 1);
+
+	while(true)
+	{
+#ifdef __linux__
+		auto conn = accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+		auto conn = accept(fd, nullptr, nullptr);
+#endif
+		if(conn != -1)
+		{
+#ifndef __linux__
+			if(!setNonBlocking(conn))
+			{
+				auto err = errno;
+				close(conn);
+				errno = err;
+				throwNetEx(t, "Could not make socket non-blocking");
+			}
+#endif
+			int one = 1;
+			setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // harmless failure on Unix sockets
+			croc_pushInt(t, conn);
+			return 1;
+		}
+
+		switch(errno)
+		{
+			// The connection went away before we got to it; try the next one.
+			case EINTR: case ECONNABORTED: case EPROTO: continue;
+			case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+			case EWOULDBLOCK:
+#endif
+				croc_pushNull(t);
+				return 1;
+			default:
+				throwNetEx(t, "Error accepting connection");
+		}
+	}
+}
+
+uint8_t* getRWBuffer(CrocThread* t, uword& size)
+{
+	croc_ex_checkParam(t, 2, CrocType_Memblock);
+	auto offset = cast(uword)croc_ex_checkIntParam(t, 3);
+	size = cast(uword)croc_ex_checkIntParam(t, 4);
+	return cast(uint8_t*)croc_memblock_getData(t, 2) + offset;
+}
+
+// These return the number of bytes transferred, or null if the operation would block.
+word_t _recv(CrocThread* t)
+{
+	auto fd = getFD(t, 1);
+	uword size;
+	auto buf = getRWBuffer(t, size);
+
+	while(true)
+	{
+		auto n = recv(fd, buf, size, 0);
+
+		if(n >= 0)
+		{
+			croc_pushInt(t, n);
+			return 1;
+		}
+		else if(errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			croc_pushNull(t);
+			return 1;
+		}
+		else if(errno != EINTR)
+			throwNetEx(t, "Error reading from socket");
+	}
+}
+
+word_t _send(CrocThread* t)
+{
+	auto fd = getFD(t, 1);
+	uword size;
+	auto buf = getRWBuffer(t, size);
+
+	while(true)
+	{
+#ifdef MSG_NOSIGNAL
+		auto n = send(fd, buf, size, MSG_NOSIGNAL);
+#else
+		auto n = send(fd, buf, size, 0);
+#endif
+		if(n >= 0)
+		{
+			croc_pushInt(t, n);
+			return 1;
+		}
+		else if(errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			croc_pushNull(t);
+			return 1;
+		}
+		else if(errno != EINTR)
+			throwNetEx(t, "Error writing to socket");
+	}
+}
+
+word_t _shutdown(CrocThread* t)
+{
+	if(shutdown(getFD(t, 1), SHUT_WR) == -1 && errno != ENOTCONN)
+		throwNetEx(t, "Error shutting down socket");
+
+	return 0;
+}
+
+word_t _close(CrocThread* t)
+{
+	// EINTR still closes the descriptor on Linux, so there's nothing to retry.
+	if(close(getFD(t, 1)) == -1 && errno != EINTR)
+		throwNetEx(t, "Error closing socket");
+
+	if(croc_isValidIndex(t, 2) && croc_isString(t, 2))
+		unlink(croc_getString(t, 2));
+
+	return 0;
+}
+
+word_t commonGetAddr(CrocThread* t, bool remote)
+{
+	auto fd = getFD(t, 1);
+	sockaddr_storage addr;
+	socklen_t len = sizeof(addr);
+
+	if((remote ? getpeername(fd, cast(sockaddr*)&addr, &len) : getsockname(fd, cast(sockaddr*)&addr, &len)) == -1)
+		throwNetEx(t, "Could not get socket address");
+
+	return pushAddr(t, addr, len);
+}
+
+word_t _localAddr(CrocThread* t)
+{
+	return commonGetAddr(t, false);
+}
+
+word_t _remoteAddr(CrocThread* t)
+{
+	return commonGetAddr(t, true);
+}
+
+// Passed to the script half in this order.
+const CrocRegisterFunc _primFuncs[] =
+{
+	{"resolve",       3, &_resolve      },
+	{"unixAddr",      1, &_unixAddr     },
+	{"socket",        1, &_socket       },
+	{"connect",       2, &_connect      },
+	{"connectResult", 1, &_connectResult},
+	{"listen",        2, &_listen       },
+	{"accept",        1, &_accept       },
+	{"recv",          4, &_recv         },
+	{"send",          4, &_send         },
+	{"shutdown",      1, &_shutdown     },
+	{"close",         2, &_close        },
+	{"localAddr",     1, &_localAddr    },
+	{"remoteAddr",    1, &_remoteAddr   },
+	{nullptr, 0, nullptr}
+};
+#endif
+
+// =====================================================================================================================
+// Loader
+
+word loader(CrocThread* t)
+{
+#ifdef _WIN32
+	croc_eh_throwStd(t, "RuntimeError", "The net library is not supported on this platform");
+#else
+	croc_pushStringn(t, net_croc_text, net_croc_length);
+#ifdef CROC_BUILTIN_DOCS
+	croc_compiler_compileStmtsDTEx(t, "net.croc");
+#else
+	croc_compiler_compileStmtsEx(t, "net.croc");
+#endif
+	croc_function_newScript(t, -1);
+	croc_pushNull(t);
+
+	uword numPrims = 0;
+
+	for(auto f = _primFuncs; f->name != nullptr; f++, numPrims++)
+		croc_function_new(t, f->name, f->maxParams, f->func, 0);
+
+	croc_call(t, -2 - numPrims, 0);
+	croc_popTop(t);
+
+#ifdef CROC_BUILTIN_DOCS
+	CrocDoc doc;
+	croc_ex_doc_init(t, &doc, __FILE__);
+	croc_dup(t, 0);
+	croc_ex_doc_push(&doc, moduleDocs);
+		croc_dup(t, -2);
+		croc_ex_doc_mergeModuleDocs(&doc);
+		croc_popTop(t);
+	croc_ex_doc_pop(&doc, -1);
+	croc_ex_doc_finish(&doc);
+	croc_pop(t, 2);
+#endif
+#endif
+	return 0;
+}
+}
+
+void initNetLib(CrocThread* t)
+{
+	croc_ex_makeModule(t, "net", &loader);
+}
+#endif
+}
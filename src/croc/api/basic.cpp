@@ -4,6 +4,7 @@
 #include "croc/internal/basic.hpp"
 #include "croc/internal/calls.hpp"
 #include "croc/internal/stack.hpp"
+#include "croc/internal/variables.hpp"
 #include "croc/types/base.hpp"
 
 using namespace croc;
@@ -194,6 +195,7 @@ extern "C"
 		else if(auto ns = getNamespace(t, obj))
 		{
 			API_CHECK_PARAM(key, -1, String, "key");
+			loadLazyGlobal(t, ns, key);
 
 			if(!ns->contains(key))
 			{
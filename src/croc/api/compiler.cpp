@@ -27,8 +27,13 @@ extern "C"
 	- \ref CrocCompilerFlags_Docs will cause the compiler to parse documentation comments and place doc decorators on
 		the program items they document, meaning run-time accessible documentation will be available. If you leave
 		out this flag, doc comments are ignored (unless you use one of the DT compilation functions below).
-	- \ref CrocCompilerFlags_All enables all features except runtime docs. This is the default setting.
-	- \ref CrocCompilerFlags_AllDocs enables all optional features.
+	- \ref CrocCompilerFlags_Inline enables inlining of calls to small local functions. A local function qualifies if
+		it is never reassigned, takes a fixed number of untyped parameters, and its body is a single \c return of a
+		small expression involving only its parameters and constants. The closure is still created, but direct calls
+		to it are replaced by its body. Errors in inlined code are reported on the line of the call. This is an
+		optimization and is not included in \ref CrocCompilerFlags_All.
+	- \ref CrocCompilerFlags_All enables all features except runtime docs and inlining. This is the default setting.
+	- \ref CrocCompilerFlags_AllDocs enables all of the above features except inlining.
 	\endparblock
 
 	\returns
@@ -173,6 +178,39 @@ extern "C"
 		return commonCompileStmts(t_, name, true);
 	}
 
+	/** Similar to \ref croc_compiler_compileModule, but additionally finds the module's static imports: the modules
+	imported by \c import statements whose module names are constant strings. Imports whose names are only known at
+	runtime (and calls to \c modules.load) aren't included.
+
+	\returns a positive number if compilation succeeded. In this case, there will be \a two items on top of the stack:
+	the module's funcdef on top, and below it an array of the names of the modules it imports, in the order they first
+	appear in the source. In case of failure, there will only be one value, the exception object, just like \ref
+	croc_compiler_compileModule. */
+	int croc_compiler_compileModuleImports(CrocThread* t_, const char* name, const char** modName)
+	{
+		auto t = Thread::from(t_);
+		API_CHECK_NUM_PARAMS(1);
+		API_CHECK_PARAM(src, -1, String, "source code");
+		croc_array_new(t_, 0);
+		croc_swapTop(t_);
+		auto imports = croc_absIndex(t_, -2);
+		Compiler c(t);
+		crocstr modNameStr;
+		c.leaveDocTable(false);
+		c.collectImports(imports);
+		auto ret = c.compileModule(src->toDArray(), atoda(name), modNameStr);
+		*modName = cast(const char*)modNameStr.ptr;
+		croc_remove(t_, -2);
+
+		if(ret < 0)
+		{
+			croc_remove(t_, -2);
+			return ret;
+		}
+
+		return ret - 1;
+	}
+
 	/** Compiles a single Croc expression as a string on top of the stack into a funcdef which takes variadic arguments
 	and returns the result of evaluating that expression. Just like with the other compilation functions, the source
 	stack slot is replaced by either the funcdef on success or the exception object on failure.
@@ -22,4 +22,19 @@ extern "C"
 		*len = fd->name->length;
 		return fd->name->toCString();
 	}
+
+	/** Moves the bytecode and line info of the funcdef in the given slot (and of all the funcdefs nested inside it) into
+	the shared code segment, a process-wide read-only arena which all VMs can use at once. Every VM which shares an
+	identical funcdef this way uses the same copy, instead of each having its own. This is done automatically for the
+	standard libraries' Croc code, and by \c modules.load for all modules if \c modules.shareCode is set.
+
+	What's shared is never freed (until the process exits), so this is meant for code which will be loaded over and over,
+	like a module imported by every VM, and not for code which is only used once. The funcdef must not be running on any
+	thread. Doing this more than once to the same funcdef does nothing. */
+	void croc_funcdef_shareCode(CrocThread* t_, word_t funcdef)
+	{
+		auto t = Thread::from(t_);
+		API_CHECK_PARAM(fd, funcdef, Funcdef, "funcdef");
+		Funcdef::shareCode(t->vm->mem, fd);
+	}
 }
\ No newline at end of file
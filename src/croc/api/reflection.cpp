@@ -4,6 +4,7 @@
 #include "croc/internal/basic.hpp"
 #include "croc/internal/calls.hpp"
 #include "croc/internal/stack.hpp"
+#include "croc/internal/variables.hpp"
 #include "croc/types/base.hpp"
 
 using namespace croc;
@@ -58,14 +59,17 @@ extern "C"
 
 	namespace
 	{
-		int hasFieldImpl(Value v, String* name)
+		int hasFieldImpl(Thread* t, Value v, String* name)
 		{
 			switch(v.type)
 			{
-				case CrocType_Table:     return v.mTable->get(Value::from(name)) != nullptr;
+				case CrocType_Table:
+					return v.mTable->contains(Value::from(name)) ||
+						(loadLazyModule(t, v.mTable, Value::from(name)) && v.mTable->contains(Value::from(name)));
 				case CrocType_Class:     return v.mClass->getField(name) != nullptr;
 				case CrocType_Instance:  return v.mInstance->getField(name) != nullptr;
-				case CrocType_Namespace: return v.mNamespace->get(name) != nullptr;
+				case CrocType_Namespace:
+					return v.mNamespace->get(name) != nullptr || isLazyGlobal(t, v.mNamespace, name);
 				default:                 return false;
 			}
 		}
@@ -91,7 +95,7 @@ extern "C"
 		auto t = Thread::from(t_);
 		auto v = *getValue(t, obj);
 		auto name = String::create(t->vm, atoda(fieldName));
-		return hasFieldImpl(v, name);
+		return hasFieldImpl(t, v, name);
 	}
 
 	/** \returns nonzero if the object in slot \c obj has a field named the string in slot \c name. Does not take \c
@@ -101,7 +105,7 @@ extern "C"
 		auto t = Thread::from(t_);
 		auto v = *getValue(t, obj);
 		API_CHECK_PARAM(nameStr, name, String, "field name");
-		return hasFieldImpl(v, nameStr);
+		return hasFieldImpl(t, v, nameStr);
 	}
 
 	/** \returns nonzero if the object in slot \c obj can have the method named \c methodName called on it. Does not
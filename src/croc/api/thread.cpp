@@ -2,10 +2,26 @@
 #include "croc/api.h"
 #include "croc/api/apichecks.hpp"
 #include "croc/internal/stack.hpp"
+#include "croc/internal/thread.hpp"
 #include "croc/types/base.hpp"
 
 using namespace croc;
 
+namespace
+{
+	word_t pushNewThread(Thread* t, Thread* nt)
+	{
+		nt->setHookFunc(t->vm->mem, t->hookFunc);
+		nt->hooks = t->hooks;
+		nt->hookDelay = t->hookDelay;
+		nt->hookCounter = t->hookCounter;
+		nt->budget = t->budget;
+		nt->budgetLeft = t->budget;
+		nt->budgetAction = t->budgetAction;
+		return croc_pushThread(*t, *nt);
+	}
+}
+
 extern "C"
 {
 	/** Creates and pushes a new thread object in this VM, using the script function at \c func as its main function.
@@ -22,12 +38,64 @@ extern "C"
 				__FUNCTION__);
 
 		croc_gc_maybeCollect(t_);
-		auto nt = Thread::create(t->vm, f);
-		nt->setHookFunc(t->vm->mem, t->hookFunc);
-		nt->hooks = t->hooks;
-		nt->hookDelay = t->hookDelay;
-		nt->hookCounter = t->hookCounter;
-		return croc_pushThread(t_, *nt);
+		return pushNewThread(t, Thread::create(t->vm, f));
+	}
+
+	/** Like \ref croc_thread_new, but the new thread is \em stackful: it runs on a separate C stack, which means it can
+	yield from anywhere, even with native functions or metamethods on its call stack. Natives can also yield it directly
+	with \ref croc_thread_yield.
+
+	Stackful threads are more expensive to create, and aren't supported on all platforms; this throws a \c RuntimeError
+	if they're not, or if the stack couldn't be allocated.
+
+	\returns the stack index of the pushed value. */
+	word_t croc_thread_newStackful(CrocThread* t_, word_t func)
+	{
+		auto t = Thread::from(t_);
+		API_CHECK_PARAM(f, func, Function, "thread function");
+
+		if(f->isNative)
+			croc_eh_throwStd(t_, "ValueError", "%s - Native functions may not be used as the body of a thread",
+				__FUNCTION__);
+
+		croc_gc_maybeCollect(t_);
+		auto nt = Thread::createStackful(t->vm, f);
+
+		if(nt == nullptr)
+			croc_eh_throwStd(t_, "RuntimeError", "%s - Could not create a stackful thread", __FUNCTION__);
+
+		return pushNewThread(t, nt);
+	}
+
+	/** \returns nonzero if the given thread is stackful (see \ref croc_thread_newStackful). */
+	int croc_thread_isStackful(CrocThread* t_)
+	{
+		return Thread::from(t_)->stackful != nullptr;
+	}
+
+	/** Yields the given thread from inside a native function. The thread must be stackful (see
+	\ref croc_thread_newStackful) and currently running. The top \c numValues values on the stack are popped and yielded.
+	This function returns once the thread is resumed, with the values it was resumed with pushed onto the stack.
+
+	\returns the number of values that were pushed. */
+	uword_t croc_thread_yield(CrocThread* t_, uword_t numValues)
+	{
+		auto t = Thread::from(t_);
+		API_CHECK_NUM_PARAMS(numValues);
+
+		if(t == t->vm->mainThread)
+			croc_eh_throwStd(t_, "RuntimeError", "%s - Attempting to yield out of the main thread", __FUNCTION__);
+
+		if(t->stackful == nullptr)
+			croc_eh_throwStd(t_, "RuntimeError", "%s - Only stackful threads can be yielded from native code",
+				__FUNCTION__);
+
+		if(t->state != CrocThreadState_Running || t->vm->curThread != t)
+			croc_eh_throwStd(t_, "StateError", "%s - Attempting to yield a thread that isn't running", __FUNCTION__);
+
+		yieldImpl(t, t->stackIndex - numValues, numValues, -1);
+		suspendStackful(t);
+		return t->numYields;
 	}
 
 	/** \returns the execution state of the given thread. */
@@ -129,4 +197,43 @@ extern "C"
 	{
 		return Thread::from(t_)->shouldHalt;
 	}
+
+	/** Gives the thread a budget, to bound how long it can run without a hook function having to be called.
+
+	The budget is counted down by one at every loop backedge (each time around a loop) and at every call to a script
+	function. Since every path through a script that doesn't finish must do one of those, a runaway script always runs
+	out eventually. Checking it costs a compare at those points, so it's fine to leave on in production. When the
+	budget runs out, \c action says what happens:
+
+	- \ref CrocBudgetAction_Throw throws a \c TimeoutError on the thread, and the budget is refilled. \c catch and
+	  \c finally blocks run with the refilled budget, so a script that catches the error and keeps going still times
+	  out again; to let the thread keep going unbounded, turn the budget off.
+	- \ref CrocBudgetAction_Yield makes the thread yield no values, as if it had executed <tt>yield()</tt>, and the
+	  budget is refilled. This gives time slices for preemptive green threading: whatever resumes the thread can't tell
+	  it apart from an ordinary yield, so, for example, the \c thread library's scheduler just moves on to the next
+	  task. The main thread can't yield, and neither can a non-stackful thread with a native call on its stack; if the
+	  budget runs out somewhere like that, the thread yields at the first backedge or call where it can.
+
+	Threads created by a thread with a budget start out with the same budget and action, like hooks. Resetting a
+	thread refills its budget.
+
+	\param budget is how many backedges and calls the thread may make, or 0 to turn the budget off.
+	\param action is one of the \ref CrocBudgetAction values. */
+	void croc_thread_setBudget(CrocThread* t_, uword_t budget, CrocBudgetAction action)
+	{
+		auto t = Thread::from(t_);
+
+		if(action != CrocBudgetAction_Throw && action != CrocBudgetAction_Yield)
+			croc_eh_throwStd(t_, "ApiError", "%s - Invalid budget action %d", __FUNCTION__, cast(int)action);
+
+		t->budget = budget;
+		t->budgetLeft = budget;
+		t->budgetAction = cast(uint8_t)action;
+	}
+
+	/** \returns how much of the thread's budget is left, or 0 if it has none. See \ref croc_thread_setBudget. */
+	uword_t croc_thread_getBudget(CrocThread* t_)
+	{
+		return Thread::from(t_)->budgetLeft;
+	}
 }
\ No newline at end of file
@@ -1,16 +1,20 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "croc/api.h"
 #include "croc/types/base.hpp"
 #include "croc/base/gc.hpp"
 #include "croc/addons/all.hpp"
 #include "croc/api/apichecks.hpp"
+#include "croc/internal/calls.hpp"
 #include "croc/internal/eh.hpp"
 #include "croc/internal/gc.hpp"
+#include "croc/internal/lock.hpp"
 #include "croc/internal/stack.hpp"
 #include "croc/stdlib/all.hpp"
+#include "croc/util/misc.hpp"
 
 using namespace croc;
 
@@ -22,6 +26,8 @@ namespace
 	{
 		vm->globals->clear(vm->mem);
 		vm->registry->clear(vm->mem);
+		vm->lazyGlobals->clear(vm->mem);
+		vm->lazyModules = nullptr;
 		vm->refTab.clear(vm->mem);
 
 		for(auto t = vm->allThreads; t != nullptr; t = t->next)
@@ -54,6 +60,33 @@ namespace
 			// you did. Stop doing that.");
 	}
 
+	// Standard libraries which aren't needed by the VM itself or by other libraries' initialization are registered with
+	// this instead of being loaded up front. The library is loaded by its init function the first time its global is
+	// used (see loadLazyGlobal), which is indistinguishable from it having been there all along, except when iterating
+	// over the global namespace.
+	void lazyLib(CrocThread* t, const char* name, CrocNativeFunc loader)
+	{
+		auto vm = Thread::from(t)->vm;
+		croc_vm_pushGlobals(t);
+		croc_function_newWithEnv(t, name, 0, loader, 0);
+		vm->lazyGlobals->set(vm->mem, String::create(vm, atoda(name)), *getValue(Thread::from(t), -1));
+		croc_popTop(t);
+	}
+
+	template<void (*Init)(CrocThread*)>
+	word_t lazyLoader(CrocThread* t)
+	{
+#ifdef CROC_BUILTIN_DOCS
+		// The same flags croc_vm_open loads the other libs with.
+		auto oldFlags = croc_compiler_setFlags(t, CrocCompilerFlags_AllDocs);
+#endif
+		Init(t);
+#ifdef CROC_BUILTIN_DOCS
+		croc_compiler_setFlags(t, oldFlags);
+#endif
+		return 0;
+	}
+
 	const char* CompiledInAddons[] =
 	{
 #ifdef CROC_PCRE_ADDON
@@ -76,6 +109,162 @@ namespace
 #endif
 		nullptr
 	};
+
+	struct LibFlag
+	{
+		const char* name;
+		uint32_t flag;
+	};
+
+	const LibFlag UnsafeLibFlags[] =
+	{
+		{"file",  CrocUnsafeLib_File},
+		{"os",    CrocUnsafeLib_OS},
+		{"debug", CrocUnsafeLib_Debug},
+		{nullptr, 0}
+	};
+
+	const LibFlag AddonFlags[] =
+	{
+		{"pcre",   CrocAddons_Pcre},
+		{"devil",  CrocAddons_Devil},
+		{"net",    CrocAddons_Net},
+		{"glfw",   CrocAddons_Glfw},
+		{"openal", CrocAddons_OpenAL},
+		{"imgui",  CrocAddons_ImGui},
+		{nullptr, 0}
+	};
+
+	// Which of the libs have a field in the namespace or table on top of the stack. Pops it.
+	uint32_t libsIn(CrocThread* t, const LibFlag* libs)
+	{
+		uint32_t ret = 0;
+
+		for(auto lib = libs; lib->name != nullptr; lib++)
+		{
+			if(croc_hasField(t, -1, lib->name))
+				ret |= lib->flag;
+		}
+
+		croc_popTop(t);
+		return ret;
+	}
+
+	uint32_t compiledInAddons()
+	{
+		uint32_t ret = 0;
+
+		for(auto addon = CompiledInAddons; *addon != nullptr; addon++)
+		{
+			for(auto lib = AddonFlags; lib->name != nullptr; lib++)
+			{
+				if(strcmp(*addon, lib->name) == 0)
+					ret |= lib->flag;
+			}
+		}
+
+		return ret;
+	}
+
+	// Image files written by croc_vm_saveImage start with this header, which says which unsafe libs and addons have to
+	// be loaded before the image can be. The rest is what modules.saveImage writes.
+	const uint32_t ImageFileMagic = 0x49567243; // "CrVI"
+	const size_t ImageFileHeaderSize = 12;
+
+	void putUInt32(uint8_t* p, uint32_t v)
+	{
+		p[0] = cast(uint8_t)v;
+		p[1] = cast(uint8_t)(v >> 8);
+		p[2] = cast(uint8_t)(v >> 16);
+		p[3] = cast(uint8_t)(v >> 24);
+	}
+
+	uint32_t getUInt32(const uint8_t* p)
+	{
+		return p[0] | (cast(uint32_t)p[1] << 8) | (cast(uint32_t)p[2] << 16) | (cast(uint32_t)p[3] << 24);
+	}
+
+	bool readImageHeader(FILE* f, uint32_t& unsafeLibs, uint32_t& addons)
+	{
+		uint8_t header[ImageFileHeaderSize];
+
+		if(fread(header, 1, sizeof(header), f) != sizeof(header) || getUInt32(header) != ImageFileMagic)
+			return false;
+
+		unsafeLibs = getUInt32(header + 4);
+		addons = getUInt32(header + 8);
+		return true;
+	}
+
+	// Pushes a memblock holding what modules.saveImage writes, and returns its slot.
+	word_t pushModulesImage(CrocThread* t)
+	{
+		croc_ex_lookup(t, "stream.MemblockStream");
+		croc_pushNull(t);
+		croc_call(t, -2, 1);
+		auto stream = croc_getStackSize(t) - 1;
+
+		croc_ex_lookup(t, "modules.saveImage");
+		croc_pushNull(t);
+		croc_dup(t, stream);
+		croc_call(t, -3, 0);
+
+		croc_pushNull(t);
+		croc_methodCall(t, stream, "getBacking", 1);
+		return stream;
+	}
+
+	// croc_vm_snapshot keeps the image it makes in the template VM's registry under this name, for croc_vm_cloneSnapshot
+	// to load.
+	const char* SnapshotImage = "vm.snapshotImage";
+
+	// Loads what modules.saveImage wrote from the memblock in the given slot with modules.loadImage.
+	bool loadModulesImage(CrocThread* t, word_t data, bool checkSources)
+	{
+		croc_ex_lookup(t, "stream.MemblockStream");
+		croc_pushNull(t);
+		croc_dup(t, data);
+		croc_call(t, -3, 1);
+
+		croc_ex_lookup(t, "modules.loadImage");
+		croc_pushNull(t);
+		croc_dup(t, -3);
+		croc_pushBool(t, checkSources);
+		croc_call(t, -4, 1);
+
+		auto ret = croc_getBool(t, -1);
+		croc_pop(t, 2);
+		return ret;
+	}
+
+	// Params are the filename, unsafe libs, and addons.
+	word_t _openImage(CrocThread* t)
+	{
+		croc_vm_loadUnsafeLibs(t, cast(CrocUnsafeLib)croc_getInt(t, 2));
+		croc_vm_loadAddons(t, cast(CrocAddons)croc_getInt(t, 3));
+		croc_pushBool(t, croc_vm_loadImage(t, croc_getString(t, 1)));
+		return 1;
+	}
+
+	// Params are the image memblock, unsafe libs, addons, modules.path, and modules.cacheDir.
+	word_t _cloneVM(CrocThread* t)
+	{
+		croc_vm_loadUnsafeLibs(t, cast(CrocUnsafeLib)croc_getInt(t, 2));
+		croc_vm_loadAddons(t, cast(CrocAddons)croc_getInt(t, 3));
+
+		croc_pushGlobal(t, "modules");
+		croc_dup(t, 4);
+		croc_fielda(t, -2, "path");
+		croc_dup(t, 5);
+		croc_fielda(t, -2, "cacheDir");
+		croc_popTop(t);
+
+		// A clone copies the template VM's modules as they are, regardless of whether their files have changed since.
+		if(!loadModulesImage(t, 1, false))
+			croc_eh_throwStd(t, "ValueError", "Image format mismatch");
+
+		return 0;
+	}
 }
 
 extern "C"
@@ -108,7 +297,9 @@ extern "C"
 	permitting). While it's not safe for multiple threads to access a single VM without synchronization, accessing
 	separate VMs from separate threads is perfectly fine.
 
-	The safe standard libraries will already be loaded into the global namespace.
+	The safe standard libraries will already be loaded into the global namespace. (Most of them are really only loaded
+	the first time their globals are used, but the only way to tell is that they don't show up when iterating over the
+	global namespace until then.)
 
 	When you're done with a VM, you should call \ref croc_vm_close to free the memory and call any pending finalizers.
 
@@ -125,6 +316,10 @@ extern "C"
 		vm->mem.init(memFunc, ctx);
 		vm->disableGC();
 
+		// Has to be done before any strings are made.
+		vm->rng.seed();
+		strHashKeyInit(vm->strHashKey, vm->rng.next64() ^ cast(uint64_t)cast(uword)vm);
+
 		vm->metaTabs = DArray<Namespace*>::alloc(vm->mem, CrocType_NUMTYPES);
 		vm->mainThread = Thread::create(vm);
 
@@ -143,10 +338,11 @@ extern "C"
 		vm->curThread = vm->mainThread;
 		vm->globals = Namespace::create(vm->mem, String::create(vm, ATODA("")));
 		vm->registry = Namespace::create(vm->mem, String::create(vm, ATODA("<registry>")));
+		vm->lazyGlobals = Namespace::create(vm->mem, String::create(vm, ATODA("<lazyGlobals>")));
+		vm->lazyModules = nullptr;
 		vm->unhandledEx = Function::create(vm->mem, vm->globals, String::create(vm, ATODA("defaultUnhandledEx")), 1,
 			defaultUnhandledEx, 0);
 		vm->ehFrames = DArray<NativeEHFrame>::alloc(vm->mem, 10);
-		vm->rng.seed();
 
 		// _G = _G._G = _G._G._G = _G._G._G._G = ...
 		push(t, Value::from(vm->globals));
@@ -179,19 +375,22 @@ extern "C"
 		initTextLib(*t); // depends on memblock
 		initStreamLib(*t); // depends on math, object, text
 		initArrayLib(*t);
-		initAsciiLib(*t);
-		initCompilerLib(*t);
 		initConsoleLib(*t); // depends on stream
-		initEnvLib(*t);
-		initJSONLib(*t); // depends on stream
 		initPathLib(*t);
-		initReplLib(*t);
-		initSerializationLib(*t); // depends on .. lots of libs :P
 		initThreadLib(*t);
-		initTimeLib(*t);
-		initDoctoolsLibs(*t);
 
-		initModulesLib(*t);
+		// These are loaded the first time they're used.
+		lazyLib(*t, "ascii", &lazyLoader<initAsciiLib>);
+		lazyLib(*t, "compiler", &lazyLoader<initCompilerLib>);
+		lazyLib(*t, "doctools", &lazyLoader<initDoctoolsLibs>);
+		lazyLib(*t, "env", &lazyLoader<initEnvLib>);
+		lazyLib(*t, "json", &lazyLoader<initJSONLib>);
+		lazyLib(*t, "repl", &lazyLoader<initReplLib>);
+		lazyLib(*t, "serialization", &lazyLoader<initSerializationLib>);
+		lazyLib(*t, "time", &lazyLoader<initTimeLib>);
+		lazyLib(*t, "workers", &lazyLoader<initWorkersLib>);
+
+		initModulesLib(*t); // depends on path
 
 #ifdef CROC_BUILTIN_DOCS
 		croc_compiler_setFlags(*t, CrocCompilerFlags_All);
@@ -215,12 +414,17 @@ extern "C"
 	/** Frees all objects and memory associated with the VM that owns the given thread. Calls finalizers on objects as
 	well.
 
-	In addition, this will also check if there were any memory leaks... if so, please report a bug! */
+	In addition, this will also check if there were any memory leaks... if so, please report a bug!
+
+	If the VM lock is enabled, this first waits (with the lock released) for any OS threads started with
+	\c thread.spawnOS to finish. */
 	void croc_vm_close(CrocThread* t)
 	{
 		auto vm = Thread::from(t)->vm;
 
+		waitForOSThreads(Thread::from(t));
 		freeAll(vm);
+		Thread::freePools(vm);
 		vm->metaTabs.free(vm->mem);
 		vm->metaStrings.free(vm->mem);
 		vm->stringTab.clear(vm->mem);
@@ -233,6 +437,7 @@ extern "C"
 		vm->toFree.clear(vm->mem);
 		vm->toFinalize.clear(vm->mem);
 		vm->ehFrames.free(vm->mem);
+		freeVMLock(vm);
 		vm->mem.cleanup();
 
 		if(vm->mem.totalBytes != 0)
@@ -248,13 +453,15 @@ extern "C"
 
 	/** Loads unsafe standard libraries into the global namespace of the given thread's VM.
 
+	Like most of the safe libraries, they're actually only loaded the first time they're used.
+
 	\param libs controls which libraries are loaded, and should be an or-ing together of members of the \ref
 		CrocUnsafeLib enum. */
 	void croc_vm_loadUnsafeLibs(CrocThread* t, CrocUnsafeLib libs)
 	{
-		if(libs & CrocUnsafeLib_File)  initFileLib(t);
-		if(libs & CrocUnsafeLib_OS)    initOSLib(t);
-		if(libs & CrocUnsafeLib_Debug) initDebugLib(t);
+		if(libs & CrocUnsafeLib_File)  lazyLib(t, "file",  &lazyLoader<initFileLib>);
+		if(libs & CrocUnsafeLib_OS)    lazyLib(t, "os",    &lazyLoader<initOSLib>);
+		if(libs & CrocUnsafeLib_Debug) lazyLib(t, "debug", &lazyLoader<initDebugLib>);
 	}
 
 	/** Loads addon libraries into the VM. You must have compiled these addons into your Croc library to load them.
@@ -266,7 +473,7 @@ extern "C"
 	{
 		if(libs & CrocAddons_Pcre)   initPcreLib(t);
 		if(libs & CrocAddons_Devil)  initDevilLib(t);
-		if(libs & CrocAddons_Net)    {} //initNetLib(t);
+		if(libs & CrocAddons_Net)    initNetLib(t);
 		if(libs & CrocAddons_Glfw)   initGlfwLib(t);
 		if(libs & CrocAddons_OpenAL) initOpenAlLib(t);
 		if(libs & CrocAddons_ImGui)  initImGuiLib(t);
@@ -288,7 +495,7 @@ extern "C"
 		if(!(exclude & CrocAddons_Devil))  initDevilLib(t);
 #endif
 #ifdef CROC_NET_ADDON
-		if(!(exclude & CrocAddons_Net))    {} //initNetLib(t);
+		if(!(exclude & CrocAddons_Net))    initNetLib(t);
 #endif
 #ifdef CROC_GLFW_ADDON
 		if(!(exclude & CrocAddons_Glfw))   initGlfwLib(t);
@@ -301,6 +508,256 @@ extern "C"
 #endif
 	}
 
+	/** \returns which unsafe standard libraries have been loaded into the given thread's VM with \ref
+	croc_vm_loadUnsafeLibs, as an or-ing together of members of the \ref CrocUnsafeLib enum. (Since they're loaded lazily,
+	this says which were asked for, not which have been used.) */
+	CrocUnsafeLib croc_vm_loadedUnsafeLibs(CrocThread* t)
+	{
+		// The unsafe libs are globals.
+		croc_vm_pushGlobals(t);
+		return cast(CrocUnsafeLib)libsIn(t, UnsafeLibFlags);
+	}
+
+	/** \returns which addons have been loaded into the given thread's VM, as an or-ing together of members of the \ref
+	CrocAddons enum. */
+	CrocAddons croc_vm_loadedAddons(CrocThread* t)
+	{
+		// The addons have loaders in modules.customLoaders.
+		croc_ex_lookup(t, "modules.customLoaders");
+		return cast(CrocAddons)libsIn(t, AddonFlags);
+	}
+
+	/** Writes an image file of the modules which have been imported into the given thread's VM, which \ref
+	croc_vm_loadImage or \ref croc_vm_openImage can load much faster than importing the modules normally.
+
+	The image is what the Croc \c modules.saveImage function writes (see its docs for what is and isn't saved), after a
+	header which records which unsafe libraries and addons were loaded into this VM.
+
+	\param filename is the name of the file to write. If it already exists it's overwritten.
+	\throws IOException if the file couldn't be written. */
+	void croc_vm_saveImage(CrocThread* t, const char* filename)
+	{
+		auto image = pushModulesImage(t);
+
+		uint8_t header[ImageFileHeaderSize];
+		putUInt32(header, ImageFileMagic);
+		putUInt32(header + 4, croc_vm_loadedUnsafeLibs(t));
+		putUInt32(header + 8, croc_vm_loadedAddons(t));
+
+		uword_t size;
+		auto data = croc_memblock_getDatan(t, image, &size);
+		auto f = fopen(filename, "wb");
+		auto ok = f != nullptr &&
+			fwrite(header, 1, sizeof(header), f) == sizeof(header) &&
+			fwrite(data, 1, size, f) == size;
+
+		if(f != nullptr)
+			ok = (fclose(f) == 0) && ok;
+
+		if(!ok)
+		{
+			remove(filename);
+			croc_eh_throwStd(t, "IOException", "%s - Error writing image file '%s'", __FUNCTION__, filename);
+		}
+
+		croc_popTop(t);
+	}
+
+	/** Imports the modules from an image file written by \ref croc_vm_saveImage into the given thread's VM, using the
+	Croc \c modules.loadImage function.
+
+	\returns nonzero if the modules were imported. Returns 0 and changes nothing if the file doesn't exist or isn't an
+	image, if the image needs unsafe libraries or addons which aren't loaded into this VM, if any of the files the
+	modules were loaded from have changed since it was written, or if it was written by a version of Croc with a
+	different serialization format. In those cases you'll have to import the modules normally
+	(and can then write a new image).
+	\throws IOException if the file couldn't be read, and whatever \c modules.loadImage throws. */
+	int croc_vm_loadImage(CrocThread* t, const char* filename)
+	{
+		auto f = fopen(filename, "rb");
+
+		if(f == nullptr)
+			return false;
+
+		uint32_t unsafeLibs, addons;
+		long start, end;
+
+		if(!readImageHeader(f, unsafeLibs, addons) ||
+			(unsafeLibs & ~croc_vm_loadedUnsafeLibs(t)) != 0 ||
+			(addons & ~croc_vm_loadedAddons(t)) != 0 ||
+			(start = ftell(f)) < 0 ||
+			fseek(f, 0, SEEK_END) != 0 ||
+			(end = ftell(f)) < 0 ||
+			fseek(f, start, SEEK_SET) != 0)
+		{
+			fclose(f);
+			return false;
+		}
+
+		auto size = cast(uword_t)(end - start);
+		auto data = croc_memblock_new(t, size);
+		auto ok = fread(croc_memblock_getData(t, data), 1, size, f) == size;
+		fclose(f);
+
+		if(!ok)
+			croc_eh_throwStd(t, "IOException", "%s - Error reading image file '%s'", __FUNCTION__, filename);
+
+		auto ret = loadModulesImage(t, data, true);
+		croc_popTop(t);
+		return ret;
+	}
+
+	// Opens a new VM with the same memory function, libraries, addons, and module settings as the given thread's VM, and
+	// loads the modules image in the given slot into it.
+	CrocThread* cloneFromImage(CrocThread* t, word_t image)
+	{
+		auto &mem = Thread::from(t)->vm->mem;
+		auto unsafeLibs = croc_vm_loadedUnsafeLibs(t);
+		auto addons = croc_vm_loadedAddons(t);
+		uword_t size;
+		auto data = croc_memblock_getDatan(t, image, &size);
+
+		auto ret = croc_vm_open(mem.memFunc, mem.ctx);
+		croc_function_new(ret, "cloneVM", 5, &_cloneVM, 0);
+		croc_pushNull(ret);
+		croc_memblock_fromNativeArray(ret, data, size);
+		croc_pushInt(ret, unsafeLibs);
+		croc_pushInt(ret, addons);
+		croc_ex_lookup(t, "modules.path");
+		croc_pushString(ret, croc_getString(t, -1));
+		croc_ex_lookup(t, "modules.cacheDir");
+
+		if(croc_isString(t, -1))
+			croc_pushString(ret, croc_getString(t, -1));
+		else
+			croc_pushNull(ret);
+
+		croc_pop(t, 2);
+
+		if(croc_tryCall(ret, -7, 0) == CrocCallRet_Error)
+		{
+			croc_pushToString(ret, -1);
+			croc_pushString(t, croc_getString(ret, -1));
+			croc_vm_close(ret);
+			croc_eh_throwStd(t, "RuntimeError", "%s - Error loading the copy of the VM: %s", __FUNCTION__,
+				croc_getString(t, -1));
+		}
+
+		return ret;
+	}
+
+	/** Makes a new VM which is a copy of the given thread's VM, as far as the application is concerned: it has the same
+	unsafe libraries and addons loaded, the same \c modules.path and \c modules.cacheDir, and copies of all the modules
+	which have been imported into it (in their current state), without having to find, compile, or run any of them
+	again. This is meant for making many VMs from a template VM which has been set up once, each of which is completely
+	independent of it and of each other.
+
+	It's done the same way as \ref croc_vm_saveImage and \ref croc_vm_loadImage, but in memory, so the same things are
+	and aren't copied. In particular, anything which isn't reachable from the imported modules' namespaces (such as
+	other globals, the registry, and other threads) isn't copied, and the VM lock is not enabled on the new VM. The new
+	VM uses the same memory allocator function and context as the given VM.
+
+	The given VM should not be running any code but the native code calling this.
+
+	Each call copies the modules as they are at the time of the call. If the template VM won't change between clones,
+	\ref croc_vm_snapshot and \ref croc_vm_cloneSnapshot avoid copying the modules every time.
+
+	\returns the main thread of the new VM.
+	\throws ValueError or TypeError (into the given thread) if something the modules refer to can't be copied. Errors
+		while loading the copy are rethrown into the given thread as a RuntimeError. */
+	CrocThread* croc_vm_clone(CrocThread* t)
+	{
+		auto image = pushModulesImage(t);
+		auto ret = cloneFromImage(t, image);
+		croc_pop(t, croc_getStackSize(t) - image);
+		return ret;
+	}
+
+	/** Copies the modules imported into the given thread's VM (in their current state), like \ref croc_vm_clone does,
+	and keeps the copy in that VM for \ref croc_vm_cloneSnapshot to use. Any snapshot which was taken before is
+	replaced.
+
+	\throws ValueError or TypeError if something the modules refer to can't be copied. */
+	void croc_vm_snapshot(CrocThread* t)
+	{
+		auto image = pushModulesImage(t);
+		croc_dup(t, image);
+		croc_ex_setRegistryVar(t, SnapshotImage);
+		croc_pop(t, croc_getStackSize(t) - image);
+	}
+
+	/** Makes a new VM like \ref croc_vm_clone, but from the snapshot taken by the last call to \ref croc_vm_snapshot on
+	the given thread's VM, rather than copying the modules again. The new VM only has what was in the modules when the
+	snapshot was taken; the libraries, addons, \c modules.path and \c modules.cacheDir are taken from the given VM as it
+	is now.
+
+	\returns the main thread of the new VM.
+	\throws ApiError if there is no snapshot. Errors while loading the copy are rethrown into the given thread as a
+		RuntimeError. */
+	CrocThread* croc_vm_cloneSnapshot(CrocThread* t)
+	{
+		croc_vm_pushRegistry(t);
+
+		if(!croc_hasField(t, -1, SnapshotImage))
+			croc_eh_throwStd(t, "ApiError", "%s - The VM has no snapshot", __FUNCTION__);
+
+		croc_field(t, -1, SnapshotImage);
+		auto ret = cloneFromImage(t, croc_getStackSize(t) - 1);
+		croc_pop(t, 2);
+		return ret;
+	}
+
+	/** Throws away the snapshot taken by \ref croc_vm_snapshot in the given thread's VM, if there is one. */
+	void croc_vm_dropSnapshot(CrocThread* t)
+	{
+		croc_vm_pushRegistry(t);
+
+		if(croc_hasField(t, -1, SnapshotImage))
+		{
+			croc_pushString(t, SnapshotImage);
+			croc_removeKey(t, -2);
+		}
+
+		croc_popTop(t);
+	}
+
+	/** Opens a new VM like \ref croc_vm_open, loads the unsafe libraries and addons which the given image file needs,
+	and then loads the image into it with \ref croc_vm_loadImage.
+
+	\returns the new VM's main thread, or NULL if the image couldn't be loaded for any reason (including errors, which are
+	not reported). In that case the VM has already been closed. */
+	CrocThread* croc_vm_openImage(CrocMemFunc memFunc, void* ctx, const char* filename)
+	{
+		auto f = fopen(filename, "rb");
+
+		if(f == nullptr)
+			return nullptr;
+
+		uint32_t unsafeLibs, addons;
+		auto ok = readImageHeader(f, unsafeLibs, addons);
+		fclose(f);
+
+		if(!ok || (addons & ~compiledInAddons()) != 0)
+			return nullptr;
+
+		auto t = croc_vm_open(memFunc, ctx);
+
+		croc_function_new(t, "openImage", 3, &_openImage, 0);
+		croc_pushNull(t);
+		croc_pushString(t, filename);
+		croc_pushInt(t, unsafeLibs);
+		croc_pushInt(t, addons);
+
+		if(croc_tryCall(t, -5, 1) == CrocCallRet_Error || !croc_getBool(t, -1))
+		{
+			croc_vm_close(t);
+			return nullptr;
+		}
+
+		croc_popTop(t);
+		return t;
+	}
+
 	/** Gets the main thread object of the VM that owns the given thread. This thread will never be collected, so it's
 	safe to keep a reference to it somewhere (as long as you don't close its owning VM...!).*/
 	CrocThread* croc_vm_getMainThread(CrocThread* t)
@@ -369,6 +826,7 @@ extern "C"
 		else
 			API_PARAM_TYPE_ERROR(-1, "metatable", "namespace|null");
 
+		updateTypeMMCache(t->vm, type);
 		croc_popTop(t_);
 	}
 
@@ -392,4 +850,45 @@ extern "C"
 		auto t = Thread::from(t_);
 		return push(t, Value::from(t->vm->globals));
 	}
+
+	/** Enables the VM lock, which lets more than one OS thread run code in the given thread's VM, and makes the calling
+	OS thread its holder. Does nothing if the lock is already enabled. There's no way to disable it again.
+
+	Without the lock, a VM can only be used by one OS thread at a time, and it's up to the host to make sure of that.
+	With it, whichever OS thread holds the lock can use the VM, and the others wait for their turn. Only one runs Croc
+	code at once, so this doesn't make scripts any faster; what it buys is that a blocking call (reading a file, waiting
+	for a process, resolving a host name) only blocks the OS thread making it, rather than the whole VM. The blocking
+	functions in the standard library release the lock while they block, and your own native functions can do the same
+	with \ref croc_vm_releaseLock and \ref croc_vm_acquireLock. An OS thread which has been kept waiting for a while
+	also gets its turn at the holder's next loop iteration or script function call.
+
+	The \c thread.spawnOS function, which runs a Croc function on a new OS thread, can only be used once this has been
+	called. */
+	void croc_vm_enableLock(CrocThread* t)
+	{
+		enableVMLock(Thread::from(t));
+	}
+
+	/** Releases the VM lock, letting other OS threads use the VM. Does nothing if the lock isn't enabled (see \ref
+	croc_vm_enableLock), so native functions can call this unconditionally around anything that might block.
+
+	Between this and the matching \ref croc_vm_acquireLock, the calling OS thread must not use the VM in any way: no API
+	functions, and no touching objects or memory belonging to it, since another OS thread may be changing or freeing them.
+	That includes data pointers you got earlier, such as a memblock's data; another thread could resize the memblock out
+	from under you. Either copy what you need before releasing the lock, or use memory nothing else can get at.
+
+	\param t must be the thread the calling native function is running on. */
+	void croc_vm_releaseLock(CrocThread* t)
+	{
+		releaseVMLock(Thread::from(t));
+	}
+
+	/** Reacquires the VM lock after \ref croc_vm_releaseLock, blocking until it's available. Does nothing if the lock isn't
+	enabled.
+
+	\param t must be the same thread that was passed to \ref croc_vm_releaseLock. */
+	void croc_vm_acquireLock(CrocThread* t)
+	{
+		acquireVMLock(Thread::from(t));
+	}
 }
\ No newline at end of file
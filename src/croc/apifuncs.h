@@ -16,17 +16,29 @@ extern "C" {
 @ingroup API
 Creating, setting up, and destroying Croc VMs. */
 /**@{*/
-CROCAPI void*        croc_DefaultMemFunc               (void* ctx, void* p, uword_t oldSize, uword_t newSize);
-CROCAPI CrocThread*  croc_vm_open                      (CrocMemFunc memFunc, void* ctx);
-CROCAPI const char** croc_vm_includedAddons            ();
-CROCAPI void         croc_vm_close                     (CrocThread* t);
-CROCAPI void         croc_vm_loadUnsafeLibs            (CrocThread* t, CrocUnsafeLib libs);
-CROCAPI void         croc_vm_loadAddons                (CrocThread* t, CrocAddons libs);
-CROCAPI void         croc_vm_loadAvailableAddonsExcept (CrocThread* t, CrocAddons exclude);
+CROCAPI void*         croc_DefaultMemFunc               (void* ctx, void* p, uword_t oldSize, uword_t newSize);
+CROCAPI CrocThread*   croc_vm_open                      (CrocMemFunc memFunc, void* ctx);
+CROCAPI const char**  croc_vm_includedAddons            ();
+CROCAPI void          croc_vm_close                     (CrocThread* t);
+CROCAPI void          croc_vm_loadUnsafeLibs            (CrocThread* t, CrocUnsafeLib libs);
+CROCAPI void          croc_vm_loadAddons                (CrocThread* t, CrocAddons libs);
+CROCAPI void          croc_vm_loadAvailableAddonsExcept (CrocThread* t, CrocAddons exclude);
+CROCAPI CrocUnsafeLib croc_vm_loadedUnsafeLibs          (CrocThread* t);
+CROCAPI CrocAddons    croc_vm_loadedAddons              (CrocThread* t);
+CROCAPI void          croc_vm_saveImage                 (CrocThread* t, const char* filename);
+CROCAPI int           croc_vm_loadImage                 (CrocThread* t, const char* filename);
+CROCAPI CrocThread*   croc_vm_openImage                 (CrocMemFunc memFunc, void* ctx, const char* filename);
+CROCAPI CrocThread*   croc_vm_clone                     (CrocThread* t);
+CROCAPI void          croc_vm_snapshot                  (CrocThread* t);
+CROCAPI CrocThread*   croc_vm_cloneSnapshot             (CrocThread* t);
+CROCAPI void          croc_vm_dropSnapshot              (CrocThread* t);
 
 /** Opens a croc VM using \ref croc_DefaultMemFunc as the allocator. */
 #define croc_vm_openDefault() (croc_vm_open(&croc_DefaultMemFunc, 0))
 
+/** Opens a croc VM from an image file using \ref croc_DefaultMemFunc as the allocator. */
+#define croc_vm_openImageDefault(filename) (croc_vm_openImage(&croc_DefaultMemFunc, 0, (filename)))
+
 /** Loads all unsafe libraries into the given thread's VM. */
 #define croc_vm_loadAllUnsafeLibs(t) (croc_vm_loadUnsafeLibs((t), CrocUnsafeLib_All))
 
@@ -45,6 +57,9 @@ CROCAPI word_t      croc_vm_pushTypeMT         (CrocThread* t, CrocType type);
 CROCAPI void        croc_vm_setTypeMT          (CrocThread* t, CrocType type);
 CROCAPI word_t      croc_vm_pushRegistry       (CrocThread* t);
 CROCAPI word_t      croc_vm_pushGlobals        (CrocThread* t);
+CROCAPI void        croc_vm_enableLock         (CrocThread* t);
+CROCAPI void        croc_vm_releaseLock        (CrocThread* t);
+CROCAPI void        croc_vm_acquireLock        (CrocThread* t);
 /**@}*/
 /*====================================================================================================================*/
 /** @defgroup RawMM Raw memory management
@@ -320,6 +335,15 @@ on the stack are any upvalues. */
 	(croc_pushCurEnvironment(t), croc_function_newWithEnv((t), (name), (maxParams), (func), (numUpvals)))
 /**@}*/
 /*====================================================================================================================*/
+/** @defgroup Funcdefs Funcdefs
+@ingroup API
+Functions which operate on function definitions. */
+/**@{*/
+CROCAPI const char* croc_funcdef_getName   (CrocThread* t, word_t funcdef);
+CROCAPI const char* croc_funcdef_getNamen  (CrocThread* t, word_t funcdef, uword_t* len);
+CROCAPI void        croc_funcdef_shareCode (CrocThread* t, word_t funcdef);
+/**@}*/
+/*====================================================================================================================*/
 /** @defgroup Classes Classes
 @ingroup API
 Functions which operate on classes. */
@@ -348,6 +372,9 @@ CROCAPI int         croc_class_isFrozen        (CrocThread* t, word_t cls);
 Functions which operate on threads. */
 /**@{*/
 CROCAPI word_t          croc_thread_new            (CrocThread* t, word_t func);
+CROCAPI word_t          croc_thread_newStackful    (CrocThread* t, word_t func);
+CROCAPI int             croc_thread_isStackful     (CrocThread* t);
+CROCAPI uword_t         croc_thread_yield          (CrocThread* t, uword_t numValues);
 CROCAPI CrocThreadState croc_thread_getState       (CrocThread* t);
 CROCAPI const char*     croc_thread_getStateString (CrocThread* t);
 CROCAPI uword_t         croc_thread_getCallDepth   (CrocThread* t);
@@ -356,6 +383,8 @@ CROCAPI void            croc_thread_resetWithFunc  (CrocThread* t, word_t slot);
 CROCAPI void            croc_thread_halt           (CrocThread* t);
 CROCAPI void            croc_thread_pendingHalt    (CrocThread* t);
 CROCAPI int             croc_thread_hasPendingHalt (CrocThread* t);
+CROCAPI void            croc_thread_setBudget      (CrocThread* t, uword_t budget, CrocBudgetAction action);
+CROCAPI uword_t         croc_thread_getBudget      (CrocThread* t);
 /**@}*/
 /*====================================================================================================================*/
 /** @defgroup Basic Basic operations
@@ -414,6 +443,7 @@ CROCAPI int     croc_compiler_compileStmts         (CrocThread* t, const char* n
 CROCAPI int     croc_compiler_compileExpr          (CrocThread* t, const char* name);
 CROCAPI int     croc_compiler_compileModuleDT      (CrocThread* t, const char* name, const char** modName);
 CROCAPI int     croc_compiler_compileStmtsDT       (CrocThread* t, const char* name);
+CROCAPI int     croc_compiler_compileModuleImports (CrocThread* t, const char* name, const char** modName);
 CROCAPI word_t  croc_compiler_processDocComment    (CrocThread* t);
 CROCAPI word_t  croc_compiler_parseDocCommentText  (CrocThread* t);
 
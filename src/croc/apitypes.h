@@ -143,6 +143,13 @@ typedef enum CrocThreadHook
 	CrocThreadHook_Line = 16     /**< . */
 } CrocThreadHook;
 
+/** An enumeration of what happens when a thread runs out of the budget set with \ref croc_thread_setBudget. */
+typedef enum CrocBudgetAction
+{
+	CrocBudgetAction_Throw = 0, /**< Throw a \c TimeoutError on the thread. */
+	CrocBudgetAction_Yield = 1  /**< Make the thread yield, as if it had done <tt>yield()</tt>. */
+} CrocBudgetAction;
+
 /** An enumeration of possible return values from the \ref croc_tryCall and \ref croc_tryMethodCall functions. These
 values will all be negative to distinguish them from the normal return value (how many values the function returned). */
 typedef enum CrocCallRet
@@ -186,6 +193,7 @@ typedef enum CrocCompilerFlags
 	CrocCompilerFlags_Asserts = 2,         /**< Enables \c assert() codegen. */
 	CrocCompilerFlags_Debug = 4,           /**< Enables debug info. Currently can't be disabled. */
 	CrocCompilerFlags_Docs = 8,            /**< Enables doc comment parsing and doc decorators. */
+	CrocCompilerFlags_Inline = 16,         /**< Enables inlining of small local functions at their call sites. */
 
 	/** All features except doc comments. */
 	CrocCompilerFlags_All = CrocCompilerFlags_TypeConstraints | CrocCompilerFlags_Asserts | CrocCompilerFlags_Debug,
@@ -63,6 +63,19 @@ namespace croc
 			length = 0;
 		}
 
+		// Makes mem forget about this array without freeing it, so that another Memory with the same memFunc can adopt
+		// it. The array itself is left alone.
+		void release(Memory& mem)
+		{
+			mem.releaseRaw(ptr, ARRAY_BYTE_SIZE(length) MEMBERTYPEID);
+		}
+
+		// Makes mem responsible for this array, which must have been released from a Memory with the same memFunc.
+		void adopt(Memory& mem)
+		{
+			mem.adoptRaw(ptr, ARRAY_BYTE_SIZE(length) MEMBERTYPEID);
+		}
+
 		void resize(Memory& mem, size_t newLength)
 		{
 			if(length == newLength)
@@ -202,6 +215,9 @@ namespace croc
 
 		inline bool operator==(const DArray<T>& other) const
 		{
+			if(ptr == other.ptr)
+				return length == other.length;
+
 			size_t len = length;
 
 			if(other.length < len)
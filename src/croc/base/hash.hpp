@@ -61,6 +61,8 @@ namespace croc
 		inline void init(hash_t hash)                 { (void)hash; }
 		inline bool equals(const K& key, hash_t hash) { (void)hash; return this->key == key; }
 		inline void copyFrom(HashNode<K, V>* other)   { value = other->value; }
+		template<typename Hasher>
+		inline hash_t getHash()                       { return Hasher::toHash(&key); }
 	};
 
 	template<typename K, typename V>
@@ -71,6 +73,8 @@ namespace croc
 		inline void init(hash_t hash)                 { this->hash = hash; }
 		inline bool equals(const K& key, hash_t hash) { return this->hash == hash && this->key == key; }
 		inline void copyFrom(HashNodeWithHash<K, V>* other)   { this->value = other->value; hash = other->hash; }
+		template<typename Hasher>
+		inline hash_t getHash()                       { return hash; }
 	};
 
 	template<typename K, typename V, typename Hasher = DefaultHasher, typename Node = HashNode<K, V> >
@@ -126,10 +130,18 @@ namespace croc
 			return &insertNode(mem, key)->value;
 		}
 
-		Node* insertNode(Memory& mem, K key)
+		V* insert(Memory& mem, K key, hash_t hash)
 		{
-			auto hash = Hasher::toHash(&key);
+			return &insertNode(mem, key, hash)->value;
+		}
+
+		inline Node* insertNode(Memory& mem, K key)
+		{
+			return insertNode(mem, key, Hasher::toHash(&key));
+		}
 
+		Node* insertNode(Memory& mem, K key, hash_t hash)
+		{
 			{
 				auto node = lookupNode(key, hash);
 
@@ -153,7 +165,7 @@ namespace croc
 
 			if(IS_USED(mainPosNode))
 			{
-				auto otherNode = &mNodes[Hasher::toHash(&mainPosNode->key) & mHashMask];
+				auto otherNode = &mNodes[mainPosNode->template getHash<Hasher>() & mHashMask];
 
 				if(otherNode == mainPosNode)
 				{
@@ -183,9 +195,13 @@ namespace croc
 			return mainPosNode;
 		}
 
-		bool remove(K key)
+		inline bool remove(K key)
+		{
+			return remove(key, Hasher::toHash(&key));
+		}
+
+		bool remove(K key, hash_t hash)
 		{
-			auto hash = Hasher::toHash(&key);
 			auto nodes = mNodes;
 			auto n = &mNodes[hash & mHashMask];
 
@@ -490,7 +506,7 @@ namespace croc
 
 				if(IS_USED(node))
 				{
-					auto newNode = insertNode(mem, node->key);
+					auto newNode = insertNode(mem, node->key, node->template getHash<Hasher>());
 					newNode->copyFrom(node);
 					newNode->flags = node->flags; // the used bit won't matter
 				}
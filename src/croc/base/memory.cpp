@@ -164,6 +164,26 @@ namespace croc
 		len = 0;
 	}
 
+	void Memory::releaseRaw(void* ptr, size_t len TYPEID_PARAM)
+	{
+		if(len == 0)
+			return;
+
+		(void)ptr;
+		LEAK_DETECT(leaks.freeRaw(ptr, ti));
+		totalBytes -= len;
+	}
+
+	void Memory::adoptRaw(void* ptr, size_t len TYPEID_PARAM)
+	{
+		if(len == 0)
+			return;
+
+		(void)ptr;
+		totalBytes += len;
+		LEAK_DETECT(leaks.newRaw(ptr, len, ti));
+	}
+
 	// =================================================================================================================
 	// Private
 	// =================================================================================================================
@@ -52,6 +52,11 @@ namespace croc
 		void resizeRaw(void*& ptr, size_t& len, size_t newLen TYPEID_PARAM);
 		void freeRaw(void*& ptr, size_t& len TYPEID_PARAM);
 
+		// For handing raw blocks between Memories which use the same memFunc and ctx. releaseRaw makes this one forget
+		// about a block without freeing it, and adoptRaw makes it take responsibility for one.
+		void releaseRaw(void* ptr, size_t len TYPEID_PARAM);
+		void adoptRaw(void* ptr, size_t len TYPEID_PARAM);
+
 	private:
 		GCObject* allocateRC(size_t size, bool acyclic TYPEID_PARAM);
 		GCObject* allocateGCObject(size_t size, bool acyclic, uint32_t gcflags);
@@ -0,0 +1,103 @@
+
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+
+#include "croc/base/sharedcode.hpp"
+#include "croc/util/str.hpp"
+
+namespace croc
+{
+	namespace
+	{
+		// Blocks are allocated with their data right after this header, so that the data is as aligned as malloc makes
+		// it.
+		struct alignas(16) SharedBlock
+		{
+			SharedBlock* next;
+			hash_t hash;
+			size_t length;
+
+			uint8_t* data() { return cast(uint8_t*)(this + 1); }
+		};
+
+		const size_t MinBuckets = 256;
+
+		// None of this is ever freed. The key is fixed, since which blocks share a hash bucket only affects speed.
+		std::mutex segmentMutex;
+		SharedBlock** buckets = nullptr;
+		size_t numBuckets = 0;
+		size_t numBlocks = 0;
+		size_t totalBytes = 0;
+		StrHashKey key;
+
+		// Called with the mutex locked.
+		void grow()
+		{
+			auto newNumBuckets = numBuckets == 0 ? MinBuckets : numBuckets * 2;
+			auto newBuckets = cast(SharedBlock**)calloc(newNumBuckets, sizeof(SharedBlock*));
+
+			if(newBuckets == nullptr)
+				return; // the chains just get longer
+
+			if(numBuckets == 0)
+				strHashKeyInit(key, 0x5368617265644344ULL); // "SharedCD"
+
+			for(size_t i = 0; i < numBuckets; i++)
+			{
+				for(auto b = buckets[i]; b != nullptr; )
+				{
+					auto next = b->next;
+					auto &slot = newBuckets[b->hash & (newNumBuckets - 1)];
+					b->next = slot;
+					slot = b;
+					b = next;
+				}
+			}
+
+			free(buckets);
+			buckets = newBuckets;
+			numBuckets = newNumBuckets;
+		}
+	}
+
+	DArray<const uint8_t> shareData(DArray<const uint8_t> data)
+	{
+		std::lock_guard<std::mutex> guard(segmentMutex);
+
+		if(numBlocks >= numBuckets)
+			grow();
+
+		if(numBuckets == 0)
+			return DArray<const uint8_t>();
+
+		auto h = strHash(key, data);
+		auto &slot = buckets[h & (numBuckets - 1)];
+
+		for(auto b = slot; b != nullptr; b = b->next)
+		{
+			if(b->hash == h && b->length == data.length && memcmp(b->data(), data.ptr, data.length) == 0)
+				return DArray<const uint8_t>::n(b->data(), b->length);
+		}
+
+		auto b = cast(SharedBlock*)malloc(sizeof(SharedBlock) + data.length);
+
+		if(b == nullptr)
+			return DArray<const uint8_t>();
+
+		b->hash = h;
+		b->length = data.length;
+		memcpy(b->data(), data.ptr, data.length);
+		b->next = slot;
+		slot = b;
+		numBlocks++;
+		totalBytes += data.length;
+		return DArray<const uint8_t>::n(b->data(), b->length);
+	}
+
+	size_t sharedDataSize()
+	{
+		std::lock_guard<std::mutex> guard(segmentMutex);
+		return totalBytes;
+	}
+}
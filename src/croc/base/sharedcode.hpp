@@ -0,0 +1,22 @@
+#ifndef CROC_BASE_SHAREDCODE_HPP
+#define CROC_BASE_SHAREDCODE_HPP
+
+#include "croc/base/darray.hpp"
+#include "croc/base/sanity.hpp"
+
+namespace croc
+{
+	// The shared code segment is a process-wide arena of immutable blocks of data which any number of VMs can point
+	// into at once, from any OS thread. Blocks are deduplicated by their contents and never freed, so that VMs don't
+	// have to keep track of who else is using them. It's meant for things that every VM would otherwise have its own
+	// identical copy of, like the bytecode of the standard library's funcdefs, so it should only be given data which
+	// will be the same every time (and which has no pointers into any VM's heap).
+
+	// Returns a block in the shared segment with the same contents as data, adding one if there isn't one yet.
+	DArray<const uint8_t> shareData(DArray<const uint8_t> data);
+
+	// How many bytes of data are in the shared segment.
+	size_t sharedDataSize();
+}
+
+#endif
@@ -303,13 +303,20 @@ namespace croc
 		if(isRoots)
 		{
 			for(auto &ar: o->actRecs.slice(0, o->arIndex))
+			{
 				COND_CALLBACK(ar.func);
+				COND_CALLBACK(ar.ctorInstance);
+			}
 
-			for(auto &val: o->stack.slice(0, o->stackIndex))
-				VALUE_CALLBACK(val);
+			// Threads that haven't started yet or have died don't have a stack.
+			if(o->stack.length > 0)
+			{
+				for(auto &val: o->stack.slice(0, o->stackIndex))
+					VALUE_CALLBACK(val);
 
-			// I guess this can't _hurt_..
-			o->stack.slice(o->stackIndex, o->stack.length).fill(Value::nullValue);
+				// I guess this can't _hurt_..
+				o->stack.slice(o->stackIndex, o->stack.length).fill(Value::nullValue);
+			}
 
 			for(auto &val: o->results.slice(0, o->resultIndex))
 				VALUE_CALLBACK(val);
@@ -350,6 +357,8 @@ namespace croc
 
 		COND_CALLBACK(vm->exception);
 		callback(vm->registry);
+		callback(vm->lazyGlobals);
+		COND_CALLBACK(vm->lazyModules);
 		callback(vm->unhandledEx);
 
 		for(auto n: vm->refTab)
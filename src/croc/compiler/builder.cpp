@@ -152,6 +152,14 @@ namespace croc
 		mNumParams = numParams;
 	}
 
+	// While nonzero, all instructions are attributed to this line (used for inlined code). Returns the old value.
+	uword FuncBuilder::setLineOverride(uword line)
+	{
+		auto ret = mLineOverride;
+		mLineOverride = line;
+		return ret;
+	}
+
 	FuncBuilder* FuncBuilder::parent()
 	{
 		return mParent;
@@ -2335,7 +2343,7 @@ namespace croc
 
 	uword FuncBuilder::addInst(uword line, Instruction i)
 	{
-		mLineInfo.add(line);
+		mLineInfo.add(mLineOverride ? mLineOverride : line);
 		mCode.add(i);
 		return mCode.length() - 1;
 	}
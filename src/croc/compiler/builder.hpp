@@ -289,6 +289,7 @@ namespace croc
 		List<LocVarDesc, 16> mLocVars;
 
 		uword mDummyNameCounter = 0;
+		uword mLineOverride = 0;
 
 	public:
 		FuncBuilder(Compiler& c, CompileLoc location, crocstr name, FuncBuilder* parent = nullptr) :
@@ -319,7 +320,8 @@ namespace croc
 			mSwitchTables(c),
 			mLineInfo(c),
 			mLocVars(c),
-			mDummyNameCounter(0)
+			mDummyNameCounter(0),
+			mLineOverride(0)
 		{
 			// let's just always make null const 0
 			addNullConst();
@@ -335,6 +337,7 @@ namespace croc
 		void setVarret(bool isVarret);
 		bool isVarret();
 		void setNumParams(uword numParams);
+		uword setLineOverride(uword line);
 		FuncBuilder* parent();
 		void printExpStack();
 		void checkExpStackEmpty();
@@ -1,4 +1,6 @@
 
+#include <initializer_list>
+
 #include "croc/compiler/builder.hpp"
 #include "croc/compiler/codegen.hpp"
 #include "croc/internal/eh.hpp"
@@ -8,6 +10,169 @@
 
 namespace croc
 {
+namespace
+{
+// Inlined bodies larger than this many AST nodes aren't worth the code growth.
+const word MaxInlineCost = 16;
+
+// Returns how many nodes the expression has, or -1 if it contains anything other than constants, the parameters of
+// def, and simple operators. Anything else (calls, upvalues, globals, 'this', vararg...) can't be inlined as-is.
+word inlineCost(Expression* e, FuncDef* def)
+{
+	auto sum = [&](std::initializer_list<Expression*> exps) -> word
+	{
+		word ret = 1;
+
+		for(auto sub: exps)
+		{
+			auto cost = inlineCost(sub, def);
+
+			if(cost < 0)
+				return -1;
+
+			ret += cost;
+		}
+
+		return ret;
+	};
+
+	switch(e->type)
+	{
+		case AstTag_NullExp:
+		case AstTag_BoolExp:
+		case AstTag_IntExp:
+		case AstTag_FloatExp:
+		case AstTag_StringExp:
+			return 1;
+
+		case AstTag_IdentExp:
+			for(auto &p: def->params.slice(1, def->params.length))
+			{
+				if(p.name->name == (cast(IdentExp*)e)->name->name)
+					return 1;
+			}
+
+			return -1;
+
+		case AstTag_NegExp:
+		case AstTag_NotExp:
+		case AstTag_ComExp:
+		case AstTag_LenExp:
+		case AstTag_AsExp:
+			return sum({(cast(UnExp*)e)->op});
+
+		case AstTag_OrOrExp:
+		case AstTag_AndAndExp:
+		case AstTag_OrExp:
+		case AstTag_XorExp:
+		case AstTag_AndExp:
+		case AstTag_EqualExp:
+		case AstTag_NotEqualExp:
+		case AstTag_IsExp:
+		case AstTag_NotIsExp:
+		case AstTag_LTExp:
+		case AstTag_LEExp:
+		case AstTag_GTExp:
+		case AstTag_GEExp:
+		case AstTag_Cmp3Exp:
+		case AstTag_InExp:
+		case AstTag_NotInExp:
+		case AstTag_ShlExp:
+		case AstTag_ShrExp:
+		case AstTag_UShrExp:
+		case AstTag_AddExp:
+		case AstTag_SubExp:
+		case AstTag_MulExp:
+		case AstTag_DivExp:
+		case AstTag_ModExp:
+			return sum({(cast(BinaryExp*)e)->op1, (cast(BinaryExp*)e)->op2});
+
+		case AstTag_CondExp:
+			return sum({(cast(CondExp*)e)->cond, (cast(CondExp*)e)->op1, (cast(CondExp*)e)->op2});
+
+		case AstTag_DotExp:
+			return sum({(cast(DotExp*)e)->op, (cast(DotExp*)e)->name});
+
+		case AstTag_IndexExp:
+			return sum({(cast(IndexExp*)e)->op, (cast(IndexExp*)e)->index});
+
+		case AstTag_CatExp: {
+			word ret = 1;
+
+			for(auto sub: (cast(CatExp*)e)->operands)
+			{
+				auto cost = inlineCost(sub, def);
+
+				if(cost < 0)
+					return -1;
+
+				ret += cost;
+			}
+
+			return ret;
+		}
+		default:
+			return -1;
+	}
+}
+
+// Returns the expression that def's body returns, if def is simple enough to be inlined; nullptr otherwise.
+Expression* inlineBody(FuncDef* def)
+{
+	if(def->isVararg || def->returns.length > 0)
+		return nullptr;
+
+	for(auto &p: def->params)
+	{
+		if(p.typeMask != cast(uint32_t)TypeMask::Any || p.classTypes.length > 0 || p.customConstraint || p.defValue)
+			return nullptr;
+	}
+
+	// Strip off scopes, blocks, and (no-op, since there are no constraints) typechecks around a single return.
+	auto s = def->code;
+
+	while(true)
+	{
+		if(auto scope = AST_AS(ScopeStmt, s))
+			s = scope->statement;
+		else if(auto block = AST_AS(BlockStmt, s))
+		{
+			Statement* only = nullptr;
+
+			for(auto sub: block->statements)
+			{
+				if(sub->type == AstTag_TypecheckStmt)
+					continue;
+
+				if(only)
+					return nullptr;
+
+				only = sub;
+			}
+
+			if(only == nullptr)
+				return nullptr;
+
+			s = only;
+		}
+		else
+			break;
+	}
+
+	auto ret = AST_AS(ReturnStmt, s);
+
+	if(ret == nullptr || ret->exprs.length != 1)
+		return nullptr;
+
+	auto cost = inlineCost(ret->exprs[0], def);
+
+	if(cost < 0 || cost > MaxInlineCost)
+		return nullptr;
+
+	return ret->exprs[0];
+}
+}
+
 	void Codegen::codegenStatements(FuncDef* d)
 	{
 		bool failed;
@@ -108,6 +273,8 @@ namespace croc
 	{
 		bool failed;
 
+		auto numInlines = mInlines.length();
+
 		// This scope is to allow the FuncBuilder's dtor to run and clean up gunk whether or not it failed.
 		{
 			FuncBuilder inner(c, d->location, d->name->name, fb);
@@ -139,6 +306,7 @@ namespace croc
 			});
 
 			fb = fb->parent();
+			mInlines.length(numInlines); // the inner function's candidates die with its builder
 
 			if(!failed)
 				croc_remove(*c.thread(), -2); // dummy null
@@ -329,6 +497,8 @@ namespace croc
 			visitDecorator(d->decorator, [this, &d]{ fb->pushVar(d->def->name); });
 			fb->assign(d->endLocation, 1, 1);
 		}
+		else if(d->protection == Protection::Local && c.inlining())
+			addInlineCandidate(d);
 
 		return d;
 	}
@@ -926,7 +1096,8 @@ namespace croc
 	{
 		if(!fb->inTryCatch() &&
 			s->exprs.length == 1 &&
-			(s->exprs[0]->type == AstTag_CallExp || s->exprs[0]->type == AstTag_MethodCallExp))
+			(s->exprs[0]->type == AstTag_CallExp || s->exprs[0]->type == AstTag_MethodCallExp) &&
+			isMultRet(s->exprs[0]))
 		{
 			visit(s->exprs[0]);
 			fb->makeTailcall();
@@ -1285,6 +1456,12 @@ namespace croc
 
 	CallExp* Codegen::visit(CallExp* e)
 	{
+		if(auto cand = findInline(e))
+		{
+			codeInlineCall(e, *cand);
+			return e;
+		}
+
 		visitCall(e->endLocation, e->op, e->context, [&]
 		{
 			codeGenList(e->args);
@@ -1349,6 +1526,19 @@ namespace croc
 
 	IdentExp* Codegen::visit(IdentExp* e)
 	{
+		if(mInlineDef)
+		{
+			// Parameters of an inlined function refer to the registers its arguments were evaluated into.
+			for(uword i = 1; i < mInlineDef->params.length; i++)
+			{
+				if(mInlineDef->params[i].name->name == e->name->name)
+				{
+					fb->pushExp(ExpType::Local, mInlineBase + i - 1);
+					return e;
+				}
+			}
+		}
+
 		fb->pushVar(e->name);
 		return e;
 	}
@@ -1434,7 +1624,7 @@ namespace croc
 		if(e->values.length > INST_MAX_ARRAY_FIELDS)
 			c.semException(e->location, "Array constructor has too many fields (more than %u)", INST_MAX_ARRAY_FIELDS);
 
-		if(e->values.length > 0 && e->values[e->values.length - 1]->isMultRet())
+		if(e->values.length > 0 && isMultRet(e->values[e->values.length - 1]))
 			fb->pushArray(e->location, e->values.length - 1);
 		else
 			fb->pushArray(e->location, e->values.length);
@@ -1564,7 +1754,7 @@ namespace croc
 
 		visit(exprs[exprs.length - 1]);
 
-		if(!allowMultRet || !exprs[exprs.length - 1]->isMultRet())
+		if(!allowMultRet || !isMultRet(exprs[exprs.length - 1]))
 			fb->toTemporary(exprs[exprs.length - 1]->endLocation);
 	}
 
@@ -1582,6 +1772,108 @@ namespace croc
 		visit(exprs[exprs.length - 1]);
 	}
 
+	// Like Expression::isMultRet, but inlined calls only ever give one value.
+	bool Codegen::isMultRet(Expression* e)
+	{
+		return e->isMultRet() && findInline(e) == nullptr;
+	}
+
+	void Codegen::addInlineCandidate(FuncDecl* d)
+	{
+		for(auto name: mAssignedNames)
+		{
+			if(name == d->def->name->name)
+				return;
+		}
+
+		auto body = inlineBody(d->def);
+
+		if(body == nullptr)
+			return;
+
+		uword reg;
+		auto idx = fb->searchLocal(d->def->name->name, reg);
+		assert(idx >= 0);
+
+		InlineCandidate cand;
+		cand.owner = fb;
+		cand.local = cast(uword)idx;
+		cand.def = d->def;
+		cand.body = body;
+		mInlines.add(cand);
+	}
+
+	Codegen::InlineCandidate* Codegen::findInline(Expression* e)
+	{
+		if(mInlines.length() == 0)
+			return nullptr;
+
+		auto call = AST_AS(CallExp, e);
+
+		if(call == nullptr || call->context != nullptr)
+			return nullptr;
+
+		auto id = AST_AS(IdentExp, call->op);
+
+		if(id == nullptr)
+			return nullptr;
+
+		// Resolve the name the same way FuncBuilder::searchVar would, but without creating upvalues.
+		for(auto f = fb; f != nullptr; f = f->parent())
+		{
+			uword reg;
+			auto idx = f->searchLocal(id->name->name, reg);
+
+			if(idx < 0)
+				continue;
+
+			for(auto &cand: mInlines)
+			{
+				if(cand.owner == f && cand.local == cast(uword)idx)
+				{
+					auto &args = call->args;
+
+					if(args.length + 1 != cand.def->params.length ||
+						(args.length > 0 && isMultRet(args[args.length - 1])))
+						return nullptr;
+
+					return &cand;
+				}
+			}
+
+			return nullptr;
+		}
+
+		return nullptr;
+	}
+
+	void Codegen::codeInlineCall(CallExp* e, InlineCandidate cand)
+	{
+		// Evaluate the args into consecutive temporaries, then generate the body with the params bound to them. The
+		// whole body is attributed to the call's line, so errors in it show up where the call was.
+		auto numArgs = e->args.length;
+		codeGenList(e->args, false);
+
+		auto oldDef = mInlineDef;
+		auto oldBase = mInlineBase;
+		mInlineDef = cand.def;
+		mInlineBase = numArgs > 0 ? fb->getExp(-cast(int)numArgs).index : 0;
+		auto oldLine = fb->setLineOverride(e->location.line);
+
+		visit(cand.body);
+
+		fb->setLineOverride(oldLine);
+		mInlineDef = oldDef;
+		mInlineBase = oldBase;
+
+		// Put the result where the call's result would have gone.
+		auto result = fb->getExp(-1);
+		fb->pop(numArgs + 1);
+		auto reg = fb->pushRegister();
+		fb->moveToReg(e->endLocation, reg, result);
+		fb->pushExp(ExpType::Temporary, reg);
+	}
+
 	// ---------------------------------------------------------------------------
 	// Condition codegen
 
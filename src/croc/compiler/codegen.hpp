@@ -19,11 +19,29 @@ namespace croc
 	class Codegen : public AstVisitor
 	{
 	private:
+		// A local function which can be inlined: the local 'local' of 'owner', whose body is 'def' returning 'body'.
+		struct InlineCandidate
+		{
+			FuncBuilder* owner;
+			uword local;
+			FuncDef* def;
+			Expression* body;
+		};
+
 		FuncBuilder* fb;
+		DArray<crocstr> mAssignedNames;
+		List<InlineCandidate> mInlines;
+		FuncDef* mInlineDef;
+		uword mInlineBase;
 
 	public:
-		Codegen(Compiler& c) :
-			AstVisitor(c)
+		Codegen(Compiler& c, DArray<crocstr> assignedNames = DArray<crocstr>()) :
+			AstVisitor(c),
+			fb(nullptr),
+			mAssignedNames(assignedNames),
+			mInlines(c),
+			mInlineDef(nullptr),
+			mInlineBase(0)
 		{}
 
 		using AstVisitor::visit;
@@ -47,6 +65,10 @@ namespace croc
 		IfComprehension* visit(IfComprehension* e, std::function<void()> inner);
 		void codeGenList(DArray<Expression*> exprs, bool allowMultRet = true);
 		void codeGenAssignRHS(DArray<Expression*> exprs);
+		bool isMultRet(Expression* e);
+		void addInlineCandidate(FuncDecl* d);
+		InlineCandidate* findInline(Expression* e);
+		void codeInlineCall(CallExp* e, InlineCandidate cand);
 		InstRef codeCondition(Expression* e);
 		InstRef codeCondition(CondExp* e);
 		InstRef codeCondition(OrOrExp* e);
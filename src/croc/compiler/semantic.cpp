@@ -163,6 +163,9 @@ namespace croc
 		if(s->expr->isConstant() && !s->expr->isString())
 			c.semException(s->expr->location, "Import expression must evaluate to a string");
 
+		if(s->expr->isString())
+			c.addImport(s->expr->asString());
+
 		// We rewrite import statements as function calls/local variable declarations. The rewrites work as follows:
 		// import blah
 		// 		modules.load("blah")
@@ -765,6 +768,9 @@ namespace croc
 
 	AssignStmt* Semantic::visit(AssignStmt* s)
 	{
+		for(auto lhs: s->lhs)
+			noteAssigned(lhs);
+
 		VISIT_ARR(s->lhs);
 		VISIT_ARR(s->rhs);
 		return s;
@@ -772,6 +778,7 @@ namespace croc
 
 	OpAssignStmt* Semantic::visitOpAssign(OpAssignStmt* s)
 	{
+		noteAssigned(s->lhs);
 		VISIT(s->lhs);
 		VISIT(s->rhs);
 		return s;
@@ -791,6 +798,7 @@ namespace croc
 
 	Statement* Semantic::visit(CondAssignStmt* s)
 	{
+		noteAssigned(s->lhs);
 		VISIT(s->lhs);
 		VISIT(s->rhs);
 
@@ -802,6 +810,7 @@ namespace croc
 
 	CatAssignStmt* Semantic::visit(CatAssignStmt* s)
 	{
+		noteAssigned(s->lhs);
 		VISIT(s->lhs);
 		VISIT(s->rhs);
 
@@ -823,12 +832,14 @@ namespace croc
 
 	IncStmt* Semantic::visit(IncStmt* s)
 	{
+		noteAssigned(s->exp);
 		VISIT(s->exp);
 		return s;
 	}
 
 	DecStmt* Semantic::visit(DecStmt* s)
 	{
+		noteAssigned(s->exp);
 		VISIT(s->exp);
 		return s;
 	}
@@ -1677,4 +1688,20 @@ namespace croc
 		croc_popTop(*c.thread());
 		return new(c) Identifier(loc, str);
 	}
+
+	// Remembers names which are assigned to anywhere in the code, so that codegen knows which local functions can never
+	// be rebound and are therefore safe to inline.
+	void Semantic::noteAssigned(Expression* lhs)
+	{
+		if(!c.inlining())
+			return;
+
+		if(auto id = AST_AS(IdentExp, lhs))
+			mAssignedNames.add(id->name->name);
+	}
+
+	DArray<crocstr> Semantic::assignedNames()
+	{
+		return mAssignedNames.toArrayView();
+	}
 }
\ No newline at end of file
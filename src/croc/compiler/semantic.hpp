@@ -22,12 +22,14 @@ namespace croc
 
 		FinallyDepth* mFinallyDepth;
 		uword mDummyNameCounter = 0;
+		List<crocstr> mAssignedNames;
 
 	public:
 		Semantic(Compiler& c) :
 			IdentityVisitor(c),
 			mFinallyDepth(nullptr),
-			mDummyNameCounter(0)
+			mDummyNameCounter(0),
+			mAssignedNames(c)
 		{}
 
 		using AstVisitor::visit;
@@ -44,6 +46,8 @@ namespace croc
 		Expression* visitComparison(BinaryExp* e);
 		ForComprehension* visitForComp(ForComprehension* e);
 		Identifier* genDummyVar(CompileLoc loc, const char* fmt);
+		void noteAssigned(Expression* lhs);
+		DArray<crocstr> assignedNames();
 
 		virtual Module* visit(Module* m) override;
 		virtual FuncDef* visit(FuncDef* d) override;
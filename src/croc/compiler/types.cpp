@@ -19,6 +19,7 @@ namespace croc
 		mIsLoneStmt(false),
 		mDanglingDoc(false),
 		mStringTab(0),
+		mImports(0),
 		mNodes(),
 		mArrays(),
 		mHeapArrays(),
@@ -195,6 +196,28 @@ namespace croc
 		return ret;
 	}
 
+	// If collectImports was given an array, adds the name of a statically-imported module to it (once).
+	void Compiler::addImport(crocstr name)
+	{
+		if(mImports == 0)
+			return;
+
+		auto len = croc_len(*t, mImports);
+
+		for(crocint i = 0; i < len; i++)
+		{
+			croc_idxi(*t, mImports, i);
+			auto found = getCrocstr(t, -1) == name;
+			croc_popTop(*t);
+
+			if(found)
+				return;
+		}
+
+		croc_pushStringn(*t, cast(const char*)name.ptr, name.length);
+		croc_cateq(*t, mImports, 1);
+	}
+
 	int Compiler::compileModule(crocstr src, crocstr name, crocstr& modName)
 	{
 		(void)modName;
@@ -217,7 +240,7 @@ namespace croc
 
 			Semantic sem(*this);
 			mod = sem.visit(mod);
-			Codegen cg(*this);
+			Codegen cg(*this, sem.assignedNames());
 			cg.visit(mod);
 		});
 	}
@@ -242,7 +265,7 @@ namespace croc
 
 			Semantic sem(*this);
 			stmts = sem.visit(stmts);
-			Codegen cg(*this);
+			Codegen cg(*this, sem.assignedNames());
 			cg.codegenStatements(stmts);
 		});
 	}
@@ -257,7 +280,7 @@ namespace croc
 			auto exp = parser.parseExpressionFunc(name);
 			Semantic sem(*this);
 			exp = sem.visit(exp);
-			Codegen cg(*this);
+			Codegen cg(*this, sem.assignedNames());
 			cg.codegenStatements(exp);
 		});
 	}
@@ -88,6 +88,7 @@ namespace croc
 		bool mDanglingDoc;
 		bool mLeaveDocTable;
 		word mStringTab;
+		word mImports;
 
 		BumpAllocator<CROC_COMPILER_PAGE_SIZE> mNodes;
 		BumpAllocator<CROC_COMPILER_PAGE_SIZE> mArrays;
@@ -105,7 +106,9 @@ namespace croc
 		inline bool docComments()     { return mLeaveDocTable || (mFlags & CrocCompilerFlags_Docs) != 0; }
 		inline bool docTable()        { return mLeaveDocTable; }
 		inline bool docDecorators()   { return (mFlags & CrocCompilerFlags_Docs) != 0; }
+		inline bool inlining()        { return (mFlags & CrocCompilerFlags_Inline) != 0; }
 		inline void leaveDocTable(bool l) { mLeaveDocTable = l; }
+		inline void collectImports(word arr) { mImports = arr; }
 
 		void lexException(CompileLoc loc, const char* msg, ...) CROCPRINT(3, 4);
 		void synException(CompileLoc loc, const char* msg, ...) CROCPRINT(3, 4);
@@ -123,6 +126,7 @@ namespace croc
 		void updateTempArray(DArray<uint8_t> old, DArray<uint8_t> new_);
 		void removeTempArray(DArray<uint8_t> arr);
 		DArray<uint8_t> copyArray(DArray<uint8_t> arr);
+		void addImport(crocstr name);
 		int compileModule(crocstr src, crocstr name, crocstr& modName);
 		int compileStmts(crocstr src, crocstr name);
 		int compileExpr(crocstr src, crocstr name);
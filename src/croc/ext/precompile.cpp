@@ -0,0 +1,159 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include "croc/api.h"
+
+// Compiles the stdlib modules given on the command line and writes a C++ file defining croc::PrecompiledModules, which
+// holds them serialized the same way serialization.serializeModule does them. It's linked against everything in the
+// Croc library except that file, so the modules it compiles are compiled by the same compiler and flags that the
+// library would use at runtime.
+//
+// Usage: crocprecompile outfile.cpp module.croc...
+
+namespace
+{
+bool readFile(const char* filename, std::string& contents)
+{
+	auto fp = fopen(filename, "rb");
+
+	if(fp == nullptr)
+		return false;
+
+	char buf[4096];
+	size_t n;
+
+	while((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		contents.append(buf, n);
+
+	auto ok = !ferror(fp);
+	fclose(fp);
+	return ok;
+}
+
+// Takes the source of a module and returns the serialized module and the name it's registered under ("foo/bar.croc"
+// for module foo.bar, which is what registerModuleFromString is given).
+word_t _compileAndSerialize(CrocThread* t)
+{
+	// Compiled once to get the module's name, since the source name is part of the funcdef.
+	const char* modName;
+	croc_dup(t, 1);
+	croc_compiler_compileModuleEx(t, "<precompile>", &modName);
+
+	std::string sourceName = modName;
+
+	for(auto &c: sourceName)
+	{
+		if(c == '.')
+			c = '/';
+	}
+
+	sourceName += ".croc";
+	auto nameSlot = croc_pushString(t, modName);
+	auto sourceNameSlot = croc_pushString(t, sourceName.c_str());
+
+	croc_dup(t, 1);
+	croc_compiler_compileModuleEx(t, sourceName.c_str(), &modName);
+	auto fd = croc_getStackSize(t) - 1;
+
+	croc_ex_lookup(t, "stream.MemblockStream");
+	croc_pushNull(t);
+	croc_call(t, -2, 1);
+	auto stream = croc_getStackSize(t) - 1;
+
+	croc_ex_lookup(t, "serialization.serializeModule");
+	croc_pushNull(t);
+	croc_dup(t, fd);
+	croc_dup(t, nameSlot);
+	croc_dup(t, stream);
+	croc_call(t, -5, 0);
+
+	croc_dup(t, stream);
+	croc_pushNull(t);
+	croc_methodCall(t, -2, "getBacking", 1);
+	croc_dup(t, sourceNameSlot);
+	return 2;
+}
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 3)
+	{
+		fprintf(stderr, "Usage: %s outfile.cpp module.croc...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	auto t = croc_vm_openDefault();
+
+#ifdef CROC_BUILTIN_DOCS
+	// croc_vm_open compiles the stdlib modules with docs on.
+	croc_compiler_setFlags(t, CrocCompilerFlags_AllDocs);
+#endif
+
+	std::string out = "// Generated by crocprecompile; do not edit.\n\n#include \"croc/stdlib/helpers/register.hpp\"\n\n"
+		"namespace croc\n{\nnamespace\n{\n";
+	std::string table = "}\n\nconst PrecompiledModule PrecompiledModules[] =\n{\n";
+	char buf[64];
+
+	for(int i = 2; i < argc; i++)
+	{
+		std::string src;
+
+		if(!readFile(argv[i], src))
+		{
+			fprintf(stderr, "Could not read '%s'\n", argv[i]);
+			croc_vm_close(t);
+			return EXIT_FAILURE;
+		}
+
+		croc_function_new(t, "compileAndSerialize", 1, &_compileAndSerialize, 0);
+		croc_pushNull(t);
+		croc_pushStringn(t, src.c_str(), src.length());
+
+		if(croc_tryCall(t, -3, 2) == CrocCallRet_Error)
+		{
+			croc_pushToString(t, -1);
+			fprintf(stderr, "Error precompiling '%s': %s\n", argv[i], croc_getString(t, -1));
+			croc_vm_close(t);
+			return EXIT_FAILURE;
+		}
+
+		uword_t length;
+		auto data = (const unsigned char*)croc_memblock_getDatan(t, -2, &length);
+
+		snprintf(buf, sizeof(buf), "const uint8_t module%d[] =\n{", i - 2);
+		out += buf;
+
+		for(uword_t j = 0; j < length; j++)
+		{
+			snprintf(buf, sizeof(buf), (j % 20) == 0 ? "\n\t0x%02x," : " 0x%02x,", data[j]);
+			out += buf;
+		}
+
+		out += "\n};\n\n";
+
+		snprintf(buf, sizeof(buf), ", module%d, sizeof(module%d)},\n", i - 2, i - 2);
+		table += "\t{\"";
+		table += croc_getString(t, -1);
+		table += "\"";
+		table += buf;
+
+		croc_pop(t, 2);
+	}
+
+	croc_vm_close(t);
+
+	out += table + "\t{nullptr, nullptr, 0}\n};\n}\n";
+
+	auto fp = fopen(argv[1], "wb");
+
+	if(fp == nullptr || fwrite(out.c_str(), 1, out.length(), fp) != out.length() || fclose(fp) != 0)
+	{
+		fprintf(stderr, "Could not write '%s'\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -6,8 +6,10 @@
 #include "croc/api.h"
 #include "croc/internal/basic.hpp"
 #include "croc/internal/calls.hpp"
+#include "croc/internal/eh.hpp"
 #include "croc/internal/interpreter.hpp"
 #include "croc/internal/stack.hpp"
+#include "croc/internal/variables.hpp"
 #include "croc/types/base.hpp"
 
 #define BUFFERLENGTH 120
@@ -237,7 +239,8 @@ namespace croc
 				}
 
 			case CrocType_Table:
-				return container.mTable->contains(item);
+				return container.mTable->contains(item) ||
+					(loadLazyModule(t, container.mTable, item) && container.mTable->contains(item));
 
 			case CrocType_Array:
 				return container.mArray->contains(item);
@@ -250,7 +253,8 @@ namespace croc
 						croc_getString(*t, -1));
 				}
 
-				return container.mNamespace->contains(item.mString);
+				return container.mNamespace->contains(item.mString) ||
+					isLazyGlobal(t, container.mNamespace, item.mString);
 
 			default:
 				auto method = getMM(t, container, MM_In);
@@ -504,7 +508,7 @@ namespace croc
 						key.mInt, str->cpLength);
 
 				auto s = str->toDArray();
-				auto offs = utf8CPIdxToByte(s, cast(uword)index);
+				auto offs = str->cpIdxToByte(t->vm, cast(uword)index);
 				auto len = utf8SequenceLength(s[offs]);
 				t->stack[dest] = Value::from(String::createUnverified(t->vm, s.slice(offs, offs + len), 1));
 				return;
@@ -524,7 +528,12 @@ namespace croc
 
 	void tableIdxImpl(Thread* t, AbsStack dest, Table* container, Value key)
 	{
-		if(auto v = container->get(key))
+		auto v = container->get(key);
+
+		if(v == nullptr && loadLazyModule(t, container, key))
+			v = container->get(key);
+
+		if(v)
 			t->stack[dest] = *v;
 		else
 			t->stack[dest] = Value::nullValue;
@@ -755,6 +764,14 @@ namespace croc
 							name->toCString(), i->parent->name->toCString());
 					}
 				}
+				else if(v->type == CrocType_Null && isExField(t, i, name))
+				{
+					auto ex = push(t, container);
+					pushExField(t, ex, name);
+					t->stack[dest] = t->stack[t->stackIndex - 1];
+					croc_pop(*t, 2);
+					return;
+				}
 
 				t->stack[dest] = *v;
 				return;
@@ -762,6 +779,9 @@ namespace croc
 			case CrocType_Namespace: {
 				auto v = container.mNamespace->get(name);
 
+				if(v == nullptr && loadLazyGlobal(t, container.mNamespace, name))
+					v = container.mNamespace->get(name);
+
 				if(v == nullptr)
 				{
 					toStringImpl(t, container, false);
@@ -825,6 +845,7 @@ namespace croc
 				return;
 			}
 			case CrocType_Namespace: {
+				loadLazyGlobal(t, cont.mNamespace, name);
 				cont.mNamespace->set(t->vm->mem, name, value);
 				return;
 			}
@@ -1115,23 +1136,7 @@ namespace croc
 
 	void stringConcat(Thread* t, Value first, DArray<Value> vals, uword len, uword cpLen)
 	{
-		auto tmpBuffer = ustring::alloc(t->vm->mem, len);
-		uword i = 0;
-
-		auto add = [&](Value& v)
-		{
-			auto s = v.mString->toDArray();
-			tmpBuffer.slicea(i, i + s.length, ustring::n(cast(uchar*)s.ptr, s.length));
-			i += s.length;
-		};
-
-		add(first);
-
-		for(auto &v: vals)
-			add(v);
-
-		vals[vals.length - 1] = Value::from(String::createUnverified(t->vm, tmpBuffer, cpLen));
-		tmpBuffer.free(t->vm->mem);
+		vals[vals.length - 1] = Value::from(String::cat(t->vm, first.mString, vals, len, cpLen));
 	}
 
 	void catEqImpl(Thread* t, AbsStack dest, AbsStack firstSlot, uword num)
@@ -83,20 +83,46 @@ namespace croc
 
 	Function* getMM(Thread* t, Value obj, Metamethod method)
 	{
-		auto name = t->vm->metaStrings[method];
-		Value ret;
-
 		if(obj.type == CrocType_Instance)
-			ret = getInstanceMethod(t, obj.mInstance, name);
-		else
-			ret = getGlobalMetamethod(t, obj.type, name);
+		{
+			auto c = obj.mInstance->parent;
+
+			if(!c->mmCacheValid)
+				c->updateMMCache(t->vm);
+
+			return c->mmCache[method];
+		}
+		else if(auto mt = getMetatable(t, obj.type))
+		{
+			auto &cache = t->vm->typeMMCache[obj.type];
 
-		if(ret.type == CrocType_Function)
-			return ret.mFunction;
+			if(cache.mt != mt || cache.version != mt->version)
+				updateTypeMMCache(t->vm, obj.type);
+
+			return cache.methods[method];
+		}
 
 		return nullptr;
 	}
 
+	void updateTypeMMCache(VM* vm, CrocType type)
+	{
+		auto &cache = vm->typeMMCache[type];
+		auto mt = vm->metaTabs[type];
+		cache.mt = mt;
+		cache.version = mt ? mt->version : 0;
+
+		for(uword i = 0; i < MM_NUMMETAMETHODS; i++)
+		{
+			auto m = mt ? mt->get(vm->metaStrings[i]) : nullptr;
+
+			if(m && m->type == CrocType_Function)
+				cache.methods[i] = m->mFunction;
+			else
+				cache.methods[i] = nullptr;
+		}
+	}
+
 	Namespace* getMetatable(Thread* t, CrocType type)
 	{
 		assert(type >= CrocType_FirstUserType && type <= CrocType_LastUserType);
@@ -182,6 +208,15 @@ namespace croc
 		auto expectedResults = t->currentAR->expectedResults;
 		auto results = loadResults(t);
 
+		// Constructors called by instantiating a class return the new instance, whatever they return themselves
+		Value inst;
+
+		if(t->currentAR->ctorInstance)
+		{
+			inst = Value::from(t->currentAR->ctorInstance);
+			results = DArray<Value>::n(&inst, 1);
+		}
+
 		// Pop the act record (which also closes upvals and removes EH frames)
 		popARTo(t, t->arIndex - 1);
 
@@ -214,6 +249,49 @@ namespace croc
 		assert(t->stackIndex > 0);
 	}
 
+	// Specialized version of funcCallPrologue for when the interpreter calls a non-vararg script function with exactly
+	// as many params as it takes and wants one result back, and there are no hooks to call. The caller checks all that.
+	void lightCallPrologue(Thread* t, Function* func, AbsStack slot, uword numParams)
+	{
+		assert(!func->isNative && !func->scriptFunc->isVararg && numParams == func->numParams);
+		auto funcdef = func->scriptFunc;
+		auto base = slot + 1;
+		checkStack(t, base + funcdef->stackSize - 1);
+		t->stack.slice(base + numParams, base + funcdef->stackSize).fill(Value::nullValue);
+
+		auto ar = pushAR(t);
+		ar->base = base;
+		ar->vargBase = base;
+		ar->savedTop = base + funcdef->stackSize;
+		ar->returnSlot = slot;
+		ar->func = func;
+		ar->pc = funcdef->code.ptr;
+		ar->expectedResults = 1;
+		ar->numTailcalls = 0;
+		ar->firstResult = 0;
+		ar->numResults = 0;
+		ar->unwindCounter = 0;
+		ar->unwindReturn = nullptr;
+		ar->ctorInstance = nullptr;
+		ar->isLight = true;
+
+		t->stackBase = base;
+		t->stackIndex = ar->savedTop;
+	}
+
+	// Counterpart of lightCallPrologue. The result is already in the return slot, so this just pops the frame.
+	void lightCallEpilogue(Thread* t)
+	{
+		if(t->hooks & CrocThreadHook_Ret)
+			callHook(t, CrocThreadHook_Ret);
+
+		popARTo(t, t->arIndex - 1);
+		t->numYields = 1;
+
+		assert(t->arIndex > 0);
+		t->stackIndex = t->currentAR->savedTop;
+	}
+
 	void saveResults(Thread* t, Thread* from, AbsStack first, uword num)
 	{
 		if(num == 0)
@@ -268,17 +346,38 @@ namespace croc
 				if(!cls->isFrozen)
 					freezeImpl(t, cls);
 
-				if(cls->constructor == nullptr && numParams > 1)
+				auto ctor = cls->ctorFunc;
+
+				if(ctor == nullptr && numParams > 1)
 					croc_eh_throwStd(*t, "ParamError",
 						"Class '%s' has no constructor but was called with %" CROC_SIZE_T_FORMAT " parameters",
 						cls->name->toCString(), numParams - 1);
 
 				auto inst = Instance::create(t->vm->mem, cls);
 
-				// call any constructor
-				if(cls->constructor)
+				// An empty constructor doesn't have to be called, unless it'd complain about the params or be hooked.
+				if(ctor && cls->ctorIsTrivial && numParams <= ctor->maxParams && !(t->hooks & CrocThreadHook_Call))
+					ctor = nullptr;
+
+				// A script constructor gets its own frame right here rather than being run in a nested interpreter;
+				// callEpilogue will then return the instance in its place.
+				if(ctor && !ctor->isNative && !isTailcall)
+				{
+					t->stack[slot] = Value::from(ctor);
+					t->stack[slot + 1] = Value::from(inst);
+					auto isScript = funcCallPrologue(t, ctor, slot, expectedResults, slot + 1, numParams);
+					assert(isScript);
+#ifdef NDEBUG
+					(void)isScript;
+#endif
+					t->currentAR->ctorInstance = inst;
+					return true;
+				}
+
+				// call any other constructor
+				if(ctor)
 				{
-					t->stack[slot] = Value::from(cls->constructor->mFunction);
+					t->stack[slot] = Value::from(ctor);
 					t->stack[slot + 1] = Value::from(inst);
 
 					t->nativeCallDepth++;
@@ -415,6 +514,8 @@ namespace croc
 			{
 				ar->expectedResults = expectedResults;
 				ar->numTailcalls = 0;
+				ar->ctorInstance = nullptr;
+				ar->isLight = false;
 			}
 
 			// Set the stack indices.
@@ -446,6 +547,8 @@ namespace croc
 			ar->numTailcalls = 0;
 			ar->unwindCounter = 0;
 			ar->unwindReturn = nullptr;
+			ar->ctorInstance = nullptr;
+			ar->isLight = false;
 
 			t->stackBase = ar->base;
 
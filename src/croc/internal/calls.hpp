@@ -11,6 +11,7 @@ namespace croc
 	Value getInstanceMethod(Thread* t, Instance* inst, String* name);
 	Value getGlobalMetamethod(Thread* t, CrocType type, String* name);
 	Function* getMM(Thread* t, Value obj, Metamethod method);
+	void updateTypeMMCache(VM* vm, CrocType type);
 	Namespace* getMetatable(Thread* t, CrocType type);
 	void closeUpvals(Thread* t, AbsStack index);
 	Upval* findUpval(Thread* t, uword num);
@@ -18,6 +19,8 @@ namespace croc
 	// void popAR(Thread* t);
 	void popARTo(Thread* t, uword removeTo);
 	void callEpilogue(Thread* t);
+	void lightCallPrologue(Thread* t, Function* func, AbsStack slot, uword numParams);
+	void lightCallEpilogue(Thread* t);
 	void saveResults(Thread* t, Thread* from, AbsStack first, uword num);
 	DArray<Value> loadResults(Thread* t);
 	bool callPrologue(Thread* t, AbsStack slot, word expectedResults, uword numParams, bool isTailcall = false);
@@ -57,6 +57,6 @@ namespace croc
 			c->finalizer = finalizer;
 		}
 
-		c->freeze(t->vm->mem);
+		c->freeze(t->vm);
 	}
 }
\ No newline at end of file
@@ -63,27 +63,35 @@ namespace croc
 			ar = t->currentAR;
 
 		if(ar == nullptr || ar->func == nullptr)
+			return pushDebugLoc(t, nullptr, 0);
+		else
+			return pushDebugLoc(t, ar->func, ar->func->isNative ? 0 : pcToLine(ar, ar->pc));
+	}
+
+	word pushDebugLoc(Thread* t, Function* func, word line)
+	{
+		if(func == nullptr)
 			return croc_eh_pushLocationObject(*t, "<no location available>", 0, CrocLocation_Unknown);
 		else
 		{
-			pushFullNamespaceName(t, ar->func->environment);
+			pushFullNamespaceName(t, func->environment);
 
 			if(croc_len(*t, -1) == 0)
 				croc_dupTop(*t);
 			else
 				croc_pushString(*t, ".");
 
-			push(t, Value::from(ar->func->name));
+			push(t, Value::from(func->name));
 
 			auto slot = t->stackIndex - 3;
 			catImpl(t, slot, slot, 3);
 			auto s = croc_getString(*t, -3);
 			croc_pop(*t, 3);
 
-			if(ar->func->isNative)
+			if(func->isNative)
 				return croc_eh_pushLocationObject(*t, s, 0, CrocLocation_Native);
 			else
-				return croc_eh_pushLocationObject(*t, s, pcToLine(ar, ar->pc), CrocLocation_Script);
+				return croc_eh_pushLocationObject(*t, s, line, CrocLocation_Script);
 		}
 	}
 
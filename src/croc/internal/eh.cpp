@@ -39,10 +39,12 @@ namespace croc
 		eh->jbuf = &buf;
 	}
 
-	void pushExecEHFrame(Thread* t, jmp_buf& buf)
+	// The frame belongs to the AR below the one execute() started with, which isn't necessarily the current AR: a
+	// thread resumed after yielding from a nested call starts executing in that nested call.
+	void pushExecEHFrame(Thread* t, uword startARIndex, jmp_buf& buf)
 	{
 		pushNativeEHFrame(t, t->stackIndex - 1 - t->stackBase, buf);
-		t->vm->currentEH->actRecord--;
+		t->vm->currentEH->actRecord = startARIndex - 2;
 	}
 
 	void pushScriptEHFrame(Thread* t, bool isCatch, RelStack slot, Instruction* pc)
@@ -90,7 +92,7 @@ namespace croc
 			popScriptEHFrame(t);
 	}
 
-	bool tryCode(Thread* t, RelStack slot, std::function<void()> dg)
+	bool tryCodeImpl(Thread* t, RelStack slot, void (*fn)(void*), void* ctx)
 	{
 		jmp_buf buf;
 		bool ret;
@@ -99,11 +101,11 @@ namespace croc
 		auto ehCheck = t->vm->ehIndex;
 #endif
 		pushNativeEHFrame(t, slot, buf);
-		auto ehStatus = setjmp(buf);
+		auto ehStatus = CROC_SETJMP(buf);
 
 		if(ehStatus == EHStatus_Okay)
 		{
-			dg();
+			fn(ctx);
 			ret = false;
 		}
 		else
@@ -118,19 +120,59 @@ namespace croc
 		return ret;
 	}
 
-	word pushTraceback(Thread* t)
+	// Appends t's call stack to the array raw as (function, line, tailcall count) triples, innermost first. This is all
+	// that's done when an exception is thrown; making Location objects out of it is left until someone asks for them.
+	void captureRawTraceback(Thread* t, Array* raw)
+	{
+		auto &mem = t->vm->mem;
+		auto idx = raw->length;
+		raw->resize(mem, idx + t->arIndex * 3);
+
+		// The slice has to outlive the loop, since reverse() only holds a reference to it.
+		auto ars = t->actRecs.slice(0, t->arIndex);
+
+		for(auto &ar: ars.reverse())
+		{
+			if(ar.func == nullptr)
+			{
+				raw->idxa(mem, idx++, Value::nullValue);
+				raw->idxa(mem, idx++, Value::from(cast(crocint)0));
+			}
+			else
+			{
+				raw->idxa(mem, idx++, Value::from(ar.func));
+				raw->idxa(mem, idx++, Value::from(cast(crocint)(ar.func->isNative ? 0 : pcToLine(&ar, ar.pc))));
+			}
+
+			raw->idxa(mem, idx++, Value::from(cast(crocint)ar.numTailcalls));
+		}
+	}
+
+	// Pushes the Location of the frame'th frame of a raw traceback (see captureRawTraceback).
+	word pushRawTracebackLoc(Thread* t, Array* raw, uword frame)
+	{
+		auto func = raw->data[frame * 3].value;
+		auto line = raw->data[frame * 3 + 1].value.mInt;
+		return pushDebugLoc(t, func.type == CrocType_Function ? func.mFunction : nullptr, cast(word)line);
+	}
+
+	// Turns a raw traceback into an array of Locations, the way it's presented in the traceback field of exceptions.
+	word pushTracebackFromRaw(Thread* t, word raw)
 	{
 		auto ret = croc_array_new(*t, 0);
+		auto numFrames = getArray(t, raw)->length / 3;
 
-		for(auto &ar: t->actRecs.slice(0, t->arIndex).reverse())
+		for(uword i = 0; i < numFrames; i++)
 		{
-			pushDebugLoc(t, &ar);
+			pushRawTracebackLoc(t, getArray(t, raw), i);
 			croc_cateq(*t, ret, 1);
 
-			if(ar.numTailcalls > 0)
+			auto numTailcalls = cast(uword)getArray(t, raw)->data[i * 3 + 2].value.mInt;
+
+			if(numTailcalls > 0)
 			{
 				croc_pushFormat(*t,
-					"<%" CROC_SIZE_T_FORMAT " tailcall%s>", ar.numTailcalls, ar.numTailcalls == 1 ? "" : "s");
+					"<%" CROC_SIZE_T_FORMAT " tailcall%s>", numTailcalls, numTailcalls == 1 ? "" : "s");
 				croc_eh_pushLocationObject(*t, croc_getString(*t, -1), -1, CrocLocation_Script);
 				croc_cateq(*t, ret, 1);
 				croc_popTop(*t);
@@ -140,10 +182,105 @@ namespace croc
 		return ret;
 	}
 
+	word pushTraceback(Thread* t)
+	{
+		auto raw = croc_array_new(*t, 0);
+		captureRawTraceback(t, getArray(t, raw));
+		pushTracebackFromRaw(t, raw);
+		croc_insertAndPop(*t, raw);
+		return raw;
+	}
+
+	// Throwable's location and traceback fields hold null until they're first read, and are then built from the raw
+	// traceback (see captureRawTraceback) in the rawTraceback hidden field, which only Throwable and the classes derived
+	// from it have. The VM handles them itself rather than leaving it to a metamethod, so that they behave the same way
+	// for subclasses which have their own opField.
+	bool isExField(Thread* t, Instance* i, String* name)
+	{
+		auto n = name->toDArray();
+
+		if(n != ATODA("location") && n != ATODA("traceback"))
+			return false;
+
+		auto v = i->getField(name);
+		return v != nullptr && v->type == CrocType_Null &&
+			i->getHiddenField(String::create(t->vm, ATODA("rawTraceback"))) != nullptr;
+	}
+
+	// Pushes the value of one of the fields that isExField is true for, building it if need be.
+	word pushExField(Thread* t, word ex, String* name)
+	{
+		auto isLocation = name->toDArray() == ATODA("location");
+		auto ret = push(t, *getInstance(t, ex)->getField(name));
+
+		if(!croc_isNull(*t, ret))
+			return ret;
+
+		croc_popTop(*t);
+		auto raw = croc_hfield(*t, ex, "rawTraceback");
+
+		if(croc_isNull(*t, raw))
+		{
+			// Never thrown. The location isn't cached, so that throwing it later will still fill it in.
+			croc_popTop(*t);
+
+			if(isLocation)
+			{
+				croc_eh_pushLocationClass(*t);
+				croc_pushNull(*t);
+				croc_call(*t, ret, 1);
+				return ret;
+			}
+
+			croc_array_new(*t, 0);
+		}
+		else
+		{
+			if(!isLocation)
+				pushTracebackFromRaw(t, raw);
+			else if(getArray(t, raw)->length > 0)
+				pushRawTracebackLoc(t, getArray(t, raw), 0);
+			else
+				croc_eh_pushLocationObject(*t, "<no location available>", 0, CrocLocation_Unknown);
+
+			croc_insertAndPop(*t, raw);
+		}
+
+		croc_dupTop(*t);
+		croc_fielda(*t, ex, name->toCString());
+		return ret;
+	}
+
+	namespace
+	{
+		// Whether one of Throwable's location and traceback fields is still waiting to be built.
+		bool exFieldUnbuilt(Thread* t, word ex, const char* name)
+		{
+			auto v = getInstance(t, ex)->getField(String::create(t->vm, atoda(name)));
+			return v == nullptr || v->type == CrocType_Null;
+		}
+	}
+
 	void continueTraceback(Thread* t, Value ex)
 	{
-		push(t, ex);
-		croc_field(*t, -1, "traceback");
+		auto e = push(t, ex);
+
+		if(croc_hasHField(*t, e, "rawTraceback"))
+		{
+			// If nobody has looked at the traceback yet, it can stay raw.
+			auto raw = croc_hfield(*t, e, "rawTraceback");
+
+			if(exFieldUnbuilt(t, e, "traceback") && !croc_isNull(*t, raw))
+			{
+				captureRawTraceback(t, getArray(t, raw));
+				croc_pop(*t, 2);
+				return;
+			}
+
+			croc_popTop(*t);
+		}
+
+		croc_field(*t, e, "traceback");
 		pushTraceback(t);
 		croc_cateq(*t, -2, 1);
 		croc_pop(*t, 2);
@@ -152,6 +289,39 @@ namespace croc
 	void addLocationInfo(Thread* t, Value ex)
 	{
 		auto e = push(t, ex);
+
+		// Throwable's location and traceback are filled in lazily from the raw traceback (see isExField).
+		if(croc_hasHField(*t, e, "rawTraceback"))
+		{
+			bool capture;
+
+			if(exFieldUnbuilt(t, e, "location"))
+			{
+				capture = croc_isNull(*t, croc_hfield(*t, e, "rawTraceback"));
+				croc_popTop(*t);
+			}
+			else
+			{
+				croc_field(*t, e, "location");
+				capture = croc_getInt(*t, croc_field(*t, -1, "col")) == CrocLocation_Unknown;
+				croc_pop(*t, 2);
+			}
+
+			if(capture)
+			{
+				croc_array_new(*t, 0);
+				captureRawTraceback(t, getArray(t, -1));
+				croc_hfielda(*t, e, "rawTraceback");
+				croc_pushNull(*t);
+				croc_fielda(*t, e, "location");
+				croc_pushNull(*t);
+				croc_fielda(*t, e, "traceback");
+			}
+
+			croc_popTop(*t);
+			return;
+		}
+
 		auto loc = croc_field(*t, e, "location");
 		auto col = croc_field(*t, loc, "col");
 
@@ -173,95 +343,131 @@ namespace croc
 			croc_pop(*t, 2);
 	}
 
-	void throwImpl(Thread* t, Value ex, bool rethrowing)
+	namespace
 	{
-		if(ex.type != CrocType_Instance)
+		void beginThrow(Thread* t, Value ex, bool rethrowing)
 		{
-			pushTypeStringImpl(t, ex);
-			croc_eh_throwStd(*t, "TypeError", "Only instances can be thrown, not '%s'", croc_getString(*t, -1));
-		}
-
-		if(!rethrowing)
-			addLocationInfo(t, ex);
+			if(ex.type != CrocType_Instance)
+			{
+				pushTypeStringImpl(t, ex);
+				croc_eh_throwStd(*t, "TypeError", "Only instances can be thrown, not '%s'", croc_getString(*t, -1));
+			}
 
-		if(t->currentAR)
-		{
-			t->currentAR->unwindCounter = 0;
-			t->currentAR->unwindReturn = nullptr;
-		}
+			if(!rethrowing)
+				addLocationInfo(t, ex);
 
-		auto vm = t->vm;
-		vm->exception = ex.mInstance;
-		auto jumpFrame = vm->currentEH;
-		auto destThread = jumpFrame ? jumpFrame->t : nullptr;
+			if(t->currentAR)
+			{
+				t->currentAR->unwindCounter = 0;
+				t->currentAR->unwindReturn = nullptr;
+			}
 
-		// Kill any threads between here and where the exception is being caught
-		for(auto curThread = t; curThread != destThread; curThread = curThread->threadThatResumedThis)
-		{
-			popARTo(curThread, 0);
-			vm->curThread = curThread->threadThatResumedThis;
+			t->vm->exception = ex.mInstance;
 		}
 
-		if(jumpFrame == nullptr)
+		// Pops ARs down to destAR and clears the stack above slot, which receives the exception if it's being caught.
+		void unwindTo(Thread* t, Value ex, uword destAR, uword slot, bool isCatch)
 		{
-			// Uh oh, no handler; call the unhandled handler. At this point, there are no running threads, so let's use
-			// the main thread.
-			t = vm->mainThread;
-			t->setHookFunc(t->vm->mem, nullptr);
-			t->hooks = 0;
+			popARTo(t, destAR + 1);
+			closeUpvals(t, slot);
 
-			push(t, Value::from(vm->unhandledEx));
-			push(t, Value::nullValue);
-			push(t, Value::from(vm->exception));
-			vm->exception = nullptr;
+			// This can happen at top-level, when popARTo sets the stack index to 1.
+			if(t->stackIndex <= slot)
+				t->stackIndex = slot + 1;
 
-			if(croc_tryCall(*t, -3, 0) < 0)
-				fprintf(stderr, "Error in unhandled exception handler!\n");
+			t->stack.slice(slot + 1, t->stackIndex).fill(Value::nullValue);
 
-			abort();
+			if(isCatch)
+			{
+				t->stack[slot] = ex;
+				t->vm->exception = nullptr;
+			}
 		}
-		else
+
+		// Script code runs with the stack index at the top of its function's frame, but a throw from a native call or a
+		// resumed thread can leave it below that, and anything pushed (such as for a metamethod call) would then land on
+		// the catching function's registers.
+		void unwindToScriptHandler(Thread* t, Value ex, ScriptEHFrame* frame)
 		{
-			t = vm->curThread;
-			auto threadFrame = t->currentEH;
-			// Signed, since native EH frames can have an AR of -1 which means it's at top-level
-			bool isScript = threadFrame && cast(word)threadFrame->actRecord > cast(word)jumpFrame->actRecord;
+			unwindTo(t, ex, frame->actRecord, frame->slot, frame->isCatch);
+			t->currentAR->pc = frame->pc;
+			t->stackIndex = t->currentAR->savedTop;
+		}
 
-			uword destAR, slot;
+		void finishThrow(Thread* t, Value ex)
+		{
+			auto vm = t->vm;
+			auto jumpFrame = vm->currentEH;
+			auto destThread = jumpFrame ? jumpFrame->t : nullptr;
 
-			if(isScript)
-			{
-				destAR = threadFrame->actRecord;
-				slot = threadFrame->slot;
-			}
-			else
+			// Kill any threads between here and where the exception is being caught
+			for(auto curThread = t; curThread != destThread; curThread = curThread->threadThatResumedThis)
 			{
-				destAR = jumpFrame->actRecord;
-				slot = jumpFrame->slot;
+				popARTo(curThread, 0);
+				vm->curThread = curThread->threadThatResumedThis;
 			}
 
-			popARTo(t, destAR + 1);
-			closeUpvals(t, slot);
+			if(jumpFrame == nullptr)
+			{
+				// Uh oh, no handler; call the unhandled handler. At this point, there are no running threads, so let's
+				// use the main thread.
+				t = vm->mainThread;
+				t->setHookFunc(t->vm->mem, nullptr);
+				t->hooks = 0;
 
-			// This can happen at top-level, when popARTo sets the stack index to 1.
-			if(t->stackIndex <= slot)
-				t->stackIndex = slot + 1;
+				push(t, Value::from(vm->unhandledEx));
+				push(t, Value::nullValue);
+				push(t, Value::from(vm->exception));
+				vm->exception = nullptr;
 
-			t->stack.slice(slot + 1, t->stackIndex).fill(Value::nullValue);
+				if(croc_tryCall(*t, -3, 0) < 0)
+					fprintf(stderr, "Error in unhandled exception handler!\n");
 
-			if(!isScript || threadFrame->isCatch)
+				abort();
+			}
+			else
 			{
-				t->stack[slot] = ex;
-				t->vm->exception = nullptr;
+				t = vm->curThread;
+				auto threadFrame = t->currentEH;
+				// Signed, since native EH frames can have an AR of -1 which means it's at top-level
+				bool isScript = threadFrame && cast(word)threadFrame->actRecord > cast(word)jumpFrame->actRecord;
+
+				if(isScript)
+					unwindToScriptHandler(t, ex, threadFrame);
+				else
+				{
+					unwindTo(t, ex, jumpFrame->actRecord, jumpFrame->slot, true);
+					t->stackIndex = jumpFrame->slot + 1;
+				}
+
+				CROC_LONGJMP(*jumpFrame->jbuf, isScript ? EHStatus_ScriptFrame : EHStatus_NativeFrame);
 			}
+		}
+	}
 
-			if(isScript)
-				t->currentAR->pc = threadFrame->pc;
-			else
-				t->stackIndex = slot + 1;
+	void throwImpl(Thread* t, Value ex, bool rethrowing)
+	{
+		beginThrow(t, ex, rethrowing);
+		finishThrow(t, ex);
+	}
+
+	void scriptThrow(Thread* t, Value ex, bool rethrowing)
+	{
+		beginThrow(t, ex, rethrowing);
 
-			longjmp(*jumpFrame->jbuf, isScript ? EHStatus_ScriptFrame : EHStatus_NativeFrame);
+		auto jumpFrame = t->vm->currentEH;
+		auto threadFrame = t->currentEH;
+
+		if(jumpFrame && jumpFrame->t == t && threadFrame &&
+			cast(word)threadFrame->actRecord > cast(word)jumpFrame->actRecord)
+		{
+			// Caught by a script handler in the same execute() as the throw, so there's nothing to longjmp over.
+			unwindToScriptHandler(t, ex, threadFrame);
+			popScriptEHFrame(t);
+			return;
 		}
+
+		finishThrow(t, ex);
 	}
 
 	void unwind(Thread* t)
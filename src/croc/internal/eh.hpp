@@ -2,6 +2,7 @@
 #define CROC_INTERNAL_EH_HPP
 
 #include <functional>
+#include <type_traits>
 
 #include "croc/types/base.hpp"
 
@@ -9,17 +10,32 @@ namespace croc
 {
 	word defaultUnhandledEx(CrocThread* t);
 	void pushNativeEHFrame(Thread* t, RelStack slot, jmp_buf& buf);
-	void pushExecEHFrame(Thread* t, jmp_buf& buf);
+	void pushExecEHFrame(Thread* t, uword startARIndex, jmp_buf& buf);
 	void pushScriptEHFrame(Thread* t, bool isCatch, RelStack slot, Instruction* pc);
 	void popNativeEHFrame(Thread* t);
 	void popScriptEHFrame(Thread* t);
 	void unwindThisFramesEH(Thread* t);
-	bool tryCode(Thread* t, RelStack slot, std::function<void()> dg);
+	bool tryCodeImpl(Thread* t, RelStack slot, void (*fn)(void*), void* ctx);
+	void captureRawTraceback(Thread* t, Array* raw);
+	word pushRawTracebackLoc(Thread* t, Array* raw, uword frame);
+	word pushTracebackFromRaw(Thread* t, word raw);
 	word pushTraceback(Thread* t);
+	bool isExField(Thread* t, Instance* i, String* name);
+	word pushExField(Thread* t, word ex, String* name);
 	void continueTraceback(Thread* t, Value ex);
 	void addLocationInfo(Thread* t, Value ex);
 	void throwImpl(Thread* t, Value ex, bool rethrowing);
+	void scriptThrow(Thread* t, Value ex, bool rethrowing);
 	void unwind(Thread* t);
+
+	// Runs dg, returning true if it threw an exception (which is left in slot). This is a template rather than taking a
+	// std::function so that calling it never has to heap-allocate the closure.
+	template<typename F>
+	inline bool tryCode(Thread* t, RelStack slot, F&& dg)
+	{
+		typedef typename std::remove_reference<F>::type Fn;
+		return tryCodeImpl(t, slot, [](void* ctx) { (*cast(Fn*)ctx)(); }, cast(void*)&dg);
+	}
 }
 
 #endif
\ No newline at end of file
@@ -10,6 +10,7 @@
 #include "croc/internal/debug.hpp"
 #include "croc/internal/eh.hpp"
 #include "croc/internal/interpreter.hpp"
+#include "croc/internal/lock.hpp"
 #include "croc/internal/stack.hpp"
 #include "croc/internal/thread.hpp"
 #include "croc/internal/variables.hpp"
@@ -31,9 +32,21 @@
 			RT = &t->stack[stackBase + (*pc)->uimm]; (*pc)++;\
 	} while(false)
 
+// For after anything that can call into other code, such as loading a lazily-loaded global (see loadLazyGlobal). Those
+// calls can grow t->actRecs, which moves the current AR, and pc points into it.
+#define ReloadPC() (pc = &t->currentAR->pc)
+
 #define GetUImm() (((*pc)++)->uimm)
 #define GetImm() (((*pc)++)->imm)
 
+// Counts a loop backedge or script call against the thread's budget (see croc_thread_setBudget). These are also the
+// points where the VM lock is handed over to another OS thread that's been waiting for it (see croc_vm_enableLock).
+#define CountBudget()\
+	do {\
+		if((t->budgetLeft != 0 && --t->budgetLeft == 0) || t->vm->lockWanted.load(std::memory_order_relaxed))\
+			goto _checkpoint;\
+	} while(false)
+
 #define AdjustParams()\
 	do {\
 		if(numParams == 0)\
@@ -305,17 +318,39 @@ namespace croc
 			croc_eh_throwStd(*t, "TypeError", "Attempting to bitwise %s-assign a '%s' and a '%s'",
 				name, croc_getString(*t, -2), croc_getString(*t, -1));
 		}
+
+		// Called when a thread's budget runs out. Throws for CrocBudgetAction_Throw. Otherwise returns whether the thread
+		// can yield where it is; if it can't, the budget is left to run out again at the next backedge or call.
+		bool budgetExpired(Thread* t)
+		{
+			if(t->budgetAction == CrocBudgetAction_Throw)
+			{
+				// Refilled rather than turned off, so that a catch block that doesn't return (or loops forever itself)
+				// still times out again.
+				t->budgetLeft = t->budget;
+				croc_eh_throwStd(*t, "TimeoutError", "Thread ran out of its budget (%" CROC_SIZE_T_FORMAT ")", t->budget);
+			}
+
+			if(t == t->vm->mainThread || (t->nativeCallDepth > 0 && t->stackful == nullptr))
+			{
+				t->budgetLeft = 1;
+				return false;
+			}
+
+			t->budgetLeft = t->budget;
+			return true;
+		}
 	}
 
 	void execute(Thread* t, uword startARIndex)
 	{
 		assert(t->stackIndex > 1); // for the exec EH frame
 		jmp_buf buf;
-		pushExecEHFrame(t, buf);
+		pushExecEHFrame(t, startARIndex, buf);
 		auto savedNativeDepth = t->nativeCallDepth; // doesn't need to be volatile since it never changes value
 
 	_exceptionRetry:
-		auto ehStatus = setjmp(buf);
+		auto ehStatus = CROC_SETJMP(buf);
 		if(ehStatus == EHStatus_Okay)
 		{
 		t->state = CrocThreadState_Running;
@@ -516,12 +551,17 @@ namespace croc
 					newGlobalImpl(t, constTable[GetUImm()].mString, env, t->stack[stackBase + rd]);
 					break;
 
-				case Op_GetGlobal:
-					t->stack[stackBase + rd] = getGlobalImpl(t, constTable[GetUImm()].mString, env);
+				case Op_GetGlobal: {
+					// Getting a lazily-loaded global calls its loader, which can move the stack.
+					auto val = getGlobalImpl(t, constTable[GetUImm()].mString, env);
+					ReloadPC();
+					t->stack[stackBase + rd] = val;
 					break;
+				}
 
 				case Op_SetGlobal:
 					setGlobalImpl(t, constTable[GetUImm()].mString, env, t->stack[stackBase + rd]);
+					ReloadPC();
 					break;
 
 				case Op_GetUpval:  t->stack[stackBase + rd] = *upvals[GetUImm()]->value; break;
@@ -593,7 +633,10 @@ namespace croc
 					GetRT();
 					auto jump = GetImm();
 
-					if(inImpl(t, *RS, *RT) == cast(bool)rd)
+					auto found = inImpl(t, *RS, *RT);
+					ReloadPC();
+
+					if(found == cast(bool)rd)
 						(*pc) += jump;
 					break;
 				}
@@ -612,7 +655,12 @@ namespace croc
 					auto jump = GetImm();
 
 					if(rd != 0)
+					{
 						(*pc) += jump;
+
+						if(jump < 0)
+							CountBudget();
+					}
 					break;
 				}
 				case Op_Switch: {
@@ -680,6 +728,7 @@ namespace croc
 							t->stack[stackBase + rd + 3] = Value::from(idx);
 							t->stack[stackBase + rd] = Value::from(idx + step);
 							(*pc) += jump;
+							CountBudget();
 						}
 					}
 					else
@@ -689,6 +738,7 @@ namespace croc
 							t->stack[stackBase + rd + 3] = Value::from(idx);
 							t->stack[stackBase + rd] = Value::from(idx + step);
 							(*pc) += jump;
+							CountBudget();
 						}
 					}
 					break;
@@ -755,12 +805,16 @@ namespace croc
 						{
 							t->stack[stackBase + rd + 2] = t->stack[stackBase + funcReg];
 							(*pc) += jump;
+							CountBudget();
 						}
 					}
 					else
 					{
 						if(src->mThread->state != CrocThreadState_Dead)
+						{
 							(*pc) += jump;
+							CountBudget();
+						}
 					}
 					break;
 				}
@@ -784,8 +838,8 @@ namespace croc
 
 				case Op_Throw:
 					GetRS();
-					throwImpl(t, *RS, cast(bool)rd);
-					assert(false); // should never get here
+					scriptThrow(t, *RS, cast(bool)rd);
+					goto _reentry; // caught in this same execute() (otherwise scriptThrow doesn't return)
 
 				// Function Calling
 			{
@@ -828,6 +882,22 @@ namespace croc
 						numResults = -1; // second uimm is a dummy
 
 					AdjustParams();
+
+					// Fast path for the common case of calling a script function with its exact arity for one result.
+					if(numResults == 1 && !isTailcall && !t->hooks)
+					{
+						auto &func = t->stack[stackBase + rd];
+
+						if(func.type == CrocType_Function && !func.mFunction->isNative &&
+							!func.mFunction->scriptFunc->isVararg && numParams == func.mFunction->numParams)
+						{
+							lightCallPrologue(t, func.mFunction, stackBase + rd, numParams);
+							croc_gc_maybeCollect(*t);
+							CountBudget();
+							goto _reentry;
+						}
+					}
+
 					isScript = callPrologue(t, stackBase + rd, numResults, numParams, isTailcall);
 
 					// fall through
@@ -836,6 +906,8 @@ namespace croc
 
 					if(!isScript && !isTailcall && numResults >= 0)
 						t->stackIndex = t->currentAR->savedTop;
+					else if(isScript)
+						CountBudget();
 
 					// We always go to reentry, even with native tailcalls, since script hook funcs may be run before
 					// native tailcalls.
@@ -846,7 +918,16 @@ namespace croc
 					auto numResults = GetUImm();
 					auto firstResult = stackBase + rd;
 
-					if(numResults == 0)
+					if(t->currentAR->isLight)
+					{
+						// The return slot is below this frame, so it's safe to write the result there right away.
+						auto haveResult = numResults == 0 ? t->stackIndex > firstResult : numResults > 1;
+						t->stack[t->currentAR->returnSlot] = haveResult ? t->stack[firstResult] : Value::nullValue;
+
+						if(numResults == 0)
+							t->stackIndex = t->currentAR->savedTop;
+					}
+					else if(numResults == 0)
 					{
 						saveResults(t, t, firstResult, t->stackIndex - firstResult);
 						t->stackIndex = t->currentAR->savedTop;
@@ -856,7 +937,10 @@ namespace croc
 					break;
 				}
 				case Op_Ret: {
-					callEpilogue(t);
+					if(t->currentAR->isLight)
+						lightCallEpilogue(t);
+					else
+						callEpilogue(t);
 
 					if(t->arIndex < startARIndex)
 						goto _return;
@@ -957,12 +1041,20 @@ namespace croc
 					if(t == t->vm->mainThread)
 						croc_eh_throwStd(*t, "RuntimeError", "Attempting to yield out of the main thread");
 
-					if(t->nativeCallDepth > 0)
+					if(t->nativeCallDepth > 0 && t->stackful == nullptr)
 						croc_eh_throwStd(*t, "RuntimeError",
 							"Attempting to yield across native / metamethod call boundary");
 
 					t->savedStartARIndex = startARIndex;
 					yieldImpl(t, stackBase + rd, numParams, numResults);
+
+					if(t->stackful)
+					{
+						// Stackful threads stay right here while suspended, and carry on once they're resumed.
+						suspendStackful(t);
+						goto _reentry;
+					}
+
 					goto _return;
 				}
 				case Op_CheckParams: {
@@ -1188,7 +1280,7 @@ namespace croc
 					croc_gc_maybeCollect(*t);
 					break;
 				}
-				case Op_Index:       GetRS(); GetRT(); idxImpl(t, stackBase + rd, *RS, *RT);  break;
+				case Op_Index:       GetRS(); GetRT(); idxImpl(t, stackBase + rd, *RS, *RT); ReloadPC(); break;
 				case Op_IndexAssign: GetRS(); GetRT(); idxaImpl(t, stackBase + rd, *RS, *RT); break;
 
 				case Op_Field: {
@@ -1203,6 +1295,7 @@ namespace croc
 					}
 
 					fieldImpl(t, stackBase + rd, *RS, RT->mString, false);
+					ReloadPC();
 					break;
 				}
 				case Op_FieldAssign: {
@@ -1217,6 +1310,7 @@ namespace croc
 					}
 
 					fieldaImpl(t, stackBase + rd, RS->mString, *RT, false);
+					ReloadPC();
 					break;
 				}
 				case Op_Slice: {
@@ -1362,6 +1456,27 @@ namespace croc
 				default:
 					croc_eh_throwStd(*t, "VMError", "Unimplemented opcode %s", OpNames[cast(uword)opcode]);
 			}
+
+			continue;
+
+		_checkpoint:
+			// This happens after a jump or call has been made, so the thread is at a clean instruction boundary; going
+			// back through _reentry picks up wherever it now is.
+			if(t->vm->lockWanted.load(std::memory_order_relaxed))
+				switchVMLock(t);
+
+			if(t->budgetLeft == 0 && t->budget != 0 && budgetExpired(t))
+			{
+				t->savedStartARIndex = startARIndex;
+				yieldImpl(t, t->stackIndex, 0, 0);
+
+				if(!t->stackful)
+					goto _return;
+
+				suspendStackful(t);
+			}
+
+			goto _reentry;
 		}
 		}
 		else // catch!
@@ -0,0 +1,223 @@
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+
+#include "croc/internal/lock.hpp"
+#include "croc/types/base.hpp"
+
+#ifdef CROC_LEAK_DETECTOR
+#  define VMLOCKTYPEID ,typeid(VMLock)
+#else
+#  define VMLOCKTYPEID
+#endif
+
+namespace croc
+{
+	// The VM lock itself is the held flag; the mutex only protects this struct, so that the lock can be waited on with
+	// a timeout and handed directly from one OS thread to another.
+	struct VMLock
+	{
+		std::mutex mutex;
+		std::condition_variable changed; // signalled whenever held, numAcquired or numOSThreads change
+		bool held;
+		uword numWaiting;
+		uint64_t numAcquired;
+		uword numOSThreads;
+	};
+
+	namespace
+	{
+		// How long an OS thread waits for the lock before asking the holder to hand it over at its next backedge or call.
+		// Blocking natives usually release it well within this, so it rarely comes to that.
+		const std::chrono::milliseconds SwitchInterval(5);
+
+		const uword OSThreadEHFrames = 4;
+
+		// Called with the mutex locked.
+		void take(VM* vm, std::unique_lock<std::mutex>& guard)
+		{
+			auto l = vm->lock;
+
+			if(l->held)
+			{
+				l->numWaiting++;
+
+				while(l->held)
+				{
+					// Ask again every interval, since the flag is cleared each time the lock changes hands.
+					if(l->changed.wait_for(guard, SwitchInterval) == std::cv_status::timeout && l->held)
+						vm->lockWanted.store(true, std::memory_order_relaxed);
+				}
+
+				l->numWaiting--;
+			}
+
+			l->held = true;
+			l->numAcquired++;
+			vm->lockWanted.store(false, std::memory_order_relaxed);
+			l->changed.notify_all();
+		}
+
+		// Moves the VM's native EH stack into t while its OS thread doesn't have the lock.
+		void stash(Thread* t)
+		{
+			auto vm = t->vm;
+			assert(t->lockedEHFrames.length == 0);
+			t->lockedEHFrames = vm->ehFrames;
+			t->lockedEHIndex = vm->ehIndex;
+			vm->ehFrames = DArray<NativeEHFrame>();
+			vm->ehIndex = 0;
+			vm->currentEH = nullptr;
+		}
+
+		void install(Thread* t)
+		{
+			auto vm = t->vm;
+			vm->ehFrames = t->lockedEHFrames;
+			vm->ehIndex = t->lockedEHIndex;
+			vm->currentEH = vm->ehIndex > 0 ? &vm->ehFrames[vm->ehIndex - 1] : nullptr;
+			vm->curThread = t;
+			t->lockedEHFrames = DArray<NativeEHFrame>();
+			t->lockedEHIndex = 0;
+		}
+	}
+
+	// Creates the VM lock, held by the calling OS thread. Does nothing if it already exists.
+	void enableVMLock(Thread* t)
+	{
+		auto vm = t->vm;
+
+		if(vm->lock != nullptr)
+			return;
+
+		vm->lock = new(vm->mem.allocRaw(sizeof(VMLock) VMLOCKTYPEID)) VMLock();
+		vm->lock->held = true;
+		vm->lock->numAcquired = 1;
+	}
+
+	void freeVMLock(VM* vm)
+	{
+		if(vm->lock == nullptr)
+			return;
+
+		assert(vm->lock->numOSThreads == 0);
+		vm->lock->~VMLock();
+		void* ptr = vm->lock;
+		size_t size = sizeof(VMLock);
+		vm->mem.freeRaw(ptr, size VMLOCKTYPEID);
+		vm->lock = nullptr;
+	}
+
+	void releaseVMLock(Thread* t)
+	{
+		auto l = t->vm->lock;
+
+		if(l == nullptr)
+			return;
+
+		stash(t);
+
+		std::lock_guard<std::mutex> guard(l->mutex);
+		assert(l->held);
+		l->held = false;
+		l->changed.notify_all();
+	}
+
+	void acquireVMLock(Thread* t)
+	{
+		auto l = t->vm->lock;
+
+		if(l == nullptr)
+			return;
+
+		{
+			std::unique_lock<std::mutex> guard(l->mutex);
+			take(t->vm, guard);
+		}
+
+		install(t);
+	}
+
+	// Called by the interpreter when lockWanted is set. Hands the lock to one of the OS threads waiting for it, then
+	// waits to get it back.
+	void switchVMLock(Thread* t)
+	{
+		auto vm = t->vm;
+		auto l = vm->lock;
+		assert(l != nullptr);
+
+		{
+			std::unique_lock<std::mutex> guard(l->mutex);
+
+			if(l->numWaiting == 0)
+			{
+				vm->lockWanted.store(false, std::memory_order_relaxed);
+				return;
+			}
+
+			stash(t);
+			l->held = false;
+			auto before = l->numAcquired;
+			l->changed.notify_all();
+
+			// Otherwise this thread would most likely just take it right back.
+			while(l->numAcquired == before)
+				l->changed.wait(guard);
+
+			take(vm, guard);
+		}
+
+		install(t);
+	}
+
+	// Sets up t, which was made with Thread::create, to run on a new OS thread. Must be called by an OS thread which
+	// holds the lock. The new OS thread can acquire the lock with t once it's been released.
+	void beginOSThread(Thread* t)
+	{
+		auto l = t->vm->lock;
+		assert(l != nullptr && t->lockedEHFrames.length == 0);
+		t->lockedEHFrames = DArray<NativeEHFrame>::alloc(t->vm->mem, OSThreadEHFrames);
+		t->lockedEHIndex = 0;
+
+		std::lock_guard<std::mutex> guard(l->mutex);
+		l->numOSThreads++;
+	}
+
+	// Called by an OS thread started with beginOSThread when it's finished. Releases the lock for good; after this, the OS
+	// thread must not touch the VM at all.
+	void endOSThread(Thread* t)
+	{
+		auto vm = t->vm;
+		auto l = vm->lock;
+		assert(vm->ehIndex == 0);
+		vm->ehFrames.free(vm->mem);
+		vm->currentEH = nullptr;
+
+		std::lock_guard<std::mutex> guard(l->mutex);
+		l->held = false;
+		l->numOSThreads--;
+		l->changed.notify_all();
+	}
+
+	// Releases the lock until every OS thread has finished. Used when closing the VM.
+	void waitForOSThreads(Thread* t)
+	{
+		auto l = t->vm->lock;
+
+		if(l == nullptr)
+			return;
+
+		releaseVMLock(t);
+
+		{
+			std::unique_lock<std::mutex> guard(l->mutex);
+
+			while(l->numOSThreads > 0)
+				l->changed.wait(guard);
+		}
+
+		acquireVMLock(t);
+	}
+}
@@ -0,0 +1,18 @@
+#ifndef CROC_INTERNAL_LOCK_HPP
+#define CROC_INTERNAL_LOCK_HPP
+
+#include "croc/types/base.hpp"
+
+namespace croc
+{
+	void enableVMLock(Thread* t);
+	void freeVMLock(VM* vm);
+	void releaseVMLock(Thread* t);
+	void acquireVMLock(Thread* t);
+	void switchVMLock(Thread* t);
+	void beginOSThread(Thread* t);
+	void endOSThread(Thread* t);
+	void waitForOSThreads(Thread* t);
+}
+
+#endif
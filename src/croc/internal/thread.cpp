@@ -9,6 +9,131 @@
 
 namespace croc
 {
+	namespace
+	{
+		// Body of a thread that's being started, whether on this C stack or its own.
+		void startThread(Thread* t, Thread* from, AbsStack slot, uword numParams)
+		{
+			checkStack(t, cast(AbsStack)(numParams + 2));
+			t->stack[1] = Value::from(t->coroFunc);
+			t->stack.slicea(2, 2 + numParams, from->stack.slice(slot + 1, slot + 1 + numParams));
+			t->stackIndex += numParams;
+
+			auto result = callPrologue(t, cast(AbsStack)1, -1, numParams);
+			assert(result);
+#ifdef NDEBUG
+			(void)result;
+#endif
+			execute(t, t->arIndex);
+		}
+
+		// A dead thread has no use for its stacks until it's reset and resumed again, so let other threads have them.
+		void releaseStacks(Thread* t)
+		{
+			assert(t->state == CrocThreadState_Dead);
+			t->freeStacks();
+#ifdef CROC_STACKFUL_THREADS
+			t->freeCStack();
+#endif
+		}
+
+#ifdef CROC_STACKFUL_THREADS
+		// Puts t's native EH frames back on top of the VM's EH stack and switches to its C stack. Returns once t yields
+		// or dies.
+		void switchTo(Thread* t, Thread* from)
+		{
+			auto ctx = t->stackful;
+			auto vm = t->vm;
+			auto num = ctx->numEHFrames;
+			ctx->from = from;
+			ctx->ehBase = vm->ehIndex;
+
+			if(num > 0)
+			{
+				if(vm->ehIndex + num > vm->ehFrames.length)
+					vm->ehFrames.resize(vm->mem, (vm->ehIndex + num) * 2);
+
+				vm->ehFrames.slicea(vm->ehIndex, vm->ehIndex + num, ctx->ehFrames.slice(0, num));
+
+				// The bottom frame catches whatever escapes the thread, on behalf of whoever resumed it this time.
+				auto bottom = &vm->ehFrames[vm->ehIndex];
+				bottom->t = from;
+				bottom->actRecord = from->arIndex - 1;
+				bottom->slot = from->stackBase;
+
+				vm->ehIndex += num;
+				vm->currentEH = &vm->ehFrames[vm->ehIndex - 1];
+				ctx->numEHFrames = 0;
+			}
+
+			swapcontext(&ctx->caller, &ctx->ctx);
+		}
+
+		// Called on t's own C stack. Takes its native EH frames off the VM's EH stack and switches back to the thread
+		// that resumed it.
+		void switchOut(Thread* t)
+		{
+			auto ctx = t->stackful;
+			auto vm = t->vm;
+			auto num = vm->ehIndex - ctx->ehBase;
+
+			if(num > ctx->ehFrames.length)
+				ctx->ehFrames.resize(vm->mem, num);
+
+			ctx->ehFrames.slicea(0, num, vm->ehFrames.slice(ctx->ehBase, vm->ehIndex));
+			ctx->numEHFrames = num;
+			vm->ehIndex = ctx->ehBase;
+			vm->currentEH = vm->ehIndex > 0 ? &vm->ehFrames[vm->ehIndex - 1] : nullptr;
+
+			swapcontext(&ctx->ctx, &ctx->caller);
+		}
+
+		// Entry point of a stackful thread's C stack. makecontext only passes ints, hence the pointer being split up.
+		void stackfulMain(unsigned int hi, unsigned int lo)
+		{
+			auto t = cast(Thread*)((cast(uintptr_t)hi << 16 << 16) | cast(uintptr_t)lo);
+			auto ctx = t->stackful;
+			jmp_buf buf;
+			pushNativeEHFrame(ctx->from, 0, buf);
+
+			if(CROC_SETJMP(buf) == EHStatus_Okay)
+				startThread(t, ctx->from, ctx->from->stackBase, ctx->numParams);
+			else
+			{
+				t->nativeCallDepth = 0;
+				ctx->failed = true;
+			}
+
+			popNativeEHFrame(ctx->from);
+			setcontext(&ctx->caller);
+		}
+
+		bool resumeStackful(Thread* t, Thread* from, AbsStack slot, uword numParams)
+		{
+			auto ctx = t->stackful;
+			ctx->failed = false;
+
+			if(t->state == CrocThreadState_Initial)
+			{
+				ctx->numParams = numParams;
+				ctx->numEHFrames = 0;
+				getcontext(&ctx->ctx);
+				ctx->ctx.uc_stack.ss_sp = ctx->stack;
+				ctx->ctx.uc_stack.ss_size = ctx->stackSize;
+				ctx->ctx.uc_link = nullptr;
+				auto p = cast(uintptr_t)t;
+				makecontext(&ctx->ctx, cast(void(*)())&stackfulMain, 2,
+					cast(unsigned int)(p >> 16 >> 16), cast(unsigned int)(p & 0xFFFFFFFF));
+			}
+			else
+				saveResults(t, from, slot + 2, numParams - 1); // skip 'this'
+
+			switchTo(t, from);
+			return ctx->failed;
+		}
+#endif
+	}
+
 	void yieldImpl(Thread* t, AbsStack firstValue, word numValues, word expectedResults)
 	{
 		auto ar = pushAR(t);
@@ -17,6 +142,8 @@ namespace croc
 		*ar = t->actRecs[t->arIndex - 2];
 
 		ar->func = nullptr;
+		ar->ctorInstance = nullptr;
+		ar->isLight = false;
 
 		assert(firstValue > t->stackBase);
 
@@ -38,6 +165,16 @@ namespace croc
 
 	void resume(Thread* t, Thread* from, AbsStack slot, uword expectedResults, uword numParams)
 	{
+		// Threads don't get their stacks until they first run. Their value stack might already exist if something was
+		// pushed onto them, so the AR stack is what tells.
+		if(t->actRecs.length == 0)
+			t->allocStacks();
+
+#ifdef CROC_STACKFUL_THREADS
+		if(t->stackful && t->stackful->stack == nullptr && !t->allocCStack())
+			croc_eh_throwStd(*from, "RuntimeError", "Could not allocate a C stack for a stackful thread");
+#endif
+
 		// Set up AR on the calling thread, which is used to get yielded values from the resumed thread
 		auto ar = pushAR(from);
 		ar->base = slot;
@@ -52,6 +189,8 @@ namespace croc
 		ar->numResults = 0;
 		ar->unwindCounter = 0;
 		ar->unwindReturn = nullptr;
+		ar->ctorInstance = nullptr;
+		ar->isLight = false;
 		from->stackBase = slot;
 		from->stackIndex = slot + 1;
 
@@ -59,22 +198,17 @@ namespace croc
 		from->state = CrocThreadState_Waiting;
 		t->threadThatResumedThis = from;
 
-		auto failed = tryCode(from, 0, [&]
-		{
-			if(t->state == CrocThreadState_Initial)
-			{
-				checkStack(t, cast(AbsStack)(numParams + 2));
-				t->stack[1] = Value::from(t->coroFunc);
-				t->stack.slicea(2, 2 + numParams, from->stack.slice(slot + 1, slot + 1 + numParams));
-				t->stackIndex += numParams;
+		bool failed;
 
-				auto result = callPrologue(t, cast(AbsStack)1, -1, numParams);
-				assert(result);
-#ifdef NDEBUG
-				(void)result;
+#ifdef CROC_STACKFUL_THREADS
+		if(t->stackful)
+			failed = resumeStackful(t, from, slot, numParams);
+		else
 #endif
-				execute(t, t->arIndex);
-			}
+		failed = tryCode(from, 0, [&]
+		{
+			if(t->state == CrocThreadState_Initial)
+				startThread(t, from, slot, numParams);
 			else
 			{
 				// Get rid of 'this'
@@ -107,6 +241,7 @@ namespace croc
 				saveResults(from, from, from->stackIndex - 1, 1);
 				callEpilogue(from); // get rid of the resume AR
 				from->stackIndex = slot + 1;
+				releaseStacks(t);
 				continueTraceback(from, *getValue(from, -1));
 				croc_eh_rethrow(*from);
 			}
@@ -115,6 +250,25 @@ namespace croc
 		// Move the values from the yielded thread's stack to the calling thread's stack
 		saveResults(from, t, t->stackIndex - t->numYields, t->numYields);
 		t->stackIndex -= t->numYields;
+
+		if(t->state == CrocThreadState_Dead)
+			releaseStacks(t);
+
 		callEpilogue(from);
 	}
+
+	// Suspends a stackful thread which has already set up its yield with yieldImpl. Returns once it's resumed, with
+	// the values it was resumed with in place of the yielded ones.
+	void suspendStackful(Thread* t)
+	{
+#ifdef CROC_STACKFUL_THREADS
+		switchOut(t);
+		callEpilogue(t);
+		t->state = CrocThreadState_Running;
+		t->vm->curThread = t;
+#else
+		(void)t;
+		assert(false);
+#endif
+	}
 }
\ No newline at end of file
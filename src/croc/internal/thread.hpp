@@ -7,6 +7,7 @@ namespace croc
 {
 	void yieldImpl(Thread* t, AbsStack firstValue, word numValues, word expectedResults);
 	void resume(Thread* t, Thread* from, AbsStack slot, uword expectedResults, uword numParams);
+	void suspendStackful(Thread* t);
 }
 
 #endif
\ No newline at end of file
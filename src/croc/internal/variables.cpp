@@ -1,10 +1,14 @@
 
 #include "croc/api.h"
+#include "croc/internal/calls.hpp"
+#include "croc/internal/stack.hpp"
 #include "croc/internal/variables.hpp"
 #include "croc/types/base.hpp"
 
 namespace croc
 {
+	const char* LazyGlobalHook = "modules.lazyGlobalLoaded";
+
 	Value getGlobalImpl(Thread* t, String* name, Namespace* env)
 	{
 		if(auto glob = env->get(name))
@@ -16,6 +20,9 @@ namespace croc
 				return *glob;
 		}
 
+		if(loadLazyGlobal(t, env->root ? env->root : env, name))
+			return getGlobalImpl(t, name, env);
+
 		croc_eh_throwStd(*t, "NameError", "Attempting to get a nonexistent global '%s'", name->toCString());
 		assert(false);
 		return Value::nullValue; // dummy
@@ -29,16 +36,85 @@ namespace croc
 		if(env->root && env->root->setIfExists(t->vm->mem, name, val))
 			return;
 
+		if(loadLazyGlobal(t, env->root ? env->root : env, name))
+			return setGlobalImpl(t, name, env, val);
+
 		croc_eh_throwStd(*t, "NameError", "Attempting to set a nonexistent global '%s'", name->toCString());
 		assert(false);
 	}
 
 	void newGlobalImpl(Thread* t, String* name, Namespace* env, Value val)
 	{
-		if(env->contains(name))
+		if(env->contains(name) || isLazyGlobal(t, env, name))
 			croc_eh_throwStd(*t, "NameError", "Attempting to create global '%s' that already exists",
 				name->toCString());
 
 		env->set(t->vm->mem, name, val);
 	}
+
+	// Standard libraries that nothing has used yet have no globals. Instead, vm->lazyGlobals maps their names to native
+	// functions that load them, and these are used when a name can't be found in the global namespace.
+	bool isLazyGlobal(Thread* t, Namespace* ns, String* name)
+	{
+		return ns == t->vm->globals && t->vm->lazyGlobals->contains(name);
+	}
+
+	// If name is a lazy global in ns, loads it and returns true; after that, it's an ordinary global.
+	bool loadLazyGlobal(Thread* t, Namespace* ns, String* name)
+	{
+		if(!isLazyGlobal(t, ns, name))
+			return false;
+
+		// When this is reached from a script function, nothing above its frame is in use, but the stack index might not
+		// have been brought back up to the frame's top (e.g. after catching an exception thrown out of another thread).
+		// Pushing below the top would overwrite its registers, so the loader call goes above them.
+		auto oldTop = t->stackIndex;
+
+		if(t->arIndex > 0 && t->currentAR->func && !t->currentAR->func->isNative &&
+			t->stackIndex < t->currentAR->savedTop)
+			t->stackIndex = t->currentAR->savedTop;
+
+		auto vm = t->vm;
+		auto loader = *vm->lazyGlobals->get(name);
+		push(t, Value::from(name)); // the name might not be referenced anywhere else once it's removed
+		vm->lazyGlobals->remove(vm->mem, name);
+
+		auto funcSlot = push(t, loader) + t->stackBase;
+		push(t, Value::nullValue);
+		commonCall(t, funcSlot, 0, callPrologue(t, funcSlot, 0, 1));
+
+		// Tell the modules library, so that it can add the library's modules to modules.loaded.
+		if(auto hook = vm->registry->get(String::create(vm, atoda(LazyGlobalHook))))
+		{
+			funcSlot = push(t, *hook) + t->stackBase;
+			push(t, Value::nullValue);
+			push(t, Value::from(name));
+			commonCall(t, funcSlot, 0, callPrologue(t, funcSlot, 0, 2));
+		}
+
+		t->stackIndex = oldTop;
+		return true;
+	}
+
+	// The global which a module name's first segment names (so the "doctools" of "doctools.output").
+	String* lazyGlobalNameOf(Thread* t, String* moduleName)
+	{
+		auto name = moduleName->toDArray();
+		uword len = 0;
+
+		while(len < name.length && name[len] != '.')
+			len++;
+
+		return len == name.length ? moduleName : String::create(t->vm, name.slice(0, len));
+	}
+
+	// vm->lazyModules is modules.loaded. Looking up a lazily-loaded library's module in it loads the library, which
+	// puts the module there.
+	bool loadLazyModule(Thread* t, Table* tab, Value key)
+	{
+		if(tab != t->vm->lazyModules || key.type != CrocType_String)
+			return false;
+
+		return loadLazyGlobal(t, t->vm->globals, lazyGlobalNameOf(t, key.mString));
+	}
 }
\ No newline at end of file
@@ -5,9 +5,15 @@
 
 namespace croc
 {
+	extern const char* LazyGlobalHook;
+
 	Value getGlobalImpl(Thread* t, String* name, Namespace* env);
 	void setGlobalImpl(Thread* t, String* name, Namespace* env, Value val);
 	void newGlobalImpl(Thread* t, String* name, Namespace* env, Value val);
+	bool isLazyGlobal(Thread* t, Namespace* ns, String* name);
+	bool loadLazyGlobal(Thread* t, Namespace* ns, String* name);
+	String* lazyGlobalNameOf(Thread* t, String* moduleName);
+	bool loadLazyModule(Thread* t, Table* tab, Value key);
 }
 
 #endif
\ No newline at end of file
@@ -31,7 +31,10 @@ namespace croc
 	void initStringLib_StringBuffer(CrocThread* t);
 	void initTextLib(CrocThread* t);
 	void initThreadLib(CrocThread* t);
+	void initThreadLib_OS(CrocThread* t);
+	void initThreadLib_Scheduler(CrocThread* t);
 	void initTimeLib(CrocThread* t);
+	void initWorkersLib(CrocThread* t);
 
 #ifdef CROC_BUILTIN_DOCS
 	void docExceptionsLib(CrocThread* t);
@@ -40,6 +43,8 @@ namespace croc
 	void docMiscLib_Vector(CrocThread* t, CrocDoc* doc);
 	void docStringLib(CrocThread* t);
 	void docStringLib_StringBuffer(CrocThread* t, CrocDoc* doc);
+	void docThreadLib_OS(CrocThread* t, CrocDoc* doc);
+	void docThreadLib_Scheduler(CrocThread* t, CrocDoc* doc);
 #endif
 }
 
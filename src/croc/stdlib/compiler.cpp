@@ -18,6 +18,7 @@ void _pushFlagsArray(CrocThread* t, uword f)
 	if(f & CrocCompilerFlags_Asserts)         croc_pushString(t, "asserts");
 	if(f & CrocCompilerFlags_Debug)           croc_pushString(t, "debug");
 	if(f & CrocCompilerFlags_Docs)            croc_pushString(t, "docs");
+	if(f & CrocCompilerFlags_Inline)          croc_pushString(t, "inline");
 
 	croc_array_newFromStack(t, croc_getStackSize(t) - start);
 }
@@ -35,6 +36,8 @@ uword _stringToFlag(CrocThread* t, word idx)
 		return CrocCompilerFlags_Debug;
 	if(s == ATODA("docs"))
 		return CrocCompilerFlags_Docs;
+	if(s == ATODA("inline"))
+		return CrocCompilerFlags_Inline;
 	if(s == ATODA("all"))
 		return CrocCompilerFlags_All;
 	if(s == ATODA("alldocs"))
@@ -62,6 +65,9 @@ const StdlibRegisterInfo _setFlags_info =
 			\li \tt{"docs"} will cause the compiler to parse documentation comments and place doc decorators on the
 				program items they document, meaning run-time accessible documentation will be available. If you leave
 				out this flag, doc comments are ignored (unless you use one of the DT compilation functions below).
+			\li \tt{"inline"} enables inlining of calls to small local functions which are never reassigned and whose
+				bodies are a single \tt{return} of a small expression of their parameters. Errors in inlined code are
+				reported on the line of the call. This flag is not included in \tt{"all"} or \tt{"alldocs"}.
 			\li \tt{"all"} is the same as specifying \tt{"typeconstraints"}, \tt{"asserts"}, and \tt{"debug"}.
 			\li \tt{"alldocs"} is the same as specifying \tt{"all"} and \tt{"docs"}.
 		\endlist
@@ -322,6 +328,46 @@ word_t _compileStmtsDT(CrocThread* t)
 	return _compileStmtsImpl(t, true);
 }
 
+const StdlibRegisterInfo _compileModuleImports_info =
+{
+	Docstr(DFunc("compileModuleImports") DParam("source", "string")
+		DParamD("filename", "string", "\"<compiled from string>\"")
+	R"(Works just like \link{compileModule} but additionally finds the module's static imports: the modules imported by
+	\tt{import} statements whose module names are constant strings. Imports whose names are only known at runtime (and
+	calls to \link{modules.load}) aren't included.
+
+	The parameters are the same as \link{compileModule}.
+
+	\returns different things depending on whether or not compilation was successful.
+
+	If compilation was successful, it returns three values: the first two are the same as \link{compileModule}, and the
+	third is an array of the names of the imported modules, in the order they first appear in the source.
+
+	If compilation failed, it returns the exact same things as \link{compileModule}.)"),
+
+	"compileModuleImports", 2
+};
+
+word_t _compileModuleImports(CrocThread* t)
+{
+	croc_ex_checkStringParam(t, 1);
+	auto name = croc_ex_optStringParam(t, 2, "<compiled from string>");
+
+	croc_dup(t, 1);
+	const char* modName;
+	auto result = croc_compiler_compileModuleImports(t, name, &modName);
+
+	if(result >= 0)
+	{
+		croc_pushString(t, modName);
+		croc_moveToTop(t, -3);
+		return 3;
+	}
+
+	_pushResultToString(t, result);
+	return 2;
+}
+
 const StdlibRegisterInfo _compileModuleEx_info =
 {
 	Docstr(DFunc("compileModuleEx") DParam("source", "string")
@@ -522,6 +568,7 @@ const StdlibRegister _globalFuncs[] =
 	_DListItem(_compileExpr),
 	_DListItem(_compileModuleDT),
 	_DListItem(_compileStmtsDT),
+	_DListItem(_compileModuleImports),
 	_DListItem(_compileModuleEx),
 	_DListItem(_compileStmtsEx),
 	_DListItem(_compileExprEx),
@@ -309,6 +309,75 @@ word_t _getHook(CrocThread* t)
 	return 3;
 }
 
+const StdlibRegisterInfo _setBudget_info =
+{
+	Docstr(DFunc("setBudget") DParam("budget", "int") DParamD("action", "string", "\"throw\"")
+	R"(\b{Takes an optional thread as its first parameter.} Sets or removes the given thread's budget.
+
+	The budget is counted down at every loop backedge and script function call the thread makes, so a thread stuck in a
+	loop or infinite recursion always runs out eventually. No hook function is involved, and counting it is cheap.
+
+	Threads created by the given thread after this is set start out with the same budget.
+
+	\param[budget] is how many backedges and calls the thread may make before something happens, or 0 to remove the
+		budget.
+	\param[action] says what happens when the budget runs out:
+
+		\dlist
+			\li{\tt{"throw"}} throws a \link{TimeoutError} on the thread, and refills its budget. \tt{catch} and
+				\tt{finally} blocks run on the refilled budget, so catching the error doesn't let the thread run
+				forever.
+			\li{\tt{"yield"}} makes the thread yield with no values, and refills its budget. Whatever resumed the
+				thread sees this as an ordinary \tt{yield()}, so tasks run by \link{thread.run} given this kind of
+				budget are preemptively time-sliced. If the thread can't yield where its budget runs out (it's the main
+				thread, or there's a native call in the way), it yields as soon as it can.
+		\endlist
+
+	\throws[RangeError] if \tt{budget} is negative.
+	\throws[ValueError] if \tt{action} is invalid.)"),
+
+	"setBudget", 3
+};
+
+word_t _setBudget(CrocThread* t)
+{
+	word arg;
+	auto thread = getThreadParam(t, arg);
+	auto budget = croc_ex_checkIntParam(t, arg + 1);
+	auto action = croc_ex_optParam(t, arg + 2, CrocType_String) ? getCrocstr(t, arg + 2) : ATODA("throw");
+
+	if(budget < 0 || cast(uword)budget > std::numeric_limits<uword>::max())
+		croc_eh_throwStd(t, "RangeError", "invalid budget (%" CROC_INTEGER_FORMAT ")", budget);
+
+	auto a = CrocBudgetAction_Throw;
+
+	if(action == ATODA("yield"))
+		a = CrocBudgetAction_Yield;
+	else if(action != ATODA("throw"))
+		croc_eh_throwStd(t, "ValueError", "invalid budget action '%.*s'", cast(int)action.length, action.ptr);
+
+	croc_thread_setBudget(thread, cast(uword)budget, a);
+	return 0;
+}
+
+const StdlibRegisterInfo _getBudget_info =
+{
+	Docstr(DFunc("getBudget")
+	R"(\b{Takes an optional thread as its first parameter.}
+
+	\returns how much of the given thread's budget is left (see \link{setBudget}), or 0 if it has none.)"),
+
+	"getBudget", 1
+};
+
+word_t _getBudget(CrocThread* t)
+{
+	word arg;
+	auto thread = getThreadParam(t, arg);
+	croc_pushInt(t, cast(crocint)croc_thread_getBudget(thread));
+	return 1;
+}
+
 const StdlibRegisterInfo _callDepth_info =
 {
 	Docstr(DFunc("callDepth")
@@ -1079,6 +1148,8 @@ const StdlibRegister _globalFuncs[] =
 {
 	_DListItem(_setHook),
 	_DListItem(_getHook),
+	_DListItem(_setBudget),
+	_DListItem(_getBudget),
 	_DListItem(_callDepth),
 	_DListItem(_sourceName),
 	_DListItem(_sourceLine),
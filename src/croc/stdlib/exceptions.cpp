@@ -94,6 +94,9 @@ struct ExDesc
 	{"SwitchError", Docstr(DClass("SwitchError") DBase("Throwable")
 		R"(Thrown when a switch without a 'default' is given a value not listed in its cases.)")
 	},
+	{"TimeoutError", Docstr(DClass("TimeoutError") DBase("Throwable")
+		R"(Thrown when a thread runs out of the budget its host gave it (or that was set with \link{debug.setBudget}).)")
+	},
 	{"TypeError", Docstr(DClass("TypeError") DBase("Throwable")
 		R"(Thrown when an incorrect type is given to an operation (i.e. trying to add strings, or when invalid types are
 		given to function parameters).)")
@@ -359,7 +362,11 @@ const char* _Throwable_docs =
 	exception classes by just deriving from this class.
 
 	This class is also exported into the global namespace, so you can access it without having to import it from this
-	module.)";
+	module.
+
+	Throwing an exception only records the raw call stack; the \tt{location} and \tt{traceback} fields are built from
+	it the first time they're read. This makes throwing and catching exceptions cheap when nobody looks at where they
+	came from.)";
 
 const char* _Throwable_fieldDocs[] =
 {
@@ -568,14 +575,11 @@ const StdlibRegister _Throwable_methods[] =
 void initThrowableClass(CrocThread* t, Thread* t_)
 {
 	croc_class_new(t, "Throwable", 0);
-		croc_pushGlobal(t, "Location");
-		croc_pushNull(t);
-		croc_call(t, -2, 1);
-		croc_class_addField(t, -2, "location");
-
+		croc_pushNull(t);       croc_class_addField(t, -2, "location");
 		croc_pushString(t, ""); croc_class_addField(t, -2, "msg");
 		croc_pushNull(t);       croc_class_addField(t, -2, "cause");
-		croc_array_new(t, 0);   croc_class_addField(t, -2, "traceback");
+		croc_pushNull(t);       croc_class_addField(t, -2, "traceback");
+		croc_pushNull(t);       croc_class_addHField(t, -2, "rawTraceback");
 
 		registerMethods(t, _Throwable_methods);
 
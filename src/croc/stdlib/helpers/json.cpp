@@ -397,7 +397,16 @@ namespace croc
 					croc_eh_throwStd(t, "LexicalException", "(%u:%u): Invalid character in string token", mLine, mCol);
 				else
 				{
-					croc_ex_buffer_addChar(&buf, mCharacter);
+					// Add the whole run of ordinary characters at once rather than one at a time.
+					auto runEnd = mCharPos;
+
+					while(runEnd < mSourceEnd && *runEnd != '\"' && *runEnd != '\\' && *runEnd >= 0x20)
+						runEnd++;
+
+					auto run = custring::n(mCharPos, runEnd - mCharPos);
+					croc_ex_buffer_addStringn(&buf, cast(const char*)run.ptr, run.length);
+					mCol += fastUtf8CPLength(run) - 1;
+					mSourcePtr = runEnd;
 					nextChar();
 				}
 			}
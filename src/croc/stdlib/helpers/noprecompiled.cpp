@@ -0,0 +1,13 @@
+
+#include "croc/stdlib/helpers/register.hpp"
+
+// Used in place of the generated precompiled.cpp by the precompiler itself (which has to compile the modules from
+// source), and when the build isn't precompiling the stdlib.
+
+namespace croc
+{
+	const PrecompiledModule PrecompiledModules[] =
+	{
+		{nullptr, nullptr, 0}
+	};
+}
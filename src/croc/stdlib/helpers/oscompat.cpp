@@ -8,7 +8,9 @@
 
 #ifndef _WIN32
 #include <dirent.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 
@@ -296,7 +298,13 @@ namespace croc
 		DWORD bytesRead;
 
 	_retry:
-		if(!ReadFile(f, cast(LPVOID)data.ptr, cast(DWORD)data.length, &bytesRead, nullptr))
+		croc_vm_releaseLock(t);
+		auto ok = ReadFile(f, cast(LPVOID)data.ptr, cast(DWORD)data.length, &bytesRead, nullptr);
+		auto err = GetLastError();
+		croc_vm_acquireLock(t);
+		SetLastError(err);
+
+		if(!ok)
 		{
 			if(GetLastError() == ERROR_BROKEN_PIPE)
 			{
@@ -320,8 +328,13 @@ namespace croc
 	int64_t write(CrocThread* t, FileHandle f, DArray<uint8_t> data)
 	{
 		DWORD bytesWritten;
+		croc_vm_releaseLock(t);
+		auto ok = WriteFile(f, cast(LPVOID)data.ptr, cast(DWORD)data.length, &bytesWritten, nullptr);
+		auto err = GetLastError();
+		croc_vm_acquireLock(t);
+		SetLastError(err);
 
-		if(!WriteFile(f, cast(LPVOID)data.ptr, cast(DWORD)data.length, &bytesWritten, nullptr))
+		if(!ok)
 		{
 			pushSystemErrorMsg(t);
 			return -1;
@@ -831,6 +844,40 @@ namespace croc
 		Sleep(msec);
 	}
 
+	namespace
+	{
+		struct ThreadStart
+		{
+			ThreadFunc func;
+			void* arg;
+		};
+
+		DWORD WINAPI threadMain(LPVOID p)
+		{
+			auto start = *cast(ThreadStart*)p;
+			::free(p);
+			start.func(start.arg);
+			return 0;
+		}
+	}
+
+	bool startThread(CrocThread* t, ThreadFunc func, void* arg)
+	{
+		auto start = cast(ThreadStart*)malloc(sizeof(ThreadStart));
+		start->func = func;
+		start->arg = arg;
+
+		if(auto h = CreateThread(nullptr, 0, &threadMain, start, 0, nullptr))
+		{
+			CloseHandle(h);
+			return true;
+		}
+
+		::free(start);
+		pushSystemErrorMsg(t);
+		return false;
+	}
+
 	// =================================================================================================================
 	// Processes
 
@@ -851,7 +898,11 @@ namespace croc
 
 	int closeProcess(CrocThread* t, ProcessHandle p)
 	{
+		croc_vm_releaseLock(t);
 		auto ret = _pclose(p);
+		auto err = errno;
+		croc_vm_acquireLock(t);
+		errno = err;
 
 		if(ret != -1)
 			return ret;
@@ -990,20 +1041,32 @@ namespace croc
 
 	int64_t read(CrocThread* t, FileHandle f, DArray<uint8_t> data)
 	{
+		croc_vm_releaseLock(t);
 		auto bytesRead = ::read(f, data.ptr, data.length);
+		auto err = errno;
+		croc_vm_acquireLock(t);
 
 		if(bytesRead == -1)
+		{
+			errno = err;
 			pushSystemErrorMsg(t);
+		}
 
 		return bytesRead;
 	}
 
 	int64_t write(CrocThread* t, FileHandle f, DArray<uint8_t> data)
 	{
+		croc_vm_releaseLock(t);
 		auto bytesWritten = ::write(f, data.ptr, data.length);
+		auto err = errno;
+		croc_vm_acquireLock(t);
 
 		if(bytesWritten == -1)
+		{
+			errno = err;
 			pushSystemErrorMsg(t);
+		}
 
 		return bytesWritten;
 	}
@@ -1490,6 +1553,43 @@ namespace croc
 		}
 	}
 
+	namespace
+	{
+		struct ThreadStart
+		{
+			ThreadFunc func;
+			void* arg;
+		};
+
+		void* threadMain(void* p)
+		{
+			auto start = *cast(ThreadStart*)p;
+			::free(p);
+			start.func(start.arg);
+			return nullptr;
+		}
+	}
+
+	bool startThread(CrocThread* t, ThreadFunc func, void* arg)
+	{
+		auto start = cast(ThreadStart*)malloc(sizeof(ThreadStart));
+		start->func = func;
+		start->arg = arg;
+
+		pthread_t thread;
+		auto err = pthread_create(&thread, nullptr, &threadMain, start);
+
+		if(err == 0)
+		{
+			pthread_detach(thread);
+			return true;
+		}
+
+		::free(start);
+		croc_pushString(t, strerror(err));
+		return false;
+	}
+
 	// =================================================================================================================
 	// Processes
 
@@ -1512,7 +1612,11 @@ namespace croc
 
 	int closeProcess(CrocThread* t, ProcessHandle p)
 	{
+		croc_vm_releaseLock(t);
 		auto ret = pclose(p);
+		auto err = errno;
+		croc_vm_acquireLock(t);
+		errno = err;
 
 		if(ret != -1)
 			return ret;
@@ -108,9 +108,13 @@ namespace croc
 	};
 
 	typedef FILE* ProcessHandle;
+	typedef void (*ThreadFunc)(void* arg);
 
 	// Most of these functions have some kind of "invalid" return value. If that's returned, then the error message will
 	// be sitting on top of the thread's stack.
+	//
+	// read, write and closeProcess release the VM lock (see croc_vm_releaseLock) while they block, so any memory passed
+	// to them must be something no other thread can free or resize in the meantime.
 
 	// Error handling
 	void pushSystemErrorMsg(CrocThread* t);
@@ -160,6 +164,7 @@ namespace croc
 
 	// Threading
 	void sleep(uword msec);
+	bool startThread(CrocThread* t, ThreadFunc func, void* arg); // func runs on a new detached OS thread
 
 	// Processes
 	ProcessHandle openProcess(CrocThread* t, crocstr cmd, FileAccess access);
@@ -31,6 +31,19 @@ namespace croc
 				}
 			});
 		}
+
+		// Pushes the module's precompiled funcdef and returns true, or returns false if it wasn't precompiled or was
+		// precompiled by a build with a different serialization format, in which case the source has to be compiled.
+		bool loadPrecompiledModule(CrocThread* t, const char* name, const char* sourceName)
+		{
+			for(auto m = PrecompiledModules; m->sourceName != nullptr; m++)
+			{
+				if(strcmp(m->sourceName, sourceName) == 0)
+					return loadSerializedModule(t, DArray<const uint8_t>::n(m->data, m->length), name);
+			}
+
+			return false;
+		}
 	}
 
 	void registerModule(CrocThread* t, const char* name, CrocNativeFunc loader)
@@ -46,13 +59,19 @@ namespace croc
 	{
 		makeModuleNamespace(t, name);
 
-		croc_pushString(t, source);
-		const char* modName;
-		croc_compiler_compileModuleEx(t, sourceName, &modName);
+		if(!loadPrecompiledModule(t, name, sourceName))
+		{
+			croc_pushString(t, source);
+			const char* modName;
+			croc_compiler_compileModuleEx(t, sourceName, &modName);
+
+			if(strcmp(name, modName) != 0)
+				croc_eh_throwStd(t, "ImportException",
+					"Import name (%s) does not match name given in module statement (%s)", name, modName);
+		}
 
-		if(strcmp(name, modName) != 0)
-			croc_eh_throwStd(t, "ImportException",
-				"Import name (%s) does not match name given in module statement (%s)", name, modName);
+		// Every VM has the same code for these.
+		croc_funcdef_shareCode(t, -1);
 
 		croc_swapTop(t);
 		croc_dupTop(t);
@@ -46,6 +46,23 @@ namespace croc
 		CrocNativeFunc func;
 	};
 
+	// The stdlib modules which the build compiled ahead of time (see croc/ext/precompile.cpp), in the format written by
+	// serialization.serializeModule. The array ends with an entry whose sourceName is null. It's defined in the generated
+	// precompiled.cpp, or in helpers/noprecompiled.cpp when there are none.
+	struct PrecompiledModule
+	{
+		const char* sourceName;
+		const uint8_t* data;
+		uword length;
+	};
+
+	extern const PrecompiledModule PrecompiledModules[];
+
+	// Defined in serialization.cpp. Deserializes a module written by serialization.serializeModule, checks that it's
+	// called name, and pushes its top-level funcdef. If the data was written by a Croc build with a different data format,
+	// returns false and pushes nothing.
+	bool loadSerializedModule(CrocThread* t, DArray<const uint8_t> data, const char* name);
+
 	void registerModule(CrocThread* t, const char* name, CrocNativeFunc loader);
 	void registerModuleFromString(CrocThread* t, const char* name, const char* source, const char* sourceName);
 	void registerGlobals(CrocThread* t, const StdlibRegister* funcs);
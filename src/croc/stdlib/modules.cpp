@@ -1,6 +1,7 @@
 
 #include "croc/api.h"
 #include "croc/internal/stack.hpp"
+#include "croc/internal/variables.hpp"
 #include "croc/stdlib/helpers/oscompat.hpp"
 #include "croc/stdlib/helpers/register.hpp"
 #include "croc/types/base.hpp"
@@ -10,10 +11,19 @@ namespace croc
 namespace
 {
 #include "croc/stdlib/modules.croc.hpp"
+
+// The global which a module name's first segment names (so the "doctools" of "doctools.output").
+String* globalNameOf(Thread* t, word slot)
+{
+	croc_ex_checkParam(*t, slot, CrocType_String);
+	return lazyGlobalNameOf(t, getStringObj(t, slot));
+}
 }
 
 void initModulesLib(CrocThread* t)
 {
+	oscompat::initTime(); // for _putFileContents
+
 	croc_table_new(t, 1);
 		croc_function_new(t, "_setfenv", 2, [](CrocThread* t) -> word_t
 		{
@@ -91,6 +101,135 @@ void initModulesLib(CrocThread* t)
 			return 1;
 		}, 0);
 		croc_fielda(t, -2, "_getFileContents");
+
+		// 64-bit FNV-1a, used to key the compiled module cache.
+		croc_function_new(t, "_hash", 1, [](CrocThread* t) -> word_t
+		{
+			crocstr data;
+
+			if(croc_isString(t, 1))
+				data = getCrocstr(t, 1);
+			else
+			{
+				croc_ex_checkParam(t, 1, CrocType_Memblock);
+				auto mb = croc_memblock_getData(t, 1);
+				data = crocstr::n(cast(const unsigned char*)mb, croc_len(t, 1));
+			}
+
+			uint64_t hash = 14695981039346656037ULL;
+
+			for(auto b: data)
+			{
+				hash ^= b;
+				hash *= 1099511628211ULL;
+			}
+
+			croc_pushInt(t, cast(crocint_t)hash);
+			return 1;
+		}, 0);
+		croc_fielda(t, -2, "_hash");
+
+		// Writes the memblock to a temporary file next to the given name and then renames it over the name, so that
+		// nothing ever sees a partially-written file. Returns whether it worked.
+		croc_function_new(t, "_putFileContents", 2, [](CrocThread* t) -> word_t
+		{
+			croc_ex_checkParam(t, 1, CrocType_String);
+			croc_ex_checkParam(t, 2, CrocType_Memblock);
+			auto name = getCrocstr(t, 1);
+			auto data = DArray<uint8_t>::n(cast(uint8_t*)croc_memblock_getData(t, 2), croc_len(t, 2));
+
+			croc_pushFormat(t, "%.*s.%" CROC_HEX64_FORMAT ".tmp", cast(int)name.length, name.ptr,
+				cast(uint64_t)(oscompat::microTime() ^ cast(uintptr_t)&data));
+			auto tmpName = getCrocstr(t, -1);
+			auto f = oscompat::openFile(t, tmpName, oscompat::FileAccess::Write, oscompat::FileCreate::MustNotExist);
+
+			if(f == oscompat::InvalidHandle)
+			{
+				croc_pushBool(t, false);
+				return 1;
+			}
+
+			bool ok = true;
+
+			while(ok && data.length > 0)
+			{
+				auto bytesWritten = oscompat::write(t, f, data);
+
+				if(bytesWritten <= 0)
+					ok = false;
+				else
+					data = data.slice(cast(uword)bytesWritten, data.length);
+			}
+
+			ok = oscompat::close(t, f) && ok;
+			ok = ok && oscompat::moveFromTo(t, tmpName, name, true);
+
+			if(!ok)
+				oscompat::remove(t, tmpName);
+
+			croc_pushBool(t, ok);
+			return 1;
+		}, 0);
+		croc_fielda(t, -2, "_putFileContents");
+
+		// Whether the module's global is a lazily-loaded standard library which hasn't been loaded yet.
+		croc_function_new(t, "_isLazy", 1, [](CrocThread* t) -> word_t
+		{
+			auto t_ = Thread::from(t);
+			croc_pushBool(t, isLazyGlobal(t_, t_->vm->globals, globalNameOf(t_, 1)));
+			return 1;
+		}, 0);
+		croc_fielda(t, -2, "_isLazy");
+
+		// Loads all the lazily-loaded standard libraries which haven't been loaded yet.
+		croc_function_new(t, "_loadLazy", 0, [](CrocThread* t) -> word_t
+		{
+			auto t_ = Thread::from(t);
+			auto vm = t_->vm;
+			uword idx = 0;
+			String** name;
+			Value* loader;
+
+			while(vm->lazyGlobals->next(idx, name, loader))
+			{
+				loadLazyGlobal(t_, vm->globals, *name);
+				idx = 0;
+			}
+
+			return 0;
+		}, 0);
+		croc_fielda(t, -2, "_loadLazy");
+
+		// Sets the function which is called with a global's name after it's lazily loaded, and the table of loaded
+		// modules, lookups in which load lazily-loaded libraries.
+		croc_function_new(t, "_setLazyHook", 2, [](CrocThread* t) -> word_t
+		{
+			croc_ex_checkParam(t, 1, CrocType_Function);
+			croc_ex_checkParam(t, 2, CrocType_Table);
+			Thread::from(t)->vm->lazyModules = getTable(Thread::from(t), 2);
+			croc_dup(t, 1);
+			croc_ex_setRegistryVar(t, LazyGlobalHook);
+			return 0;
+		}, 0);
+		croc_fielda(t, -2, "_setLazyHook");
+
+		// Sets the namespace of functions which modules.prefetch's workers call (see workers.cpp's _runJob).
+		croc_function_new(t, "_setWorkerJobs", 1, [](CrocThread* t) -> word_t
+		{
+			croc_ex_checkParam(t, 1, CrocType_Namespace);
+			croc_dup(t, 1);
+			croc_ex_setRegistryVar(t, "modules.workerJobs");
+			return 0;
+		}, 0);
+		croc_fielda(t, -2, "_setWorkerJobs");
+
+		croc_function_new(t, "_shareCode", 1, [](CrocThread* t) -> word_t
+		{
+			croc_ex_checkParam(t, 1, CrocType_Funcdef);
+			croc_funcdef_shareCode(t, 1);
+			return 0;
+		}, 0);
+		croc_fielda(t, -2, "_shareCode");
 	croc_newGlobal(t, "_modulestmp");
 
 	registerModuleFromString(t, "modules", modules_croc_text, "modules.croc");
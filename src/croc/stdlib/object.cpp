@@ -1,5 +1,6 @@
 
 #include "croc/api.h"
+#include "croc/internal/eh.hpp"
 #include "croc/internal/stack.hpp"
 #include "croc/stdlib/helpers/register.hpp"
 #include "croc/types/base.hpp"
@@ -73,7 +74,17 @@ word_t _instanceFieldsOfIter(CrocThread* t)
 		croc_setUpval(t, 1);
 
 		push(Thread::from(t), Value::from(*key));
-		push(Thread::from(t), *value);
+
+		// Exceptions' location and traceback are built the first time they're read.
+		if(value->type == CrocType_Null && isExField(Thread::from(t), c, *key))
+		{
+			croc_pushUpval(t, 0);
+			pushExField(Thread::from(t), croc_getStackSize(t) - 1, *key);
+			croc_insertAndPop(t, -2);
+		}
+		else
+			push(Thread::from(t), *value);
+
 		return 2;
 	}
 
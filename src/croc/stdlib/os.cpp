@@ -54,7 +54,8 @@ word_t _shellCmd(CrocThread* t)
 const StdlibRegisterInfo _sleep_info =
 {
 	Docstr(DFunc("sleep") DParam("duration", "float")
-	R"(Pauses execution of the current system thread for at least \tt{duration} seconds.)"),
+	R"(Pauses execution of the current system thread for at least \tt{duration} seconds. Other OS threads can use the VM
+	in the meantime (see \link{thread.spawnOS}).)"),
 
 	"sleep", 1
 };
@@ -67,7 +68,12 @@ word_t _sleep(CrocThread* t)
 		croc_eh_throwStd(t, "RangeError", "Invalid sleep duration: %g", dur);
 
 	if(dur > 0)
+	{
+		croc_vm_releaseLock(t);
 		oscompat::sleep(cast(uword)(dur * 1000));
+		croc_vm_acquireLock(t);
+	}
+
 	return 0;
 }
 
@@ -185,7 +191,8 @@ const StdlibRegisterInfo _Process_wait_info =
 	Docstr(DFunc("wait")
 	R"(Waits for the subprocess to complete (if it hasn't yet already) and returns its exit code as an integer.
 
-	This will block as long as necessary.)"),
+	This will block the OS thread as long as necessary, but other OS threads can use the VM in the meantime (see
+	\link{thread.spawnOS}).)"),
 
 	"wait", 0
 };
@@ -198,11 +205,12 @@ word_t _Process_wait(CrocThread* t)
 		croc_eh_throwStd(t, "StateError", "Waiting on a dead process");
 
 	auto proc = cast(oscompat::ProcessHandle)croc_getNativeobj(t, -1);
-	auto ret = oscompat::closeProcess(t, proc);
 
+	// Cleared before waiting, since this releases the VM lock and another OS thread might try to wait on it too.
 	croc_pushNull(t);
 	croc_hfielda(t, 0, "proc");
-	croc_pushInt(t, ret);
+
+	croc_pushInt(t, oscompat::closeProcess(t, proc));
 	return 1;
 }
 
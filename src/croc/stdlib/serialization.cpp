@@ -3,6 +3,7 @@
 #include <type_traits>
 
 #include "croc/api.h"
+#include "croc/internal/basic.hpp"
 #include "croc/internal/eh.hpp"
 #include "croc/internal/stack.hpp"
 #include "croc/stdlib/helpers/register.hpp"
@@ -14,245 +15,704 @@ namespace
 {
 #include "croc/stdlib/serialization.croc.hpp"
 
+// This gets bumped any time the serialization format changes.
+const crocint SerialVersion = 2;
+
+// Type tags are the CrocType values, plus these two.
+const uint8_t TransientTag = 254;
+const uint8_t BackrefTag = 255;
+
+// Data is written to and read from the streams this much at a time.
+const uword ChunkSize = 64 * 1024;
+
+uint8_t endianness()
+{
+	union
+	{
+		uint32_t i;
+		char c[4];
+	} test = {0x01020304};
+
+	return test.c[0] == 4 ? 0 : 1; // 1 for big-endian, 0 for little
+}
+
 namespace Ser
 {
 const char* _Output = "_output";
-const char* _RawBuf = "_rawBuf";
+const char* _Trans = "_trans";
+const char* _State = "_state";
+const char* _SerializeFunc = "_serializeFunc";
 
-template<typename T>
-void _integer(CrocThread* t, T v)
+// Tables, namespaces, arrays and instances keep track of how far through their contents they are with one of these,
+// rather than with recursion, so that deeply nested data can't overflow the native stack.
+struct Frame
 {
-	croc_dup(t, 0);
-	croc_pushNull(t);
-	croc_pushInt(t, cast(crocint)v);
-	croc_methodCall(t, -3, "_integer", 0);
+	GCObject* obj;
+	uword idx;
+	uword step;
+	Value pending; // the value half of a key-value pair, written after the key
+	bool hasPending;
+};
+
+// Lives on writeGraph's native stack, with a pointer to it in the serializer's _state field so that the callback given
+// to opSerialize methods can get at it.
+struct State
+{
+	Memory* mem;
+	DArray<uint8_t> buf;
+	uword used;
+	Hash<GCObject*, uword> objTable;
+	uword objIndex;
+	DArray<Frame> frames;
+	uword numFrames;
+	Value output;
+	Value trans;
+	Value serializeFunc;
+	Value writeExact;
+	Value view; // a memblock which is pointed at whatever's being written to the output
+};
+
+State& getState(CrocThread* t)
+{
+	croc_field(t, 0, _State);
+
+	if(!croc_isNativeobj(t, -1))
+		croc_eh_throwStd(t, "StateError", "Attempting to serialize a value outside of writeGraph");
+
+	auto ret = cast(State*)croc_getNativeobj(t, -1);
+	croc_popTop(t);
+	return *ret;
 }
 
-template<typename T>
-void _pushit(CrocThread* t, T v)
+void writeRaw(CrocThread* t, State& s, const uint8_t* ptr, uword len)
 {
-	push(Thread::from(t), Value::from(v));
+	auto t_ = Thread::from(t);
+	push(t_, s.writeExact);
+	push(t_, s.output);
+	push(t_, s.view);
+	croc_memblock_reviewNativeArray(t, -1, cast(void*)ptr, len);
+	croc_call(t, -3, 0);
 }
 
-template<>
-void _pushit<Value>(CrocThread* t, Value v)
+void flush(CrocThread* t, State& s)
 {
-	push(Thread::from(t), v);
+	if(s.used > 0)
+	{
+		writeRaw(t, s, s.buf.ptr, s.used);
+		s.used = 0;
+	}
 }
 
-template<typename T>
-void _serialize(CrocThread* t, T v)
+// Gets room for n (at most ChunkSize) bytes in the buffer, flushing it first if needed.
+inline uint8_t* reserve(CrocThread* t, State& s, uword n)
 {
-	croc_dup(t, 0);
-	croc_pushNull(t);
-	_pushit(t, v);
-	croc_methodCall(t, -3, "_serialize", 0);
+	if(s.used + n > s.buf.length)
+		flush(t, s);
+
+	auto ret = s.buf.ptr + s.used;
+	s.used += n;
+	return ret;
 }
 
-void _writeUInt8(CrocThread* t, uint8_t b)
+inline void _writeUInt8(CrocThread* t, State& s, uint8_t b)
 {
-	croc_dup(t, 0);
-	croc_pushNull(t);
-	croc_pushInt(t, b);
-	croc_methodCall(t, -3, "_uint8", 0);
+	*reserve(t, s, 1) = b;
 }
 
-template<typename T>
-void _serializeArray(CrocThread* t, DArray<T> arr)
+void _integer(CrocThread* t, State& s, crocint v)
 {
-	_integer(t, arr.length);
+	uint8_t bytes[(sizeof(crocint) * 8 + 6) / 7];
+	uword n = 0;
+	bool more;
 
-	for(auto &val: arr)
-		_serialize(t, val);
+	do
+	{
+		uint8_t b = v & 0x7F;
+		v >>= 7;
+		more = !((v == 0 && (b & 0x40) == 0) || (v == -1 && (b & 0x40) != 0));
+
+		if(more)
+			b |= 0x80;
+
+		bytes[n++] = b;
+	} while(more);
+
+	memcpy(reserve(t, s, n), bytes, n);
+}
+
+void _append(CrocThread* t, State& s, DArray<uint8_t> arr)
+{
+	if(arr.length < ChunkSize)
+		memcpy(reserve(t, s, arr.length), arr.ptr, arr.length);
+	else
+	{
+		flush(t, s);
+		writeRaw(t, s, arr.ptr, arr.length);
+	}
+}
+
+// Writes a backreference and returns true if v has been written already. Otherwise gives it the next index.
+bool alreadyWritten(CrocThread* t, State& s, GCObject* v)
+{
+	if(auto idx = s.objTable.lookup(v))
+	{
+		_writeUInt8(t, s, BackrefTag);
+		_integer(t, s, cast(crocint)*idx);
+		return true;
+	}
+
+	*s.objTable.insert(*s.mem, v) = s.objIndex++;
+	return false;
+}
+
+// Returns true and sets ret if the transients table has a replacement for v.
+bool getTransient(CrocThread* t, State& s, Value v, Value& ret)
+{
+	if(s.trans.type == CrocType_Table)
+	{
+		auto tab = s.trans.mTable;
+
+		if(tab->length() == 0)
+			return false;
+
+		auto r = tab->get(v);
+
+		if(r == nullptr || r->isFalse())
+			return false;
+
+		ret = *r;
+		return true;
+	}
+
+	auto t_ = Thread::from(t);
+	push(t_, s.trans);
+	push(t_, v);
+	croc_idx(t, -2);
+	ret = *getValue(t_, -1);
+	croc_pop(t, 2);
+	return !ret.isFalse();
+}
+
+void pushFrame(State& s, GCObject* obj)
+{
+	if(s.numFrames == s.frames.length)
+		s.frames.resize(*s.mem, s.frames.length == 0 ? 16 : s.frames.length * 2);
+
+	auto &f = s.frames[s.numFrames++];
+	f.obj = obj;
+	f.idx = 0;
+	f.step = 0;
+	f.hasPending = false;
+}
+
+void serialize(CrocThread* t, State& s, Value v);
+
+template<typename T>
+void _serialize(CrocThread* t, State& s, T v)
+{
+	serialize(t, s, Value::from(v));
 }
 
 template<>
-void _serializeArray<uword>(CrocThread* t, DArray<uword> arr)
+void _serialize<Value>(CrocThread* t, State& s, Value v)
+{
+	serialize(t, s, v);
+}
+
+template<typename T>
+void _serializeArray(CrocThread* t, State& s, DArray<T> arr)
 {
-	_integer(t, arr.length);
+	_integer(t, s, arr.length);
 
 	for(auto &val: arr)
-		_integer(t, val);
+		_serialize(t, s, val);
 }
 
-void _append(CrocThread* t, DArray<uint8_t> arr)
+template<>
+void _serializeArray<uword>(CrocThread* t, State& s, DArray<uword> arr)
 {
-	croc_ex_lookup(t, "stream.Stream.writeExact");
-	croc_field(t, 0, _Output);
-	croc_field(t, 0, _RawBuf);
-	croc_memblock_reviewNativeArray(t, -1, cast(void*)arr.ptr, arr.length);
-	croc_call(t, -3, 0);
+	_integer(t, s, arr.length);
+
+	for(auto &val: arr)
+		_integer(t, s, val);
 }
 
-word_t _nativeSerializeFunction(CrocThread* t)
+void serializeFunction(CrocThread* t, State& s, Function* v)
 {
 	auto t_ = Thread::from(t);
-	auto v = getFunction(t_, 1);
 
 	// we do this first so we can allocate it at the beginning of deserialization
-	_integer(t, v->numUpvals);
-	_serialize(t, v->scriptFunc);
+	_integer(t, s, v->numUpvals);
+	_serialize(t, s, v->scriptFunc);
 
 	if(v->environment == t_->vm->globals)
-		_writeUInt8(t, 0);
+		_writeUInt8(t, s, 0);
 	else
 	{
-		_writeUInt8(t, 1);
-		_serialize(t, v->environment);
+		_writeUInt8(t, s, 1);
+		_serialize(t, s, v->environment);
 	}
 
 	for(auto upval: v->scriptUpvals())
-		_serialize(t, cast(GCObject*)upval);
-
-	return 0;
+		_serialize(t, s, cast(GCObject*)upval);
 }
 
-word_t _nativeSerializeFuncdef(CrocThread* t)
+void serializeFuncdef(CrocThread* t, State& s, Funcdef* v)
 {
-	auto t_ = Thread::from(t);
-	auto v = getFuncdef(t_, 1);
-
-	_serialize(t, v->locFile);
-	_integer(t, v->locLine);
-	_integer(t, v->locCol);
-	_writeUInt8(t, cast(uint8_t)v->isVararg);
-	_writeUInt8(t, cast(uint8_t)v->isVarret);
-	_serialize(t, v->name);
-	_integer(t, v->numParams);
-	_serializeArray(t, v->paramMasks);
-	_integer(t, v->numReturns);
-	_serializeArray(t, v->returnMasks);
-
-	_integer(t, v->upvals.length);
+	_serialize(t, s, v->locFile);
+	_integer(t, s, v->locLine);
+	_integer(t, s, v->locCol);
+	_writeUInt8(t, s, cast(uint8_t)v->isVararg);
+	_writeUInt8(t, s, cast(uint8_t)v->isVarret);
+	_serialize(t, s, v->name);
+	_integer(t, s, v->numParams);
+	_serializeArray(t, s, v->paramMasks);
+	_integer(t, s, v->numReturns);
+	_serializeArray(t, s, v->returnMasks);
+
+	_integer(t, s, v->upvals.length);
 
 	for(auto &uv: v->upvals)
 	{
-		_writeUInt8(t, cast(uint8_t)uv.isUpval);
-		_integer(t, uv.index);
+		_writeUInt8(t, s, cast(uint8_t)uv.isUpval);
+		_integer(t, s, uv.index);
 	}
 
-	_integer(t, v->stackSize);
-	_serializeArray(t, v->innerFuncs);
-	_serializeArray(t, v->constants);
-	_integer(t, v->code.length);
-	_append(t, v->code.template as<uint8_t>());
+	_integer(t, s, v->stackSize);
+	_serializeArray(t, s, v->innerFuncs);
+	_serializeArray(t, s, v->constants);
+	_integer(t, s, v->code.length);
+	_append(t, s, v->code.template as<uint8_t>());
 
 	if(auto e = v->environment)
 	{
-		_writeUInt8(t, 1);
-		_serialize(t, e);
+		_writeUInt8(t, s, 1);
+		_serialize(t, s, e);
 	}
 	else
-		_writeUInt8(t, 0);
+		_writeUInt8(t, s, 0);
 
 	if(auto f = v->cachedFunc)
 	{
-		_writeUInt8(t, 1);
-		_serialize(t, f);
+		_writeUInt8(t, s, 1);
+		_serialize(t, s, f);
 	}
 	else
-		_writeUInt8(t, 0);
+		_writeUInt8(t, s, 0);
 
-	_integer(t, v->switchTables.length);
+	_integer(t, s, v->switchTables.length);
 
 	for(auto &st: v->switchTables)
 	{
-		_integer(t, st.offsets.length());
+		_integer(t, s, st.offsets.length());
 
 		for(auto node: st.offsets)
 		{
-			_serialize(t, node->key);
-			_integer(t, node->value);
+			_serialize(t, s, node->key);
+			_integer(t, s, node->value);
 		}
 
-		_integer(t, st.defaultOffset);
+		_integer(t, s, st.defaultOffset);
 	}
 
-	_integer(t, v->lineInfo.length);
-	_append(t, v->lineInfo.template as<uint8_t>());
-	_serializeArray(t, v->upvalNames);
+	_integer(t, s, v->lineInfo.length);
+	_append(t, s, v->lineInfo.template as<uint8_t>());
+	_serializeArray(t, s, v->upvalNames);
 
-	_integer(t, v->locVarDescs.length);
+	_integer(t, s, v->locVarDescs.length);
 
 	for(auto &desc: v->locVarDescs)
 	{
-		_serialize(t, desc.name);
-		_integer(t, desc.pcStart);
-		_integer(t, desc.pcEnd);
-		_integer(t, desc.reg);
+		_serialize(t, s, desc.name);
+		_integer(t, s, desc.pcStart);
+		_integer(t, s, desc.pcEnd);
+		_integer(t, s, desc.reg);
 	}
-
-	return 0;
 }
 
-word_t _nativeSerializeClass(CrocThread* t)
+void serializeClass(CrocThread* t, State& s, Class* v)
 {
-	auto v = getClass(Thread::from(t), 1);
-
 	uword index = 0;
 	String** key;
 	Value* value;
 
-	_integer(t, v->methods.length());
+	_integer(t, s, v->methods.length());
 
 	while(v->nextMethod(index, key, value))
 	{
-		_serialize(t, *key);
-		_serialize(t, *value);
+		_serialize(t, s, *key);
+		_serialize(t, s, *value);
 	}
 
-	_integer(t, v->fields.length());
+	_integer(t, s, v->fields.length());
 	index = 0;
 
 	while(v->nextField(index, key, value))
 	{
-		_serialize(t, *key);
-		_serialize(t, *value);
+		_serialize(t, s, *key);
+		_serialize(t, s, *value);
 	}
 
-	_integer(t, v->hiddenFields.length());
+	_integer(t, s, v->hiddenFields.length());
 	index = 0;
 
 	while(v->nextHiddenField(index, key, value))
 	{
-		_serialize(t, *key);
-		_serialize(t, *value);
+		_serialize(t, s, *key);
+		_serialize(t, s, *value);
 	}
+}
 
-	return 0;
+// Returns true if the instance's fields should be written out, or false if its opSerialize method took care of it.
+bool serializeInstance(CrocThread* t, State& s, Instance* v)
+{
+	auto t_ = Thread::from(t);
+
+	// have to do this so we can deserialize properly
+	_integer(t, s, v->parent->numInstanceFields * sizeof(Array::Slot));
+	_serialize(t, s, v->parent);
+
+	auto slot = push(t_, Value::from(v));
+
+	if(croc_hasField(t, slot, "opSerialize") || croc_hasMethod(t, slot, "opSerialize"))
+	{
+		croc_field(t, slot, "opSerialize");
+
+		if(croc_isFunction(t, -1))
+		{
+			croc_popTop(t);
+			_writeUInt8(t, s, 1);
+
+			// It may write to the output directly.
+			flush(t, s);
+			croc_pushNull(t);
+			push(t_, s.output);
+			push(t_, s.serializeFunc);
+			croc_methodCall(t, slot, "opSerialize", 0);
+			return false;
+		}
+		else if(croc_isBool(t, -1))
+		{
+			if(!croc_getBool(t, -1))
+			{
+				croc_pushToStringRaw(t, slot);
+				croc_eh_throwStd(t, "ValueError", "Attempting to serialize '%s' whose opSerialize field is false",
+					croc_getString(t, -1));
+			}
+
+			// fall out, serialize literally
+		}
+		else
+		{
+			croc_pushToStringRaw(t, slot);
+			croc_pushTypeString(t, -2);
+			croc_eh_throwStd(t, "TypeError",
+				"Attempting to serialize '%s' whose opSerialize field is '%s', not bool or function",
+				croc_getString(t, -2), croc_getString(t, -1));
+		}
+
+		croc_popTop(t);
+	}
+
+	// TODO: relax the finalizer restriction, since finalizers aren't "native-only" any more
+	if(v->parent->finalizer != nullptr)
+	{
+		croc_pushToStringRaw(t, slot);
+		croc_eh_throwStd(t, "ValueError", "Attempting to serialize '%s' which has a finalizer", croc_getString(t, -1));
+	}
+
+	croc_popTop(t);
+	_writeUInt8(t, s, 0);
+	_integer(t, s, v->fields->length());
+	return true;
 }
 
-word_t _nativeSerializeInstance(CrocThread* t)
+// Writes v, or the start of it. Returns true if v has been replaced by another value which should be written next.
+bool writeValue(CrocThread* t, State& s, Value& v)
 {
-	auto v = getInstance(Thread::from(t), 1);
+	Value replacement;
 
-	uword index = 0;
-	String** key;
-	Value* value;
+	if(getTransient(t, s, v, replacement))
+	{
+		_writeUInt8(t, s, TransientTag);
+		v = replacement;
+		return true;
+	}
+
+	switch(v.type)
+	{
+		case CrocType_Null:
+			_writeUInt8(t, s, CrocType_Null);
+			return false;
+
+		case CrocType_Bool:
+			_writeUInt8(t, s, CrocType_Bool);
+			_writeUInt8(t, s, cast(uint8_t)v.mBool);
+			return false;
+
+		case CrocType_Int:
+			_writeUInt8(t, s, CrocType_Int);
+			_integer(t, s, v.mInt);
+			return false;
+
+		case CrocType_Float:
+			_writeUInt8(t, s, CrocType_Float);
+			memcpy(reserve(t, s, sizeof(crocfloat)), &v.mFloat, sizeof(crocfloat));
+			return false;
+
+		case CrocType_Nativeobj:
+			croc_eh_throwStd(t, "TypeError", "Attempting to serialize a nativeobj. Please use the transients table.");
+			return false;
+
+		case CrocType_String: {
+			if(alreadyWritten(t, s, v.mGCObj))
+				return false;
+
+			auto str = v.mString;
+			_writeUInt8(t, s, CrocType_String);
+			_integer(t, s, str->length);
+			_append(t, s, DArray<uint8_t>::n(cast(uint8_t*)str->toUString(), str->length));
+			return false;
+		}
+		case CrocType_Weakref: {
+			// although weakrefs are implemented as objects, their value-ness means that really the only way to properly
+			// serialize/deserialize them is to treat them like a value: just embed them every time they show up.
+			_writeUInt8(t, s, CrocType_Weakref);
 
-	_integer(t, v->fields->length());
+			if(auto obj = v.mWeakref->obj)
+			{
+				_writeUInt8(t, s, 1);
+				v = Value::from(obj);
+				return true;
+			}
 
-	while(v->nextField(index, key, value))
+			_writeUInt8(t, s, 0);
+			return false;
+		}
+		case CrocType_Table:
+			if(alreadyWritten(t, s, v.mGCObj))
+				return false;
+
+			_writeUInt8(t, s, CrocType_Table);
+			_integer(t, s, v.mTable->length());
+			pushFrame(s, v.mGCObj);
+			return false;
+
+		case CrocType_Namespace: {
+			if(alreadyWritten(t, s, v.mGCObj))
+				return false;
+
+			auto ns = v.mNamespace;
+			_writeUInt8(t, s, CrocType_Namespace);
+			_serialize(t, s, ns->name);
+
+			if(ns->parent == nullptr)
+				_writeUInt8(t, s, 0);
+			else
+			{
+				_writeUInt8(t, s, 1);
+				_serialize(t, s, ns->parent);
+			}
+
+			_integer(t, s, ns->length());
+			pushFrame(s, v.mGCObj);
+			return false;
+		}
+		case CrocType_Array:
+			if(alreadyWritten(t, s, v.mGCObj))
+				return false;
+
+			_writeUInt8(t, s, CrocType_Array);
+			_integer(t, s, v.mArray->length);
+			pushFrame(s, v.mGCObj);
+			return false;
+
+		case CrocType_Memblock:
+			if(alreadyWritten(t, s, v.mGCObj))
+				return false;
+
+			if(!v.mMemblock->ownData)
+				croc_eh_throwStd(t, "ValueError", "Attempting to serialize a memblock which does not own its data");
+
+			_writeUInt8(t, s, CrocType_Memblock);
+			_integer(t, s, v.mMemblock->data.length);
+			_append(t, s, v.mMemblock->data);
+			return false;
+
+		case CrocType_Function:
+			if(alreadyWritten(t, s, v.mGCObj))
+				return false;
+
+			if(v.mFunction->isNative)
+			{
+				croc_eh_throwStd(t, "ValueError", "Attempting to serialize a native function '%s'",
+					v.mFunction->name->toCString());
+			}
+
+			_writeUInt8(t, s, CrocType_Function);
+			serializeFunction(t, s, v.mFunction);
+			return false;
+
+		case CrocType_Funcdef:
+			if(alreadyWritten(t, s, v.mGCObj))
+				return false;
+
+			_writeUInt8(t, s, CrocType_Funcdef);
+			serializeFuncdef(t, s, v.mFuncdef);
+			return false;
+
+		case CrocType_Class: {
+			if(alreadyWritten(t, s, v.mGCObj))
+				return false;
+
+			auto c = v.mClass;
+			_writeUInt8(t, s, CrocType_Class);
+			_serialize(t, s, c->name);
+
+			// TODO: relax the finalizer restriction, since finalizers aren't "native-only" any more
+			if(c->isFrozen && c->finalizer != nullptr)
+			{
+				croc_eh_throwStd(t, "ValueError", "Attempting to serialize class '%s' which has a finalizer",
+					c->name->toCString());
+			}
+
+			serializeClass(t, s, c);
+			_writeUInt8(t, s, cast(uint8_t)c->isFrozen);
+			return false;
+		}
+		case CrocType_Instance:
+			if(alreadyWritten(t, s, v.mGCObj))
+				return false;
+
+			_writeUInt8(t, s, CrocType_Instance);
+
+			if(serializeInstance(t, s, v.mInstance))
+				pushFrame(s, v.mGCObj);
+
+			return false;
+
+		case CrocType_Thread:
+			croc_eh_throwStd(t, "TypeError", "Attempting to serialize a thread. Please use the transients table.");
+			return false;
+
+		case CrocType_Upval:
+			if(alreadyWritten(t, s, v.mGCObj))
+				return false;
+
+			_writeUInt8(t, s, CrocType_Upval);
+			v = *(cast(Upval*)v.mGCObj)->value;
+			return true;
+
+		default: assert(false); return false; // dummy
+	}
+}
+
+// Finds the next value to write from the frame at index frame. Returns false if it's done.
+bool writeNext(CrocThread* t, State& s, uword frame, Value& v)
+{
+	auto &f = s.frames[frame];
+
+	if(f.hasPending)
 	{
-		_serialize(t, *key);
-		_serialize(t, *value);
+		f.hasPending = false;
+		v = f.pending;
+		return true;
 	}
 
-	if(v->hiddenFieldsData == nullptr)
-		_integer(t, 0);
-	else
+	switch(f.obj->type)
 	{
-		_integer(t, v->parent->hiddenFields.length());
-		index = 0;
+		case CrocType_Table: {
+			Value* key;
+			Value* val;
 
-		while(v->nextHiddenField(index, key, value))
-		{
-			_serialize(t, *key);
-			_serialize(t, *value);
+			if(!(cast(Table*)f.obj)->next(f.idx, key, val))
+				return false;
+
+			v = *key;
+			f.pending = *val;
+			f.hasPending = true;
+			return true;
+		}
+		case CrocType_Namespace: {
+			String** key;
+			Value* val;
+
+			if(!(cast(Namespace*)f.obj)->next(f.idx, key, val))
+				return false;
+
+			v = Value::from(*key);
+			f.pending = *val;
+			f.hasPending = true;
+			return true;
 		}
+		case CrocType_Array: {
+			auto arr = cast(Array*)f.obj;
+
+			if(f.idx >= arr->length)
+				return false;
+
+			v = arr->data[f.idx++].value;
+			return true;
+		}
+		case CrocType_Instance: {
+			auto inst = cast(Instance*)f.obj;
+			String** key;
+			Value* val;
+
+			if(f.step == 0)
+			{
+				if(inst->nextField(f.idx, key, val))
+				{
+					v = Value::from(*key);
+					f.pending = *val;
+					f.hasPending = true;
+					return true;
+				}
+
+				f.step = 1;
+				f.idx = 0;
+
+				if(inst->hiddenFieldsData == nullptr)
+				{
+					_integer(t, s, 0);
+					return false;
+				}
+
+				_integer(t, s, inst->parent->hiddenFields.length());
+			}
+
+			if(!inst->nextHiddenField(f.idx, key, val))
+				return false;
+
+			v = Value::from(*key);
+			f.pending = *val;
+			f.hasPending = true;
+			return true;
+		}
+		default: assert(false); return false; // dummy
 	}
+}
 
-	return 0;
+void serialize(CrocThread* t, State& s, Value v)
+{
+	auto base = s.numFrames;
+
+	while(true)
+	{
+		while(writeValue(t, s, v))
+			continue;
+
+		while(true)
+		{
+			if(s.numFrames == base)
+				return;
+
+			if(writeNext(t, s, s.numFrames - 1, v))
+				break;
+
+			s.numFrames--;
+		}
+	}
 }
 
 // void _serializeStack(CrocThread* t, CrocThread* v)
@@ -400,491 +860,1083 @@ word_t _nativeSerializeInstance(CrocThread* t)
 // 	return 0;
 // }
 
-word_t _serializeUpval(CrocThread* t)
+word_t _writeGraph(CrocThread* t)
 {
-	if(!croc_isValidIndex(t, 1))
-	{
-		croc_eh_throwStd(t, "ParamError", "Too few parameters (expected at least 1, got %" CROC_SIZE_T_FORMAT ")",
-			croc_getStackSize(t) - 1);
-	}
+	auto t_ = Thread::from(t);
+	croc_ex_checkAnyParam(t, 1);
+	croc_ex_checkAnyParam(t, 2);
 
-	auto uv = *getValue(Thread::from(t), 1);
+	if(!croc_isTable(t, 2) && !croc_isInstance(t, 2))
+		croc_ex_paramTypeError(t, 2, "table|instance");
 
-	if(uv.type != CrocType_Upval)
-		croc_eh_throwStd(t, "TypeError", "Expected upval for parameter");
+	if(croc_is(t, 1, 2))
+		croc_eh_throwStd(t, "ValueError", "Object to serialize is the same as the transients table");
 
-	croc_dup(t, 0);
-	croc_pushNull(t);
-	croc_dup(t, 1);
-	croc_methodCall(t, -3, "_alreadyWritten", 1);
+	croc_field(t, 0, _State);
 
-	if(croc_getBool(t, -1))
-		return 0;
+	if(!croc_isNull(t, -1))
+		croc_eh_throwStd(t, "StateError", "Attempting to call writeGraph on a Serializer which is already writing one");
 
 	croc_popTop(t);
+	croc_dup(t, 2);
+	croc_fielda(t, 0, _Trans);
+
+	// Objects in objTable can't be allowed to be collected, or their addresses could be reused by new objects.
+	t_->vm->disableGC();
+
+	State s;
+	s.mem = &t_->vm->mem;
+	s.buf = DArray<uint8_t>::alloc(*s.mem, ChunkSize);
+	s.used = 0;
+	s.objTable.init();
+	s.objIndex = 0;
+	s.frames = DArray<Frame>();
+	s.numFrames = 0;
+	croc_field(t, 0, _Output);         s.output = *getValue(t_, -1);        croc_popTop(t);
+	s.trans = *getValue(t_, 2);
+	croc_field(t, 0, _SerializeFunc);  s.serializeFunc = *getValue(t_, -1); croc_popTop(t);
+	croc_ex_lookup(t, "stream.Stream.writeExact"); s.writeExact = *getValue(t_, -1); croc_popTop(t);
+	croc_memblock_new(t, 0);           s.view = *getValue(t_, -1);          croc_popTop(t);
+
+	croc_pushNativeobj(t, &s);
+	croc_fielda(t, 0, _State);
 
-	croc_dup(t, 0);
-	croc_pushNull(t);
-	croc_pushInt(t, CrocType_Upval);
-	croc_methodCall(t, -3, "_tag", 0);
+	auto slot = croc_pushNull(t);
+	auto failed = tryCode(t_, slot, [&]
+	{
+		_writeUInt8(t, s, endianness());
+		_integer(t, s, sizeof(uword) * 8);
+		_integer(t, s, sizeof(crocint));
+		_integer(t, s, sizeof(crocfloat));
+		_integer(t, s, SerialVersion);
+		serialize(t, s, *getValue(t_, 1));
+		flush(t, s);
+	});
 
-	croc_dup(t, 0);
+	t_->vm->enableGC();
 	croc_pushNull(t);
-	push(Thread::from(t), *(cast(Upval*)uv.mGCObj)->value);
-	croc_methodCall(t, -3, "_serialize", 0);
+	croc_fielda(t, 0, _State);
+	s.buf.free(*s.mem);
+	s.objTable.clear(*s.mem);
+	s.frames.free(*s.mem);
 
+	if(failed)
+		croc_eh_rethrow(t);
+
+	croc_popTop(t); // eh slot
+	croc_field(t, 0, _Output);
+	croc_pushNull(t);
+	croc_methodCall(t, -2, "flush", 0);
 	return 0;
 }
 
-word_t _instSize(CrocThread* t)
+// The callback given to opSerialize methods.
+word_t _serialize(CrocThread* t)
 {
-	croc_pushInt(t, getInstance(Thread::from(t), 1)->parent->numInstanceFields * sizeof(Array::Slot));
-	return 1;
+	croc_ex_checkAnyParam(t, 1);
+	auto &s = getState(t);
+	serialize(t, s, *getValue(Thread::from(t), 1));
+
+	// opSerialize may write to the output directly after this returns.
+	flush(t, s);
+	return 0;
 }
 }
 
 namespace Deser
 {
 const char* _Input = "_input";
-const char* _RawBuf = "_rawBuf";
 const char* _Trans = "_trans";
-const char* _ObjTable = "_objTable";
-const char* _DummyObj = "_dummyObj";
+const char* _State = "_state";
 const char* _DeserializeFunc = "_deserializeFunc";
 
-word_t _readGraph(CrocThread* t)
-{
-	if(!croc_isValidIndex(t, 1))
-	{
-		croc_eh_throwStd(t, "ParamError", "Too few parameters (expected at least 1, got %" CROC_SIZE_T_FORMAT ")",
-			croc_getStackSize(t) - 1);
-	}
+// Stands for "any type" when a type is expected.
+const CrocType AnyType = CrocType_NUMTYPES;
 
-	if(!croc_isTable(t, 1) && !croc_isInstance(t, 1))
-	{
-		croc_pushTypeString(t, 1);
-		croc_eh_throwStd(t, "TypeError", "Expected type 'table|instance' for parameter 1, not '%s'",
-			croc_getString(t, -1));
-	}
+// Like the serializer's frames, these keep track of how far through reading their contents tables, namespaces, arrays
+// and instances are, as well as transients, weakrefs and upvals (which are each followed by one value).
+struct Frame
+{
+	GCObject* obj; // null for transients
+	uint8_t tag;
+	uword step;
+	bool gotKey;   // for key-value pairs, whether the key's been read and the value's next
+	uword remaining;
+	CrocType want;     // the type of the value the frame wants next
+	CrocType expected; // for transients, the type of the value the transient was read in place of
+	Value key;
+};
 
-	croc_dup(t, 1);       croc_fielda(t, 0, _Trans);
-	croc_array_new(t, 0); croc_fielda(t, 0, _ObjTable);
-	croc_table_new(t, 0); croc_fielda(t, 0, _DummyObj);
+struct State
+{
+	Memory* mem;
+	VM* vm;
+	DArray<uint8_t> buf;
+	uword pos;
+	uword end;
+	bool readAhead; // if the input is seekable, it's read a chunk at a time, then seeked back over whatever's left
+	DArray<GCObject*> objs;
+	uword numObjs;
+	DArray<Frame> frames;
+	uword numFrames;
+	Value input;
+	Value trans;
+	Value deserializeFunc;
+	Value readExact;
+	Value view;
+	Value dummyObj;
+};
 
-	Thread::from(t)->vm->disableGC();
+State& getState(CrocThread* t)
+{
+	croc_field(t, 0, _State);
 
-	auto slot = croc_pushNull(t);
-	auto failed = tryCode(Thread::from(t), slot, [&]
-	{
-		croc_dup(t, 0);
-		croc_pushNull(t);
-		croc_methodCall(t, -2, "_readSignature", 0);
-		croc_dup(t, 0);
-		croc_pushNull(t);
-		croc_methodCall(t, -2, "_deserialize", 1);
-	});
+	if(!croc_isNativeobj(t, -1))
+		croc_eh_throwStd(t, "StateError", "Attempting to deserialize a value outside of readGraph");
 
-	Thread::from(t)->vm->enableGC();
-	croc_field(t, 0, _ObjTable);
-	croc_lenai(t, -1, 0);
+	auto ret = cast(State*)croc_getNativeobj(t, -1);
 	croc_popTop(t);
-	croc_pushNull(t);
-	croc_fielda(t, 0, _DummyObj);
-
-	if(failed)
-		croc_eh_rethrow(t);
-
-	croc_remove(t, -2); // eh slot
-	croc_gc_collectFull(t);
-	return 1;
+	return *ret;
 }
 
-crocint _integer(CrocThread* t)
+// Calls the input's read method to fill as much of the rest of the buffer as it will.
+uword readSome(CrocThread* t, State& s)
 {
-	croc_dup(t, 0);
+	auto t_ = Thread::from(t);
+	auto len = s.buf.length - s.end;
+	push(t_, s.input);
 	croc_pushNull(t);
-	croc_methodCall(t, -2, "_integer", 1);
-	auto ret = croc_getInt(t, -1);
-	croc_popTop(t);
-	return ret;
-}
+	push(t_, s.view);
+	croc_memblock_reviewNativeArray(t, -1, s.buf.ptr + s.end, len);
+	croc_methodCall(t, -3, "read", 1);
+
+	if(!croc_isInt(t, -1) || croc_getInt(t, -1) < 0 || cast(uword)croc_getInt(t, -1) > len)
+		croc_eh_throwStd(t, "ValueError", "Input stream's read method returned an invalid byte count");
 
-uword _length(CrocThread* t)
-{
-	croc_dup(t, 0);
-	croc_pushNull(t);
-	croc_methodCall(t, -2, "_length", 1);
 	auto ret = cast(uword)croc_getInt(t, -1);
 	croc_popTop(t);
 	return ret;
 }
 
-word _deserialize(CrocThread* t)
+// Makes sure there are at least n bytes buffered. Throws an EOFException if the input runs out first.
+void need(CrocThread* t, State& s, uword n)
 {
-	auto ret = croc_dup(t, 0);
-	croc_pushNull(t);
-	croc_methodCall(t, -2, "_deserialize", 1);
-	return ret;
+	auto have = s.end - s.pos;
+
+	if(have >= n)
+		return;
+
+	// Deserializing from memory, there's nothing more to get.
+	if(s.input.type == CrocType_Null)
+		croc_eh_throwStd(t, "ValueError", "Malformed data (unexpected end of data)");
+
+	memmove(s.buf.ptr, s.buf.ptr + s.pos, have);
+	s.pos = 0;
+	s.end = have;
+
+	if(s.buf.length < n)
+		s.buf.resize(*s.mem, n);
+
+	if(s.readAhead)
+	{
+		while(s.end < n)
+		{
+			auto got = readSome(t, s);
+
+			if(got == 0)
+				break;
+
+			s.end += got;
+		}
+	}
+
+	if(s.end < n)
+	{
+		auto t_ = Thread::from(t);
+		push(t_, s.readExact);
+		push(t_, s.input);
+		push(t_, s.view);
+		croc_memblock_reviewNativeArray(t, -1, s.buf.ptr + s.end, n - s.end);
+		croc_call(t, -3, 0);
+		s.end = n;
+	}
 }
 
-uint8_t _readUInt8(CrocThread* t)
+// Seeks the input back over anything that was read ahead, so that it's positioned right after what's been
+// deserialized.
+void unread(CrocThread* t, State& s)
 {
-	croc_dup(t, 0);
-	croc_pushNull(t);
-	croc_methodCall(t, -2, "_uint8", 1);
-	auto ret = cast(uint8_t)croc_getInt(t, -1);
-	croc_popTop(t);
-	return ret;
+	if(s.end > s.pos && s.input.type != CrocType_Null)
+	{
+		push(Thread::from(t), s.input);
+		croc_pushNull(t);
+		croc_pushInt(t, -cast(crocint)(s.end - s.pos));
+		croc_pushString(t, "c");
+		croc_methodCall(t, -4, "seek", 0);
+	}
+
+	s.pos = s.end = 0;
 }
 
-void _readBlock(CrocThread* t, DArray<uint8_t> arr)
+inline uint8_t _readUInt8(CrocThread* t, State& s)
 {
-	croc_ex_lookup(t, "stream.Stream.readExact");
-	croc_field(t, 0, _Input);
-	croc_field(t, 0, _RawBuf);
-	croc_memblock_reviewNativeArray(t, -1, arr.ptr, arr.length);
-	croc_call(t, -3, 0);
+	if(s.pos == s.end)
+		need(t, s, 1);
+
+	return s.buf[s.pos++];
 }
 
-void _addObject(CrocThread* t, GCObject* obj)
+crocint _integer(CrocThread* t, State& s)
 {
-	croc_dup(t, 0);
-	croc_pushNull(t);
-	push(Thread::from(t), Value::from(obj));
-	croc_methodCall(t, -3, "_addObject", 0);
+	uint64_t ret = 0;
+	uword shift = 0;
+	uint8_t b;
+
+	while(true)
+	{
+		if(shift >= sizeof(crocint) * 8)
+			croc_eh_throwStd(t, "ValueError", "Malformed data (overlong integer)");
+
+		b = _readUInt8(t, s);
+		ret |= cast(uint64_t)(b & 0x7F) << shift;
+		shift += 7;
+
+		if((b & 0x80) == 0)
+			break;
+	}
+
+	if(shift < sizeof(crocint) * 8 && (b & 0x40))
+		ret |= ~cast(uint64_t)0 << shift;
+
+	return cast(crocint)ret;
 }
 
-void _deserializeObj(CrocThread* t, const char* methodName)
+uword _length(CrocThread* t, State& s)
 {
-	croc_dup(t, 0);
-	croc_pushNull(t);
-	croc_methodCall(t, -2, methodName, 1);
+	auto ret = _integer(t, s);
+
+	if(ret < 0 || ret > 0xFFFFFFFF)
+		croc_eh_throwStd(t, "ValueError", "Malformed data (length field has a value of %" CROC_INTEGER_FORMAT ")", ret);
+
+	return cast(uword)ret;
 }
 
-String* _deserializeString(CrocThread* t)
+void _readBlock(CrocThread* t, State& s, DArray<uint8_t> arr)
 {
-	_deserializeObj(t, "_deserializeString");
-	auto ret = getStringObj(Thread::from(t), -1);
-	croc_popTop(t);
-	return ret;
+	for(uword done = 0; done < arr.length; )
+	{
+		auto n = arr.length - done;
+
+		if(n > ChunkSize)
+			n = ChunkSize;
+
+		need(t, s, n);
+		memcpy(arr.ptr + done, s.buf.ptr + s.pos, n);
+		s.pos += n;
+		done += n;
+	}
 }
 
-word_t _deserializeNamespaceImpl(CrocThread* t)
+void _addObject(State& s, GCObject* obj)
 {
-	auto t_ = Thread::from(t);
-	auto ret = Namespace::createPartial(t_->vm->mem);
-	_addObject(t, cast(GCObject*)ret);
+	if(s.numObjs == s.objs.length)
+		s.objs.resize(*s.mem, s.objs.length == 0 ? 64 : s.objs.length * 2);
 
-	auto name = _deserializeString(t);
-	Namespace* parent = nullptr;
+	s.objs[s.numObjs++] = obj;
+}
 
-	if(_readUInt8(t) != 0)
+void checkType(CrocThread* t, CrocType wanted, Value v)
+{
+	if(wanted != AnyType && v.type != wanted)
 	{
-		_deserializeObj(t, "_deserializeNamespace");
-		parent = getNamespace(t_, -1); assert(parent != nullptr);
-		croc_popTop(t);
+		croc_eh_throwStd(t, "ValueError",
+			"Malformed data (expected type '%s' but found a backref to type '%s' instead)",
+			typeToString(wanted), typeToString(v.type));
 	}
+}
 
-	Namespace::finishCreate(ret, name, parent);
-	push(t_, Value::from(ret));
+void pushFrame(State& s, GCObject* obj, uint8_t tag)
+{
+	if(s.numFrames == s.frames.length)
+		s.frames.resize(*s.mem, s.frames.length == 0 ? 16 : s.frames.length * 2);
+
+	auto &f = s.frames[s.numFrames++];
+	f.obj = obj;
+	f.tag = tag;
+	f.step = 0;
+	f.gotKey = false;
+	f.remaining = 0;
+	f.want = AnyType;
+	f.expected = AnyType;
+}
 
-	auto len = _length(t);
+Value deserialize(CrocThread* t, State& s, CrocType wanted);
 
-	for(uword i = 0; i < len; i++)
-	{
-		_deserializeObj(t, "_deserializeString");
-		_deserialize(t);
-		croc_fieldaStk(t, -3);
-	}
+template<typename T>
+T* _deserializeObj(CrocThread* t, State& s, CrocType wanted)
+{
+	return cast(T*)deserialize(t, s, wanted).mGCObj;
+}
 
-	return 1;
+String* _deserializeString(CrocThread* t, State& s)
+{
+	return _deserializeObj<String>(t, s, CrocType_String);
 }
 
-word_t _deserializeFunctionImpl(CrocThread* t)
+Function* _deserializeFunctionImpl(CrocThread* t, State& s)
 {
-	auto t_ = Thread::from(t);
-	auto numUpvals = _length(t);
-	auto ret = Function::createPartial(t_->vm->mem, numUpvals);
-	_addObject(t, cast(GCObject*)ret);
+	auto numUpvals = _length(t, s);
+	auto ret = Function::createPartial(*s.mem, numUpvals);
+	_addObject(s, cast(GCObject*)ret);
 
-	_deserializeObj(t, "_deserializeFuncdef");
+	auto def = _deserializeObj<Funcdef>(t, s, CrocType_Funcdef);
+	Namespace* env;
 
-	if(_readUInt8(t) != 0)
-		_deserializeObj(t, "_deserializeNamespace");
+	if(_readUInt8(t, s) != 0)
+		env = _deserializeObj<Namespace>(t, s, CrocType_Namespace);
 	else
-		push(t_, Value::from(t_->vm->globals));
+		env = s.vm->globals;
 
-	auto def = getFuncdef(t_, -2);   assert(def != nullptr);
-	auto env = getNamespace(t_, -1); assert(env != nullptr);
-	Function::finishCreate(t_->vm->mem, ret, env, def);
-	croc_pop(t, 2);
+	Function::finishCreate(*s.mem, ret, env, def);
 
 	for(auto &val: ret->scriptUpvals())
-	{
-		_deserializeObj(t, "_deserializeUpval");
-		val = cast(Upval*)getValue(t_, -1)->mGCObj;
-		croc_popTop(t);
-	}
+		val = _deserializeObj<Upval>(t, s, CrocType_Upval);
 
-	push(t_, Value::from(ret));
-	return 1;
+	return ret;
 }
 
-word_t _deserializeFuncdefImpl(CrocThread* t)
+Funcdef* _deserializeFuncdefImpl(CrocThread* t, State& s)
 {
-	auto t_ = Thread::from(t);
-	auto def = Funcdef::create(t_->vm->mem);
-	_addObject(t, cast(GCObject*)def);
-
-	def->locFile = _deserializeString(t);
-	def->locLine = _length(t);
-	def->locCol = _length(t);
-	def->isVararg = cast(bool)_readUInt8(t);
-	def->isVarret = cast(bool)_readUInt8(t);
-	def->name = _deserializeString(t);
-	def->numParams = _length(t);
-	def->paramMasks.resize(t_->vm->mem, _length(t));
+	auto &mem = *s.mem;
+	auto def = Funcdef::create(mem);
+	_addObject(s, cast(GCObject*)def);
+
+	def->locFile = _deserializeString(t, s);
+	def->locLine = _length(t, s);
+	def->locCol = _length(t, s);
+	def->isVararg = cast(bool)_readUInt8(t, s);
+	def->isVarret = cast(bool)_readUInt8(t, s);
+	def->name = _deserializeString(t, s);
+	def->numParams = _length(t, s);
+	def->paramMasks.resize(mem, _length(t, s));
 
 	for(auto &mask: def->paramMasks)
-		mask = _length(t);
+		mask = _length(t, s);
 
-	def->numReturns = _length(t);
-	def->returnMasks.resize(t_->vm->mem, _length(t));
+	def->numReturns = _length(t, s);
+	def->returnMasks.resize(mem, _length(t, s));
 
 	for(auto &mask: def->returnMasks)
-		mask = _length(t);
+		mask = _length(t, s);
 
-	def->upvals.resize(t_->vm->mem, _length(t));
+	def->upvals.resize(mem, _length(t, s));
 
 	for(auto &uv: def->upvals)
 	{
-		uv.isUpval = cast(bool)_readUInt8(t);
-		uv.index = _length(t);
+		uv.isUpval = cast(bool)_readUInt8(t, s);
+		uv.index = _length(t, s);
 	}
 
-	def->stackSize = _length(t);
+	def->stackSize = _length(t, s);
 
-	def->innerFuncs.resize(t_->vm->mem, _length(t));
+	def->innerFuncs.resize(mem, _length(t, s));
 
 	for(auto &func: def->innerFuncs)
-	{
-		_deserializeObj(t, "_deserializeFuncdef");
-		func = getFuncdef(t_, -1); assert(func != nullptr);
-		croc_popTop(t);
-	}
+		func = _deserializeObj<Funcdef>(t, s, CrocType_Funcdef);
 
-	def->constants.resize(t_->vm->mem, _length(t));
+	def->constants.resize(mem, _length(t, s));
 
 	for(auto &val: def->constants)
-	{
-		_deserialize(t);
-		val = *getValue(t_, -1);
-		croc_popTop(t);
-	}
+		val = deserialize(t, s, AnyType);
 
-	def->code.resize(t_->vm->mem, _length(t));
-	_readBlock(t, def->code.template as<uint8_t>());
+	def->code.resize(mem, _length(t, s));
+	_readBlock(t, s, def->code.template as<uint8_t>());
 
-	if(_readUInt8(t) != 0)
-	{
-		_deserializeObj(t, "_deserializeNamespace");
-		def->environment = getNamespace(t_, -1); assert(def->environment != nullptr);
-		croc_popTop(t);
-	}
+	if(_readUInt8(t, s) != 0)
+		def->environment = _deserializeObj<Namespace>(t, s, CrocType_Namespace);
 
-	if(_readUInt8(t) != 0)
-	{
-		_deserializeObj(t, "_deserializeFunction");
-		def->cachedFunc = getFunction(t_, -1); assert(def->cachedFunc != nullptr);
-		croc_popTop(t);
-	}
+	if(_readUInt8(t, s) != 0)
+		def->cachedFunc = _deserializeObj<Function>(t, s, CrocType_Function);
 
-	def->switchTables.resize(t_->vm->mem, _length(t));
+	def->switchTables.resize(mem, _length(t, s));
 
 	for(auto &st: def->switchTables)
 	{
-		auto numOffsets = _length(t);
+		auto numOffsets = _length(t, s);
 
 		for(uword i = 0; i < numOffsets; i++)
 		{
-			_deserialize(t);
-			auto offs = cast(word)_integer(t);
-			*st.offsets.insert(t_->vm->mem, *getValue(t_, -1)) = offs;
-			croc_popTop(t);
+			auto key = deserialize(t, s, AnyType);
+			auto offs = cast(word)_integer(t, s);
+			*st.offsets.insert(mem, key) = offs;
 		}
 
-		st.defaultOffset = cast(word)_integer(t);
+		st.defaultOffset = cast(word)_integer(t, s);
 	}
 
-	def->lineInfo.resize(t_->vm->mem, _length(t));
-	_readBlock(t, def->lineInfo.template as<uint8_t>());
+	def->lineInfo.resize(mem, _length(t, s));
+	_readBlock(t, s, def->lineInfo.template as<uint8_t>());
 
-	def->upvalNames.resize(t_->vm->mem, _length(t));
+	def->upvalNames.resize(mem, _length(t, s));
 
 	for(auto &name: def->upvalNames)
-		name = _deserializeString(t);
+		name = _deserializeString(t, s);
 
-	def->locVarDescs.resize(t_->vm->mem, _length(t));
+	def->locVarDescs.resize(mem, _length(t, s));
 
 	for(auto &desc: def->locVarDescs)
 	{
-		desc.name = _deserializeString(t);
-		desc.pcStart = _length(t);
-		desc.pcEnd = _length(t);
-		desc.reg = _length(t);
+		desc.name = _deserializeString(t, s);
+		desc.pcStart = _length(t, s);
+		desc.pcEnd = _length(t, s);
+		desc.reg = _length(t, s);
 	}
 
-	push(t_, Value::from(def));
-	return 1;
+	return def;
 }
 
-word_t _deserializeClassImpl(CrocThread* t)
+Class* _deserializeClassImpl(CrocThread* t, State& s)
 {
-	auto t_ = Thread::from(t);
-	auto v = Class::create(t_->vm->mem, nullptr);
-	_addObject(t, cast(GCObject*)v);
+	auto v = Class::create(*s.mem, nullptr);
+	_addObject(s, cast(GCObject*)v);
 
-	v->name = _deserializeString(t);
+	v->name = _deserializeString(t, s);
 
-	auto numMethods = _length(t);
+	auto numMethods = _length(t, s);
 
 	for(uword i = 0; i < numMethods; i++)
 	{
-		auto name = _deserializeString(t);
-		_deserialize(t);
+		auto name = _deserializeString(t, s);
 
-		if(!v->addMethod(t_->vm->mem, name, *getValue(t_, -1), false))
+		if(!v->addMethod(*s.mem, name, deserialize(t, s, AnyType), false))
 		{
 			croc_eh_throwStd(t, "ValueError", "Malformed data (class %s already has a method '%s')",
 				v->name->toCString(), name->toCString());
 		}
-
-		croc_popTop(t);
 	}
 
-	auto numFields = _length(t);
+	auto numFields = _length(t, s);
 
 	for(uword i = 0; i < numFields; i++)
 	{
-		auto name = _deserializeString(t);
-		_deserialize(t);
+		auto name = _deserializeString(t, s);
 
-		if(!v->addField(t_->vm->mem, name, *getValue(t_, -1), false))
+		if(!v->addField(*s.mem, name, deserialize(t, s, AnyType), false))
 		{
 			croc_eh_throwStd(t, "ValueError", "Malformed data (class %s already has a field '%s')",
 				v->name->toCString(), name->toCString());
 		}
-
-		croc_popTop(t);
 	}
 
-	auto numHiddenFields = _length(t);
+	auto numHiddenFields = _length(t, s);
 
 	for(uword i = 0; i < numHiddenFields; i++)
 	{
-		auto name = _deserializeString(t);
-		_deserialize(t);
+		auto name = _deserializeString(t, s);
 
-		if(!v->addHiddenField(t_->vm->mem, name, *getValue(t_, -1)))
+		if(!v->addHiddenField(*s.mem, name, deserialize(t, s, AnyType)))
 		{
 			croc_eh_throwStd(t, "ValueError", "Malformed data (class %s already has a hidden field '%s')",
 				v->name->toCString(), name->toCString());
 		}
+	}
 
-		croc_popTop(t);
+	if(_readUInt8(t, s) != 0)
+		v->freeze(s.vm);
+
+	return v;
+}
+
+// Reads a value with the given type (or any type). Returns true if it's been read completely, or false if it pushed a
+// frame to read the rest of it.
+bool readValue(CrocThread* t, State& s, CrocType wanted, Value& v)
+{
+	auto tag = _readUInt8(t, s);
+
+	if(tag == BackrefTag)
+	{
+		auto idx = _integer(t, s);
+
+		if(idx < 0 || cast(uword)idx >= s.numObjs)
+			croc_eh_throwStd(t, "ValueError", "Malformed data (invalid back-reference)");
+
+		v = Value::from(s.objs[cast(uword)idx]);
+		checkType(t, wanted, v);
+		return true;
+	}
+	else if(tag == TransientTag)
+	{
+		pushFrame(s, nullptr, tag);
+		s.frames[s.numFrames - 1].expected = wanted;
+		return false;
+	}
+	else if(wanted != AnyType && tag != wanted)
+	{
+		if(tag >= CrocType_NUMTYPES)
+		{
+			croc_eh_throwStd(t, "ValueError", "Malformed data (expected type '%s' but found garbage instead)",
+				typeToString(wanted));
+		}
+		else
+		{
+			croc_eh_throwStd(t, "ValueError", "Malformed data (expected type '%s' but found '%s' instead)",
+				typeToString(wanted), typeToString(cast(CrocType)tag));
+		}
 	}
 
-	if(_readUInt8(t) != 0)
-		v->freeze(t_->vm->mem);
+	switch(tag)
+	{
+		case CrocType_Null:
+			v = Value::nullValue;
+			return true;
+
+		case CrocType_Bool:
+			v = Value::from(_readUInt8(t, s) != 0);
+			return true;
+
+		case CrocType_Int:
+			v = Value::from(_integer(t, s));
+			return true;
+
+		case CrocType_Float: {
+			crocfloat f;
+			need(t, s, sizeof(crocfloat));
+			memcpy(&f, s.buf.ptr + s.pos, sizeof(crocfloat));
+			s.pos += sizeof(crocfloat);
+			v = Value::from(f);
+			return true;
+		}
+		case CrocType_String: {
+			auto len = _length(t, s);
+			need(t, s, len);
 
-	push(t_, Value::from(v));
-	return 1;
+			if(!croc_tryPushStringn(t, cast(const char*)s.buf.ptr + s.pos, len))
+				croc_eh_throwStd(t, "ValueError", "Malformed data (invalid UTF-8 in string)");
+
+			s.pos += len;
+			v = *getValue(Thread::from(t), -1);
+			croc_popTop(t);
+			_addObject(s, v.mGCObj);
+			return true;
+		}
+		case CrocType_Weakref:
+			if(_readUInt8(t, s) != 0)
+			{
+				pushFrame(s, nullptr, tag);
+				return false;
+			}
+
+			v = Weakref::makeref(s.vm, s.dummyObj);
+			return true;
+
+		case CrocType_Table: {
+			auto len = _length(t, s);
+			auto tab = Table::create(*s.mem);
+			_addObject(s, cast(GCObject*)tab);
+			pushFrame(s, cast(GCObject*)tab, tag);
+			s.frames[s.numFrames - 1].remaining = len;
+			return false;
+		}
+		case CrocType_Namespace: {
+			auto ns = Namespace::createPartial(*s.mem);
+			_addObject(s, cast(GCObject*)ns);
+			pushFrame(s, cast(GCObject*)ns, tag);
+			return false;
+		}
+		case CrocType_Array: {
+			auto arr = Array::create(*s.mem, _length(t, s));
+			_addObject(s, cast(GCObject*)arr);
+			pushFrame(s, cast(GCObject*)arr, tag);
+			s.frames[s.numFrames - 1].remaining = arr->length;
+			return false;
+		}
+		case CrocType_Memblock: {
+			auto mb = Memblock::create(*s.mem, _length(t, s));
+			_addObject(s, cast(GCObject*)mb);
+			_readBlock(t, s, mb->data);
+			v = Value::from(mb);
+			return true;
+		}
+		case CrocType_Function:
+			v = Value::from(_deserializeFunctionImpl(t, s));
+			return true;
+
+		case CrocType_Funcdef:
+			v = Value::from(_deserializeFuncdefImpl(t, s));
+			return true;
+
+		case CrocType_Class:
+			v = Value::from(_deserializeClassImpl(t, s));
+			return true;
+
+		case CrocType_Instance: {
+			auto size = _length(t, s);
+
+			if(size >= (1 << 20) || size % sizeof(Array::Slot) != 0) // 1MB should be a reasonably insane upper bound :P
+				croc_eh_throwStd(t, "ValueError", "Malformed data (invalid instance size)");
+
+			auto inst = Instance::createPartial(*s.mem, size, false); // always false for now, might change later
+			_addObject(s, cast(GCObject*)inst);
+			pushFrame(s, cast(GCObject*)inst, tag);
+			return false;
+		}
+		case CrocType_Upval: {
+			auto &mem = *s.mem;
+			auto uv = ALLOC_OBJ(mem, Upval);
+			uv->type = CrocType_Upval;
+			uv->nextuv = nullptr;
+			uv->value = &uv->closedValue;
+			_addObject(s, cast(GCObject*)uv);
+			pushFrame(s, cast(GCObject*)uv, tag);
+			return false;
+		}
+		default:
+			croc_eh_throwStd(t, "ValueError", "Malformed data (invalid type tag)");
+			return false; // dummy
+	}
 }
 
-word_t _deserializeInstanceImpl(CrocThread* t)
+// Moves the frame at index frame along. The first time, v is ignored; after that, v is the value it last asked for.
+// Returns true if it wants another value (of type frames[frame].want), or false if it's done, in which case v is set
+// to its result.
+bool readNext(CrocThread* t, State& s, uword frame, Value& v)
 {
-	auto t_ = Thread::from(t);
-	auto size = _length(t);
+	auto &f = s.frames[frame];
+
+	switch(f.tag)
+	{
+		case TransientTag: {
+			if(f.step++ == 0)
+				return true;
+
+			Value ret;
+
+			if(s.trans.type == CrocType_Table)
+			{
+				auto r = s.trans.mTable->get(v);
+				ret = r ? *r : Value::nullValue;
+			}
+			else
+			{
+				auto t_ = Thread::from(t);
+				push(t_, s.trans);
+				push(t_, v);
+				croc_idx(t, -2);
+				ret = *getValue(t_, -1);
+				croc_pop(t, 2);
+			}
 
-	if(size < sizeof(Instance) || size >= (1 << 20)) // 1MB should be a reasonably insane upper bound :P
-		croc_eh_throwStd(t, "ValueError", "Malformed data (invalid instance size)");
+			if(ret.type == CrocType_Null)
+			{
+				push(Thread::from(t), v);
+				croc_pushToStringRaw(t, -1);
+				croc_eh_throwStd(t, "ValueError",
+					"Malformed data or invalid transient table (transient key %s does not exist)",
+					croc_getString(t, -1));
+			}
 
-	auto v = Instance::createPartial(t_->vm->mem, size, false); // always false for now, might change later
-	_addObject(t, cast(GCObject*)v);
+			checkType(t, f.expected, ret);
+			v = ret;
+			return false;
+		}
+		case CrocType_Weakref:
+			if(f.step++ == 0)
+				return true;
 
-	_deserializeObj(t, "_deserializeClass");
-	auto parent = getClass(t_, -1); assert(parent != nullptr);
+			v = Weakref::makeref(s.vm, v);
+			return false;
 
-	if(!parent->isFrozen)
-		croc_eh_throwStd(t, "ValueError", "Malformed data (instance of an unfrozen class somehow exists)");
+		case CrocType_Upval:
+			if(f.step++ == 0)
+				return true;
 
-	if(!Instance::finishCreate(v, parent))
-		croc_eh_throwStd(t, "ValueError",
-			"Malformed data (instance size %" CROC_SIZE_T_FORMAT
-				" does not match base class size %" CROC_SIZE_T_FORMAT ")",
-			v->memSize, sizeof(Instance) + parent->numInstanceFields * sizeof(Array::Slot));
+			(cast(Upval*)f.obj)->closedValue = v;
+			v = Value::from(f.obj);
+			return false;
+
+		case CrocType_Table:
+			if(f.step++ != 0)
+			{
+				if(!f.gotKey)
+				{
+					f.key = v;
+					f.gotKey = true;
+					return true;
+				}
+
+				tableIdxaImpl(Thread::from(t), cast(Table*)f.obj, f.key, v);
+				f.gotKey = false;
+				f.remaining--;
+			}
+
+			if(f.remaining > 0)
+				return true;
+
+			v = Value::from(f.obj);
+			return false;
+
+		case CrocType_Array: {
+			auto arr = cast(Array*)f.obj;
+
+			// opDeserialize methods could resize it through a backref.
+			if(f.step++ != 0 && f.remaining > 0 && f.remaining <= arr->length)
+				arr->idxa(*s.mem, arr->length - f.remaining--, v);
+
+			if(f.remaining > 0 && f.remaining <= arr->length)
+				return true;
+
+			v = Value::from(f.obj);
+			return false;
+		}
+		case CrocType_Namespace: {
+			auto ns = cast(Namespace*)f.obj;
+
+			if(f.step == 0)
+			{
+				// the name comes first
+				f.step = 1;
+				f.want = CrocType_String;
+				return true;
+			}
+			else if(f.step == 1)
+			{
+				// then maybe the parent
+				f.step = 2;
+				f.key = v;
+
+				if(_readUInt8(t, s) != 0)
+				{
+					f.want = CrocType_Namespace;
+					return true;
+				}
+
+				v = Value::nullValue;
+			}
+
+			if(f.step == 2)
+			{
+				Namespace::finishCreate(ns, f.key.mString, v.type == CrocType_Null ? nullptr : v.mNamespace);
+				f.step = 3;
+				f.remaining = _length(t, s);
+			}
+			else if(!f.gotKey)
+			{
+				f.key = v;
+				f.gotKey = true;
+				f.want = AnyType;
+				return true;
+			}
+			else
+			{
+				ns->set(*s.mem, f.key.mString, v);
+				f.gotKey = false;
+				f.remaining--;
+			}
+
+			if(f.remaining > 0)
+			{
+				f.want = CrocType_String;
+				return true;
+			}
+
+			v = Value::from(f.obj);
+			return false;
+		}
+		case CrocType_Instance: {
+			auto inst = cast(Instance*)f.obj;
+
+			if(f.step == 0)
+			{
+				f.step = 1;
+				f.want = CrocType_Class;
+				return true;
+			}
+			else if(f.step == 1)
+			{
+				auto parent = v.mClass;
+
+				if(!parent->isFrozen)
+					croc_eh_throwStd(t, "ValueError", "Malformed data (instance of an unfrozen class somehow exists)");
+
+				if(!Instance::finishCreate(inst, parent))
+					croc_eh_throwStd(t, "ValueError",
+						"Malformed data (instance size %" CROC_SIZE_T_FORMAT
+							" does not match base class size %" CROC_SIZE_T_FORMAT ")",
+						inst->memSize, sizeof(Instance) + parent->numInstanceFields * sizeof(Array::Slot));
+
+				v = Value::from(f.obj);
+
+				if(_readUInt8(t, s) != 0)
+				{
+					auto t_ = Thread::from(t);
+					auto slot = push(t_, v);
+
+					if(!croc_hasMethod(t, slot, "opDeserialize"))
+					{
+						croc_pushTypeString(t, slot);
+						croc_eh_throwStd(t, "ValueError",
+							"'%s' was serialized with opSerialize, but does not have a matching opDeserialize",
+							croc_getString(t, -1));
+					}
+
+					// It may read from the input directly, so nothing can be read ahead while it runs.
+					unread(t, s);
+					auto readAhead = s.readAhead;
+					s.readAhead = false;
+					croc_pushNull(t);
+					push(t_, s.input);
+					push(t_, s.deserializeFunc);
+					croc_methodCall(t, slot, "opDeserialize", 0);
+					s.readAhead = readAhead;
+					return false;
+				}
+
+				// step 2 is the fields, and step 3 the hidden fields
+				f.step = 2;
+				f.remaining = _length(t, s);
+			}
+			else if(!f.gotKey)
+			{
+				f.key = v;
+				f.gotKey = true;
+				f.want = AnyType;
+				return true;
+			}
+			else
+			{
+				auto name = f.key.mString;
+
+				if(f.step == 2)
+				{
+					if(inst->getField(name) == nullptr)
+					{
+						croc_eh_throwStd(t, "ValueError", "Malformed data (no field '%s' in instance of class '%s')",
+							name->toCString(), inst->parent->name->toCString());
+					}
+
+					inst->setField(*s.mem, name, v);
+				}
+				else
+				{
+					if(inst->getHiddenField(name) == nullptr)
+					{
+						croc_eh_throwStd(t, "ValueError",
+							"Malformed data (no hidden field '%s' in instance of class '%s')",
+							name->toCString(), inst->parent->name->toCString());
+					}
+
+					inst->setHiddenField(*s.mem, name, v);
+				}
+
+				f.gotKey = false;
+				f.remaining--;
+			}
+
+			if(f.remaining == 0 && f.step == 2)
+			{
+				f.step = 3;
+				f.remaining = _length(t, s);
+			}
+
+			if(f.remaining > 0)
+			{
+				f.want = CrocType_String;
+				return true;
+			}
+
+			v = Value::from(f.obj);
+			return false;
+		}
+		default: assert(false); return false; // dummy
+	}
+}
 
-	if(_readUInt8(t) != 0)
+Value deserialize(CrocThread* t, State& s, CrocType wanted)
+{
+	auto base = s.numFrames;
+	Value v;
+	auto done = readValue(t, s, wanted, v);
+
+	while(true)
 	{
-		push(t_, Value::from(v));
+		if(done)
+		{
+			if(s.numFrames == base)
+				return v;
+
+			checkType(t, s.frames[s.numFrames - 1].want, v);
+		}
+
+		auto frame = s.numFrames - 1;
 
-		if(!croc_hasMethod(t, -1, "opDeserialize"))
+		if(readNext(t, s, frame, v))
+			done = readValue(t, s, s.frames[frame].want, v);
+		else
 		{
-			croc_pushTypeString(t, -1);
-			croc_eh_throwStd(t, "ValueError",
-				"'%s' was serialized with opSerialize, but does not have a matching opDeserialize",
-				croc_getString(t, -1));
+			s.numFrames--;
+			done = true;
 		}
+	}
+}
 
-		croc_pushNull(t);
-		croc_field(t, 0, _Input);
-		croc_field(t, 0, _DeserializeFunc);
-		croc_methodCall(t, -4, "opDeserialize", 0);
+// Sets up everything but the buffer, the input and the things that go with it, and the transients.
+void initState(CrocThread* t, State& s)
+{
+	auto t_ = Thread::from(t);
+	s.mem = &t_->vm->mem;
+	s.vm = t_->vm;
+	s.buf = DArray<uint8_t>();
+	s.pos = 0;
+	s.end = 0;
+	s.readAhead = false;
+	s.objs = DArray<GCObject*>();
+	s.numObjs = 0;
+	s.frames = DArray<Frame>();
+	s.numFrames = 0;
+	s.input = Value::nullValue;
+	s.trans = Value::nullValue;
+	s.deserializeFunc = Value::nullValue;
+	s.readExact = Value::nullValue;
+	croc_memblock_new(t, 0); s.view = *getValue(t_, -1);     croc_popTop(t);
+	croc_table_new(t, 0);    s.dummyObj = *getValue(t_, -1); croc_popTop(t);
+}
+
+word_t _readGraph(CrocThread* t)
+{
+	auto t_ = Thread::from(t);
+
+	if(!croc_isValidIndex(t, 1))
+	{
+		croc_eh_throwStd(t, "ParamError", "Too few parameters (expected at least 1, got %" CROC_SIZE_T_FORMAT ")",
+			croc_getStackSize(t) - 1);
 	}
-	else
+
+	if(!croc_isTable(t, 1) && !croc_isInstance(t, 1))
+	{
+		croc_pushTypeString(t, 1);
+		croc_eh_throwStd(t, "TypeError", "Expected type 'table|instance' for parameter 1, not '%s'",
+			croc_getString(t, -1));
+	}
+
+	croc_field(t, 0, _State);
+
+	if(!croc_isNull(t, -1))
+	{
+		croc_eh_throwStd(t, "StateError",
+			"Attempting to call readGraph on a Deserializer which is already reading one");
+	}
+
+	croc_popTop(t);
+	croc_dup(t, 1);
+	croc_fielda(t, 0, _Trans);
+
+	t_->vm->disableGC();
+
+	State s;
+	initState(t, s);
+	s.buf = DArray<uint8_t>::alloc(*s.mem, ChunkSize);
+	croc_field(t, 0, _Input);           s.input = *getValue(t_, -1);           croc_popTop(t);
+	s.trans = *getValue(t_, 1);
+	croc_field(t, 0, _DeserializeFunc); s.deserializeFunc = *getValue(t_, -1); croc_popTop(t);
+	croc_ex_lookup(t, "stream.Stream.readExact"); s.readExact = *getValue(t_, -1); croc_popTop(t);
+
+	croc_pushNativeobj(t, &s);
+	croc_fielda(t, 0, _State);
+
+	auto slot = croc_pushNull(t);
+	auto failed = tryCode(t_, slot, [&]
 	{
-		auto numFields = _length(t);
+		croc_field(t, 0, _Input);
+		croc_pushNull(t);
+		croc_methodCall(t, -2, "seekable", 1);
+		s.readAhead = croc_isTrue(t, -1);
+		croc_popTop(t);
+
+		if(_readUInt8(t, s) != endianness())
+			croc_eh_throwStd(t, "ValueError", "Data was serialized with a different endianness");
+
+		auto bits = _integer(t, s);
 
-		for(uword i = 0; i < numFields; i++)
+		if(bits != cast(crocint)(sizeof(uword) * 8))
 		{
-			auto name = _deserializeString(t);
-			_deserialize(t);
+			croc_eh_throwStd(t, "ValueError",
+				"Data was serialized on a %" CROC_INTEGER_FORMAT "-bit platform; this is a %u-bit platform",
+				bits, cast(unsigned)(sizeof(uword) * 8));
+		}
 
-			if(v->getField(name) == nullptr)
-			{
-				croc_eh_throwStd(t, "ValueError", "Malformed data (no field '%s' in instance of class '%s')",
-					name->toCString(), parent->name->toCString());
-			}
+		auto size = _integer(t, s);
 
-			v->setField(t_->vm->mem, name, *getValue(t_, -1));
-			croc_popTop(t);
+		if(size != cast(crocint)sizeof(crocint))
+		{
+			croc_eh_throwStd(t, "ValueError",
+				"Data was serialized from a Croc build with %" CROC_INTEGER_FORMAT
+				"-bit ints; this build has %u-bit ints", size, cast(unsigned)sizeof(crocint));
 		}
 
-		auto numHiddenFields = _length(t);
+		size = _integer(t, s);
+
+		if(size != cast(crocint)sizeof(crocfloat))
+		{
+			croc_eh_throwStd(t, "ValueError",
+				"Data was serialized from a Croc build with %" CROC_INTEGER_FORMAT
+				"-bit floats; this build has %u-bit floats", size, cast(unsigned)sizeof(crocfloat));
+		}
 
-		for(uword i = 0; i < numHiddenFields; i++)
+		if(_integer(t, s) != SerialVersion)
 		{
-			auto name = _deserializeString(t);
-			_deserialize(t);
+			croc_eh_throwStd(t, "ValueError",
+				"Data was serialized from a Croc build with a different serial data format");
+		}
 
-			if(v->getHiddenField(name) == nullptr)
-			{
-				croc_eh_throwStd(t, "ValueError", "Malformed data (no hidden field '%s' in instance of class '%s')",
-					name->toCString(), parent->name->toCString());
-			}
+		push(t_, deserialize(t, s, AnyType));
+		unread(t, s);
+	});
 
-			v->setHiddenField(t_->vm->mem, name, *getValue(t_, -1));
-			croc_popTop(t);
+	t_->vm->enableGC();
+	croc_pushNull(t);
+	croc_fielda(t, 0, _State);
+	s.buf.free(*s.mem);
+	s.objs.free(*s.mem);
+	s.frames.free(*s.mem);
+
+	if(failed)
+		croc_eh_rethrow(t);
+
+	croc_remove(t, -2); // eh slot
+	croc_gc_maybeCollect(t);
+	return 1;
+}
+
+// The callback given to opDeserialize methods.
+word_t _deserializeCB(CrocThread* t)
+{
+	auto &s = getState(t);
+	auto wanted = AnyType;
+
+	if(croc_isValidIndex(t, 1) && !croc_isNull(t, 1))
+	{
+		auto name = croc_ex_checkStringParam(t, 1);
+		uword i = CrocType_Null;
+
+		for(; i <= CrocType_Upval; i++)
+		{
+			if(i != CrocType_Nativeobj && i != CrocType_Thread && strcmp(name, typeToString(cast(CrocType)i)) == 0)
+				break;
 		}
+
+		if(i > CrocType_Upval)
+			croc_eh_throwStd(t, "ValueError", "Invalid requested type '%s'", name);
+
+		wanted = cast(CrocType)i;
 	}
 
-	push(t_, Value::from(v));
+	push(Thread::from(t), deserialize(t, s, wanted));
 	return 1;
 }
 
-word_t _limitedSize(CrocThread* t, uword max, const char* msg)
+uword _limitedSize(CrocThread* t, State& s, uword max, const char* msg)
 {
-	auto ret = _length(t);
+	auto ret = _length(t, s);
 
 	if(ret >= max)
 		croc_eh_throwStd(t, "ValueError", "Malformed data (%s)", msg);
@@ -1121,77 +2173,93 @@ word_t _limitedSize(CrocThread* t, uword max, const char* msg)
 // 	pushThread(t, ret);
 // 	return 1;
 // }
-
-word_t _deserializeUpvalImpl(CrocThread* t)
-{
-	auto t_ = Thread::from(t);
-	auto uv = ALLOC_OBJ(t_->vm->mem, Upval);
-	uv->type = CrocType_Upval;
-	uv->nextuv = nullptr;
-	uv->value = &uv->closedValue;
-	_addObject(t, cast(GCObject*)uv);
-	_deserialize(t);
-	uv->closedValue = *getValue(t_, -1);
-	push(t_, Value::from(cast(GCObject*)uv));
-	return 1;
-}
 }
 
 CrocRegisterFunc _serializeFuncs[] =
 {
-	{"_nativeSerializeFunction", 1, &Ser::_nativeSerializeFunction},
-	{"_nativeSerializeFuncdef",  1, &Ser::_nativeSerializeFuncdef },
-	{"_nativeSerializeClass",    1, &Ser::_nativeSerializeClass   },
-	{"_nativeSerializeInstance", 1, &Ser::_nativeSerializeInstance},
-	// {"_nativeSerializeThread",   1, &Ser::_nativeSerializeThread  },
-	{"_serializeUpval",          1, &Ser::_serializeUpval       },
-	{"_instSize",                1, &Ser::_instSize               },
+	{"writeGraph", 2, &Ser::_writeGraph},
+	{"_serialize", 1, &Ser::_serialize },
 	{nullptr, 0, nullptr}
 };
 
 CrocRegisterFunc _deserializeFuncs[] =
 {
-	{"_deserializeNamespaceImpl", 0, &Deser::_deserializeNamespaceImpl},
-	{"_deserializeFunctionImpl",  0, &Deser::_deserializeFunctionImpl },
-	{"_deserializeFuncdefImpl",   0, &Deser::_deserializeFuncdefImpl  },
-	{"_deserializeClassImpl",     0, &Deser::_deserializeClassImpl    },
-	{"_deserializeInstanceImpl",  0, &Deser::_deserializeInstanceImpl },
-	// {"_deserializeThreadImpl",    0, &Deser::_deserializeThreadImpl   },
-	{"_deserializeUpvalImpl",     0, &Deser::_deserializeUpvalImpl    },
-	{"readGraph",                 1, &Deser::_readGraph               },
+	{"readGraph",       1, &Deser::_readGraph     },
+	{"_deserializeCB",  1, &Deser::_deserializeCB },
 	{nullptr, 0, nullptr}
 };
 }
 
+bool loadSerializedModule(CrocThread* t, DArray<const uint8_t> data, const char* name)
+{
+	using namespace Deser;
+
+	if(data.length < 4 || memcmp(data.ptr, "Croc", 4) != 0)
+		return false;
+
+	auto t_ = Thread::from(t);
+	t_->vm->disableGC();
+
+	// The data is only ever read out of the buffer, and with no input, need() never touches it.
+	State s;
+	initState(t, s);
+	s.buf = DArray<uint8_t>::n(const_cast<uint8_t*>(data.ptr), data.length);
+	s.pos = 4;
+	s.end = data.length;
+	croc_table_new(t, 0); s.trans = *getValue(t_, -1); croc_popTop(t);
+
+	bool matches = false;
+	auto slot = croc_pushNull(t);
+	auto failed = tryCode(t_, slot, [&]
+	{
+		matches =
+			_readUInt8(t, s) == endianness() &&
+			_integer(t, s) == cast(crocint)(sizeof(uword) * 8) &&
+			_integer(t, s) == cast(crocint)sizeof(crocint) &&
+			_integer(t, s) == cast(crocint)sizeof(crocfloat) &&
+			_integer(t, s) == SerialVersion;
+
+		if(!matches)
+			return;
+
+		auto ret = deserialize(t, s, CrocType_Array);
+		auto arr = ret.mArray->toDArray();
+
+		if(arr.length != 2 || arr[0].value.type != CrocType_String || arr[1].value.type != CrocType_Funcdef)
+			croc_eh_throwStd(t, "ValueError", "Data deserialized from module is not in the proper format");
+
+		auto def = arr[1].value.mFuncdef;
+
+		if(def->upvals.length != 0 || def->cachedFunc != nullptr)
+			croc_eh_throwStd(t, "ValueError", "Data deserialized from module has an invalid funcdef");
+
+		if(strcmp(name, arr[0].value.mString->toCString()) != 0)
+		{
+			croc_eh_throwStd(t, "ImportException", "Import name (%s) does not match name given in module statement (%s)",
+				name, arr[0].value.mString->toCString());
+		}
+
+		push(t_, Value::from(def));
+	});
+
+	t_->vm->enableGC();
+	s.objs.free(*s.mem);
+	s.frames.free(*s.mem);
+
+	if(failed)
+		croc_eh_rethrow(t);
+
+	if(matches)
+		croc_remove(t, -2); // eh slot
+	else
+		croc_popTop(t);
+
+	return matches;
+}
+
 void initSerializationLib(CrocThread* t)
 {
 	croc_table_new(t, 0);
-		croc_table_new(t, 0);
-			croc_pushInt(t, 254);                croc_fielda(t, -2, "transient");
-			croc_pushInt(t, 255);                croc_fielda(t, -2, "backref");
-
-			croc_pushInt(t, CrocType_Null);      croc_fielda(t, -2, "null");
-			croc_pushInt(t, CrocType_Bool);      croc_fielda(t, -2, "bool");
-			croc_pushInt(t, CrocType_Int);       croc_fielda(t, -2, "int");
-			croc_pushInt(t, CrocType_Float);     croc_fielda(t, -2, "float");
-
-			croc_pushInt(t, CrocType_Nativeobj); croc_fielda(t, -2, "nativeobj");
-			croc_pushInt(t, CrocType_String);    croc_fielda(t, -2, "string");
-			croc_pushInt(t, CrocType_Weakref);   croc_fielda(t, -2, "weakref");
-
-			croc_pushInt(t, CrocType_Table);     croc_fielda(t, -2, "table");
-			croc_pushInt(t, CrocType_Namespace); croc_fielda(t, -2, "namespace");
-			croc_pushInt(t, CrocType_Array);     croc_fielda(t, -2, "array");
-			croc_pushInt(t, CrocType_Memblock);  croc_fielda(t, -2, "memblock");
-			croc_pushInt(t, CrocType_Function);  croc_fielda(t, -2, "function");
-			croc_pushInt(t, CrocType_Funcdef);   croc_fielda(t, -2, "funcdef");
-			croc_pushInt(t, CrocType_Class);     croc_fielda(t, -2, "class");
-			croc_pushInt(t, CrocType_Instance);  croc_fielda(t, -2, "instance");
-			croc_pushInt(t, CrocType_Thread);    croc_fielda(t, -2, "thread");
-
-			croc_pushInt(t, CrocType_Upval);     croc_fielda(t, -2, "upval");
-		croc_fielda(t, -2, "TypeTags");
-
 		croc_table_new(t, 0);
 			croc_ex_registerFields(t, _serializeFuncs);
 		croc_fielda(t, -2, "ExtraSerializeMethods");
@@ -1200,17 +2268,8 @@ void initSerializationLib(CrocThread* t)
 			croc_ex_registerFields(t, _deserializeFuncs);
 		croc_fielda(t, -2, "ExtraDeserializeMethods");
 
-		union
-		{
-			uint32_t i;
-			char c[4];
-		} test = {0x01020304};
-
-		croc_pushInt(t, test.c[0] == 4 ? 0 : 1); // 1 for big-endian, 0 for little
-		croc_fielda(t, -2, "Endianness");
-
-		croc_pushInt(t, sizeof(uword) * 8);
-		croc_fielda(t, -2, "PlatformBits");
+		croc_pushInt(t, SerialVersion);
+		croc_fielda(t, -2, "FormatVersion");
 	croc_newGlobal(t, "_serializationtmp");
 
 	registerModuleFromString(t, "serialization", serialization_croc_text, "serialization.croc");
@@ -1220,4 +2279,4 @@ void initSerializationLib(CrocThread* t)
 	croc_removeKey(t, -2);
 	croc_popTop(t);
 }
-}
\ No newline at end of file
+}
@@ -56,21 +56,36 @@ word_t _nativeStreamCtor(CrocThread* t)
 	return 0;
 }
 
+// oscompat::read and write release the VM lock while they block, so another OS thread could try to resize the memblock
+// being read into or written from. Marking it as not owning its data for the duration makes that an error instead.
+// Exceptions don't unwind, so it has to be unpinned by hand before throwing.
+inline bool pinMemblock(Memblock* mb)
+{
+	auto owned = mb->ownData;
+	mb->ownData = false;
+	return owned;
+}
+
 word_t _nativeStreamRead(CrocThread* t)
 {
 	auto handle = cast(oscompat::FileHandle)cast(uword)croc_getNativeobj(t, 1);
 	auto offset = cast(uword)croc_getInt(t, 3);
 	auto size = cast(uword)croc_getInt(t, 4);
-	auto dest = cast(uint8_t*)croc_memblock_getData(t, 2) + offset;
+	auto mb = getMemblock(Thread::from(t), 2);
+	auto dest = mb->data.ptr + offset;
 
 	auto initial = size;
+	auto owned = pinMemblock(mb);
 
 	while(size > 0)
 	{
 		auto numRead = oscompat::read(t, handle, DArray<uint8_t>::n(dest, size));
 
 		if(numRead == -1)
+		{
+			mb->ownData = owned;
 			oscompat::throwIOEx(t);
+		}
 
 		if(numRead == 0)
 			break; // EOF
@@ -84,6 +99,7 @@ word_t _nativeStreamRead(CrocThread* t)
 		dest += numRead;
 	}
 
+	mb->ownData = owned;
 	croc_pushInt(t, initial - size);
 	return 1;
 }
@@ -93,18 +109,24 @@ word_t _nativeStreamWrite(CrocThread* t)
 	auto handle = cast(oscompat::FileHandle)cast(uword)croc_getNativeobj(t, 1);
 	auto offset = cast(uword)croc_getInt(t, 3);
 	auto size = cast(uword)croc_getInt(t, 4);
-	auto src = cast(uint8_t*)croc_memblock_getData(t, 2) + offset;
+	auto mb = getMemblock(Thread::from(t), 2);
+	auto src = mb->data.ptr + offset;
 
 	auto initial = size;
+	auto owned = pinMemblock(mb);
 
 	while(size > 0)
 	{
 		auto numWritten = oscompat::write(t, handle, DArray<uint8_t>::n(src, size));
 
 		if(numWritten == -1)
+		{
+			mb->ownData = owned;
 			oscompat::throwIOEx(t);
+		}
 		else if(numWritten == 0)
 		{
+			mb->ownData = owned;
 			croc_pushGlobal(t, "EOFException");
 			croc_pushNull(t);
 			croc_call(t, -2, 1);
@@ -115,6 +137,7 @@ word_t _nativeStreamWrite(CrocThread* t)
 		src += numWritten;
 	}
 
+	mb->ownData = owned;
 	croc_pushInt(t, initial);
 	return 1;
 }
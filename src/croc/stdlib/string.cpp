@@ -371,10 +371,11 @@ const StdlibRegisterInfo _ord_info =
 
 word_t _ord(CrocThread* t)
 {
-	auto s = checkCrocstrParam(t, 0);
-	auto cpLen = croc_len(t, 0); // we want the CP length, not the byte length
-	auto idx = croc_ex_optIndexParam(t, 1, cpLen, "codepoint", 0);
-	croc_pushInt(t, utf8CharAt(s, idx));
+	croc_ex_checkParam(t, 0, CrocType_String);
+	auto t_ = Thread::from(t);
+	auto s = getStringObj(t_, 0);
+	auto idx = croc_ex_optIndexParam(t, 1, s->cpLength, "codepoint", 0);
+	croc_pushInt(t, s->charAt(t_->vm, idx));
 	return 1;
 }
 
@@ -393,10 +394,13 @@ word_t _commonFind(CrocThread* t)
 
 	auto start = croc_ex_optIndexParam(t, 2, srcCPLen, "start", reverse ? (srcCPLen - 1) : 0);
 
+	auto t_ = Thread::from(t);
+	auto startByte = getStringObj(t_, 0)->cpIdxToByte(t_->vm, start);
+
 	if(reverse)
-		croc_pushInt(t, utf8ByteIdxToCP(src, strRLocate(src, pat, utf8CPIdxToByte(src, start))));
+		croc_pushInt(t, utf8ByteIdxToCP(src, strRLocate(src, pat, startByte)));
 	else
-		croc_pushInt(t, utf8ByteIdxToCP(src, strLocate(src, pat, utf8CPIdxToByte(src, start))));
+		croc_pushInt(t, utf8ByteIdxToCP(src, strLocate(src, pat, startByte)));
 
 	return 1;
 }
@@ -109,7 +109,7 @@ word_t _asciiEncodeInternal(CrocThread* t)
 	while(src < end)
 	{
 		if(*src < 0x80)
-			src++;
+			src += asciiPrefixLength(custring::n(src, end - src));
 		else
 		{
 			if(src != last)
@@ -156,7 +156,7 @@ word_t _asciiDecodeInternal(CrocThread* t)
 	while(src < end)
 	{
 		if(*src < 0x80)
-			src++;
+			src += asciiPrefixLength(custring::n(src, end - src));
 		else
 		{
 			if(src != last)
@@ -206,7 +206,7 @@ word_t _latin1EncodeInternal(CrocThread* t)
 	while(src < end)
 	{
 		if(*src < 0x80)
-			src++;
+			src += asciiPrefixLength(custring::n(src, end - src));
 		else
 		{
 			if(src != last)
@@ -255,7 +255,7 @@ word_t _latin1DecodeInternal(CrocThread* t)
 	while(src < end)
 	{
 		if(*src < 0x80)
-			src++;
+			src += asciiPrefixLength(custring::n(src, end - src));
 		else
 		{
 			if(src != last)
@@ -293,6 +293,17 @@ word_t _utf8DecodeInternal(CrocThread* t)
 	auto end = cast(const uchar*)mb.ptr + mb.length;
 	auto last = src;
 
+	// Most input is valid, in which case it can be turned into a string as-is.
+	uword cpLen;
+
+	if(verifyUtf8(custring::n(src, end - src), cpLen) == UtfError_OK)
+	{
+		auto t_ = Thread::from(t);
+		push(t_, Value::from(String::createUnverified(t_->vm, custring::n(src, end - src), cpLen)));
+		croc_pushInt(t, mb.length);
+		return 2;
+	}
+
 	CrocStrBuffer s;
 	croc_ex_buffer_init(t, &s);
 
@@ -300,7 +311,7 @@ word_t _utf8DecodeInternal(CrocThread* t)
 	{
 		if(*src < 0x80)
 		{
-			src++;
+			src += asciiPrefixLength(custring::n(src, end - src));
 			continue;
 		}
 
@@ -1,6 +1,7 @@
 
 #include "croc/api.h"
 #include "croc/internal/stack.hpp"
+#include "croc/stdlib/all.hpp"
 #include "croc/stdlib/helpers/register.hpp"
 #include "croc/types/base.hpp"
 
@@ -10,20 +11,30 @@ namespace
 {
 const StdlibRegisterInfo _new_info =
 {
-	Docstr(DFunc("new") DParam("func", "function")
+	Docstr(DFunc("new") DParam("func", "function") DParamD("stackful", "bool", "false")
 	R"(Create a new thread.
 
 	\param[func] will be the thread's main function.
+	\param[stackful] if \tt{true}, the thread gets a C stack of its own. A normal thread can't yield while there's a
+		native function or metamethod call on its call stack (say, inside a native \tt{opApply}), but a stackful one
+		can. Stackful threads cost more to create, so only use them when you need that.
 
-	\returns the new thread.)"),
+	\returns the new thread.
 
-	"new", 1
+	\throws[RuntimeError] if \tt{stackful} is \tt{true} but stackful threads aren't supported on this platform.)"),
+
+	"new", 2
 };
 
 word_t _new(CrocThread* t)
 {
 	croc_ex_checkParam(t, 1, CrocType_Function);
-	croc_thread_new(t, 1);
+
+	if(croc_ex_optBoolParam(t, 2, false))
+		croc_thread_newStackful(t, 1);
+	else
+		croc_thread_new(t, 1);
+
 	return 1;
 }
 
@@ -121,6 +132,21 @@ word_t _state(CrocThread* t)
 	return 1;
 }
 
+const StdlibRegisterInfo _isStackful_info =
+{
+	Docstr(DFunc("isStackful")
+	R"(\returns a bool indicating whether this thread was created as a stackful thread (see \link{new}).)"),
+
+	"isStackful", 0
+};
+
+word_t _isStackful(CrocThread* t)
+{
+	croc_ex_checkParam(t, 0, CrocType_Thread);
+	croc_pushBool(t, croc_thread_isStackful(croc_getThread(t, 0)));
+	return 1;
+}
+
 const StdlibRegisterInfo _isInitial_info =
 {
 	Docstr(DFunc("isInitial")
@@ -203,6 +229,7 @@ const StdlibRegister _methodFuncs[] =
 {
 	_DListItem(_reset),
 	_DListItem(_state),
+	_DListItem(_isStackful),
 	_DListItem(_isInitial),
 	_DListItem(_isRunning),
 	_DListItem(_isWaiting),
@@ -218,6 +245,9 @@ word loader(CrocThread* t)
 	croc_namespace_new(t, "thread");
 		registerFields(t, _methodFuncs);
 	croc_vm_setTypeMT(t, CrocType_Thread);
+
+	initThreadLib_Scheduler(t);
+	initThreadLib_OS(t);
 	return 0;
 }
 }
@@ -231,8 +261,10 @@ void initThreadLib(CrocThread* t)
 	croc_ex_doc_init(t, &doc, __FILE__);
 	croc_ex_doc_push(&doc,
 	DModule("thread")
-	R"()");
+	R"(Threads, a scheduler which runs many of them as cooperative tasks, and OS threads.)");
 		docFields(&doc, _globalFuncs);
+		docThreadLib_Scheduler(t, &doc);
+		docThreadLib_OS(t, &doc);
 
 		croc_vm_pushTypeMT(t, CrocType_Thread);
 			croc_ex_doc_push(&doc,
@@ -0,0 +1,384 @@
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "croc/api.h"
+#include "croc/internal/lock.hpp"
+#include "croc/internal/stack.hpp"
+#include "croc/stdlib/helpers/oscompat.hpp"
+#include "croc/stdlib/helpers/register.hpp"
+#include "croc/types/base.hpp"
+
+namespace croc
+{
+namespace
+{
+#include "croc/stdlib/thread_os.croc.hpp"
+
+// =====================================================================================================================
+// OS thread state
+
+// An OSThread has two hidden fields: a memblock holding its OSThreadInfo, and the Croc thread its function runs on. Once
+// the function finishes, its results (or the exception it threw) are left at the bottom of that thread's stack.
+const char* InfoField = "info";
+const char* ThreadField = "thread";
+
+// Registry table whose keys are the OSThreads which haven't finished yet, so that they (and everything the OS threads
+// are using) stay alive even if the program drops them.
+const char* Running = "thread.runningOSThreads";
+
+struct OSThreadInfo
+{
+	Thread* thread;
+	Instance* handle;
+	int doneFDs[2];   // a pipe whose write end is closed when the function finishes, making the read end readable
+	uword numResults;
+	bool done;
+	bool failed;
+};
+
+OSThreadInfo* getInfo(CrocThread* t, word slot)
+{
+	croc_hfield(t, slot, InfoField);
+
+	if(croc_isNull(t, -1))
+		croc_eh_throwStd(t, "StateError", "Attempting to use an OSThread which wasn't created by spawnOS");
+
+	auto ret = cast(OSThreadInfo*)croc_memblock_getData(t, -1);
+	croc_popTop(t);
+	return ret;
+}
+
+void closeFD(int& fd)
+{
+#ifndef _WIN32
+	if(fd != -1)
+	{
+		close(fd);
+		fd = -1;
+	}
+#else
+	(void)fd;
+#endif
+}
+
+// =====================================================================================================================
+// Running OS threads
+
+// The first function called on an OS thread's Croc thread. Calling the real function from a native one means it can't
+// yield, since there'd be nothing to yield to.
+word_t _osThreadBody(CrocThread* t)
+{
+	croc_pushNull(t);
+	croc_insert(t, 2);
+	return croc_call(t, 1, -1);
+}
+
+void osThreadMain(void* arg)
+{
+	auto info = cast(OSThreadInfo*)arg;
+	auto ot = info->thread;
+	CrocThread* t = *ot;
+	acquireVMLock(ot);
+
+	auto ret = croc_tryCall(t, 1, -1);
+	info->failed = ret == CrocCallRet_Error;
+	info->numResults = info->failed ? 1 : cast(uword)ret;
+	info->done = true;
+	closeFD(info->doneFDs[1]);
+
+	croc_ex_pushRegistryVar(t, Running);
+	push(ot, Value::from(info->handle));
+	croc_pushNull(t);
+	croc_idxa(t, -3);
+	croc_popTop(t);
+
+	// Nothing of the VM's can be touched after this, including info and ot, since the GC may free them at any time.
+	endOSThread(ot);
+}
+
+// =====================================================================================================================
+// Global funcs
+
+const StdlibRegisterInfo _spawnOS_info =
+{
+	Docstr(DFunc("spawnOS") DParam("func", "function") DVararg
+	R"(Calls a function on a new OS thread.
+
+	The OS threads using a VM take turns holding its lock, and only the holder can run Croc code, so this won't make
+	code that keeps the CPU busy any faster. What it's for is blocking work. The standard library's blocking functions
+	(reading and writing \link{stream.NativeStream}s, \link{os.Process.wait}, \link{os.sleep}, \link{waitRead} and
+	\link{waitWrite} outside of \link{run}, and so on) release the lock while they block, so the other OS threads keep
+	running in the meantime. An OS thread which has been kept waiting for the lock for a few milliseconds is handed it at
+	the holder's next loop iteration or function call.
+
+	\tt{func} runs on a Croc thread of its own, but not as a task, so it can't \tt{yield}, and the blocking functions
+	which suspend tasks (like \link{sleep} and \link{join}) can't be used in it. \link{waitRead} and \link{waitWrite}
+	work, by blocking the OS thread.
+
+	\param[func] is the function to call.
+	\param[vararg] are the arguments to call it with.
+
+	\returns an \link{OSThread} which can be used to wait for \tt{func} to finish and get what it returned.
+
+	\throws[StateError] if the host hasn't enabled the VM lock with \tt{croc_vm_enableLock}. (The command-line
+		interpreter does.)
+	\throws[OSException] if the OS thread couldn't be started.
+	\throws[RuntimeError] if OS threads aren't supported on this platform.)"),
+
+	"spawnOS", -1
+};
+
+word_t _spawnOS(CrocThread* t)
+{
+#ifdef _WIN32
+	return croc_eh_throwStd(t, "RuntimeError", "OS threads are not supported on this platform");
+#else
+	auto t_ = Thread::from(t);
+	auto vm = t_->vm;
+	auto numParams = croc_getStackSize(t) - 1;
+	croc_ex_checkParam(t, 1, CrocType_Function);
+
+	if(vm->lock == nullptr)
+		croc_eh_throwStd(t, "StateError", "OS threads can't be used unless the host has enabled the VM lock");
+
+	croc_pushUpval(t, 0);
+	croc_pushNull(t);
+	croc_call(t, -2, 1);
+	auto handle = croc_getStackSize(t) - 1;
+
+	croc_memblock_new(t, sizeof(OSThreadInfo));
+	auto info = cast(OSThreadInfo*)croc_memblock_getData(t, -1);
+	info->doneFDs[0] = info->doneFDs[1] = -1;
+	info->numResults = 0;
+	info->done = false;
+	info->failed = false;
+	croc_hfielda(t, handle, InfoField);
+
+	// From here on, the handle's finalizer will close the pipe.
+	if(pipe(info->doneFDs) == -1)
+	{
+		oscompat::pushSystemErrorMsg(t);
+		oscompat::throwOSEx(t);
+	}
+
+	fcntl(info->doneFDs[0], F_SETFD, FD_CLOEXEC);
+	fcntl(info->doneFDs[1], F_SETFD, FD_CLOEXEC);
+
+	auto ot = Thread::create(vm);
+	push(t_, Value::from(ot));
+	croc_hfielda(t, handle, ThreadField);
+	info->thread = ot;
+	info->handle = getInstance(t_, handle);
+
+	croc_function_new(*ot, "osThreadBody", -1, &_osThreadBody, 0);
+	croc_pushNull(*ot);
+
+	for(uword i = 1; i <= numParams; i++)
+		push(ot, *getValue(t_, i));
+
+	// The new OS thread can't do anything until this one releases the lock, so it doesn't matter that it's started
+	// before everything's ready.
+	if(!oscompat::startThread(t, &osThreadMain, info))
+		oscompat::throwOSEx(t);
+
+	beginOSThread(ot);
+
+	croc_ex_pushRegistryVar(t, Running);
+	croc_dup(t, handle);
+	croc_pushBool(t, true);
+	croc_idxa(t, -3);
+	croc_popTop(t);
+	return 1;
+#endif
+}
+
+const StdlibRegister _globalFuncs[] =
+{
+	_DListItem(_spawnOS),
+	_DListEnd
+};
+
+// =====================================================================================================================
+// OSThread
+
+const StdlibRegisterInfo OSThread_finalizer_info =
+{
+	Docstr(DFunc("finalizer")
+	R"(Closes the descriptors used to wait for the OS thread. OSThreads are kept alive until their OS threads finish, so
+	this only happens after that.)"),
+
+	"finalizer", 0
+};
+
+word_t OSThread_finalizer(CrocThread* t)
+{
+	croc_hfield(t, 0, InfoField);
+
+	if(!croc_isNull(t, -1))
+	{
+		auto info = cast(OSThreadInfo*)croc_memblock_getData(t, -1);
+		closeFD(info->doneFDs[0]);
+		closeFD(info->doneFDs[1]); // only still open if the OS thread couldn't be started
+	}
+
+	return 0;
+}
+
+const StdlibRegisterInfo OSThread_isDone_info =
+{
+	Docstr(DFunc("isDone")
+	R"(\returns whether the OS thread's function has returned or thrown an exception.)"),
+
+	"isDone", 0
+};
+
+word_t OSThread_isDone(CrocThread* t)
+{
+	croc_pushBool(t, getInfo(t, 0)->done);
+	return 1;
+}
+
+const StdlibRegister OSThread_methods[] =
+{
+	_DListItem(OSThread_finalizer),
+	_DListItem(OSThread_isDone),
+	_DListEnd
+};
+
+// The script wrapper for this is added to OSThread as join.
+const StdlibRegisterInfo OSThread_join_info =
+{
+	Docstr(DFunc("join")
+	R"(Waits for the OS thread's function to finish. If this is called from a task being run by \link{run}, only the
+	task waits; otherwise, the calling OS thread blocks (with the VM lock released).
+
+	This can be called any number of times, from any number of places.
+
+	\returns whatever the function returned.
+
+	\throws[any] whatever exception the function threw, if it threw one.)"),
+
+	"join", 0
+};
+
+const StdlibRegisterInfo OSThread_scriptMethods[] =
+{
+	OSThread_join_info,
+	{nullptr, nullptr, 0}
+};
+
+// Returns null if the function has finished. Otherwise returns a descriptor for the script wrapper to waitRead on, or
+// where that isn't supported, blocks until it's finished and then returns null.
+word_t _waitFDPrim(CrocThread* t)
+{
+	auto info = getInfo(t, 1);
+
+	if(info->done)
+	{
+		croc_pushNull(t);
+		return 1;
+	}
+
+#if defined(__linux__) || defined(_WIN32)
+	croc_pushInt(t, info->doneFDs[0]);
+#else
+	pollfd pfd;
+	pfd.fd = info->doneFDs[0];
+	pfd.events = POLLIN;
+
+	croc_vm_releaseLock(t);
+
+	while(poll(&pfd, 1, -1) == -1 && errno == EINTR)
+		continue;
+
+	croc_vm_acquireLock(t);
+	croc_pushNull(t);
+#endif
+	return 1;
+}
+
+word_t _resultPrim(CrocThread* t)
+{
+	auto t_ = Thread::from(t);
+	auto info = getInfo(t, 1);
+	assert(info->done);
+
+	croc_hfield(t, 1, ThreadField);
+	auto ot = getThread(t_, -1);
+
+	for(uword i = 0; i < info->numResults; i++)
+		push(t_, ot->stack[1 + i]);
+
+	if(info->failed)
+		croc_eh_throw(t);
+
+	return info->numResults;
+}
+
+const StdlibRegister _primFuncs[] =
+{
+	{{nullptr, "waitFD", 1}, &_waitFDPrim},
+	{{nullptr, "result", 1}, &_resultPrim},
+	_DListEnd
+};
+}
+
+// Called from the thread module's loader, with the module's namespace as the environment, after the scheduler's been
+// set up (join uses waitRead).
+void initThreadLib_OS(CrocThread* t)
+{
+	croc_table_new(t, 0);
+	croc_ex_setRegistryVar(t, Running);
+
+	croc_class_new(t, "OSThread", 0);
+	auto osThread = croc_getStackSize(t) - 1;
+		croc_pushNull(t); croc_class_addHField(t, osThread, InfoField);
+		croc_pushNull(t); croc_class_addHField(t, osThread, ThreadField);
+		registerMethods(t, OSThread_methods);
+
+	for(auto f = _globalFuncs; f->info.name != nullptr; f++)
+	{
+		croc_dup(t, osThread);
+		registerGlobal(t, *f, 1);
+	}
+
+	croc_pushStringn(t, thread_os_croc_text, thread_os_croc_length);
+	croc_compiler_compileStmtsEx(t, "thread_os.croc");
+	croc_function_newScript(t, -1);
+	croc_pushNull(t);
+
+	for(auto f = _primFuncs; f->info.name != nullptr; f++)
+		croc_function_new(t, f->info.name, f->info.maxParams, f->func, 0);
+
+	croc_call(t, -4, 1);
+	croc_class_addMethod(t, osThread, "join");
+	croc_popTop(t); // funcdef
+
+	croc_newGlobal(t, "OSThread");
+}
+
+#ifdef CROC_BUILTIN_DOCS
+void docThreadLib_OS(CrocThread* t, CrocDoc* doc)
+{
+	docFields(doc, _globalFuncs);
+
+	croc_field(t, -1, "OSThread");
+		croc_ex_doc_push(doc, DClass("OSThread")
+		R"(A handle to a function running on another OS thread, as returned by \link{spawnOS}. Constructing one yourself
+		gets you nothing useful.)");
+
+		docFields(doc, OSThread_methods);
+
+		for(auto f = OSThread_scriptMethods; f->docs != nullptr; f++)
+			croc_ex_docField(doc, f->docs);
+
+		croc_ex_doc_pop(doc, -1);
+	croc_popTop(t);
+}
+#endif
+}
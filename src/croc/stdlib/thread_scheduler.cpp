@@ -0,0 +1,1287 @@
+
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+#include "croc/api.h"
+#include "croc/internal/stack.hpp"
+#include "croc/stdlib/helpers/oscompat.hpp"
+#include "croc/stdlib/helpers/register.hpp"
+#include "croc/types/base.hpp"
+
+namespace croc
+{
+namespace
+{
+#include "croc/stdlib/thread_scheduler.croc.hpp"
+
+// =====================================================================================================================
+// Scheduler state
+
+// The scheduler's state is an array kept in the registry. Every scheduler function gets a weakref to it as its only
+// upvalue; the thread namespace is a type metatable, which outlives the registry when the VM is closed, so a strong
+// reference would keep any unfinished tasks (and everything they refer to) alive past the final collection. These are
+// the array's slots.
+//
+// Every unfinished task is kept alive by State_Tasks, so everywhere else tasks are referred to by nativeobjs (see
+// taskRef). Storing them as real references would mean the GC has to be told about every one that's overwritten, and
+// with tasks being shuffled between queues on every switch, that keeps the GC busy rescanning every thread's stack.
+enum
+{
+	State_Info,      // memblock holding a SchedInfo
+	State_Tasks,     // table whose keys are all the unfinished tasks
+	State_Ready,     // ring of (task, value, ok) triples waiting to be resumed
+	State_TimerInfo, // memblock holding a heap of TimerEntrys
+	State_Joiners,   // table mapping tasks to arrays of tasks waiting for them to finish
+	State_Readers,   // table mapping file descriptors to the task waiting for each to become readable
+	State_Writers,   // ditto, writable
+
+	State_NUM
+};
+
+const char* SchedulerState = "thread.scheduler";
+
+// A FIFO kept in a Croc array used as a circular buffer, so the GC can see what's in it. Each entry takes up a fixed
+// number of consecutive slots (the stride).
+struct Ring
+{
+	uword head;
+	uword count;
+};
+
+struct SchedInfo
+{
+	Ring ready;
+	Thread* current; // the task run() is resuming right now
+	Thread* runner;  // the bottom of the chain of threads that called run(); see runningHere
+	uword numTimers;
+	uint64_t timerSeq; // so that timers with the same deadline fire in the order they were set
+	uword numFDWaiters;
+	int epollFD;
+	bool running;
+	bool blocked; // set by a blocking primitive so run() knows not to requeue the task that called it
+};
+
+struct TimerEntry
+{
+	uint64_t deadline;
+	uint64_t seq;
+	Thread* task;
+};
+
+inline bool timerBefore(const TimerEntry& a, const TimerEntry& b)
+{
+	return a.deadline < b.deadline || (a.deadline == b.deadline && a.seq < b.seq);
+}
+
+// Returns null if the state has been collected, which only happens while the VM is being closed.
+Array* tryGetState(CrocThread* t)
+{
+	croc_pushUpval(t, 0);
+	auto obj = getValue(Thread::from(t), -1)->mWeakref->obj;
+	croc_popTop(t);
+	return cast(Array*)obj;
+}
+
+Array* getState(CrocThread* t)
+{
+	auto ret = tryGetState(t);
+
+	if(ret == nullptr)
+		croc_eh_throwStd(t, "StateError", "Attempting to use the scheduler after the VM has been closed");
+
+	return ret;
+}
+
+inline Value stateSlot(Array* st, uword slot)
+{
+	return st->data[slot].value;
+}
+
+inline SchedInfo* getInfo(Array* st)
+{
+	return cast(SchedInfo*)stateSlot(st, State_Info).mMemblock->data.ptr;
+}
+
+inline uword numTasks(Array* st)
+{
+	return stateSlot(st, State_Tasks).mTable->length();
+}
+
+inline Value taskRef(Thread* task)
+{
+	return Value::from(cast(void*)task);
+}
+
+inline Thread* getTask(Value v)
+{
+	return cast(Thread*)v.mNativeobj;
+}
+
+// Makes room for one more entry at the back of the ring, growing the array if needed, and returns the index of its
+// first slot.
+uword ringPush(Memory& mem, Array* arr, Ring& r, uword stride)
+{
+	auto cap = arr->length / stride;
+
+	if(r.count == cap)
+	{
+		auto newCap = cap < 8 ? 8 : cap * 2;
+		arr->resize(mem, newCap * stride);
+
+		// The entries which had wrapped around to the front now go after the old end.
+		for(uword i = 0; i < r.head * stride; i++)
+		{
+			arr->idxa(mem, cap * stride + i, arr->data[i].value);
+			arr->idxa(mem, i, Value::nullValue);
+		}
+
+		cap = newCap;
+	}
+
+	auto idx = (r.head + r.count) % cap;
+	r.count++;
+	return idx * stride;
+}
+
+inline uword ringFront(Ring& r, uword stride)
+{
+	return r.head * stride;
+}
+
+void ringPop(Memory& mem, Array* arr, Ring& r, uword stride)
+{
+	assert(r.count > 0);
+
+	for(uword i = 0; i < stride; i++)
+		arr->idxa(mem, r.head * stride + i, Value::nullValue);
+
+	r.head = (r.head + 1) % (arr->length / stride);
+	r.count--;
+}
+
+void makeReady(Memory& mem, Array* st, Thread* task, Value val, bool ok)
+{
+	auto info = getInfo(st);
+	auto ready = stateSlot(st, State_Ready).mArray;
+	auto idx = ringPush(mem, ready, info->ready, 3);
+	ready->idxa(mem, idx, taskRef(task));
+	ready->idxa(mem, idx + 1, val);
+	ready->idxa(mem, idx + 2, Value::from(ok));
+}
+
+// Each OS thread using the VM (see thread.spawnOS) has its own root thread at the bottom of its chain of resumers, so
+// this tells which OS thread t is running on.
+Thread* rootThread(Thread* t)
+{
+	while(t->threadThatResumedThis != nullptr)
+		t = t->threadThatResumedThis;
+
+	return t;
+}
+
+// Whether run() is running on the same OS thread as t. Code on other OS threads can't be suspended by it.
+bool runningHere(CrocThread* t, Array* st)
+{
+	auto info = getInfo(st);
+	return info->running && rootThread(Thread::from(t)) == info->runner;
+}
+
+// Only the task that run() is resuming can be suspended by the scheduler, and only if the script wrapper that called
+// the blocking primitive will be able to yield.
+void checkInTask(CrocThread* t, Array* st, const char* what)
+{
+	auto t_ = Thread::from(t);
+
+	if(getInfo(st)->current != t_)
+		croc_eh_throwStd(t, "StateError", "Attempting to %s outside of a task being run by thread.run", what);
+
+	if(t_->nativeCallDepth > 1 && t_->stackful == nullptr)
+		croc_eh_throwStd(t, "RuntimeError", "Attempting to %s across native / metamethod call boundary", what);
+}
+
+// =====================================================================================================================
+// Timers
+
+void addTimer(Memory& mem, Array* st, Thread* task, uint64_t deadline)
+{
+	auto info = getInfo(st);
+	auto entries = stateSlot(st, State_TimerInfo).mMemblock;
+	auto cap = entries->data.length / sizeof(TimerEntry);
+
+	if(info->numTimers == cap)
+		entries->resize(mem, (cap < 16 ? 16 : cap * 2) * sizeof(TimerEntry));
+
+	auto heap = cast(TimerEntry*)entries->data.ptr;
+	TimerEntry e = {deadline, info->timerSeq++, task};
+	auto i = info->numTimers++;
+
+	while(i > 0)
+	{
+		auto parent = (i - 1) / 2;
+
+		if(!timerBefore(e, heap[parent]))
+			break;
+
+		heap[i] = heap[parent];
+		i = parent;
+	}
+
+	heap[i] = e;
+}
+
+// Moves every task whose deadline has passed to the ready queue.
+void fireTimers(Memory& mem, Array* st, uint64_t now)
+{
+	auto info = getInfo(st);
+	auto heap = cast(TimerEntry*)stateSlot(st, State_TimerInfo).mMemblock->data.ptr;
+
+	while(info->numTimers > 0 && heap[0].deadline <= now)
+	{
+		makeReady(mem, st, heap[0].task, Value::nullValue, true);
+
+		auto n = --info->numTimers;
+		auto last = heap[n];
+		uword i = 0;
+
+		while(true)
+		{
+			auto child = i * 2 + 1;
+
+			if(child >= n)
+				break;
+
+			if(child + 1 < n && timerBefore(heap[child + 1], heap[child]))
+				child++;
+
+			if(!timerBefore(heap[child], last))
+				break;
+
+			heap[i] = heap[child];
+			i = child;
+		}
+
+		heap[i] = last;
+	}
+}
+
+// =====================================================================================================================
+// File descriptors
+
+#ifdef __linux__
+bool updateFD(CrocThread* t, Array* st, int fd);
+
+void ensureEpoll(CrocThread* t, Array* st)
+{
+	auto info = getInfo(st);
+
+	if(info->epollFD != -1)
+		return;
+
+	info->epollFD = epoll_create1(EPOLL_CLOEXEC);
+
+	if(info->epollFD == -1)
+	{
+		oscompat::pushSystemErrorMsg(t);
+		oscompat::throwOSEx(t);
+	}
+
+	// run() may have stopped (and closed the epoll instance) while tasks were still waiting.
+	const uword slots[] = {State_Readers, State_Writers};
+
+	for(auto slot: slots)
+	{
+		auto tab = stateSlot(st, slot).mTable;
+		size_t idx = 0;
+		Value* k;
+		Value* v;
+
+		while(tab->next(idx, k, v))
+			updateFD(t, st, cast(int)k->mInt);
+	}
+}
+
+void closeEpoll(SchedInfo* info)
+{
+	if(info->epollFD != -1)
+	{
+		close(info->epollFD);
+		info->epollFD = -1;
+	}
+}
+
+// Tells epoll what's being waited for on fd now. Returns false if fd can't be polled at all (regular files can't be,
+// but they're always ready anyway).
+bool updateFD(CrocThread* t, Array* st, int fd)
+{
+	ensureEpoll(t, st);
+	auto info = getInfo(st);
+	auto key = Value::from(cast(crocint)fd);
+
+	epoll_event ev;
+	ev.events = 0;
+	ev.data.fd = fd;
+
+	if(stateSlot(st, State_Readers).mTable->contains(key))
+		ev.events |= EPOLLIN | EPOLLRDHUP;
+
+	if(stateSlot(st, State_Writers).mTable->contains(key))
+		ev.events |= EPOLLOUT;
+
+	if(ev.events == 0)
+	{
+		epoll_ctl(info->epollFD, EPOLL_CTL_DEL, fd, nullptr);
+		return true;
+	}
+
+	if(epoll_ctl(info->epollFD, EPOLL_CTL_MOD, fd, &ev) == 0)
+		return true;
+
+	if(errno == ENOENT && epoll_ctl(info->epollFD, EPOLL_CTL_ADD, fd, &ev) == 0)
+		return true;
+
+	if(errno == EPERM)
+		return false;
+
+	oscompat::pushSystemErrorMsg(t);
+	oscompat::throwOSEx(t);
+	return false;
+}
+
+// ok is passed on to the woken task's waitRead/waitWrite, which throws if it's false (see cancelWaits).
+bool wakeFD(Memory& mem, Array* st, uword slot, int fd, bool ok = true)
+{
+	auto tab = stateSlot(st, slot).mTable;
+	auto key = Value::from(cast(crocint)fd);
+
+	if(auto v = tab->get(key))
+	{
+		makeReady(mem, st, getTask(*v), Value::nullValue, ok);
+		tab->idxa(mem, key, Value::nullValue);
+		getInfo(st)->numFDWaiters--;
+		return true;
+	}
+
+	return false;
+}
+
+// Waits up to timeout milliseconds (forever if -1) for any of the file descriptors being waited on to become ready,
+// and wakes up the tasks waiting on them. Other OS threads can use the VM while this waits.
+void pollFDs(CrocThread* t, Array* st, int timeout)
+{
+	auto& mem = Thread::from(t)->vm->mem;
+	ensureEpoll(t, st);
+
+	epoll_event events[64];
+	auto epollFD = getInfo(st)->epollFD;
+	croc_vm_releaseLock(t);
+	auto n = epoll_wait(epollFD, events, 64, timeout);
+	auto err = errno;
+	croc_vm_acquireLock(t);
+
+	if(n == -1)
+	{
+		if(err == EINTR)
+			return;
+
+		errno = err;
+		oscompat::pushSystemErrorMsg(t);
+		oscompat::throwOSEx(t);
+	}
+
+	for(int i = 0; i < n; i++)
+	{
+		auto fd = events[i].data.fd;
+		auto ev = events[i].events;
+
+		// Errors and hangups wake up everyone, so they can find out about it from whatever they do next.
+		if(ev & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+			wakeFD(mem, st, State_Readers, fd);
+
+		if(ev & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+			wakeFD(mem, st, State_Writers, fd);
+
+		updateFD(t, st, fd);
+	}
+}
+#else
+void closeEpoll(SchedInfo* info)
+{
+	(void)info;
+}
+
+void pollFDs(CrocThread* t, Array* st, int timeout)
+{
+	(void)t;
+	(void)st;
+	(void)timeout;
+}
+#endif
+
+// =====================================================================================================================
+// Running tasks
+
+void finishTask(CrocThread* t, Array* st, Thread* task)
+{
+	auto& mem = Thread::from(t)->vm->mem;
+	auto joiners = stateSlot(st, State_Joiners).mTable;
+	auto key = Value::from(task);
+
+	if(auto v = joiners->get(key))
+	{
+		for(auto &slot: v->mArray->toDArray())
+			makeReady(mem, st, getTask(slot.value), Value::nullValue, true);
+
+		joiners->idxa(mem, key, Value::nullValue);
+	}
+
+	// This has to come last, as it may be the only thing keeping the task alive.
+	stateSlot(st, State_Tasks).mTable->idxa(mem, key, Value::nullValue);
+}
+
+// Resumes the task at the front of the ready queue, and puts it back at the end if it just yielded instead of waiting
+// on something.
+void resumeNext(CrocThread* t, Array* st)
+{
+	auto t_ = Thread::from(t);
+	auto& mem = t_->vm->mem;
+	auto info = getInfo(st);
+	auto ready = stateSlot(st, State_Ready).mArray;
+	auto idx = ringFront(info->ready, 3);
+	auto task = getTask(ready->data[idx].value);
+
+	auto slot = push(t_, Value::from(task));
+	croc_pushNull(t);
+
+	if(task->state == CrocThreadState_Initial)
+	{
+		// Its arguments from spawn.
+		auto args = ready->data[idx + 1].value.mArray;
+
+		for(auto &arg: args->toDArray())
+			push(t_, arg.value);
+	}
+	else
+	{
+		push(t_, ready->data[idx + 1].value);
+		push(t_, ready->data[idx + 2].value);
+	}
+
+	ringPop(mem, ready, info->ready, 3);
+
+	if(task->state == CrocThreadState_Dead)
+	{
+		// Halted by someone else.
+		croc_setStackSize(t, slot);
+		finishTask(t, st, task);
+		return;
+	}
+
+	info->current = task;
+	info->blocked = false;
+	croc_call(t, slot, 0);
+	info->current = nullptr;
+
+	if(task->state == CrocThreadState_Dead)
+		finishTask(t, st, task);
+	else if(!info->blocked)
+		makeReady(mem, st, task, Value::nullValue, true);
+}
+
+word_t _runLoop(CrocThread* t)
+{
+	auto& mem = Thread::from(t)->vm->mem;
+	auto st = getState(t);
+	auto info = getInfo(st);
+
+	while(true)
+	{
+		// Tasks made ready during this round wait for the next one, so that the timers and file descriptors get
+		// checked regularly even if some tasks never block.
+		for(auto n = info->ready.count; n > 0; n--)
+			resumeNext(t, st);
+
+		if(info->ready.count == 0 && numTasks(st) == 0)
+			break;
+
+		int timeout = info->ready.count > 0 ? 0 : -1;
+
+		if(info->numTimers > 0)
+		{
+			auto now = oscompat::microTime();
+			fireTimers(mem, st, now);
+
+			if(info->ready.count > 0)
+				timeout = 0;
+			else if(info->numTimers > 0)
+			{
+				auto next = cast(TimerEntry*)stateSlot(st, State_TimerInfo).mMemblock->data.ptr;
+				auto wait = (next->deadline - now + 999) / 1000;
+				timeout = wait > 0x7FFFFFFF ? 0x7FFFFFFF : cast(int)wait;
+			}
+		}
+
+		if(info->numFDWaiters > 0)
+			pollFDs(t, st, timeout);
+		else if(timeout == -1)
+		{
+			croc_eh_throwStd(t, "StateError", "Deadlock: all %" CROC_SIZE_T_FORMAT " remaining tasks are blocked",
+				numTasks(st));
+		}
+		else if(timeout > 0)
+		{
+			croc_vm_releaseLock(t);
+			oscompat::sleep(timeout);
+			croc_vm_acquireLock(t);
+		}
+	}
+
+	return 0;
+}
+
+// =====================================================================================================================
+// Global funcs
+
+const StdlibRegisterInfo _spawn_info =
+{
+	Docstr(DFunc("spawn") DParam("task", "function|thread") DVararg
+	R"(Adds a new task to the scheduler. Tasks are threads which \link{run} resumes in turn, each one running until it
+	blocks on something (\link{sleep}, \link{join}, \link{waitRead} or \link{waitWrite}, or sending to or receiving
+	from a \link{Channel}) or just \tt{yield}s to let the others run.
+
+	\param[task] is either the function the task will run, in which case a new thread is created for it, or a thread in
+		the initial state. The latter lets you spawn stackful threads (see \link{new}) as tasks.
+	\param[vararg] are the arguments that will be passed to the task's function when it's first resumed.
+
+	\returns the task's thread.
+
+	\throws[StateError] if \tt{task} is a thread which isn't in the initial state.)"),
+
+	"spawn", -1
+};
+
+word_t _spawn(CrocThread* t)
+{
+	auto t_ = Thread::from(t);
+	auto st = getState(t);
+	auto numParams = croc_getStackSize(t) - 1;
+	croc_ex_checkAnyParam(t, 1);
+
+	if(croc_isThread(t, 1))
+	{
+		if(croc_thread_getState(croc_getThread(t, 1)) != CrocThreadState_Initial)
+			croc_eh_throwStd(t, "StateError", "Attempting to spawn a thread which has already been started");
+	}
+	else if(!croc_isFunction(t, 1))
+		croc_ex_paramTypeError(t, 1, "function|thread");
+
+	croc_array_newFromStack(t, numParams - 1);
+
+	if(croc_isFunction(t, 1))
+		croc_thread_new(t, 1);
+	else
+		croc_dup(t, 1);
+
+	auto task = getThread(t_, -1);
+	auto tasks = stateSlot(st, State_Tasks).mTable;
+
+	if(tasks->contains(Value::from(task)))
+		croc_eh_throwStd(t, "StateError", "Attempting to spawn a thread which is already a task");
+
+	tasks->idxa(t_->vm->mem, Value::from(task), Value::from(true));
+	makeReady(t_->vm->mem, st, task, *getValue(t_, -2), true);
+	return 1;
+}
+
+const StdlibRegisterInfo _run_info =
+{
+	Docstr(DFunc("run")
+	R"(Runs the tasks that have been \link{spawn}ed until all of them have finished. Tasks can spawn more tasks while
+	this is running.
+
+	Tasks are resumed in first-in, first-out order. Every so often (after each task that was ready has had a turn) any
+	expired \link{sleep}s are woken up and any file descriptors being waited on are polled; when no task is ready, this
+	waits for the next of those to happen without using the CPU.
+
+	\throws[StateError] if the scheduler is already running (that is, if you call this from a task), or if every
+		remaining task is waiting on something that can never happen, such as a \link{join} on a task which is itself
+		waiting on a \link{Channel} that nothing will send to.
+	\throws[any] if a task throws an exception, it propagates out of this function. The other tasks are left where they
+		were, and calling \tt{run} again will continue them.)"),
+
+	"run", 0
+};
+
+word_t _run(CrocThread* t)
+{
+	auto st = getState(t);
+	auto info = getInfo(st);
+
+	if(info->running)
+		croc_eh_throwStd(t, "StateError", "Attempting to run the scheduler while it's already running");
+
+	info->running = true;
+	info->runner = rootThread(Thread::from(t));
+	croc_pushUpval(t, 0);
+	croc_function_new(t, "runLoop", 0, &_runLoop, 1);
+	croc_pushNull(t);
+	auto failed = croc_tryCall(t, -2, 0) == CrocCallRet_Error;
+	info->running = false;
+	info->runner = nullptr;
+
+	auto cur = info->current;
+	info->current = nullptr;
+
+	if(cur && cur->state == CrocThreadState_Dead)
+		finishTask(t, st, cur);
+
+	closeEpoll(info);
+
+	if(failed)
+		croc_eh_rethrow(t);
+
+	return 0;
+}
+
+const StdlibRegisterInfo _cancelWaits_info =
+{
+	Docstr(DFunc("cancelWaits") DParam("fd", "int")
+	R"(Wakes up the tasks (if any) waiting on the OS file descriptor \tt{fd} with \link{waitRead} or \link{waitWrite},
+	making those calls throw a \tt{StateError}, and stops polling \tt{fd}.
+
+	Call this right before closing a descriptor that other tasks might be waiting on. Otherwise they'd never be woken
+	up, and the scheduler would go on polling whatever the descriptor's number gets reused for. The \tt{net} addon's
+	sockets do this when they're closed.
+
+	\throws[RangeError] if \tt{fd} is negative or too large.)"),
+
+	"cancelWaits", 1
+};
+
+word_t _cancelWaits(CrocThread* t)
+{
+	auto fd = croc_ex_checkIntParam(t, 1);
+
+	if(fd < 0 || fd > 0x7FFFFFFF)
+		croc_eh_throwStd(t, "RangeError", "Invalid file descriptor: %" CROC_INTEGER_FORMAT, fd);
+
+#ifdef __linux__
+	// Sockets' finalizers call this, and they can run after the state is gone when the VM is being closed.
+	auto st = tryGetState(t);
+
+	if(st == nullptr)
+		return 0;
+
+	auto& mem = Thread::from(t)->vm->mem;
+	auto wokeReader = wakeFD(mem, st, State_Readers, cast(int)fd, false);
+	auto wokeWriter = wakeFD(mem, st, State_Writers, cast(int)fd, false);
+	auto info = getInfo(st);
+
+	// Outside of run(), there's no epoll instance; it's rebuilt from the tables when run() starts again.
+	if((wokeReader || wokeWriter) && info->epollFD != -1)
+		epoll_ctl(info->epollFD, EPOLL_CTL_DEL, cast(int)fd, nullptr);
+#endif
+
+	return 0;
+}
+
+const StdlibRegister _globalFuncs[] =
+{
+	_DListItem(_spawn),
+	_DListItem(_run),
+	_DListItem(_cancelWaits),
+	_DListEnd
+};
+
+// These are the script wrappers in thread_scheduler.croc; they're documented here along with everything else.
+const StdlibRegisterInfo _sleep_info =
+{
+	Docstr(DFunc("sleep") DParam("ms", "int|float")
+	R"(Suspends the current task for at least \tt{ms} milliseconds while other tasks run. \tt{sleep(0)} just sends it
+	to the back of the ready queue, the same as a plain \tt{yield()}.
+
+	Like all the other blocking operations, this has to be called from the task's own code rather than from inside a
+	native function (such as a callback passed to \tt{array.apply}), unless the task is a stackful thread.
+
+	\throws[RangeError] if \tt{ms} is negative.
+	\throws[StateError] if not called from a task being run by \link{run}.)"),
+
+	"sleep", 1
+};
+
+const StdlibRegisterInfo _join_info =
+{
+	Docstr(DFunc("join") DParam("task", "thread")
+	R"(Suspends the current task until \tt{task} has finished. Returns immediately if it already has.
+
+	\throws[StateError] if not called from a task being run by \link{run}, or if \tt{task} is the current task.)"),
+
+	"join", 1
+};
+
+const StdlibRegisterInfo _waitRead_info =
+{
+	Docstr(DFunc("waitRead") DParam("fd", "int")
+	R"(Suspends the current task until the OS file descriptor \tt{fd} can be read from without blocking, or has hit an
+	error or been hung up on. Only one task can wait to read a given descriptor at a time. Descriptors which can't be
+	polled (such as regular files) are always considered ready.
+
+	If \link{run} isn't running at all (or is running on another OS thread; see \link{spawnOS}), this instead blocks the
+	whole OS thread until \tt{fd} is ready, so that code written to be run as a task (like the \tt{net} addon's sockets)
+	also works outside of one.
+
+	This is currently only supported on Linux, where it's implemented with epoll.
+
+	\throws[StateError] if called from outside a task while \link{run} is running, if another task is already
+		waiting to read \tt{fd}, or if the wait is cancelled by \link{cancelWaits}.
+	\throws[OSException] if \tt{fd} isn't a valid descriptor.
+	\throws[RuntimeError] if this isn't supported on this platform.)"),
+
+	"waitRead", 1
+};
+
+const StdlibRegisterInfo _waitWrite_info =
+{
+	Docstr(DFunc("waitWrite") DParam("fd", "int")
+	R"(Same as \link{waitRead}, but waits until \tt{fd} can be written to without blocking.)"),
+
+	"waitWrite", 1
+};
+
+const StdlibRegisterInfo _scriptFuncs[] =
+{
+	_sleep_info,
+	_join_info,
+	_waitRead_info,
+	_waitWrite_info,
+	{nullptr, nullptr, 0}
+};
+
+// =====================================================================================================================
+// Blocking primitives, given to the script wrappers
+
+word_t _sleepPrim(CrocThread* t)
+{
+	auto t_ = Thread::from(t);
+	auto st = getState(t);
+	checkInTask(t, st, "sleep");
+	auto ms = croc_ex_checkNumParam(t, 1);
+
+	if(ms < 0)
+		croc_eh_throwStd(t, "RangeError", "Invalid sleep time: %f", ms);
+
+	if(ms > 0)
+	{
+		addTimer(t_->vm->mem, st, t_, oscompat::microTime() + cast(uint64_t)(ms * 1000));
+		getInfo(st)->blocked = true;
+	}
+
+	return 0;
+}
+
+word_t _joinPrim(CrocThread* t)
+{
+	auto t_ = Thread::from(t);
+	auto& mem = t_->vm->mem;
+	auto st = getState(t);
+	checkInTask(t, st, "join a task");
+	croc_ex_checkParam(t, 1, CrocType_Thread);
+	auto task = getThread(t_, 1);
+
+	if(task == t_)
+		croc_eh_throwStd(t, "StateError", "A task cannot join itself");
+
+	if(task->state == CrocThreadState_Dead)
+	{
+		croc_pushBool(t, false);
+		return 1;
+	}
+
+	auto joiners = stateSlot(st, State_Joiners).mTable;
+
+	if(auto v = joiners->get(Value::from(task)))
+		v->mArray->append(mem, taskRef(t_));
+	else
+	{
+		auto waiting = Array::create(mem, 1);
+		waiting->idxa(mem, 0, taskRef(t_));
+		joiners->idxa(mem, Value::from(task), Value::from(waiting));
+	}
+
+	getInfo(st)->blocked = true;
+	croc_pushBool(t, true);
+	return 1;
+}
+
+word_t _waitFDPrim(CrocThread* t)
+{
+#ifdef __linux__
+	auto t_ = Thread::from(t);
+	auto st = getState(t);
+	auto fd = croc_ex_checkIntParam(t, 1);
+	auto write = croc_ex_checkBoolParam(t, 2);
+
+	if(fd < 0 || fd > 0x7FFFFFFF)
+		croc_eh_throwStd(t, "RangeError", "Invalid file descriptor: %" CROC_INTEGER_FORMAT, fd);
+
+	if(!runningHere(t, st))
+	{
+		// No scheduler to hand control to, so just block right here, letting other OS threads use the VM meanwhile.
+		pollfd pfd;
+		pfd.fd = cast(int)fd;
+		pfd.events = write ? POLLOUT : POLLIN;
+
+		croc_vm_releaseLock(t);
+		int ret;
+
+		do
+			ret = poll(&pfd, 1, -1);
+		while(ret == -1 && errno == EINTR);
+
+		auto err = errno;
+		croc_vm_acquireLock(t);
+
+		if(ret == -1)
+		{
+			errno = err;
+			oscompat::pushSystemErrorMsg(t);
+			oscompat::throwOSEx(t);
+		}
+
+		croc_pushBool(t, false);
+		return 1;
+	}
+
+	checkInTask(t, st, "wait on a file descriptor");
+
+	auto tab = stateSlot(st, write ? State_Writers : State_Readers).mTable;
+	auto key = Value::from(fd);
+
+	if(tab->contains(key))
+	{
+		croc_eh_throwStd(t, "StateError", "Another task is already waiting to %s file descriptor %" CROC_INTEGER_FORMAT,
+			write ? "write" : "read", fd);
+	}
+
+	tab->idxa(t_->vm->mem, key, taskRef(t_));
+
+	if(!updateFD(t, st, cast(int)fd))
+	{
+		tab->idxa(t_->vm->mem, key, Value::nullValue);
+		croc_pushBool(t, false);
+		return 1;
+	}
+
+	getInfo(st)->numFDWaiters++;
+	getInfo(st)->blocked = true;
+	croc_pushBool(t, true);
+	return 1;
+#else
+	return croc_eh_throwStd(t, "RuntimeError", "Waiting on file descriptors is not supported on this platform");
+#endif
+}
+
+// =====================================================================================================================
+// Channel
+
+// A channel's state is all kept in one array in one hidden field, so that getting at it only takes one lookup.
+const char* Data = "data";
+
+enum
+{
+	Chan_Info,      // memblock holding a ChannelInfo
+	Chan_Buffer,    // ring of buffered values
+	Chan_Senders,   // ring of (task, value) pairs waiting for room
+	Chan_Receivers, // ring of tasks waiting for a value
+
+	Chan_NUM
+};
+
+struct ChannelInfo
+{
+	uword capacity;
+	Ring buffer;
+	Ring senders;   // (task, value) pairs
+	Ring receivers;
+	bool closed;
+};
+
+struct Chan
+{
+	ChannelInfo* info;
+	Array* buffer;
+	Array* senders;
+	Array* receivers;
+};
+
+Chan getChan(CrocThread* t, word idx)
+{
+	croc_hfield(t, idx, Data);
+
+	if(!croc_isArray(t, -1))
+		croc_eh_throwStd(t, "StateError", "Attempting to operate on an uninitialized Channel");
+
+	auto data = getArray(Thread::from(t), -1);
+	croc_popTop(t);
+
+	Chan ret;
+	ret.info = cast(ChannelInfo*)data->data[Chan_Info].value.mMemblock->data.ptr;
+	ret.buffer = data->data[Chan_Buffer].value.mArray;
+	ret.senders = data->data[Chan_Senders].value.mArray;
+	ret.receivers = data->data[Chan_Receivers].value.mArray;
+	return ret;
+}
+
+const StdlibRegisterInfo Channel_constructor_info =
+{
+	Docstr(DFunc("constructor") DParamD("capacity", "int", "0")
+	R"(\param[capacity] is how many values can be sent without a receiver taking them before senders block. With the
+		default of 0, every send waits until a receiver takes its value.
+
+	\throws[RangeError] if \tt{capacity} is negative.)"),
+
+	"constructor", 1
+};
+
+word_t Channel_constructor(CrocThread* t)
+{
+	auto capacity = croc_ex_optIntParam(t, 1, 0);
+
+	if(capacity < 0)
+		croc_eh_throwStd(t, "RangeError", "Invalid capacity: %" CROC_INTEGER_FORMAT, capacity);
+
+	croc_array_new(t, Chan_NUM);
+		croc_memblock_new(t, sizeof(ChannelInfo));
+		auto info = cast(ChannelInfo*)croc_memblock_getData(t, -1);
+		info->capacity = cast(uword)capacity;
+		info->buffer = info->senders = info->receivers = Ring();
+		info->closed = false;
+		croc_idxai(t, -2, Chan_Info);
+		croc_array_new(t, cast(uword)capacity); croc_idxai(t, -2, Chan_Buffer);
+		croc_array_new(t, 0);                   croc_idxai(t, -2, Chan_Senders);
+		croc_array_new(t, 0);                   croc_idxai(t, -2, Chan_Receivers);
+	croc_hfielda(t, 0, Data);
+	return 0;
+}
+
+const StdlibRegisterInfo Channel_close_info =
+{
+	Docstr(DFunc("close")
+	R"(Closes this channel. Any tasks blocked on it are woken up: senders get a \tt{StateError} and receivers get
+	\tt{null, false}. Values which were already buffered can still be received. Closing a closed channel does nothing.)"),
+
+	"close", 0
+};
+
+word_t Channel_close(CrocThread* t)
+{
+	auto& mem = Thread::from(t)->vm->mem;
+	auto st = getState(t);
+	auto c = getChan(t, 0);
+
+	if(c.info->closed)
+		return 0;
+
+	c.info->closed = true;
+
+	while(c.info->receivers.count > 0)
+	{
+		auto idx = ringFront(c.info->receivers, 1);
+		makeReady(mem, st, getTask(c.receivers->data[idx].value), Value::nullValue, false);
+		ringPop(mem, c.receivers, c.info->receivers, 1);
+	}
+
+	while(c.info->senders.count > 0)
+	{
+		auto idx = ringFront(c.info->senders, 2);
+		makeReady(mem, st, getTask(c.senders->data[idx].value), Value::nullValue, false);
+		ringPop(mem, c.senders, c.info->senders, 2);
+	}
+
+	return 0;
+}
+
+const StdlibRegisterInfo Channel_isClosed_info =
+{
+	Docstr(DFunc("isClosed")
+	R"(\returns whether \link{close} has been called on this channel.)"),
+
+	"isClosed", 0
+};
+
+word_t Channel_isClosed(CrocThread* t)
+{
+	croc_pushBool(t, getChan(t, 0).info->closed);
+	return 1;
+}
+
+const StdlibRegisterInfo Channel_capacity_info =
+{
+	Docstr(DFunc("capacity")
+	R"(\returns the capacity this channel was created with.)"),
+
+	"capacity", 0
+};
+
+word_t Channel_capacity(CrocThread* t)
+{
+	croc_pushInt(t, cast(crocint)getChan(t, 0).info->capacity);
+	return 1;
+}
+
+const StdlibRegisterInfo Channel_opLength_info =
+{
+	Docstr(DFunc("opLength")
+	R"(\returns the number of values currently buffered in this channel.)"),
+
+	"opLength", 0
+};
+
+word_t Channel_opLength(CrocThread* t)
+{
+	croc_pushInt(t, cast(crocint)getChan(t, 0).info->buffer.count);
+	return 1;
+}
+
+const StdlibRegister Channel_methods[] =
+{
+	_DListItem(Channel_constructor),
+	_DListItem(Channel_close),
+	_DListItem(Channel_isClosed),
+	_DListItem(Channel_capacity),
+	_DListItem(Channel_opLength),
+	_DListEnd
+};
+
+// The script wrappers for these are added to Channel as send and recv.
+const StdlibRegisterInfo Channel_send_info =
+{
+	Docstr(DFunc("send") DParamAny("val")
+	R"(Sends \tt{val} on this channel. If a task is waiting in \link{recv}, it's handed \tt{val} directly; otherwise,
+	if the buffer has room, \tt{val} is buffered. Otherwise, the current task blocks until a receiver takes \tt{val}.
+
+	\throws[StateError] if the channel is closed (or gets closed while blocked), or if this would block but wasn't
+		called from a task being run by \link{run}.)"),
+
+	"send", 1
+};
+
+const StdlibRegisterInfo Channel_recv_info =
+{
+	Docstr(DFunc("recv")
+	R"(Receives a value from this channel, blocking the current task until one is sent if there are none.
+
+	\returns two values: the value received and \tt{true}, or \tt{null} and \tt{false} if the channel has been closed
+		and there are no buffered values left.
+
+	\throws[StateError] if this would block but wasn't called from a task being run by \link{run}.)"),
+
+	"recv", 0
+};
+
+const StdlibRegisterInfo Channel_scriptMethods[] =
+{
+	Channel_send_info,
+	Channel_recv_info,
+	{nullptr, nullptr, 0}
+};
+
+word_t _sendPrim(CrocThread* t)
+{
+	auto t_ = Thread::from(t);
+	auto& mem = t_->vm->mem;
+	auto st = getState(t);
+	croc_ex_checkParam(t, 1, CrocType_Instance);
+	croc_ex_checkAnyParam(t, 2);
+	auto c = getChan(t, 1);
+	auto val = *getValue(t_, 2);
+
+	if(c.info->closed)
+		croc_eh_throwStd(t, "StateError", "Attempting to send on a closed channel");
+
+	if(c.info->receivers.count > 0)
+	{
+		auto idx = ringFront(c.info->receivers, 1);
+		makeReady(mem, st, getTask(c.receivers->data[idx].value), val, true);
+		ringPop(mem, c.receivers, c.info->receivers, 1);
+		croc_pushBool(t, false);
+	}
+	else if(c.info->buffer.count < c.info->capacity)
+	{
+		auto idx = ringPush(mem, c.buffer, c.info->buffer, 1);
+		c.buffer->idxa(mem, idx, val);
+		croc_pushBool(t, false);
+	}
+	else
+	{
+		checkInTask(t, st, "block on a full channel");
+		auto idx = ringPush(mem, c.senders, c.info->senders, 2);
+		c.senders->idxa(mem, idx, taskRef(t_));
+		c.senders->idxa(mem, idx + 1, val);
+		getInfo(st)->blocked = true;
+		croc_pushBool(t, true);
+	}
+
+	return 1;
+}
+
+word_t _recvPrim(CrocThread* t)
+{
+	auto t_ = Thread::from(t);
+	auto& mem = t_->vm->mem;
+	auto st = getState(t);
+	croc_ex_checkParam(t, 1, CrocType_Instance);
+	auto c = getChan(t, 1);
+
+	if(c.info->buffer.count > 0)
+	{
+		croc_pushBool(t, false);
+		push(t_, c.buffer->data[ringFront(c.info->buffer, 1)].value);
+		croc_pushBool(t, true);
+		ringPop(mem, c.buffer, c.info->buffer, 1);
+
+		// A sender waiting for room can put its value in now.
+		if(c.info->senders.count > 0)
+		{
+			auto sidx = ringFront(c.info->senders, 2);
+			auto idx = ringPush(mem, c.buffer, c.info->buffer, 1);
+			c.buffer->idxa(mem, idx, c.senders->data[sidx + 1].value);
+			makeReady(mem, st, getTask(c.senders->data[sidx].value), Value::nullValue, true);
+			ringPop(mem, c.senders, c.info->senders, 2);
+		}
+
+		return 3;
+	}
+	else if(c.info->senders.count > 0)
+	{
+		auto sidx = ringFront(c.info->senders, 2);
+		croc_pushBool(t, false);
+		push(t_, c.senders->data[sidx + 1].value);
+		croc_pushBool(t, true);
+		makeReady(mem, st, getTask(c.senders->data[sidx].value), Value::nullValue, true);
+		ringPop(mem, c.senders, c.info->senders, 2);
+		return 3;
+	}
+	else if(c.info->closed)
+	{
+		croc_pushBool(t, false);
+		croc_pushNull(t);
+		croc_pushBool(t, false);
+		return 3;
+	}
+
+	checkInTask(t, st, "block on an empty channel");
+	auto idx = ringPush(mem, c.receivers, c.info->receivers, 1);
+	c.receivers->idxa(mem, idx, taskRef(t_));
+	getInfo(st)->blocked = true;
+	croc_pushBool(t, true);
+	return 1;
+}
+
+const StdlibRegister _primFuncs[] =
+{
+	{{nullptr, "sleep", 1}, &_sleepPrim},
+	{{nullptr, "join", 1}, &_joinPrim},
+	{{nullptr, "waitFD", 2}, &_waitFDPrim},
+	{{nullptr, "send", 2}, &_sendPrim},
+	{{nullptr, "recv", 1}, &_recvPrim},
+	_DListEnd
+};
+}
+
+// Called from the thread module's loader, with the module's namespace as the environment.
+void initThreadLib_Scheduler(CrocThread* t)
+{
+	croc_array_new(t, State_NUM);
+	auto state = croc_getStackSize(t) - 1;
+		croc_memblock_new(t, sizeof(SchedInfo));
+		auto info = cast(SchedInfo*)croc_memblock_getData(t, -1);
+		info->ready = Ring();
+		info->current = nullptr;
+		info->runner = nullptr;
+		info->numTimers = 0;
+		info->timerSeq = 0;
+		info->numFDWaiters = 0;
+		info->epollFD = -1;
+		info->running = false;
+		info->blocked = false;
+		croc_idxai(t, state, State_Info);
+		croc_table_new(t, 0);     croc_idxai(t, state, State_Tasks);
+		croc_array_new(t, 0);     croc_idxai(t, state, State_Ready);
+		croc_memblock_new(t, 0);  croc_idxai(t, state, State_TimerInfo);
+		croc_table_new(t, 0);     croc_idxai(t, state, State_Joiners);
+		croc_table_new(t, 0);     croc_idxai(t, state, State_Readers);
+		croc_table_new(t, 0);     croc_idxai(t, state, State_Writers);
+
+	// From here on, the state slot holds the weakref that the functions get as their upvalue.
+	croc_weakref_push(t, state);
+	croc_swapTop(t);
+	croc_ex_setRegistryVar(t, SchedulerState);
+
+	for(auto f = _globalFuncs; f->info.name != nullptr; f++)
+	{
+		croc_dup(t, state);
+		registerGlobal(t, *f, 1);
+	}
+
+	croc_class_new(t, "Channel", 0);
+	auto channel = croc_getStackSize(t) - 1;
+		croc_pushNull(t); croc_class_addHField(t, channel, Data);
+
+		for(auto f = Channel_methods; f->info.name != nullptr; f++)
+		{
+			croc_dup(t, state);
+			registerMethod(t, *f, 1);
+		}
+
+	// Run the script wrappers, which define the blocking functions as globals and return Channel's send and recv.
+	croc_pushStringn(t, thread_scheduler_croc_text, thread_scheduler_croc_length);
+	croc_compiler_compileStmtsEx(t, "thread_scheduler.croc");
+	croc_function_newScript(t, -1);
+	croc_pushNull(t);
+
+	for(auto f = _primFuncs; f->info.name != nullptr; f++)
+	{
+		croc_dup(t, state);
+		croc_function_new(t, f->info.name, f->info.maxParams, f->func, 1);
+	}
+
+	croc_call(t, -7, 2);
+	croc_class_addMethod(t, channel, "recv");
+	croc_class_addMethod(t, channel, "send");
+	croc_popTop(t); // funcdef
+
+	croc_newGlobal(t, "Channel");
+	croc_popTop(t); // state weakref
+}
+
+#ifdef CROC_BUILTIN_DOCS
+void docThreadLib_Scheduler(CrocThread* t, CrocDoc* doc)
+{
+	docFields(doc, _globalFuncs);
+
+	for(auto f = _scriptFuncs; f->docs != nullptr; f++)
+		croc_ex_docField(doc, f->docs);
+
+	croc_field(t, -1, "Channel");
+		croc_ex_doc_push(doc, DClass("Channel")
+		R"(A queue for passing values between tasks. Receivers block until there's something to receive, and senders
+		block until there's room in the buffer (or, for an unbuffered channel, until a receiver takes the value).
+		Waiting tasks are woken in the order they started waiting.
+
+		Sending and receiving only block when they have to, so they can also be used outside of tasks as long as they
+		don't need to; for example, you can fill a buffered channel before calling \link{run}.)");
+
+		docFields(doc, Channel_methods);
+
+		for(auto f = Channel_scriptMethods; f->docs != nullptr; f++)
+			croc_ex_docField(doc, f->docs);
+
+		croc_ex_doc_pop(doc, -1);
+	croc_popTop(t);
+}
+#endif
+}
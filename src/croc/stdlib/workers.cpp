@@ -0,0 +1,1028 @@
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "croc/api.h"
+#include "croc/internal/stack.hpp"
+#include "croc/stdlib/helpers/oscompat.hpp"
+#include "croc/stdlib/helpers/register.hpp"
+#include "croc/types/base.hpp"
+
+namespace croc
+{
+namespace
+{
+#include "croc/stdlib/workers.croc.hpp"
+
+#ifdef CROC_BUILTIN_DOCS
+const char* ModuleDocs =
+DModule("workers")
+R"(Runs Croc code on all of the machine's cores.
+
+A VM only ever runs Croc code on one OS thread at a time, so neither tasks nor \link{thread.spawnOS} will make
+CPU-bound code any faster. A \link{Pool} gets around that by giving each of its worker threads a whole VM of its own,
+which imports a module and then calls the functions in it that you ask for. Nothing is shared between the VMs, so the
+arguments and results are serialized with \link{serialization.serializeGraph} to get them from one to the other. This
+makes workers best suited for jobs which do a lot of work on a little data.
+
+Memblocks passed as arguments, or returned as results, are the exception: as long as the VMs allocate memory the same
+way (which the command-line interpreter's do), their data is handed over as-is instead of being copied. The memblock
+you passed or that the function returned is left empty, so pass a \tt{.dup()} of it if you want to keep it.
+
+\examples
+
+\code
+// primes.croc
+module primes
+
+function countPrimes(lo: int, hi: int)
+{
+	local count = 0
+
+	for(i; lo .. hi)
+	{
+		if(isPrime(i))
+			count++
+	}
+
+	return count
+}
+\endcode
+
+\code
+local pool = workers.Pool("primes")
+local futures = array.range(8).map(\i -> pool.submit("countPrimes", i * 1000000, (i + 1) * 1000000))
+writeln(futures.reduce(\total, f -> total + f.result(), 0))
+pool.close()
+\endcode)";
+#endif
+
+// =====================================================================================================================
+// Pool and job state
+
+// A Pool has a hidden field holding a memblock which holds a pointer to its PoolState, and a Future has the same for its
+// JobState. These are shared between the owning VM and the worker threads, so they're allocated with new and freed by
+// whichever of them lets go last.
+const char* StateField = "state";
+const char* JobField = "job";
+const char* PoolField = "pool";
+const char* ResultsField = "results";
+
+// Blocks of data handed between VMs. They're allocated with croc_DefaultMemFunc (so malloc), which is what worker VMs
+// use, so a worker can adopt one into a memblock without copying it, and so can the owning VM if it uses it too.
+typedef DArray<uint8_t> Buffer;
+
+void freeBuffer(Buffer& b)
+{
+	::free(b.ptr);
+	b = Buffer();
+}
+
+// A list of values on their way to another VM: what serializeGraph wrote of them, and the memblocks among them which
+// were moved instead (replaced by null in the serialized data).
+struct Payload
+{
+	struct Moved
+	{
+		uword index;
+		Buffer data;
+	};
+
+	Buffer data;
+	std::vector<Moved> moved;
+
+	void free()
+	{
+		freeBuffer(data);
+
+		for(auto &m: moved)
+			freeBuffer(m.data);
+
+		moved.clear();
+	}
+};
+
+struct JobState
+{
+	std::atomic<uword> refs; // one for the Future, one while it's in the pool's queue or being run
+	JobState* next;          // in the pool's queue
+	std::string funcName;
+	Payload args;
+	Payload results;
+	std::string error;       // the exception the function threw, if it did
+
+	std::mutex mutex;        // protects everything below
+	bool done;
+	int doneFDs[2];          // a pipe whose write end is closed when the job's done; only made if someone waits on it
+};
+
+struct PoolState
+{
+	std::atomic<uword> refs; // one for the Pool, one for each worker thread
+
+	// What the workers' VMs are set up with.
+	std::string module;
+	CrocUnsafeLib unsafeLibs;
+	CrocAddons addons;
+	std::string path;
+	std::string cacheDir;
+	bool hasCacheDir;
+
+	std::mutex mutex;        // protects everything below
+	std::condition_variable changed;
+	JobState* first;
+	JobState* last;
+	bool closing;
+	uword numWorkers;
+};
+
+void closeFD(int& fd)
+{
+#ifndef _WIN32
+	if(fd != -1)
+	{
+		close(fd);
+		fd = -1;
+	}
+#else
+	(void)fd;
+#endif
+}
+
+void releaseJob(JobState* job)
+{
+	if(--job->refs == 0)
+	{
+		closeFD(job->doneFDs[0]);
+		closeFD(job->doneFDs[1]);
+		job->args.free();
+		job->results.free();
+		delete job;
+	}
+}
+
+void releasePool(PoolState* pool)
+{
+	if(--pool->refs == 0)
+		delete pool;
+}
+
+void finishJob(JobState* job)
+{
+	{
+		std::lock_guard<std::mutex> guard(job->mutex);
+		job->done = true;
+		closeFD(job->doneFDs[1]);
+	}
+
+	releaseJob(job);
+}
+
+template<typename T>
+T* getState(CrocThread* t, word slot, const char* field, const char* className)
+{
+	croc_hfield(t, slot, field);
+
+	if(croc_isNull(t, -1))
+		croc_eh_throwStd(t, "StateError", "Attempting to use a %s which wasn't properly constructed", className);
+
+	auto ret = *cast(T**)croc_memblock_getData(t, -1);
+	croc_popTop(t);
+	return ret;
+}
+
+PoolState* getPool(CrocThread* t, word slot)
+{
+	return getState<PoolState>(t, slot, StateField, "Pool");
+}
+
+JobState* getJob(CrocThread* t, word slot)
+{
+	return getState<JobState>(t, slot, JobField, "Future");
+}
+
+// Sets the given hidden field of the instance at slot to a memblock holding ptr.
+void setState(CrocThread* t, word slot, const char* field, void* ptr)
+{
+	croc_memblock_new(t, sizeof(void*));
+	*cast(void**)croc_memblock_getData(t, -1) = ptr;
+	croc_hfielda(t, slot, field);
+}
+
+// =====================================================================================================================
+// Moving values between VMs
+
+bool usesDefaultMemFunc(CrocThread* t)
+{
+	return Thread::from(t)->vm->mem.memFunc == &croc_DefaultMemFunc;
+}
+
+// Takes the data out of the memblock at slot. If it can be moved, the memblock is left empty; otherwise it's copied.
+Buffer takeBuffer(CrocThread* t, word slot)
+{
+	auto t_ = Thread::from(t);
+	auto mb = getMemblock(t_, slot);
+
+	if(usesDefaultMemFunc(t) && mb->ownData)
+		return mb->release(t_->vm->mem);
+
+	auto ret = Buffer::n(cast(uint8_t*)malloc(mb->data.length), mb->data.length);
+	memcpy(ret.ptr, mb->data.ptr, ret.length);
+	return ret;
+}
+
+// Pushes a memblock holding b's data, and empties b.
+word pushBuffer(CrocThread* t, Buffer& b)
+{
+	auto t_ = Thread::from(t);
+	auto ret = croc_memblock_new(t, 0);
+
+	if(usesDefaultMemFunc(t))
+		getMemblock(t_, ret)->adopt(t_->vm->mem, b);
+	else
+	{
+		croc_lenai(t, ret, b.length);
+		memcpy(croc_memblock_getData(t, ret), b.ptr, b.length);
+		::free(b.ptr);
+	}
+
+	b = Buffer();
+	return ret;
+}
+
+// Fills p with the values in the array at slot arr.
+void pack(CrocThread* t, word arr, Payload& p)
+{
+	auto movable = usesDefaultMemFunc(t);
+	auto len = croc_len(t, arr);
+
+	// The memblocks are replaced by nulls in a copy, and only taken once the rest has been serialized, so that nothing's
+	// emptied if that fails.
+	auto copy = croc_array_new(t, len);
+
+	for(crocint i = 0; i < len; i++)
+	{
+		croc_idxi(t, arr, i);
+
+		if(movable && croc_isMemblock(t, -1) && getMemblock(Thread::from(t), -1)->ownData)
+		{
+			croc_popTop(t);
+			croc_pushNull(t);
+		}
+
+		croc_idxai(t, copy, i);
+	}
+
+	croc_ex_lookup(t, "stream.MemblockStream");
+	croc_pushNull(t);
+	croc_call(t, -2, 1);
+	auto stream = croc_getStackSize(t) - 1;
+
+	croc_ex_lookup(t, "serialization.serializeGraph");
+	croc_pushNull(t);
+	croc_dup(t, copy);
+	croc_table_new(t, 0);
+	croc_dup(t, stream);
+	croc_call(t, -5, 0);
+
+	croc_dup(t, stream);
+	croc_pushNull(t);
+	croc_methodCall(t, -2, "getBacking", 1);
+	p.data = takeBuffer(t, -1);
+
+	for(crocint i = 0; movable && i < len; i++)
+	{
+		croc_idxi(t, arr, i);
+		croc_idxi(t, copy, i);
+
+		if(croc_isMemblock(t, -2) && croc_isNull(t, -1))
+		{
+			Payload::Moved m = {cast(uword)i, takeBuffer(t, -2)};
+			p.moved.push_back(m);
+		}
+
+		croc_pop(t, 2);
+	}
+
+	croc_pop(t, 3);
+}
+
+// Pushes an array of the values in p, and empties it.
+word unpack(CrocThread* t, Payload& p)
+{
+	auto data = pushBuffer(t, p.data);
+
+	croc_ex_lookup(t, "serialization.deserializeGraph");
+	croc_pushNull(t);
+	croc_table_new(t, 0);
+	croc_ex_lookup(t, "stream.MemblockStream");
+	croc_pushNull(t);
+	croc_dup(t, data);
+	croc_call(t, -3, 1);
+	croc_call(t, -4, 1);
+
+	for(auto &m: p.moved)
+	{
+		pushBuffer(t, m.data);
+		croc_idxai(t, -2, m.index);
+	}
+
+	p.moved.clear();
+	croc_insertAndPop(t, data);
+	return data;
+}
+
+// =====================================================================================================================
+// Worker threads
+
+// Sets up a worker's VM like the pool's owner and imports the module. Param is the pool as a nativeobj. Returns the
+// module's namespace, and the namespace of its private jobs (see _runJob) or null.
+word_t _initWorker(CrocThread* t)
+{
+	auto pool = cast(PoolState*)croc_getNativeobj(t, 1);
+	croc_vm_loadUnsafeLibs(t, pool->unsafeLibs);
+	croc_vm_loadAddons(t, pool->addons);
+
+	croc_pushGlobal(t, "modules");
+	croc_pushString(t, pool->path.c_str());
+	croc_fielda(t, -2, "path");
+
+	if(pool->hasCacheDir)
+		croc_pushString(t, pool->cacheDir.c_str());
+	else
+		croc_pushNull(t);
+
+	croc_fielda(t, -2, "cacheDir");
+
+	// Every worker loads the same modules, so they may as well share the bytecode.
+	croc_pushBool(t, true);
+	croc_fielda(t, -2, "shareCode");
+	croc_popTop(t);
+
+	croc_ex_importNS(t, pool->module.c_str());
+
+	auto jobsName = pool->module + ".workerJobs";
+	croc_vm_pushRegistry(t);
+
+	if(croc_hasField(t, -1, jobsName.c_str()))
+		croc_field(t, -1, jobsName.c_str());
+	else
+		croc_pushNull(t);
+
+	croc_insertAndPop(t, -2);
+	return 2;
+}
+
+// Params are the job as a nativeobj, the module's namespace, and its private jobs. A module can give its workers
+// functions which aren't part of its interface by putting them in a namespace in the registry under the module's name
+// followed by ".workerJobs"; jobs whose function isn't in the module's namespace are looked up there.
+word_t _runJob(CrocThread* t)
+{
+	auto job = cast(JobState*)croc_getNativeobj(t, 1);
+	auto args = unpack(t, job->args);
+	auto numArgs = croc_len(t, args);
+
+	auto jobs = croc_isNull(t, 3) || croc_hasField(t, 2, job->funcName.c_str()) ? 2 : 3;
+	auto func = croc_field(t, jobs, job->funcName.c_str());
+	croc_pushNull(t);
+
+	for(crocint i = 0; i < numArgs; i++)
+		croc_idxi(t, args, i);
+
+	auto numResults = croc_call(t, func, -1);
+	auto results = croc_array_new(t, numResults);
+
+	for(uword i = 0; i < numResults; i++)
+	{
+		croc_dup(t, func + i);
+		croc_idxai(t, results, i);
+	}
+
+	pack(t, results, job->results);
+	return 0;
+}
+
+JobState* takeJob(PoolState* pool)
+{
+	std::unique_lock<std::mutex> guard(pool->mutex);
+
+	while(pool->first == nullptr && !pool->closing)
+		pool->changed.wait(guard);
+
+	auto ret = pool->first;
+
+	if(ret != nullptr)
+	{
+		pool->first = ret->next;
+
+		if(pool->first == nullptr)
+			pool->last = nullptr;
+	}
+
+	return ret;
+}
+
+void workerMain(void* arg)
+{
+	auto pool = cast(PoolState*)arg;
+	auto t = croc_vm_openDefault();
+	std::string initError;
+
+	croc_function_new(t, "initWorker", 1, &_initWorker, 0);
+	croc_pushNull(t);
+	croc_pushNativeobj(t, pool);
+
+	if(croc_tryCall(t, -3, 2) == CrocCallRet_Error)
+	{
+		croc_pushToString(t, -1);
+		initError = croc_getString(t, -1);
+		croc_pop(t, 2);
+	}
+
+	auto ns = croc_getStackSize(t) - 2;
+
+	while(auto job = takeJob(pool))
+	{
+		if(!initError.empty())
+			job->error = "The worker couldn't import '" + pool->module + "': " + initError;
+		else
+		{
+			croc_function_new(t, "runJob", 3, &_runJob, 0);
+			croc_pushNull(t);
+			croc_pushNativeobj(t, job);
+			croc_dup(t, ns);
+			croc_dup(t, ns + 1);
+
+			if(croc_tryCall(t, -5, 0) == CrocCallRet_Error)
+			{
+				croc_pushToString(t, -1);
+				job->error = croc_getString(t, -1);
+				croc_pop(t, 2);
+			}
+		}
+
+		finishJob(job);
+	}
+
+	croc_vm_close(t);
+	releasePool(pool);
+}
+
+// =====================================================================================================================
+// Global funcs
+
+const StdlibRegisterInfo _cpuCount_info =
+{
+	Docstr(DFunc("cpuCount")
+	R"(\returns the number of threads the machine can run at once (cores, or hardware threads where there are more of
+	those), or 1 if it can't be found out. This is how many workers a \link{Pool} gets by default.)"),
+
+	"cpuCount", 0
+};
+
+crocint cpuCount()
+{
+	auto ret = std::thread::hardware_concurrency();
+	return ret == 0 ? 1 : cast(crocint)ret;
+}
+
+word_t _cpuCount(CrocThread* t)
+{
+	croc_pushInt(t, cpuCount());
+	return 1;
+}
+
+const StdlibRegister _globalFuncs[] =
+{
+	_DListItem(_cpuCount),
+	_DListEnd
+};
+
+// =====================================================================================================================
+// Pool
+
+#ifdef CROC_BUILTIN_DOCS
+const char* PoolClassDocs =
+DClass("Pool")
+R"(A set of worker threads, each with its own VM which has imported the same module, and a queue of jobs for them.
+
+Jobs are calls to functions in that module. They're run in the order they were submitted, by whichever worker is free
+first.)";
+#endif
+
+const StdlibRegisterInfo _Pool_constructor_info =
+{
+	Docstr(DFunc("constructor") DParam("module", "string") DParamD("numWorkers", "int", "cpuCount()")
+	R"(Starts the worker threads.
+
+	Each worker's VM gets the same unsafe libraries and addons as this one, and the same \link{modules.path} and
+	\link{modules.cacheDir}, and then imports \tt{module}. They do that in the background, so this returns right away;
+	if the import fails, every job submitted to the pool fails with the import's error.
+
+	\param[module] is the name of the module the workers import.
+	\param[numWorkers] is how many worker threads to start.
+
+	\throws[RangeError] if \tt{numWorkers} is less than 1.
+	\throws[StateError] if this pool has already been constructed.
+	\throws[OSException] if a worker thread couldn't be started.
+	\throws[RuntimeError] if worker pools aren't supported on this platform.)"),
+
+	"constructor", 2
+};
+
+word_t _Pool_constructor(CrocThread* t)
+{
+#ifdef _WIN32
+	return croc_eh_throwStd(t, "RuntimeError", "Worker pools are not supported on this platform");
+#else
+	auto module = croc_ex_checkStringParam(t, 1);
+	auto numWorkers = croc_ex_optIntParam(t, 2, cpuCount());
+
+	if(numWorkers < 1)
+		croc_eh_throwStd(t, "RangeError", "Invalid number of workers: %" CROC_INTEGER_FORMAT, numWorkers);
+
+	croc_hfield(t, 0, StateField);
+
+	if(!croc_isNull(t, -1))
+		croc_eh_throwStd(t, "StateError", "Attempting to call constructor on an already-initialized Pool");
+
+	croc_popTop(t);
+
+	auto pool = new PoolState();
+	pool->refs = 1;
+	pool->module = module;
+	pool->unsafeLibs = croc_vm_loadedUnsafeLibs(t);
+	pool->addons = croc_vm_loadedAddons(t);
+
+	croc_ex_lookup(t, "modules.path");
+	pool->path = croc_getString(t, -1);
+	croc_popTop(t);
+
+	croc_ex_lookup(t, "modules.cacheDir");
+	pool->hasCacheDir = croc_isString(t, -1);
+
+	if(pool->hasCacheDir)
+		pool->cacheDir = croc_getString(t, -1);
+
+	croc_popTop(t);
+
+	pool->first = pool->last = nullptr;
+	pool->closing = false;
+	pool->numWorkers = 0;
+
+	// From here on, the finalizer will let go of the pool, and closing it lets any workers which were started exit.
+	setState(t, 0, StateField, pool);
+
+	for(crocint i = 0; i < numWorkers; i++)
+	{
+		pool->refs++;
+
+		if(!oscompat::startThread(t, &workerMain, pool))
+		{
+			pool->refs--;
+			oscompat::throwOSEx(t);
+		}
+
+		pool->numWorkers++;
+	}
+
+	return 0;
+#endif
+}
+
+const StdlibRegisterInfo _Pool_finalizer_info =
+{
+	Docstr(DFunc("finalizer")
+	R"(Closes the pool. Jobs which haven't been started yet are never run; nothing can be waiting on them, since a
+	\link{Future} keeps its pool alive.)"),
+
+	"finalizer", 0
+};
+
+word_t _Pool_finalizer(CrocThread* t)
+{
+	croc_hfield(t, 0, StateField);
+
+	if(croc_isNull(t, -1))
+		return 0;
+
+	auto pool = *cast(PoolState**)croc_memblock_getData(t, -1);
+	JobState* job;
+
+	{
+		std::lock_guard<std::mutex> guard(pool->mutex);
+		job = pool->first;
+		pool->first = pool->last = nullptr;
+		pool->closing = true;
+		pool->changed.notify_all();
+	}
+
+	while(job != nullptr)
+	{
+		auto next = job->next;
+		job->error = "The pool was closed before the job was started";
+		finishJob(job);
+		job = next;
+	}
+
+	releasePool(pool);
+	return 0;
+}
+
+const StdlibRegisterInfo _Pool_submit_info =
+{
+	Docstr(DFunc("submit") DParam("func", "string") DVararg
+	R"(Queues up a call to one of the functions in the pool's module.
+
+	\param[func] is the name of the function.
+	\param[vararg] are the arguments to call it with. They have to be serializable without any transients, and
+		memblocks among them are moved to the worker as described in the module docs.
+
+	\returns a \link{Future} for the results.
+
+	\throws[StateError] if the pool has been closed.)"),
+
+	"submit", -1
+};
+
+word_t _Pool_submit(CrocThread* t)
+{
+	auto pool = getPool(t, 0);
+	auto funcName = croc_ex_checkStringParam(t, 1);
+	auto numArgs = croc_getStackSize(t) - 2;
+
+	if(pool->closing)
+		croc_eh_throwStd(t, "StateError", "Attempting to submit a job to a closed Pool");
+
+	auto args = croc_array_new(t, numArgs);
+
+	for(uword i = 0; i < numArgs; i++)
+	{
+		croc_dup(t, 2 + i);
+		croc_idxai(t, args, i);
+	}
+
+	croc_pushUpval(t, 0);
+	croc_pushNull(t);
+	croc_call(t, -2, 1);
+	auto future = croc_getStackSize(t) - 1;
+
+	auto job = new JobState();
+	job->refs = 1;
+	job->next = nullptr;
+	job->funcName = funcName;
+	job->done = false;
+	job->doneFDs[0] = job->doneFDs[1] = -1;
+
+	// From here on, the Future's finalizer will let go of the job.
+	setState(t, future, JobField, job);
+	croc_dup(t, 0);
+	croc_hfielda(t, future, PoolField);
+
+	pack(t, args, job->args);
+
+	job->refs++;
+
+	{
+		std::lock_guard<std::mutex> guard(pool->mutex);
+
+		if(pool->last == nullptr)
+			pool->first = job;
+		else
+			pool->last->next = job;
+
+		pool->last = job;
+		pool->changed.notify_one();
+	}
+
+	return 1;
+}
+
+const StdlibRegisterInfo _Pool_close_info =
+{
+	Docstr(DFunc("close")
+	R"(Stops the pool from taking any more jobs. The ones already submitted still run, and once they have, the workers
+	exit and their VMs are closed. Calling this more than once does nothing.)"),
+
+	"close", 0
+};
+
+word_t _Pool_close(CrocThread* t)
+{
+	auto pool = getPool(t, 0);
+	std::lock_guard<std::mutex> guard(pool->mutex);
+	pool->closing = true;
+	pool->changed.notify_all();
+	return 0;
+}
+
+const StdlibRegisterInfo _Pool_numWorkers_info =
+{
+	Docstr(DFunc("numWorkers")
+	R"(\returns how many worker threads the pool has.)"),
+
+	"numWorkers", 0
+};
+
+word_t _Pool_numWorkers(CrocThread* t)
+{
+	croc_pushInt(t, getPool(t, 0)->numWorkers);
+	return 1;
+}
+
+const StdlibRegister _Pool_methods[] =
+{
+	_DListItem(_Pool_constructor),
+	_DListItem(_Pool_finalizer),
+	_DListItem(_Pool_close),
+	_DListItem(_Pool_numWorkers),
+	_DListEnd
+};
+
+// These get the Future class as an upvalue.
+const StdlibRegister _Pool_uvMethods[] =
+{
+	_DListItem(_Pool_submit),
+	_DListEnd
+};
+
+// The script wrapper for this is added to Pool as map.
+const StdlibRegisterInfo _Pool_map_info =
+{
+	Docstr(DFunc("map") DParam("func", "string") DParam("items", "array")
+	R"(Calls a function in the pool's module once for each item of an array, spread across the workers, and waits for
+	them all to finish. This waits the same way \link{Future.result} does.
+
+	\param[func] is the name of the function, which is called with one item each time.
+	\param[items] is the array of items.
+
+	\returns a new array of the first value each call returned, in the same order as \tt{items}.
+
+	\throws[RuntimeError] if any of the calls threw an exception.)"),
+
+	"map", 2
+};
+
+// =====================================================================================================================
+// Future
+
+#ifdef CROC_BUILTIN_DOCS
+const char* FutureClassDocs =
+DClass("Future")
+R"(The results of a job submitted to a \link{Pool}, which will be there once a worker has run it. Constructing one
+yourself gets you nothing useful.)";
+#endif
+
+const StdlibRegisterInfo _Future_finalizer_info =
+{
+	Docstr(DFunc("finalizer")
+	R"(Lets go of the job's state.)"),
+
+	"finalizer", 0
+};
+
+word_t _Future_finalizer(CrocThread* t)
+{
+	croc_hfield(t, 0, JobField);
+
+	if(!croc_isNull(t, -1))
+		releaseJob(*cast(JobState**)croc_memblock_getData(t, -1));
+
+	return 0;
+}
+
+const StdlibRegisterInfo _Future_isDone_info =
+{
+	Docstr(DFunc("isDone")
+	R"(\returns whether the job has finished, either by returning or by throwing an exception.)"),
+
+	"isDone", 0
+};
+
+word_t _Future_isDone(CrocThread* t)
+{
+	auto job = getJob(t, 0);
+	bool done;
+
+	{
+		std::lock_guard<std::mutex> guard(job->mutex);
+		done = job->done;
+	}
+
+	croc_pushBool(t, done);
+	return 1;
+}
+
+const StdlibRegister _Future_methods[] =
+{
+	_DListItem(_Future_finalizer),
+	_DListItem(_Future_isDone),
+	_DListEnd
+};
+
+// The script wrapper for this is added to Future as result.
+const StdlibRegisterInfo _Future_result_info =
+{
+	Docstr(DFunc("result")
+	R"(Waits for the job to finish. If this is called from a task being run by \link{thread.run}, only the task waits;
+	otherwise, the calling OS thread blocks (with the VM lock released).
+
+	This can be called any number of times, and returns the same values each time.
+
+	\returns whatever the function returned.
+
+	\throws[RuntimeError] if the function threw an exception, with that exception's description as its message. (The
+		exception itself stays in the worker's VM.))"),
+
+	"result", 0
+};
+
+// Returns null if the job has finished. Otherwise returns a descriptor for the script wrapper to waitRead on, or where
+// that isn't supported, blocks until it's finished and then returns null.
+word_t _waitFDPrim(CrocThread* t)
+{
+#ifdef _WIN32
+	(void)getJob(t, 1);
+	croc_pushNull(t);
+	return 1;
+#else
+	auto job = getJob(t, 1);
+	bool needPipe;
+
+	{
+		std::lock_guard<std::mutex> guard(job->mutex);
+
+		if(job->done)
+		{
+			croc_pushNull(t);
+			return 1;
+		}
+
+		needPipe = job->doneFDs[0] == -1;
+	}
+
+	// Only this VM waits on the job, so nothing else can be making the pipe meanwhile. It's made outside the lock so
+	// that the lock isn't held if it throws.
+	if(needPipe)
+	{
+		int fds[2];
+
+		if(pipe(fds) == -1)
+		{
+			oscompat::pushSystemErrorMsg(t);
+			oscompat::throwOSEx(t);
+		}
+
+		fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+		fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+		std::lock_guard<std::mutex> guard(job->mutex);
+
+		if(job->done)
+		{
+			closeFD(fds[0]);
+			closeFD(fds[1]);
+			croc_pushNull(t);
+			return 1;
+		}
+
+		job->doneFDs[0] = fds[0];
+		job->doneFDs[1] = fds[1];
+	}
+
+#ifdef __linux__
+	croc_pushInt(t, job->doneFDs[0]);
+#else
+	pollfd pfd;
+	pfd.fd = job->doneFDs[0];
+	pfd.events = POLLIN;
+
+	croc_vm_releaseLock(t);
+
+	while(poll(&pfd, 1, -1) == -1 && errno == EINTR)
+		continue;
+
+	croc_vm_acquireLock(t);
+	croc_pushNull(t);
+#endif
+	return 1;
+#endif
+}
+
+word_t _resultPrim(CrocThread* t)
+{
+	auto job = getJob(t, 1);
+	croc_hfield(t, 1, ResultsField);
+
+	if(croc_isNull(t, -1))
+	{
+		croc_popTop(t);
+		assert(job->done);
+
+		if(!job->error.empty())
+			croc_eh_throwStd(t, "RuntimeError", "Job '%s' failed: %s", job->funcName.c_str(), job->error.c_str());
+
+		unpack(t, job->results);
+		croc_dup(t, -1);
+		croc_hfielda(t, 1, ResultsField);
+	}
+
+	auto results = croc_getStackSize(t) - 1;
+	auto numResults = croc_len(t, results);
+
+	for(crocint i = 0; i < numResults; i++)
+		croc_idxi(t, results, i);
+
+	return numResults;
+}
+
+const StdlibRegister _primFuncs[] =
+{
+	{{nullptr, "waitFD", 1}, &_waitFDPrim},
+	{{nullptr, "result", 1}, &_resultPrim},
+	_DListEnd
+};
+
+word loader(CrocThread* t)
+{
+	registerGlobals(t, _globalFuncs);
+
+	croc_class_new(t, "Future", 0);
+	auto future = croc_getStackSize(t) - 1;
+		croc_pushNull(t); croc_class_addHField(t, future, JobField);
+		croc_pushNull(t); croc_class_addHField(t, future, PoolField);
+		croc_pushNull(t); croc_class_addHField(t, future, ResultsField);
+		registerMethods(t, _Future_methods);
+
+	croc_class_new(t, "Pool", 0);
+	auto pool = croc_getStackSize(t) - 1;
+		croc_pushNull(t); croc_class_addHField(t, pool, StateField);
+		registerMethods(t, _Pool_methods);
+
+		for(auto f = _Pool_uvMethods; f->info.name != nullptr; f++)
+		{
+			croc_dup(t, future);
+			registerMethod(t, *f, 1);
+		}
+
+	croc_pushStringn(t, workers_croc_text, workers_croc_length);
+	croc_compiler_compileStmtsEx(t, "workers.croc");
+	croc_function_newScript(t, -1);
+	croc_pushNull(t);
+
+	for(auto f = _primFuncs; f->info.name != nullptr; f++)
+		croc_function_new(t, f->info.name, f->info.maxParams, f->func, 0);
+
+	croc_call(t, -4, 2);
+	croc_class_addMethod(t, pool, "map");
+	croc_class_addMethod(t, future, "result");
+	croc_popTop(t); // funcdef
+
+	croc_newGlobal(t, "Pool");
+	croc_newGlobal(t, "Future");
+	return 0;
+}
+}
+
+void initWorkersLib(CrocThread* t)
+{
+	registerModule(t, "workers", &loader);
+	croc_pushGlobal(t, "workers");
+#ifdef CROC_BUILTIN_DOCS
+	CrocDoc doc;
+	croc_ex_doc_init(t, &doc, __FILE__);
+	croc_ex_doc_push(&doc, ModuleDocs);
+		docFields(&doc, _globalFuncs);
+
+		croc_field(t, -1, "Pool");
+		croc_ex_doc_push(&doc, PoolClassDocs);
+			docFields(&doc, _Pool_methods);
+			docFields(&doc, _Pool_uvMethods);
+			croc_ex_docField(&doc, _Pool_map_info.docs);
+		croc_ex_doc_pop(&doc, -1);
+		croc_popTop(t);
+
+		croc_field(t, -1, "Future");
+		croc_ex_doc_push(&doc, FutureClassDocs);
+			docFields(&doc, _Future_methods);
+			croc_ex_docField(&doc, _Future_result_info.docs);
+		croc_ex_doc_pop(&doc, -1);
+		croc_popTop(t);
+	croc_ex_doc_pop(&doc, -1);
+	croc_ex_doc_finish(&doc);
+#endif
+	croc_popTop(t);
+}
+}
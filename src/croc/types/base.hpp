@@ -1,17 +1,25 @@
 #ifndef CROC_TYPES_BASE_HPP
 #define CROC_TYPES_BASE_HPP
 
+#include <atomic>
 #include <setjmp.h>
 #include <stddef.h>
 
+#ifndef _WIN32
+#include <ucontext.h>
+#define CROC_STACKFUL_THREADS
+#endif
+
 #include "croc/apitypes.h"
 #include "croc/base/darray.hpp"
 #include "croc/base/deque.hpp"
 #include "croc/base/hash.hpp"
 #include "croc/base/memory.hpp"
+#include "croc/base/metamethods.hpp"
 #include "croc/base/opcodes.hpp"
 #include "croc/base/sanity.hpp"
 #include "croc/util/rng.hpp"
+#include "croc/util/str.hpp"
 #include "croc/util/utf.hpp"
 
 namespace croc
@@ -44,6 +52,9 @@ namespace croc
 	struct Instance;
 	struct Thread;
 	struct Upval;
+	struct StackfulContext;
+	struct NativeEHFrame;
+	struct VMLock;
 
 	// ========================================
 	// Value
@@ -172,20 +183,47 @@ namespace croc
 #undef MAKE_SET
 	};
 
+	// The backing store for strings built up by repeated concatenation. Every string which uses a rope is a prefix of
+	// the rope's data, so appending onto the longest one (the one whose length is `used`) can be done in place instead
+	// of copying the whole thing again. Ropes are not GC objects; they're reference counted by the strings using them.
+	struct Rope
+	{
+		VM* vm;
+		uword refCount;
+		uword used;     // the length of the longest string made from this rope
+		uword capacity; // bytes of data, always at least one more than `used` so there's room for a terminator
+		bool sealed;    // set when the longest string has been NUL-terminated; no more appending in place after that
+		StrHashState hashState; // state of the hash of the first `used` bytes
+		Rope* prev;     // a rope which a string's data was copied out of, kept alive as long as this one (see ropeCString)
+
+		inline unsigned char* data() const
+		{
+			return cast(unsigned char*)(this + 1);
+		}
+	};
+
 	struct String : public GCObject
 	{
 		// acyclic
 		uword hash;
 		uword length;
 		uword cpLength;
+		Rope* rope; // if non-null, data lives in this rope rather than right after the object
+		uword* cpIndex; // lazily built for long non-ASCII strings; byte offsets of every CPIndexInterval'th codepoint
 
 		inline const char* toCString() const
 		{
+			if(this->rope)
+				return (cast(String*)this)->ropeCString();
+
 			return cast(const char*)(this + 1);
 		}
 
 		inline const unsigned char* toUString() const
 		{
+			if(this->rope)
+				return this->rope->data();
+
 			return cast(const unsigned char*)(this + 1);
 		}
 
@@ -196,10 +234,11 @@ namespace croc
 
 		inline void setData(crocstr data)
 		{
-			auto dst = DArray<char>::n(cast(char*)toCString(), length);
+			assert(this->rope == nullptr);
+			auto dst = DArray<char>::n(cast(char*)(this + 1), length);
 			auto src = DArray<char>::n(cast(char*)data.ptr, data.length);
 			dst.slicea(src);
-			(cast(char*)toCString())[length] = 0; // null terminate
+			(cast(char*)(this + 1))[length] = 0; // null terminate
 		}
 
 		inline hash_t toHash() const
@@ -208,20 +247,26 @@ namespace croc
 		}
 
 		// The index is in codepoints, not byte indices.
-		inline dchar charAt(uword idx)
-		{
-			return utf8CharAt(this->toDArray(), idx);
-		}
+		dchar charAt(VM* vm, uword idx);
+		uword cpIdxToByte(VM* vm, uword idx);
 
 		static String* create(VM* vm, crocstr data);
 		static String* createUnverified(VM* vm, crocstr data, uword cpLen);
 		static String* tryCreate(VM* vm, crocstr data);
+		static String* cat(VM* vm, String* first, DArray<Value> rest, uword len, uword cpLen);
 		static void free(VM* vm, String* s);
 		crocint compare(String* other);
 		bool contains(crocstr sub);
 		String* slice(VM* vm, uword lo, uword hi);
+
+	private:
+		const char* ropeCString();
 	};
 
+	// String hashes depend on the VM's hash key, so the string table is always given them explicitly. This has no
+	// toHash so that anything which tries to hash a key without it won't compile.
+	struct StringHasher {};
+
 	struct Weakref : public GCObject
 	{
 		// acyclic
@@ -277,6 +322,8 @@ namespace croc
 		Namespace* root;
 		String* name;
 		bool visitedOnce;
+		// Bumped whenever the contents change, so caches built from this namespace can tell when they're stale.
+		uword version;
 
 		// Get a pointer to the value of a key-value pair, or null if it doesn't exist.
 		inline Value* get(String* key)
@@ -353,6 +400,8 @@ namespace croc
 		static Memblock* createView(Memory& mem, DArray<uint8_t> data);
 		static void free(Memory& mem, Memblock* m);
 		void view(Memory& mem, DArray<uint8_t> data);
+		DArray<uint8_t> release(Memory& mem);
+		void adopt(Memory& mem, DArray<uint8_t> data);
 		void resize(Memory& mem, uword newLength);
 		Memblock* slice(Memory& mem, uword lo, uword hi);
 		void sliceAssign(uword lo, uword hi, Memblock* other);
@@ -445,8 +494,12 @@ namespace croc
 
 		DArray<LocVarDesc> locVarDescs;
 
+		// Whether code and lineInfo point into the shared code segment instead of being owned by this funcdef.
+		bool sharedCode;
+
 		static Funcdef* create(Memory& mem);
 		static void free(Memory& mem, Funcdef* fd);
+		static void shareCode(Memory& mem, Funcdef* fd);
 	};
 
 	struct Class : public GCObject
@@ -465,10 +518,22 @@ namespace croc
 		DArray<Array::Slot> frozenHiddenFields;
 		uword numInstanceFields;
 
+		// Metamethod cache for frozen classes. mmCache holds the function for each Metamethod (or null). Changing or
+		// removing a method invalidates it; see updateMMCache.
+		bool mmCacheValid;
+		Function* mmCache[MM_NUMMETAMETHODS];
+
+		// Also set up at freeze time, for instantiation. instanceTemplate is what a new instance's field slots (fields
+		// followed by hidden fields) start out as. ctorIsTrivial means calling ctorFunc does nothing and can be skipped.
+		DArray<Array::Slot> instanceTemplate;
+		Function* ctorFunc;
+		bool ctorIsTrivial;
+
 		static Class* create(Memory& mem, String* name);
 		static Class::HashType::NodeType* derive(Memory& mem, Class* c, Class* parent, const char*& which);
 		static void free(Memory& mem, Class* c);
-		void freeze(Memory& mem);
+		void freeze(VM* vm);
+		void updateMMCache(VM* vm);
 
 		Value* getField       (String* name);
 		Value* getMethod      (String* name);
@@ -576,6 +641,8 @@ namespace croc
 		uword numResults;
 		uword unwindCounter;
 		Instruction* unwindReturn;
+		Instance* ctorInstance; // if not null, this is a constructor call and this is what it returns
+		bool isLight; // set up by lightCallPrologue; its one result is written straight to returnSlot
 	};
 
 	struct ScriptEHFrame
@@ -624,6 +691,7 @@ namespace croc
 		uword numYields;
 		uword nativeCallDepth;
 		uword savedStartARIndex;
+		StackfulContext* stackful; // null unless this thread runs on its own C stack
 
 		uint8_t hooks;
 		bool hooksEnabled;
@@ -631,15 +699,41 @@ namespace croc
 		uint32_t hookCounter;
 		Function* hookFunc;
 
+		uword budget;      // 0 when there's no budget; see croc_thread_setBudget
+		uword budgetLeft;  // counted down at loop backedges and script calls
+		uint8_t budgetAction;
+
+		// The VM's native EH stack as it was when this thread's OS thread released the VM lock (see croc_vm_releaseLock).
+		// Each OS thread has its own, since each one's frames point into its own C stack.
+		DArray<NativeEHFrame> lockedEHFrames;
+		uword lockedEHIndex;
+
 		static Thread* create(VM* vm);
 		static Thread* createPartial(VM* vm);
 		static Thread* create(VM* vm, Function* coroFunc);
+		static Thread* createStackful(VM* vm, Function* coroFunc);
 		static void free(Thread* t);
+		static void freePools(VM* vm);
+		void allocStacks();
+		void freeStacks();
+#ifdef CROC_STACKFUL_THREADS
+		bool allocCStack();
+		void freeCStack();
+#endif
 		void reset();
 		void setHookFunc(Memory& mem, Function* f);
 		void setCoroFunc(Memory& mem, Function* f);
 	};
 
+	// A dead thread's stacks, kept in its VM's pool for another thread to reuse.
+	struct ThreadStacks
+	{
+		DArray<ScriptEHFrame> ehFrames;
+		DArray<ActRecord> actRecs;
+		DArray<Value> stack;
+		DArray<Value> results;
+	};
+
 	struct Upval : public GCObject
 	{
 		Value* value;
@@ -647,6 +741,15 @@ namespace croc
 		Upval* nextuv;
 	};
 
+	// Croc never touches the signal mask, so don't pay for saving and restoring it on platforms where setjmp does.
+#ifdef _WIN32
+#define CROC_SETJMP(buf) setjmp(buf)
+#define CROC_LONGJMP(buf, val) longjmp(buf, val)
+#else
+#define CROC_SETJMP(buf) _setjmp(buf)
+#define CROC_LONGJMP(buf, val) _longjmp(buf, val)
+#endif
+
 	struct NativeEHFrame
 	{
 		Thread* t;
@@ -662,6 +765,34 @@ namespace croc
 		EHStatus_NativeFrame = 2
 	};
 
+#ifdef CROC_STACKFUL_THREADS
+	// A stackful thread runs on a C stack of its own, so it can be suspended with native calls still on it. While it's
+	// suspended, the native EH frames that live on that stack are moved off the VM's EH stack into ehFrames.
+	struct StackfulContext
+	{
+		ucontext_t ctx;
+		ucontext_t caller;
+		void* stack;
+		uword stackSize;
+		DArray<NativeEHFrame> ehFrames;
+		uword numEHFrames;
+		uword ehBase;
+
+		// What the thread was resumed with, and whether it died of an exception.
+		Thread* from;
+		uword numParams;
+		bool failed;
+	};
+#endif
+
+	// Metamethods looked up from a per-type metatable. Valid as long as mt and version match the metatable.
+	struct TypeMMCache
+	{
+		Namespace* mt;
+		uword version;
+		Function* methods[MM_NUMMETAMETHODS];
+	};
+
 	struct VM
 	{
 		Memory mem;
@@ -673,6 +804,8 @@ namespace croc
 		DArray<String*> metaStrings;
 		Instance* exception;
 		Namespace* registry;
+		Namespace* lazyGlobals;
+		Table* lazyModules;
 		Hash<uint64_t, GCObject*> refTab;
 		Function* unhandledEx;
 
@@ -695,16 +828,27 @@ namespace croc
 		uword ehIndex;
 
 		// Others
-		Hash<crocstr, String*, MethodHasher, HashNodeWithHash<crocstr, String*> > stringTab;
+		Hash<crocstr, String*, StringHasher, HashNodeWithHash<crocstr, String*> > stringTab;
+		StrHashKey strHashKey;
 		Hash<GCObject*, Weakref*> weakrefTab;
 		Thread* allThreads;
 		Thread* curThread;
+		DArray<ThreadStacks> stackPool; // see Thread::freeStacks
+		uword numPooledStacks;
+		DArray<void*> cStackPool; // C stacks of dead stackful threads
+		uword numPooledCStacks;
 		uint64_t currentRef;
 		String* ctorString; // also stored in metaStrings, don't have to scan it as a root
 		String* finalizerString; // also stored in metaStrings, don't have to scan it as a root
+		TypeMMCache typeMMCache[CrocType_NUMTYPES]; // not roots; everything in them is reachable from metaTabs
 		unsigned char formatBuf[CROC_FORMAT_BUF_SIZE];
 		RNG rng;
 
+		// OS thread stuff; see croc_vm_enableLock. lock is null until it's enabled. lockWanted is set by an OS thread
+		// that's been kept waiting for the lock, and is checked by the interpreter wherever it counts budget.
+		VMLock* lock;
+		std::atomic<bool> lockWanted;
+
 		inline void disableGC() { this->mem.gcDisabled++; }
 		inline void enableGC()
 		{
@@ -24,6 +24,22 @@
 
 namespace croc
 {
+	namespace
+	{
+	// A script function which does nothing but return nothing: 'saverets 0' followed by 'ret'.
+	bool isTrivialCtor(Function* f)
+	{
+		if(f->isNative)
+			return false;
+
+		auto code = f->scriptFunc->code;
+
+		return code.length == 3 &&
+			INST_GET_OPCODE(code[0]) == Op_SaveRets && code[1].uimm == 1 &&
+			INST_GET_OPCODE(code[2]) == Op_Ret;
+	}
+	}
+
 	Class* Class::create(Memory& mem, String* name)
 	{
 		auto c = ALLOC_OBJ(mem, Class);
@@ -75,14 +91,16 @@ namespace croc
 		c->methods.clear(mem);
 		c->frozenFields.free(mem);
 		c->frozenHiddenFields.free(mem);
+		c->instanceTemplate.free(mem);
 		FREE_OBJ(mem, Class, c);
 	}
 
-	void Class::freeze(Memory& mem)
+	void Class::freeze(VM* vm)
 	{
 		if(this->isFrozen)
 			return;
 
+		auto &mem = vm->mem;
 		this->isFrozen = true;
 
 		this->frozenFields = DArray<Array::Slot>::alloc(mem, this->fields.length());
@@ -110,6 +128,34 @@ namespace croc
 		}
 
 		this->numInstanceFields = this->fields.length() + this->hiddenFields.length();
+
+		this->instanceTemplate = DArray<Array::Slot>::alloc(mem, this->numInstanceFields);
+		this->instanceTemplate.slicea(0, this->frozenFields.length, this->frozenFields);
+		this->instanceTemplate.slicea(this->frozenFields.length, this->numInstanceFields, this->frozenHiddenFields);
+
+		for(auto &slot: this->instanceTemplate)
+			slot.modified = slot.value.isGCObject();
+
+		this->ctorFunc = this->constructor ? this->constructor->mFunction : nullptr;
+		this->ctorIsTrivial = this->ctorFunc == nullptr || isTrivialCtor(this->ctorFunc);
+		this->updateMMCache(vm);
+	}
+
+	void Class::updateMMCache(VM* vm)
+	{
+		assert(this->isFrozen);
+
+		for(uword i = 0; i < MM_NUMMETAMETHODS; i++)
+		{
+			auto m = this->getMethod(vm->metaStrings[i]);
+
+			if(m && m->type == CrocType_Function)
+				this->mmCache[i] = m->mFunction;
+			else
+				this->mmCache[i] = nullptr;
+		}
+
+		this->mmCacheValid = true;
 	}
 
 	// =================================================================================================================
@@ -153,6 +199,7 @@ namespace croc
 			{
 				REMOVEVALUEREF(mem, slot);
 				slot->value = value;
+				this->mmCacheValid = false;
 
 				if(value.isGCObject())
 				{
@@ -169,19 +216,23 @@ namespace croc
 		return false;
 	}
 
-#define MAKE_SET_MEMBER(funcName, memberName, frozenMemberName)\
+#define MAKE_SET_MEMBER(funcName, memberName, frozenMemberName, templateOffset)\
 	bool Class::funcName(Memory& mem, String* name, Value value)\
 	{\
 		if(auto slot = this->memberName.lookupNode(name))\
 		{\
 			if(this->isFrozen)\
 			{\
-				auto &fslot = this->frozenMemberName[cast(uword)slot->value.mInt];\
+				auto idx = cast(uword)slot->value.mInt;\
+				auto &fslot = this->frozenMemberName[idx];\
 \
 				if(fslot.value != value)\
 				{\
 					REMOVEFROZENVALUEREF(mem, fslot);\
 					fslot.value = value;\
+					auto &tslot = this->instanceTemplate[templateOffset + idx];\
+					tslot.value = value;\
+					tslot.modified = value.isGCObject();\
 \
 					if(value.isGCObject())\
 					{\
@@ -212,8 +263,8 @@ namespace croc
 		return false;\
 	}
 
-	MAKE_SET_MEMBER(setField, fields, frozenFields)
-	MAKE_SET_MEMBER(setHiddenField, hiddenFields, frozenHiddenFields)
+	MAKE_SET_MEMBER(setField, fields, frozenFields, 0)
+	MAKE_SET_MEMBER(setHiddenField, hiddenFields, frozenHiddenFields, this->frozenFields.length)
 
 	// =================================================================================================================
 	// Add
@@ -275,6 +326,7 @@ namespace croc
 			REMOVEKEYREF(mem, slot);\
 			REMOVEVALUEREF(mem, slot);\
 			this->memberName.remove(name);\
+			this->mmCacheValid = false;\
 			return true;\
 		}\
 		else\
@@ -1,3 +1,4 @@
+#include "croc/base/sharedcode.hpp"
 #include "croc/types/base.hpp"
 
 namespace croc
@@ -17,15 +18,52 @@ namespace croc
 		fd->upvals.free(mem);
 		fd->innerFuncs.free(mem);
 		fd->constants.free(mem);
-		fd->code.free(mem);
+
+		if(!fd->sharedCode)
+		{
+			fd->code.free(mem);
+			fd->lineInfo.free(mem);
+		}
 
 		for(auto &st: fd->switchTables)
 			st.offsets.clear(mem);
 
 		fd->switchTables.free(mem);
-		fd->lineInfo.free(mem);
 		fd->upvalNames.free(mem);
 		fd->locVarDescs.free(mem);
 		FREE_OBJ(mem, Funcdef, fd);
 	}
+
+	namespace
+	{
+		template<typename T>
+		bool shareArray(DArray<T>& arr, DArray<const uint8_t>& shared)
+		{
+			shared = shareData(DArray<const uint8_t>::n(cast(const uint8_t*)arr.ptr, arr.length * sizeof(T)));
+			return shared.ptr != nullptr || arr.length == 0;
+		}
+	}
+
+	// Move the funcdef's code and line info (and its inner funcdefs') into the shared code segment, so that every VM
+	// with an identical funcdef uses the same copy. Neither can change after the funcdef is created, so the only
+	// thing to watch out for is that the funcdef mustn't be running, since activation records point into its code.
+	void Funcdef::shareCode(Memory& mem, Funcdef* fd)
+	{
+		if(!fd->sharedCode)
+		{
+			DArray<const uint8_t> code, lineInfo;
+
+			if(shareArray(fd->code, code) && shareArray(fd->lineInfo, lineInfo))
+			{
+				fd->code.free(mem);
+				fd->lineInfo.free(mem);
+				fd->code = DArray<Instruction>::n(cast(Instruction*)code.ptr, code.length / sizeof(Instruction));
+				fd->lineInfo = DArray<uword>::n(cast(uword*)lineInfo.ptr, lineInfo.length / sizeof(uword));
+				fd->sharedCode = true;
+			}
+		}
+
+		for(auto inner: fd->innerFuncs)
+			shareCode(mem, inner);
+	}
 }
@@ -55,30 +55,12 @@ namespace croc
 		i->parent = parent;
 		i->fields = &parent->fields;
 
-		void* hiddenFieldsLoc = cast(void*)(i + 1);
-
-		if(parent->frozenFields.length > 0)
-		{
-			auto instFields = DArray<Array::Slot>::n(cast(Array::Slot*)(i + 1), parent->frozenFields.length);
-			instFields.slicea(parent->frozenFields);
-
-			for(auto &slot: instFields)
-				slot.modified = slot.value.isGCObject();
-
-			hiddenFieldsLoc = cast(void*)(instFields.ptr + instFields.length);
-		}
+		// The template already has the fields followed by the hidden fields, with the modified flags set up.
+		auto slots = cast(Array::Slot*)(i + 1);
+		DArray<Array::Slot>::n(slots, parent->numInstanceFields).slicea(parent->instanceTemplate);
 
 		if(parent->frozenHiddenFields.length > 0)
-		{
-			i->hiddenFieldsData = cast(Array::Slot*)hiddenFieldsLoc;
-
-			auto instHiddenFields = DArray<Array::Slot>::n(cast(Array::Slot*)hiddenFieldsLoc,
-				parent->frozenHiddenFields.length);
-			instHiddenFields.slicea(parent->frozenHiddenFields);
-
-			for(auto &slot: instHiddenFields)
-				slot.modified = slot.value.isGCObject();
-		}
+			i->hiddenFieldsData = slots + parent->frozenFields.length;
 
 		return true;
 	}
@@ -43,6 +43,28 @@ namespace croc
 		this->ownData = false;
 	}
 
+	// Take this memblock's data away from it (and from mem), leaving it empty. It must own its data. The data can then
+	// be adopted by a memblock in another VM using the same memFunc, or freed with that memFunc.
+	DArray<uint8_t> Memblock::release(Memory& mem)
+	{
+		assert(this->ownData);
+		auto ret = this->data;
+		ret.release(mem);
+		this->data = DArray<uint8_t>();
+		return ret;
+	}
+
+	// Change a memblock so it owns the given data, which was released from a VM using the same memFunc as mem.
+	void Memblock::adopt(Memory& mem, DArray<uint8_t> data)
+	{
+		if(this->ownData)
+			this->data.free(mem);
+
+		data.adopt(mem);
+		this->data = data;
+		this->ownData = true;
+	}
+
 	// Resize a memblock object.
 	void Memblock::resize(Memory& mem, uword newLength)
 	{
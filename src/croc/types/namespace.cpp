@@ -60,6 +60,7 @@ namespace croc
 			return;
 
 		CONTAINER_WRITE_BARRIER(mem, this);
+		this->version++;
 		auto node = this->data.insertNode(mem, key);
 		node->value = value;
 
@@ -80,6 +81,7 @@ namespace croc
 		{
 			REMOVEVALUEREF(mem, node);
 			node->value = value;
+			this->version++;
 
 			if(value.isGCObject())
 			{
@@ -101,6 +103,7 @@ namespace croc
 			REMOVEKEYREF(mem, node);
 			REMOVEVALUEREF(mem, node);
 			this->data.remove(key);
+			this->version++;
 		}
 	}
 
@@ -114,5 +117,6 @@ namespace croc
 		}
 
 		this->data.clear(mem);
+		this->version++;
 	}
 }
\ No newline at end of file
@@ -8,14 +8,35 @@
 #include "croc/util/utf.hpp"
 
 #define STRING_EXTRA_SIZE(len) (1 + (sizeof(char) * (len)))
+#define ROPE_SIZE(cap) (sizeof(Rope) + (sizeof(char) * (cap)))
+
+#ifdef CROC_LEAK_DETECTOR
+#  define ROPETYPEID ,typeid(Rope)
+#else
+#  define ROPETYPEID
+#endif
 
 namespace croc
 {
 	namespace
 	{
+		// Concatenations shorter than this are always copied into a new string.
+		const uword RopeThreshold = 128;
+
+		// Non-ASCII strings with at least this many codepoints get a codepoint index the first time they're indexed
+		// or sliced. The index holds the byte offset of every CPIndexInterval'th codepoint, so finding any codepoint
+		// means scanning at most that many characters.
+		const uword CPIndexThreshold = 256;
+		const uword CPIndexInterval = 64;
+
+		uword cpIndexLength(String* s)
+		{
+			return s->cpLength / CPIndexInterval + 1;
+		}
+
 		String* createInternal(VM* vm, crocstr data, std::function<uword(bool&)> getCPLen)
 		{
-			auto h = data.toHash();
+			auto h = strHash(vm->strHashKey, data);
 
 			if(auto s = vm->stringTab.lookup(data, h))
 				return *s;
@@ -32,9 +53,48 @@ namespace croc
 			ret->length = data.length;
 			ret->cpLength = cpLen;
 			ret->setData(data);
-			*vm->stringTab.insert(vm->mem, ret->toDArray()) = ret;
+			*vm->stringTab.insert(vm->mem, ret->toDArray(), h) = ret;
 			return ret;
 		}
+
+		Rope* createRope(VM* vm, uword capacity)
+		{
+			auto ret = cast(Rope*)vm->mem.allocRaw(ROPE_SIZE(capacity) ROPETYPEID);
+			ret->vm = vm;
+			ret->refCount = 0;
+			ret->used = 0;
+			ret->capacity = capacity;
+			ret->sealed = false;
+			ret->prev = nullptr;
+			strHashBegin(ret->hashState, vm->strHashKey);
+
+			// Ropes aren't GC objects, but they're freed by collecting the strings which use them, so they have to count
+			// towards the next collection just like the strings' own memory does. Otherwise a loop making big strings
+			// out of small string objects would never trigger one.
+			vm->mem.nurseryBytes += ROPE_SIZE(capacity);
+			return ret;
+		}
+
+		void releaseRope(Rope* r);
+
+		void freeRope(Rope* r)
+		{
+			auto prev = r->prev;
+			void* ptr = r;
+			uword size = ROPE_SIZE(r->capacity);
+			r->vm->mem.freeRaw(ptr, size ROPETYPEID);
+
+			if(prev)
+				releaseRope(prev);
+		}
+
+		void releaseRope(Rope* r)
+		{
+			assert(r->refCount > 0);
+
+			if(--r->refCount == 0)
+				freeRope(r);
+		}
 	}
 
 	// Create a new string object. String objects with the same data are reused. Thus,
@@ -58,6 +118,81 @@ namespace croc
 		return createInternal(vm, data, [&](bool& okay) { okay = true; return cpLen; });
 	}
 
+	// Concatenate first and the strings in rest, whose total length in bytes and codepoints are given. Longer results are
+	// put in a rope, so that the common pattern of repeatedly appending onto the same string takes linear time instead
+	// of quadratic.
+	String* String::cat(VM* vm, String* first, DArray<Value> rest, uword len, uword cpLen)
+	{
+		if(len < RopeThreshold)
+		{
+			auto tmpBuffer = ustring::alloc(vm->mem, len);
+			auto firstData = first->toDArray();
+			tmpBuffer.slicea(0, firstData.length, firstData);
+			uword i = firstData.length;
+
+			for(auto &v: rest)
+			{
+				auto s = v.mString->toDArray();
+				tmpBuffer.slicea(i, i + s.length, s);
+				i += s.length;
+			}
+
+			auto ret = createUnverified(vm, tmpBuffer, cpLen);
+			tmpBuffer.free(vm->mem);
+			return ret;
+		}
+
+		// We can only append in place if first is the longest string in its rope, and there's room.
+		auto r = first->rope;
+
+		if(r == nullptr || r->sealed || first->length != r->used || len >= r->capacity)
+		{
+			// Leave room to grow if first was itself made by appending; otherwise this may be a one-off.
+			auto capacity = (r == nullptr ? len : len + (len >> 1)) + 1;
+			r = createRope(vm, capacity);
+			memcpy(r->data(), first->toUString(), first->length);
+			r->used = first->length;
+			strHashFeed(r->hashState, vm->strHashKey, crocstr::n(r->data(), r->used));
+		}
+
+		auto dest = r->data() + r->used;
+
+		for(auto &v: rest)
+		{
+			auto s = v.mString;
+			memcpy(dest, s->toUString(), s->length);
+			dest += s->length;
+		}
+
+		auto data = crocstr::n(r->data(), len);
+
+		// Don't commit the new hash state until we know we're keeping the appended data.
+		auto hashState = r->hashState;
+		strHashFeed(hashState, vm->strHashKey, data);
+		auto h = strHashEnd(hashState, vm->strHashKey, data);
+
+		if(auto s = vm->stringTab.lookup(data, h))
+		{
+			if(r->refCount == 0)
+				freeRope(r);
+
+			return *s;
+		}
+
+		r->used = len;
+		r->hashState = hashState;
+		r->refCount++;
+
+		auto ret = ALLOC_OBJ_ACYC(vm->mem, String);
+		ret->type = CrocType_String;
+		ret->hash = h;
+		ret->length = len;
+		ret->cpLength = cpLen;
+		ret->rope = r;
+		*vm->stringTab.insert(vm->mem, data, h) = ret;
+		return ret;
+	}
+
 	String* String::tryCreate(VM* vm, crocstr data)
 	{
 		return createInternal(vm, data, [&](bool& okay)
@@ -71,14 +206,57 @@ namespace croc
 	// Free a string object.
 	void String::free(VM* vm, String* s)
 	{
-		bool b = vm->stringTab.remove(s->toDArray());
+		bool b = vm->stringTab.remove(s->toDArray(), s->hash);
 		assert(b);
 #ifdef NDEBUG
 		(void)b;
 #endif
+		if(s->rope)
+			releaseRope(s->rope);
+
+		if(s->cpIndex)
+			DArray<uword>::n(s->cpIndex, cpIndexLength(s)).free(vm->mem);
+
 		FREE_OBJ(vm->mem, String, s);
 	}
 
+	// Strings in ropes aren't necessarily followed by a NUL, since a longer string's data comes after them. The longest
+	// one, or any one which is the only string left using its rope, can just be terminated in place (which stops any
+	// more appending onto it). Any others have to be copied out into a rope of their own. Native code may still be
+	// holding a pointer to the string's old data, so the old rope is kept alive by the new one rather than released.
+	const char* String::ropeCString()
+	{
+		auto r = this->rope;
+		assert(r != nullptr);
+
+		if(this->length == r->used || r->refCount == 1)
+		{
+			r->data()[this->length] = 0;
+			r->used = this->length;
+			r->sealed = true;
+		}
+		else if(r->data()[this->length] != 0)
+		{
+			auto vm = r->vm;
+			auto newRope = createRope(vm, this->length + 1);
+			memcpy(newRope->data(), r->data(), this->length);
+			newRope->data()[this->length] = 0;
+			newRope->used = this->length;
+			newRope->sealed = true;
+			newRope->refCount = 1;
+
+			// The string table key points into the old rope, so point it at the new one.
+			auto n = vm->stringTab.lookupNode(this->toDArray(), this->hash);
+			assert(n != nullptr);
+			n->key = crocstr::n(newRope->data(), this->length);
+
+			newRope->prev = r;
+			this->rope = newRope;
+		}
+
+		return cast(const char*)this->rope->data();
+	}
+
 	// Compare two string objects.
 	crocint String::compare(String* other)
 	{
@@ -91,10 +269,59 @@ namespace croc
 		return strLocate(this->toDArray(), sub) != this->length;
 	}
 
+	// The index is in codepoints, not byte indices.
+	dchar String::charAt(VM* vm, uword idx)
+	{
+		assert(idx < this->cpLength);
+		auto s = this->toUString() + this->cpIdxToByte(vm, idx);
+		return fastDecodeUtf8Char(s);
+	}
+
+	// Convert a codepoint index (which can be equal to the length) to a byte index. This is O(1) for ASCII strings and
+	// long strings, though the latter have to build their index the first time.
+	uword String::cpIdxToByte(VM* vm, uword idx)
+	{
+		assert(idx <= this->cpLength);
+
+		if(this->length == this->cpLength)
+			return idx;
+
+		auto str = this->toDArray();
+
+		if(this->cpLength < CPIndexThreshold)
+			return utf8CPIdxToByte(str, idx);
+
+		if(this->cpIndex == nullptr)
+		{
+			auto index = DArray<uword>::alloc(vm->mem, cpIndexLength(this));
+			auto p = str.ptr;
+			uword i = 0;
+
+			for(uword cp = 0; cp < this->cpLength; cp++)
+			{
+				if(cp % CPIndexInterval == 0)
+					index[i++] = p - str.ptr;
+
+				p += utf8SequenceLength(*p);
+			}
+
+			if(this->cpLength % CPIndexInterval == 0)
+				index[i++] = this->length;
+
+			assert(i == index.length);
+			this->cpIndex = index.ptr;
+		}
+
+		auto base = this->cpIndex[idx / CPIndexInterval];
+		return base + utf8CPIdxToByte(str.slice(base, str.length), idx % CPIndexInterval);
+	}
+
 	// The slice indices are in codepoints, not byte indices.
 	// And these indices better be good.
 	String* String::slice(VM* vm, uword lo, uword hi)
 	{
-		return createUnverified(vm, utf8Slice(this->toDArray(), lo, hi), hi - lo);
+		auto loByte = this->cpIdxToByte(vm, lo);
+		auto hiByte = this->cpIdxToByte(vm, hi);
+		return createUnverified(vm, this->toDArray().slice(loByte, hiByte), hi - lo);
 	}
 }
\ No newline at end of file
@@ -1,18 +1,43 @@
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #include "croc/base/writebarrier.hpp"
 
 namespace croc
 {
+	namespace
+	{
+		// Initial sizes of a thread's stacks. Pooled stacks that grew past these are shrunk back down to them.
+		const uword DefaultEHFrames = 10;
+		const uword DefaultActRecs = 10;
+		const uword DefaultStack = 20;
+		const uword DefaultResults = 8;
+
+		// How many dead threads' stacks a VM will hang onto.
+		const uword MaxPooledStacks = 64;
+		const uword MaxPooledCStacks = 16;
+
+#ifdef CROC_STACKFUL_THREADS
+		// Address space is reserved up front, but pages are only committed as the stack grows into them.
+		const uword CStackSize = 1024 * 1024;
+#endif
+
+		template<typename T>
+		void shrinkTo(Memory& mem, DArray<T>& arr, uword size)
+		{
+			if(arr.length > size)
+				arr.resize(mem, size);
+		}
+	}
+
 	// Create a new thread object.
 	Thread* Thread::create(VM* vm)
 	{
 		auto t = createPartial(vm);
-		auto &mem = vm->mem;
-
-		t->ehFrames = DArray<ScriptEHFrame>::alloc(mem, 10);
-		t->actRecs =  DArray<ActRecord>::alloc(mem, 10);
-		t->stack =    DArray<Value>::alloc(mem, 20);
-		t->results =  DArray<Value>::alloc(mem, 8);
+		t->allocStacks();
 		t->stackIndex = cast(AbsStack)1; // So that there is a 'this' at top-level.
 		t->hooksEnabled = true;
 		return t;
@@ -33,14 +58,34 @@ namespace croc
 		return t;
 	}
 
-	// Create a new thread object with a function to be used as the thread body.
+	// Create a new thread object with a function to be used as the thread body. Its stacks aren't allocated until it's
+	// first resumed.
 	Thread* Thread::create(VM* vm, Function* coroFunc)
 	{
-		auto t = create(vm);
+		auto t = createPartial(vm);
+		t->stackIndex = cast(AbsStack)1;
+		t->hooksEnabled = true;
 		t->coroFunc = coroFunc;
 		return t;
 	}
 
+	// Create a new thread object which runs its body on a separate C stack (allocated, like the others, when it's first
+	// resumed). Returns null if the platform doesn't support that.
+	Thread* Thread::createStackful(VM* vm, Function* coroFunc)
+	{
+#ifdef CROC_STACKFUL_THREADS
+		auto t = create(vm, coroFunc);
+		auto ctx = DArray<StackfulContext>::alloc(vm->mem, 1).ptr;
+		ctx->ehFrames = DArray<NativeEHFrame>::alloc(vm->mem, 4);
+		t->stackful = ctx;
+		return t;
+#else
+		(void)vm;
+		(void)coroFunc;
+		return nullptr;
+#endif
+	}
+
 	// Free a thread object.
 	void Thread::free(Thread* t)
 	{
@@ -59,13 +104,183 @@ namespace croc
 
 		auto &mem = t->vm->mem;
 
-		t->results.free(mem);
-		t->stack.free(mem);
-		t->actRecs.free(mem);
-		t->ehFrames.free(mem);
+#ifdef CROC_STACKFUL_THREADS
+		if(auto ctx = t->stackful)
+		{
+			// If it's suspended, whatever's on its C stack is simply abandoned, same as if it had been longjmp'ed over.
+			t->freeCStack();
+			ctx->ehFrames.free(mem);
+			DArray<StackfulContext>::n(ctx, 1).free(mem);
+		}
+#endif
+
+		t->freeStacks();
 		FREE_OBJ(mem, Thread, t);
 	}
 
+	// Gives this thread its stacks, reusing a dead thread's if the VM has any pooled. Values can already have been pushed
+	// onto a thread that hasn't run yet (e.g. by croc_transferVals), which makes the value stack grow on its own; that one
+	// is kept, so that those values are too.
+	void Thread::allocStacks()
+	{
+		assert(this->actRecs.length == 0);
+		auto vm = this->vm;
+		auto &mem = vm->mem;
+
+		if(vm->numPooledStacks > 0)
+		{
+			auto &s = vm->stackPool[--vm->numPooledStacks];
+			this->ehFrames = s.ehFrames;
+			this->actRecs = s.actRecs;
+			this->results = s.results;
+
+			if(this->stack.length == 0)
+				this->stack = s.stack;
+			else
+				s.stack.free(mem);
+		}
+		else
+		{
+			this->ehFrames = DArray<ScriptEHFrame>::alloc(mem, DefaultEHFrames);
+			this->actRecs =  DArray<ActRecord>::alloc(mem, DefaultActRecs);
+			this->results =  DArray<Value>::alloc(mem, DefaultResults);
+
+			if(this->stack.length == 0)
+				this->stack = DArray<Value>::alloc(mem, DefaultStack);
+		}
+	}
+
+	// Takes this thread's stacks away, putting them in the VM's pool if there's room. The thread must not be using them
+	// anymore (it's dead, or being freed).
+	void Thread::freeStacks()
+	{
+		auto vm = this->vm;
+		auto &mem = vm->mem;
+
+		// A thread that never ran has no stacks, except maybe a value stack that something pushed onto.
+		if(this->actRecs.length == 0)
+		{
+			this->stack.free(mem);
+			return;
+		}
+
+		if(vm->numPooledStacks < MaxPooledStacks)
+		{
+			if(vm->numPooledStacks == vm->stackPool.length)
+				vm->stackPool.resize(mem, vm->stackPool.length == 0 ? 8 : vm->stackPool.length * 2);
+
+			shrinkTo(mem, this->ehFrames, DefaultEHFrames);
+			shrinkTo(mem, this->actRecs, DefaultActRecs);
+			shrinkTo(mem, this->stack, DefaultStack);
+			shrinkTo(mem, this->results, DefaultResults);
+
+			// Stale values would look like live references to the next thread's 'this' slot and the GC.
+			this->stack.fill(Value::nullValue);
+
+			auto &s = vm->stackPool[vm->numPooledStacks++];
+			s.ehFrames = this->ehFrames;
+			s.actRecs = this->actRecs;
+			s.stack = this->stack;
+			s.results = this->results;
+		}
+		else
+		{
+			this->results.free(mem);
+			this->stack.free(mem);
+			this->actRecs.free(mem);
+			this->ehFrames.free(mem);
+		}
+
+		this->ehFrames = DArray<ScriptEHFrame>();
+		this->actRecs = DArray<ActRecord>();
+		this->stack = DArray<Value>();
+		this->results = DArray<Value>();
+	}
+
+#ifdef CROC_STACKFUL_THREADS
+	// Gives this stackful thread a C stack, reusing a pooled one if there is one. Returns false if one couldn't be
+	// allocated.
+	bool Thread::allocCStack()
+	{
+		auto ctx = this->stackful;
+		assert(ctx && ctx->stack == nullptr);
+		auto vm = this->vm;
+
+		if(vm->numPooledCStacks > 0)
+			ctx->stack = vm->cStackPool[--vm->numPooledCStacks];
+		else
+		{
+			auto stack = mmap(nullptr, CStackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+				-1, 0);
+
+			if(stack == MAP_FAILED)
+				return false;
+
+			// Guard page, so that overflowing the stack crashes instead of scribbling on whatever's below it. A stack
+			// without one isn't safe to run on, so that's treated like not being able to get a stack at all.
+			if(mprotect(stack, cast(uword)sysconf(_SC_PAGESIZE), PROT_NONE) != 0)
+			{
+				munmap(stack, CStackSize);
+				return false;
+			}
+
+			ctx->stack = stack;
+		}
+
+		ctx->stackSize = CStackSize;
+		return true;
+	}
+
+	// Takes this stackful thread's C stack away, putting it in the VM's pool if there's room.
+	void Thread::freeCStack()
+	{
+		auto ctx = this->stackful;
+
+		if(ctx == nullptr || ctx->stack == nullptr)
+			return;
+
+		auto vm = this->vm;
+
+		if(vm->numPooledCStacks < MaxPooledCStacks)
+		{
+			if(vm->numPooledCStacks == vm->cStackPool.length)
+				vm->cStackPool.resize(vm->mem, MaxPooledCStacks);
+
+			vm->cStackPool[vm->numPooledCStacks++] = ctx->stack;
+		}
+		else
+			munmap(ctx->stack, ctx->stackSize);
+
+		ctx->stack = nullptr;
+		ctx->numEHFrames = 0;
+	}
+#endif
+
+	// Frees the stacks pooled by the given VM. Called when it's closed, after all its threads have been freed.
+	void Thread::freePools(VM* vm)
+	{
+		auto &mem = vm->mem;
+
+		for(auto &s: vm->stackPool.slice(0, vm->numPooledStacks))
+		{
+			s.results.free(mem);
+			s.stack.free(mem);
+			s.actRecs.free(mem);
+			s.ehFrames.free(mem);
+		}
+
+		vm->stackPool.free(mem);
+		vm->numPooledStacks = 0;
+
+#ifdef CROC_STACKFUL_THREADS
+		for(auto stack: vm->cStackPool.slice(0, vm->numPooledCStacks))
+			munmap(stack, CStackSize);
+#endif
+
+		vm->cStackPool.free(mem);
+		vm->numPooledCStacks = 0;
+	}
+
 	void Thread::reset()
 	{
 		assert(this->upvalHead == nullptr); // should be..?
@@ -77,6 +292,7 @@ namespace croc
 		this->stackBase = cast(AbsStack)0;
 		this->resultIndex = 0;
 		this->shouldHalt = false;
+		this->budgetLeft = this->budget;
 		this->state = CrocThreadState_Initial;
 	}
 
@@ -0,0 +1,61 @@
+#include "croc/util/cpu.hpp"
+
+#if defined(CROC_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace croc
+{
+	namespace
+	{
+		struct CPUFeatures
+		{
+			bool sse2;
+			bool avx2;
+
+			CPUFeatures() :
+				sse2(false),
+				avx2(false)
+			{
+#if defined(CROC_SIMD_X86) && defined(_MSC_VER)
+				int info[4];
+				__cpuid(info, 0);
+				auto maxLeaf = info[0];
+				__cpuid(info, 1);
+				sse2 = (info[3] & (1 << 26)) != 0;
+
+				// AVX2 also needs the OS to save the YMM registers on context switches.
+				bool osAVX = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6);
+
+				if(osAVX && maxLeaf >= 7)
+				{
+					__cpuidex(info, 7, 0);
+					avx2 = (info[1] & (1 << 5)) != 0;
+				}
+#elif defined(CROC_SIMD_X86)
+				__builtin_cpu_init();
+				sse2 = __builtin_cpu_supports("sse2");
+				avx2 = __builtin_cpu_supports("avx2");
+#endif
+			}
+		};
+
+		const CPUFeatures& features()
+		{
+			static CPUFeatures f;
+			return f;
+		}
+	}
+
+	// Whether the CPU we're running on supports SSE2. Always false if SIMD support wasn't compiled in.
+	bool cpuHasSSE2()
+	{
+		return features().sse2;
+	}
+
+	// Whether the CPU we're running on (and the OS) supports AVX2. Always false if SIMD support wasn't compiled in.
+	bool cpuHasAVX2()
+	{
+		return features().avx2;
+	}
+}
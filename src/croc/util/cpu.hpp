@@ -0,0 +1,23 @@
+#ifndef CROC_UTIL_CPU_HPP
+#define CROC_UTIL_CPU_HPP
+
+// SIMD code paths are only compiled on x86, and can be turned off entirely by defining CROC_NO_SIMD. Functions that use
+// instructions beyond the baseline are marked with CROC_TARGET and must only be called after checking the CPU supports
+// them at runtime.
+#if !defined(CROC_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#  define CROC_SIMD_X86 1
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define CROC_TARGET(t) __attribute__((target(t)))
+#else
+#  define CROC_TARGET(t)
+#endif
+
+namespace croc
+{
+	bool cpuHasSSE2();
+	bool cpuHasAVX2();
+}
+
+#endif
@@ -1,7 +1,12 @@
 #include <string.h>
 
+#include "croc/util/cpu.hpp"
 #include "croc/util/str.hpp"
 
+#ifdef CROC_SIMD_X86
+#include <immintrin.h>
+#endif
+
 namespace croc
 {
 	// =================================================================================================================
@@ -664,4 +669,417 @@ namespace croc
 
 		return total;
 	}
-}
\ No newline at end of file
+
+	// =================================================================================================================
+	// hashing
+
+	/**
+	Sets up a hash key from the given seed.
+	*/
+	void strHashKeyInit(StrHashKey& key, uint64_t seed)
+	{
+		key.seed = seed;
+
+		// splitmix64, to spread the seed out into the secret.
+		uint64_t x = seed;
+
+		for(auto &w: key.secret)
+		{
+			x += 0x9E3779B97F4A7C15ull;
+			auto z = x;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			w = z ^ (z >> 31);
+		}
+	}
+
+#ifdef CROC_STRING_HASH_LOOKUP3
+	// This is Bob Jenkins' lookup3 mixing, rearranged so that the length is mixed in at the end instead of the
+	// beginning. That makes it possible to feed it a string a piece at a time.
+
+#define ROT(x, k) (((x) << (k)) | ((x) >> (32 - (k))))
+
+#define MIX(a, b, c)\
+	{\
+		a -= c; a ^= ROT(c,  4); c += b;\
+		b -= a; b ^= ROT(a,  6); a += c;\
+		c -= b; c ^= ROT(b,  8); b += a;\
+		a -= c; a ^= ROT(c, 16); c += b;\
+		b -= a; b ^= ROT(a, 19); a += c;\
+		c -= b; c ^= ROT(b,  4); b += a;\
+	}
+
+#define FINAL(a, b, c)\
+	{\
+		c ^= b; c -= ROT(b, 14);\
+		a ^= c; a -= ROT(c, 11);\
+		b ^= a; b -= ROT(a, 25);\
+		c ^= b; c -= ROT(b, 16);\
+		a ^= c; a -= ROT(c,  4);\
+		b ^= a; b -= ROT(a, 14);\
+		c ^= b; c -= ROT(b, 24);\
+	}
+
+	namespace
+	{
+		inline uint32_t readWord(const uchar* p)
+		{
+			uint32_t ret;
+			memcpy(&ret, p, sizeof(ret));
+			return ret;
+		}
+	}
+
+	/**
+	Starts hashing a new string.
+	*/
+	void strHashBegin(StrHashState& state, const StrHashKey& key)
+	{
+		state.a = state.b = state.c = 0xFACEDAB5 ^ cast(uint32_t)key.seed; // face dabs!
+		state.consumed = 0;
+	}
+
+	/**
+	Hashes as much of the given string as possible. The string must be the whole string (not just the new part), and
+	any previous calls with this state must have been passed prefixes of it. Some bytes at the end may be left over
+	until \ref strHashEnd.
+	*/
+	void strHashFeed(StrHashState& state, const StrHashKey& key, custring str)
+	{
+		(void)key;
+		assert(state.consumed <= str.length);
+		auto a = state.a, b = state.b, c = state.c;
+		auto p = str.ptr + state.consumed;
+		auto end = str.ptr + str.length;
+
+		for(; end - p >= 12; p += 12)
+		{
+			a += readWord(p);
+			b += readWord(p + 4);
+			c += readWord(p + 8);
+			MIX(a, b, c);
+		}
+
+		state.a = a;
+		state.b = b;
+		state.c = c;
+		state.consumed = p - str.ptr;
+	}
+
+	/**
+	Gets the hash of the given string, which must be the same one the state was last fed. Doesn't modify the state, so
+	you can keep feeding it as the string grows.
+	*/
+	hash_t strHashEnd(const StrHashState& state, const StrHashKey& key, custring str)
+	{
+		(void)key;
+		assert(str.length - state.consumed < 12);
+		uchar tail[12] = {0};
+
+		if(str.length > state.consumed)
+			memcpy(tail, str.ptr + state.consumed, str.length - state.consumed);
+
+		auto a = state.a + readWord(tail);
+		auto b = state.b + readWord(tail + 4);
+		auto c = state.c + readWord(tail + 8);
+		b ^= cast(uint32_t)str.length;
+		FINAL(a, b, c);
+		return c;
+	}
+
+#undef ROT
+#undef MIX
+#undef FINAL
+#else
+	// Short strings (and the end of long ones) are hashed with wyhash (https://github.com/wangyi-fudan/wyhash). Before
+	// that, long strings are run through an accumulator like XXH3's (https://github.com/Cyan4973/xxHash) 64 bytes at a
+	// time, which only needs 32x32 multiplies and so can be done with SSE2 or AVX2.
+
+	namespace
+	{
+		const uint64_t WyP0 = 0x2d358dccaa6c78a5ull;
+		const uint64_t WyP1 = 0x8bb84b93962eacc9ull;
+		const uint64_t WyP2 = 0x4b33a62ed433d4a3ull;
+		const uint64_t WyP3 = 0x4d5a2da51de1aa47ull;
+
+		const uint32_t Prime32_1 = 0x9E3779B1u;
+		const uint32_t Prime32_2 = 0x85EBCA77u;
+		const uint32_t Prime32_3 = 0xC2B2AE3Du;
+		const uint64_t Prime64_1 = 0x9E3779B185EBCA87ull;
+		const uint64_t Prime64_2 = 0xC2B2AE3D27D4EB4Full;
+		const uint64_t Prime64_3 = 0x165667B19E3779F9ull;
+		const uint64_t Prime64_4 = 0x85EBCA77C2B2AE63ull;
+		const uint64_t Prime64_5 = 0x27D4EB2F165667C5ull;
+
+		const size_t StripeLen = 64;
+		const size_t StripesPerBlock = 16; // the accumulators are scrambled after each block
+		const size_t ScrambleSecret = 16;  // index of the part of the secret used for scrambling
+
+		// Stripes are only accumulated while there are more than this many bytes left. The rest is left to wyhash, so
+		// short strings never touch the accumulators, and so that the stripes don't depend on the final length.
+		const size_t TailLen = 256;
+
+		inline uint64_t read64(const uchar* p)
+		{
+			uint64_t ret;
+			memcpy(&ret, p, sizeof(ret));
+			return ret;
+		}
+
+		inline uint64_t read32(const uchar* p)
+		{
+			uint32_t ret;
+			memcpy(&ret, p, sizeof(ret));
+			return ret;
+		}
+
+		inline void wymum(uint64_t& a, uint64_t& b)
+		{
+#ifdef __SIZEOF_INT128__
+			__extension__ typedef unsigned __int128 uint128;
+			uint128 r = a;
+			r *= b;
+			a = cast(uint64_t)r;
+			b = cast(uint64_t)(r >> 64);
+#else
+			uint64_t ha = a >> 32, hb = b >> 32, la = cast(uint32_t)a, lb = cast(uint32_t)b;
+			uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+			uint64_t t = rl + (rm0 << 32);
+			uint64_t c = t < rl;
+			uint64_t lo = t + (rm1 << 32);
+			c += lo < t;
+			a = lo;
+			b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+		}
+
+		inline uint64_t wymix(uint64_t a, uint64_t b)
+		{
+			wymum(a, b);
+			return a ^ b;
+		}
+
+		uint64_t wyhash(const uchar* p, size_t len, uint64_t seed)
+		{
+			seed ^= wymix(seed ^ WyP0, WyP1);
+			uint64_t a, b;
+
+			if(len <= 16)
+			{
+				if(len >= 4)
+				{
+					a = (read32(p) << 32) | read32(p + ((len >> 3) << 2));
+					b = (read32(p + len - 4) << 32) | read32(p + len - 4 - ((len >> 3) << 2));
+				}
+				else if(len > 0)
+				{
+					a = (cast(uint64_t)p[0] << 16) | (cast(uint64_t)p[len >> 1] << 8) | p[len - 1];
+					b = 0;
+				}
+				else
+					a = b = 0;
+			}
+			else
+			{
+				auto i = len;
+
+				if(i >= 48)
+				{
+					auto see1 = seed, see2 = seed;
+
+					do
+					{
+						seed = wymix(read64(p) ^ WyP1, read64(p + 8) ^ seed);
+						see1 = wymix(read64(p + 16) ^ WyP2, read64(p + 24) ^ see1);
+						see2 = wymix(read64(p + 32) ^ WyP3, read64(p + 40) ^ see2);
+						p += 48;
+						i -= 48;
+					} while(i >= 48);
+
+					seed ^= see1 ^ see2;
+				}
+
+				while(i > 16)
+				{
+					seed = wymix(read64(p) ^ WyP1, read64(p + 8) ^ seed);
+					i -= 16;
+					p += 16;
+				}
+
+				a = read64(p + i - 16);
+				b = read64(p + i - 8);
+			}
+
+			a ^= WyP1;
+			b ^= seed;
+			wymum(a, b);
+			return wymix(a ^ WyP0 ^ len, b ^ WyP1);
+		}
+
+		// Accumulate the given number of stripes. first is the index of the first one in the whole string.
+		void accumulateScalar(uint64_t* acc, const uchar* p, size_t stripes, size_t first, const uint64_t* secret)
+		{
+			for(size_t s = 0; s < stripes; s++, p += StripeLen)
+			{
+				auto k = (first + s) % StripesPerBlock;
+
+				for(size_t j = 0; j < 8; j++)
+				{
+					auto data = read64(p + 8 * j);
+					auto dataKey = data ^ secret[k + j];
+					acc[j ^ 1] += data;
+					acc[j] += (dataKey & 0xFFFFFFFF) * (dataKey >> 32);
+				}
+
+				if(k == StripesPerBlock - 1)
+				{
+					for(size_t j = 0; j < 8; j++)
+					{
+						acc[j] ^= acc[j] >> 47;
+						acc[j] ^= secret[ScrambleSecret + j];
+						acc[j] *= Prime32_1;
+					}
+				}
+			}
+		}
+
+#ifdef CROC_SIMD_X86
+		// These do exactly the same thing as accumulateScalar, a 128 or 256 bits at a time.
+#define ACCUMULATE_SIMD(target, name, vec, N, LOAD, STORE, XOR, ADD, SHUF, MUL, SRL, SLL, SET1)\
+		CROC_TARGET(target)\
+		void name(uint64_t* acc, const uchar* p, size_t stripes, size_t first, const uint64_t* secret)\
+		{\
+			const size_t n = N;\
+			vec a[N];\
+\
+			for(size_t i = 0; i < n; i++)\
+				a[i] = LOAD(cast(const vec*)(acc + i * (8 / n)));\
+\
+			auto prime = SET1(cast(int)Prime32_1);\
+\
+			for(size_t s = 0; s < stripes; s++, p += StripeLen)\
+			{\
+				auto k = (first + s) % StripesPerBlock;\
+\
+				for(size_t i = 0; i < n; i++)\
+				{\
+					auto data = LOAD(cast(const vec*)(p + i * (StripeLen / n)));\
+					auto dataKey = XOR(data, LOAD(cast(const vec*)(secret + k + i * (8 / n))));\
+					auto product = MUL(dataKey, SHUF(dataKey, _MM_SHUFFLE(0, 3, 0, 1)));\
+					a[i] = ADD(a[i], ADD(product, SHUF(data, _MM_SHUFFLE(1, 0, 3, 2))));\
+				}\
+\
+				if(k == StripesPerBlock - 1)\
+				{\
+					for(size_t i = 0; i < n; i++)\
+					{\
+						auto x = XOR(a[i], SRL(a[i], 47));\
+						x = XOR(x, LOAD(cast(const vec*)(secret + ScrambleSecret + i * (8 / n))));\
+						auto lo = MUL(x, prime);\
+						auto hi = MUL(SHUF(x, _MM_SHUFFLE(0, 3, 0, 1)), prime);\
+						a[i] = ADD(lo, SLL(hi, 32));\
+					}\
+				}\
+			}\
+\
+			for(size_t i = 0; i < n; i++)\
+				STORE(cast(vec*)(acc + i * (8 / n)), a[i]);\
+		}
+
+		ACCUMULATE_SIMD("sse2", accumulateSSE2, __m128i, 4, _mm_loadu_si128, _mm_storeu_si128, _mm_xor_si128,
+			_mm_add_epi64, _mm_shuffle_epi32, _mm_mul_epu32, _mm_srli_epi64, _mm_slli_epi64, _mm_set1_epi32)
+		ACCUMULATE_SIMD("avx2", accumulateAVX2, __m256i, 2, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_xor_si256,
+			_mm256_add_epi64, _mm256_shuffle_epi32, _mm256_mul_epu32, _mm256_srli_epi64, _mm256_slli_epi64,
+			_mm256_set1_epi32)
+#undef ACCUMULATE_SIMD
+#endif
+
+		void accumulate(uint64_t* acc, const uchar* p, size_t stripes, size_t first, const uint64_t* secret)
+		{
+#ifdef CROC_SIMD_X86
+			if(cpuHasAVX2())
+				return accumulateAVX2(acc, p, stripes, first, secret);
+			else if(cpuHasSSE2())
+				return accumulateSSE2(acc, p, stripes, first, secret);
+#endif
+			accumulateScalar(acc, p, stripes, first, secret);
+		}
+	}
+
+	/**
+	Starts hashing a new string.
+	*/
+	void strHashBegin(StrHashState& state, const StrHashKey& key)
+	{
+		(void)key;
+		state.acc[0] = Prime32_3;
+		state.acc[1] = Prime64_1;
+		state.acc[2] = Prime64_2;
+		state.acc[3] = Prime64_3;
+		state.acc[4] = Prime64_4;
+		state.acc[5] = Prime32_2;
+		state.acc[6] = Prime64_5;
+		state.acc[7] = Prime32_1;
+		state.consumed = 0;
+	}
+
+	/**
+	Hashes as much of the given string as possible. The string must be the whole string (not just the new part), and
+	any previous calls with this state must have been passed prefixes of it. Some bytes at the end may be left over
+	until \ref strHashEnd.
+	*/
+	void strHashFeed(StrHashState& state, const StrHashKey& key, custring str)
+	{
+		assert(state.consumed <= str.length);
+		auto remaining = str.length - state.consumed;
+
+		if(remaining <= TailLen)
+			return;
+
+		auto stripes = (remaining - TailLen + StripeLen - 1) / StripeLen;
+		accumulate(state.acc, str.ptr + state.consumed, stripes, state.consumed / StripeLen, key.secret);
+		state.consumed += stripes * StripeLen;
+	}
+
+	/**
+	Gets the hash of the given string, which must be the same one the state was last fed. Doesn't modify the state, so
+	you can keep feeding it as the string grows.
+	*/
+	hash_t strHashEnd(const StrHashState& state, const StrHashKey& key, custring str)
+	{
+		assert(str.length - state.consumed <= TailLen);
+		auto seed = key.seed;
+
+		if(state.consumed > 0)
+		{
+			auto h = str.length * Prime64_1;
+
+			for(size_t i = 0; i < 8; i += 2)
+				h += wymix(state.acc[i] ^ key.secret[i], state.acc[i + 1] ^ key.secret[i + 1]);
+
+			seed ^= h;
+		}
+
+		auto h = wyhash(str.ptr + state.consumed, str.length - state.consumed, seed);
+		return cast(hash_t)(h ^ (h >> 32));
+	}
+#endif
+
+	/**
+	Hashes an entire string at once.
+	*/
+	hash_t strHash(const StrHashKey& key, custring str)
+	{
+#ifndef CROC_STRING_HASH_LOOKUP3
+		if(str.length <= TailLen)
+		{
+			auto h = wyhash(str.ptr, str.length, key.seed);
+			return cast(hash_t)(h ^ (h >> 32));
+		}
+#endif
+		StrHashState state;
+		strHashBegin(state, key);
+		strHashFeed(state, key, str);
+		return strHashEnd(state, key, str);
+	}
+}
@@ -5,6 +5,7 @@
 #include <stddef.h>
 
 #include "croc/base/darray.hpp"
+#include "croc/base/hash.hpp"
 #include "croc/util/utf.hpp"
 
 namespace croc
@@ -72,6 +73,37 @@ namespace croc
 	// conversion
 
 	size_t intToString(ustring buf, uint64_t x, size_t radix, bool isUppercase);
+
+	// =================================================================================================================
+	// hashing
+
+	// The string hash is wyhash for short strings, with an XXH3-style vectorizable accumulator in front of it for long
+	// ones. Building with CROC_STRING_HASH_LOOKUP3 defined switches back to Bob Jenkins' lookup3 instead.
+
+	// Each VM has its own random key, so which strings collide can't be worked out ahead of time.
+	struct StrHashKey
+	{
+		uint64_t seed;
+		uint64_t secret[24];
+	};
+
+	// State of an incremental string hash. The hash only depends on the bytes hashed so far and not on the final
+	// length, so a string which is being built up by appending can be hashed as it grows.
+	struct StrHashState
+	{
+#ifdef CROC_STRING_HASH_LOOKUP3
+		uint32_t a, b, c;
+#else
+		uint64_t acc[8];
+#endif
+		size_t consumed;
+	};
+
+	void strHashKeyInit(StrHashKey& key, uint64_t seed);
+	void strHashBegin(StrHashState& state, const StrHashKey& key);
+	void strHashFeed(StrHashState& state, const StrHashKey& key, custring str);
+	hash_t strHashEnd(const StrHashState& state, const StrHashKey& key, custring str);
+	hash_t strHash(const StrHashKey& key, custring str);
 }
 
 #endif
\ No newline at end of file
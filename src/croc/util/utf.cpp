@@ -1,8 +1,15 @@
+#include <string.h>
+
 #include "croc/base/darray.hpp"
 #include "croc/base/sanity.hpp"
-
+#include "croc/util/cpu.hpp"
+#include "croc/util/misc.hpp"
 #include "croc/util/utf.hpp"
 
+#ifdef CROC_SIMD_X86
+#include <immintrin.h>
+#endif
+
 namespace croc
 {
 	namespace
@@ -300,6 +307,369 @@ namespace croc
 	*/
 	#define skipBadUtf32CharBS skipBadUtf32Char<true>
 
+	namespace
+	{
+	// Verifies the characters which start in [s, stop), adding how many there were to cpLen. The last one may extend
+	// past stop (but not past end); s is left pointing after it.
+	UtfError verifyUtf8Range(const uchar*& s, const uchar* stop, const uchar* end, size_t& cpLen)
+	{
+		dchar c;
+
+		while(s < stop)
+		{
+			cpLen++;
+
+			if(*s < 0x80)
+				s++;
+			else
+			{
+				auto ok = decodeUtf8Char(s, end, c);
+
+				if(ok != UtfError_OK)
+					return ok;
+			}
+		}
+
+		return UtfError_OK;
+	}
+
+	// Counting codepoints in valid UTF-8 is just counting the bytes which aren't continuation bytes.
+	size_t countCPsScalar(const uchar* s, const uchar* end)
+	{
+		size_t ret = 0;
+
+		for(; s < end; s++)
+			ret += (*s & 0xC0) != 0x80;
+
+		return ret;
+	}
+
+	size_t asciiPrefixScalar(const uchar* s, const uchar* end)
+	{
+		auto start = s;
+
+		while(s < end && *s < 0x80)
+			s++;
+
+		return s - start;
+	}
+
+#ifdef CROC_SIMD_X86
+	// SSE2 doesn't have a byte shuffle, so all it can do is skip over ASCII quickly. Anything else goes through the
+	// scalar decoder one block at a time.
+	CROC_TARGET("sse2")
+	UtfError verifyUtf8SSE2(custring str, size_t& cpLen)
+	{
+		auto s = str.ptr;
+		auto end = s + str.length;
+
+		while(end - s >= 16)
+		{
+			if(_mm_movemask_epi8(_mm_loadu_si128(cast(const __m128i*)s)) == 0)
+			{
+				s += 16;
+				cpLen += 16;
+			}
+			else
+			{
+				auto ok = verifyUtf8Range(s, s + 16, end, cpLen);
+
+				if(ok != UtfError_OK)
+					return ok;
+			}
+		}
+
+		return verifyUtf8Range(s, end, end, cpLen);
+	}
+
+	CROC_TARGET("sse2")
+	size_t countCPsSSE2(const uchar* s, const uchar* end)
+	{
+		size_t ret = 0;
+		auto zero = _mm_setzero_si128();
+		auto lastCont = _mm_set1_epi8(cast(char)0xBF);
+
+		while(end - s >= 16)
+		{
+			// Non-continuation bytes compare (signed) greater than 0xBF. The byte counters can only count up to 255
+			// blocks before they'd overflow, so sum them up after that many.
+			auto counts = zero;
+			auto blocks = min(cast(size_t)(end - s) / 16, cast(size_t)255);
+
+			for(size_t i = 0; i < blocks; i++, s += 16)
+				counts = _mm_sub_epi8(counts, _mm_cmpgt_epi8(_mm_loadu_si128(cast(const __m128i*)s), lastCont));
+
+			auto sums = _mm_sad_epu8(counts, zero);
+			ret += cast(size_t)_mm_cvtsi128_si32(sums) + cast(size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+		}
+
+		return ret + countCPsScalar(s, end);
+	}
+
+	CROC_TARGET("sse2")
+	size_t asciiPrefixSSE2(const uchar* s, const uchar* end)
+	{
+		auto start = s;
+
+		while(end - s >= 16 && _mm_movemask_epi8(_mm_loadu_si128(cast(const __m128i*)s)) == 0)
+			s += 16;
+
+		return (s - start) + asciiPrefixScalar(s, end);
+	}
+
+	// The AVX2 validator uses the table lookup algorithm from "Validating UTF-8 In Less Than One Instruction Per Byte"
+	// (Keiser and Lemire, 2021). Each byte is classified along with the one before it, and any pair that can't occur in
+	// valid UTF-8 leaves a bit set in all three lookups.
+	const uint8_t TooShort = 1 << 0;     // 11______ 0_______ or 11______ 11______
+	const uint8_t TooLong = 1 << 1;      // 0_______ 10______
+	const uint8_t Overlong3 = 1 << 2;    // 11100000 100_____
+	const uint8_t TooLarge = 1 << 3;     // 11110100 1001____, 11110100 101_____, or 11110101+ 10______
+	const uint8_t Surrogate = 1 << 4;    // 11101101 101_____
+	const uint8_t Overlong2 = 1 << 5;    // 1100000_ 10______
+	const uint8_t TooLarge1000 = 1 << 6; // 11110101+ 1000____
+	const uint8_t Overlong4 = 1 << 6;    // 11110000 1000____
+	const uint8_t TwoConts = 1 << 7;     // 10______ 10______, which is only OK as the 3rd or 4th byte of a character
+	const uint8_t Carry = TooShort | TooLong | TwoConts;
+
+	const uint8_t Byte1High[16] =
+	{
+		TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong,
+		TwoConts, TwoConts, TwoConts, TwoConts,
+		TooShort | Overlong2,
+		TooShort,
+		TooShort | Overlong3 | Surrogate,
+		TooShort | TooLarge | TooLarge1000 | Overlong4
+	};
+
+	const uint8_t Byte1Low[16] =
+	{
+		Carry | Overlong3 | Overlong2 | Overlong4,
+		Carry | Overlong2,
+		Carry,
+		Carry,
+		Carry | TooLarge,
+		Carry | TooLarge | TooLarge1000,
+		Carry | TooLarge | TooLarge1000,
+		Carry | TooLarge | TooLarge1000,
+		Carry | TooLarge | TooLarge1000,
+		Carry | TooLarge | TooLarge1000,
+		Carry | TooLarge | TooLarge1000,
+		Carry | TooLarge | TooLarge1000,
+		Carry | TooLarge | TooLarge1000,
+		Carry | TooLarge | TooLarge1000 | Surrogate,
+		Carry | TooLarge | TooLarge1000,
+		Carry | TooLarge | TooLarge1000
+	};
+
+	const uint8_t Byte2High[16] =
+	{
+		TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort,
+		TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge1000 | Overlong4,
+		TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge,
+		TooLong | Overlong2 | TwoConts | Surrogate | TooLarge,
+		TooLong | Overlong2 | TwoConts | Surrogate | TooLarge,
+		TooShort, TooShort, TooShort, TooShort
+	};
+
+	CROC_TARGET("avx2")
+	__m256i loadTable(const uint8_t* table)
+	{
+		return _mm256_broadcastsi128_si256(_mm_loadu_si128(cast(const __m128i*)table));
+	}
+
+	CROC_TARGET("avx2")
+	__m256i highNibbles(__m256i v)
+	{
+		return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+	}
+
+	CROC_TARGET("avx2")
+	size_t sumCounts(__m256i counts)
+	{
+		auto sums = _mm256_sad_epu8(counts, _mm256_setzero_si256());
+		auto half = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+		return cast(size_t)_mm_cvtsi128_si32(half) + cast(size_t)_mm_cvtsi128_si32(_mm_srli_si128(half, 8));
+	}
+
+	CROC_TARGET("avx2")
+	UtfError verifyUtf8AVX2(custring str, size_t& cpLen)
+	{
+		auto byte1High = loadTable(Byte1High);
+		auto byte1Low = loadTable(Byte1Low);
+		auto byte2High = loadTable(Byte2High);
+		auto lowNibble = _mm256_set1_epi8(0x0F);
+		auto lastCont = _mm256_set1_epi8(cast(char)0xBF);
+		auto zero = _mm256_setzero_si256();
+
+		// Anything at or above these in the last three bytes of a block starts a character that continues past it.
+		auto incompleteMax = _mm256_setr_epi8(
+			-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+			-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+			cast(char)(0xF0 - 1), cast(char)(0xE0 - 1), cast(char)(0xC0 - 1));
+
+		auto s = str.ptr;
+		auto end = s + str.length;
+		auto prev = zero;
+		auto prevIncomplete = zero;
+		auto counts = zero;
+		size_t pending = 0;
+		uchar tail[32];
+
+		// The block after the last full one is zero-padded, which also catches a character cut off at the end. If the
+		// length is a multiple of 32, that block is all padding.
+		for(size_t pos = 0; ; pos += 32)
+		{
+			size_t n = str.length - pos;
+			__m256i input;
+
+			if(n >= 32)
+			{
+				n = 32;
+				input = _mm256_loadu_si256(cast(const __m256i*)(s + pos));
+
+				// An all-ASCII block is fine as long as the one before it didn't end partway through a character.
+				if(_mm256_movemask_epi8(input) == 0 && _mm256_testz_si256(prevIncomplete, prevIncomplete))
+				{
+					cpLen += 32;
+					prev = input;
+					continue;
+				}
+			}
+			else
+			{
+				memset(tail, 0, sizeof(tail));
+				memcpy(tail, s + pos, n);
+				input = _mm256_loadu_si256(cast(const __m256i*)tail);
+			}
+
+			auto shifted = _mm256_permute2x128_si256(prev, input, 0x21);
+			auto prev1 = _mm256_alignr_epi8(input, shifted, 15);
+			auto prev2 = _mm256_alignr_epi8(input, shifted, 14);
+			auto prev3 = _mm256_alignr_epi8(input, shifted, 13);
+
+			auto special = _mm256_and_si256(
+				_mm256_and_si256(
+					_mm256_shuffle_epi8(byte1High, highNibbles(prev1)),
+					_mm256_shuffle_epi8(byte1Low, _mm256_and_si256(prev1, lowNibble))),
+				_mm256_shuffle_epi8(byte2High, highNibbles(input)));
+
+			// A continuation byte is expected here iff one of the two bytes before it starts a 3- or 4-byte character.
+			auto must23 = _mm256_or_si256(
+				_mm256_subs_epu8(prev2, _mm256_set1_epi8(cast(char)(0xE0 - 0x80))),
+				_mm256_subs_epu8(prev3, _mm256_set1_epi8(cast(char)(0xF0 - 0x80))));
+			auto error = _mm256_xor_si256(_mm256_and_si256(must23, _mm256_set1_epi8(cast(char)0x80)), special);
+
+			// Croc also rejects the noncharacters U+FDD0..U+FDEF (EF B7 __) and U+xFFFE/U+xFFFF (__ BF BE/BF), which the
+			// tables don't. They're rare, so anything that could be one is handed over to the scalar decoder.
+			auto suspect = _mm256_or_si256(
+				_mm256_and_si256(
+					_mm256_cmpeq_epi8(prev1, lastCont),
+					_mm256_cmpeq_epi8(_mm256_or_si256(input, _mm256_set1_epi8(1)), lastCont)),
+				_mm256_and_si256(
+					_mm256_cmpeq_epi8(prev1, _mm256_set1_epi8(cast(char)0xEF)),
+					_mm256_cmpeq_epi8(input, _mm256_set1_epi8(cast(char)0xB7))));
+
+			error = _mm256_or_si256(error, suspect);
+
+			if(!_mm256_testz_si256(error, error))
+			{
+				// Back up to the start of the character that straddles the block boundary, if any, and let the scalar
+				// decoder go over this block to find out exactly what's wrong (if anything).
+				cpLen += sumCounts(counts);
+				counts = zero;
+				pending = 0;
+
+				auto p = s + pos;
+
+				while(p > s && (s + pos) - p < 4)
+				{
+					p--;
+
+					if((*p & 0xC0) != 0x80)
+						break;
+				}
+
+				cpLen -= countCPsScalar(p, s + pos);
+				auto ok = verifyUtf8Range(p, s + pos + n, end, cpLen);
+
+				if(ok != UtfError_OK)
+					return ok;
+			}
+			else if(n == 32)
+			{
+				counts = _mm256_sub_epi8(counts, _mm256_cmpgt_epi8(input, lastCont));
+
+				if(++pending == 255)
+				{
+					cpLen += sumCounts(counts);
+					counts = zero;
+					pending = 0;
+				}
+			}
+			else
+				cpLen += countCPsScalar(s + pos, end);
+
+			if(n < 32)
+				break;
+
+			prev = input;
+			prevIncomplete = _mm256_subs_epu8(input, incompleteMax);
+		}
+
+		cpLen += sumCounts(counts);
+		return UtfError_OK;
+	}
+
+	CROC_TARGET("avx2")
+	size_t countCPsAVX2(const uchar* s, const uchar* end)
+	{
+		size_t ret = 0;
+		auto lastCont = _mm256_set1_epi8(cast(char)0xBF);
+
+		while(end - s >= 32)
+		{
+			auto counts = _mm256_setzero_si256();
+			auto blocks = min(cast(size_t)(end - s) / 32, cast(size_t)255);
+
+			for(size_t i = 0; i < blocks; i++, s += 32)
+				counts = _mm256_sub_epi8(counts, _mm256_cmpgt_epi8(_mm256_loadu_si256(cast(const __m256i*)s), lastCont));
+
+			ret += sumCounts(counts);
+		}
+
+		return ret + countCPsScalar(s, end);
+	}
+
+	CROC_TARGET("avx2")
+	size_t asciiPrefixAVX2(const uchar* s, const uchar* end)
+	{
+		auto start = s;
+
+		while(end - s >= 32 && _mm256_movemask_epi8(_mm256_loadu_si256(cast(const __m256i*)s)) == 0)
+			s += 32;
+
+		return (s - start) + asciiPrefixScalar(s, end);
+	}
+#endif
+
+	// Shorter strings than this aren't worth setting up the SIMD paths for.
+	const size_t SimdThreshold = 32;
+
+	size_t countCPs(const uchar* s, const uchar* end)
+	{
+#ifdef CROC_SIMD_X86
+		if(cast(size_t)(end - s) >= SimdThreshold)
+		{
+			if(cpuHasAVX2())
+				return countCPsAVX2(s, end);
+			else if(cpuHasSSE2())
+				return countCPsSSE2(s, end);
+		}
+#endif
+		return countCPsScalar(s, end);
+	}
+	}
+
 	/**
 	Verifies whether or not the given string is valid encoded UTF-8.
 
@@ -313,26 +683,47 @@ namespace croc
 	UtfError verifyUtf8(custring str, size_t& cpLen)
 	{
 		cpLen = 0;
-		dchar c;
-		auto s = str.ptr;
-		auto end = s + str.length;
 
-		while(s < end)
+#ifdef CROC_SIMD_X86
+		if(str.length >= SimdThreshold)
 		{
-			cpLen++;
+			if(cpuHasAVX2())
+				return verifyUtf8AVX2(str, cpLen);
+			else if(cpuHasSSE2())
+				return verifyUtf8SSE2(str, cpLen);
+		}
+#endif
+		auto s = str.ptr;
+		auto end = s + str.length;
+		return verifyUtf8Range(s, end, end, cpLen);
+	}
 
-			if(*s < 0x80)
-				s++;
-			else
-			{
-				auto ok = decodeUtf8Char(s, end, c);
+	/**
+	Returns how many bytes at the beginning of the given string are ASCII (below 0x80).
+	*/
+	size_t asciiPrefixLength(custring str)
+	{
+		auto s = str.ptr;
+		auto end = s + str.length;
 
-				if(ok != UtfError_OK)
-					return ok;
-			}
+#ifdef CROC_SIMD_X86
+		if(str.length >= SimdThreshold)
+		{
+			if(cpuHasAVX2())
+				return asciiPrefixAVX2(s, end);
+			else if(cpuHasSSE2())
+				return asciiPrefixSSE2(s, end);
 		}
+#endif
+		return asciiPrefixScalar(s, end);
+	}
 
-		return UtfError_OK;
+	/**
+	Returns whether the given string is entirely ASCII.
+	*/
+	bool isAscii(custring str)
+	{
+		return asciiPrefixLength(str) == str.length;
 	}
 
 	#define UTF16_NEXT_CHAR decodeUtf16Char<false>(src, end, c)
@@ -808,13 +1199,7 @@ namespace croc
 	*/
 	size_t utf8ByteIdxToCP(custring str, size_t fake)
 	{
-		auto fakeEnd = str.ptr + fake;
-		size_t ret = 0;
-
-		for(auto s = str.ptr; s < fakeEnd; ret++)
-			s += Utf8CharLengths[*s];
-
-		return ret;
+		return countCPs(str.ptr, str.ptr + fake);
 	}
 
 	/**
@@ -45,6 +45,8 @@ namespace croc
 	void skipBadUtf32Char(const dchar*& s, const dchar* end);
 	#define skipBadUtf32CharBS skipBadUtf32Char<true>
 	UtfError verifyUtf8(custring str, size_t& cpLen);
+	size_t asciiPrefixLength(custring str);
+	bool isAscii(custring str);
 	UtfError Utf16ToUtf8(cwstring str, ustring buf, cwstring& remaining, ustring& output);
 	UtfError Utf32ToUtf8(cdstring str, ustring buf, cdstring& remaining, ustring& output);
 	UtfError Utf16ToUtf8BS(cwstring str, ustring buf, cwstring& remaining, ustring& output);